@@ -21,6 +21,7 @@ struct CameraBuffer {
 
 struct ObjectData {
     mat4 _model;
+    vec4 _bounding_sphere;  // for the culling
 };
 
 // uniform buffer
@@ -0,0 +1,718 @@
+#ifndef PATH_TRACING_GLSL
+#define PATH_TRACING_GLSL
+
+// the path tracing of the megakernel (`ray_gen.rgen`) and the wavefront kernels (`wavefront_*`):
+// the resources of the first set, sampling, materials and the accumulation of a path sample
+
+#include "shared_with_shaders.h"
+
+struct STree {
+    ivec4 _child_index; // padding 2
+};
+
+layout(set = SWS_RESULT_IMAGE_SET,      binding = SWS_RESULT_IMAGE_BINDING, rgba8)      uniform image2D ResultImage;
+layout(set = SWS_ACCUMULATED_IMAGE_SET, binding = SWS_ACCUMULATED_IMAGE_BINDING, rgba8) uniform image2D AccumulatedImage;
+layout(set = SWS_VARIANCE_IMAGE_SET,    binding = SWS_VARIANCE_IMAGE_BINDING, rgba32f)  uniform image2D VarianceImage;
+layout(set = SWS_ALBEDO_IMAGE_SET,      binding = SWS_ALBEDO_IMAGE_BINDING, rgba32f)    uniform image2D AlbedoImage;
+layout(set = SWS_NORMAL_DEPTH_IMAGE_SET, binding = SWS_NORMAL_DEPTH_IMAGE_BINDING, rgba32f) uniform image2D NormalDepthImage;
+// the previous frame, copied before the launch when reprojecting
+layout(set = SWS_HISTORY_COLOR_SET,     binding = SWS_HISTORY_COLOR_BINDING, rgba32f)   uniform readonly image2D HistoryColorImage;
+layout(set = SWS_HISTORY_STATS_SET,     binding = SWS_HISTORY_STATS_BINDING, rgba32f)   uniform readonly image2D HistoryStatsImage;
+layout(set = SWS_HISTORY_NORMAL_DEPTH_SET, binding = SWS_HISTORY_NORMAL_DEPTH_BINDING, rgba32f) uniform readonly image2D HistoryNormalDepthImage;
+
+// storage buffer
+layout(std140, set = SWS_RADIANCE_CACHE_SET, binding = SWS_RADIANCE_CACHE_BINDING) buffer RadianceCacheBuffer {
+    RecordPerPixel data[];
+} RCBuffer;
+
+layout(std140, set = SWS_STREE_SET, binding = SWS_STREE_BINDING) buffer readonly STreeBuffer {
+    STree data[];
+} sample_stree;
+
+// see GuideTables
+layout(std430, set = SWS_GUIDE_TABLES_SET, binding = SWS_GUIDE_TABLES_BINDING) buffer readonly GuideTablesBuffer {
+    vec4 data[];
+} guide_tables;
+
+layout(std140, set = SWS_EMITTERS_SET, binding = SWS_EMITTERS_BINDING) buffer readonly EmittersBuffer {
+    EmitterTriangle data[];
+} emitters;
+
+// see SamplerTables
+layout(std430, set = SWS_SAMPLER_SET, binding = SWS_SAMPLER_BINDING) buffer readonly SamplerBuffer {
+    uint data[];
+} sampler_tables;
+
+// adaptive sampling: max error of each tile (float bits, positive floats keep the order as uint), compacted list of the traced tiles
+layout(std430, set = SWS_TILE_ERRORS_SET, binding = SWS_TILE_ERRORS_BINDING) buffer TileErrorsBuffer {
+    uint data[];
+} tile_errors;
+
+layout(std430, set = SWS_ACTIVE_TILES_SET, binding = SWS_ACTIVE_TILES_BINDING) buffer readonly ActiveTilesBuffer {
+    uint data[];
+} active_tiles;
+
+// see EnvDistribution
+layout(std430, set = SWS_ENV_DISTRIBUTION_SET, binding = SWS_ENV_DISTRIBUTION_BINDING) buffer readonly EnvDistributionBuffer {
+    float data[];
+} env_distribution;
+
+// see RadianceGridCell
+layout(std430, set = SWS_RADIANCE_GRID_SET, binding = SWS_RADIANCE_GRID_BINDING) buffer RadianceGridBuffer {
+    RadianceGridCell data[];
+} radiance_grid;
+
+layout(set = SWS_ENVS_SET, binding = 0) uniform sampler2D EnvTexture;
+
+layout(set = SWS_CAMDATA_SET,       binding = SWS_CAMDATA_BINDING, std140)     uniform AppData {
+    UniformParams Params;
+};
+
+const float kBunnyRefractionIndex = 1.0f / 1.31f; // ice
+const vec3 kLightEmission = vec3(30.0f);
+
+vec3 CalcRayDir(vec2 screenUV, float aspect) {
+    vec3 u = Params.camSide.xyz;
+    vec3 v = Params.camUp.xyz;
+
+    const float planeWidth = tan(Params.camNearFarFov.z * 0.5f);
+
+    u *= (planeWidth * aspect);
+    v *= planeWidth;
+
+    const vec3 rayDir = normalize(Params.camDir.xyz + (u * screenUV.x) - (v * screenUV.y));
+    return rayDir;
+}
+
+const float MY_PI = 3.1415926535897932384626433832795;
+const float MY_INV_PI = 1.0 / MY_PI;
+
+vec2 DirToLatLong(vec3 dir) {
+    float phi = atan(dir.x, dir.z);
+    float theta = acos(dir.y);
+
+    return vec2((MY_PI + phi) * (0.5 / MY_PI), theta * MY_INV_PI);
+}
+
+vec3 LatLongToDir(vec2 uv) {
+    const float phi = uv.x * 2.0f * MY_PI - MY_PI;
+    const float theta = uv.y * MY_PI;
+    const float sin_theta = sin(theta);
+    return vec3(sin_theta * sin(phi), cos(theta), sin_theta * cos(phi));
+}
+
+// randam sampler start
+uint InitRandomSeed(uint val0, uint val1) {
+    uint v0 = val0, v1 = val1, s0 = 0;
+
+    for (uint n = 0; n < 16; n++) {
+        s0 += 0x9e3779b9;
+        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+    }
+    return v0;
+}
+
+uint RandomInt(inout uint seed) {
+    // LCG values from Numerical Recipes
+    return (seed = 1664525 * seed + 1013904223);
+}
+
+float RandomFloat(inout uint seed) {
+    //// Float version using bitmask from Numerical Recipes
+    //const uint one = 0x3f800000;
+    //const uint msk = 0x007fffff;
+    //return uintBitsToFloat(one | (msk & (RandomInt(seed) >> 9))) - 1;
+
+    // Faster version from NVIDIA examples; quality good enough for our use case.
+    return (float(RandomInt(seed) & 0x00FFFFFF) / float(0x01000000));
+}
+
+vec3 random_cosine_direction(in vec2 u) {
+    float r1 = u.x;
+    float r2 = u.y;
+    float z = sqrt(1 - r2);
+
+    float phi = MY_PI * 2 * r1;
+    float x = cos(phi) * sqrt(r2);
+    float y = sin(phi) * sqrt(r2);
+    return vec3(x, y, z);
+}
+
+// low-discrepancy sampler: owen scrambled sobol (Burley 2020)
+//  the samples of one bounce are the SWS_SOBOL_DIMS dims of one sobol point (SWS_DIM_*),
+//  the bounces are padded: each one shuffles the index with its own seed
+//  the pixels of a SWS_BLUE_NOISE_SIZE tile share the scrambling, the index is xor'ed with the blue-noise rank:
+//  every pixel still gets a whole (0, m, 2)-net at 2^m spp, and the pixels of low rank (well spread) form one as well
+struct SamplerState {
+    uint index;         // sample index ^ blue-noise rank of the pixel
+    uint seed;          // scrambling seed of the tile
+    uint bounce_index;  // the index shuffled for the current bounce (16 bits)
+    uint bounce_seed;
+};
+
+uint hash_u32(uint x) {
+    // lowbias32
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint laine_karras_permutation(uint x, uint seed) {
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed) {
+    return bitfieldReverse(laine_karras_permutation(bitfieldReverse(x), seed));
+}
+
+uint sobol(uint index, uint dim) {
+    uint x = 0;
+    for (uint bit = 0; index != 0; index >>= 1, ++bit) {
+        if ((index & 1u) != 0) {
+            x ^= sampler_tables.data[dim * 32 + bit];
+        }
+    }
+    return x;
+}
+
+float uint_to_unit_float(uint x) {
+    // 24 bits, < 1 (the same as RandomFloat)
+    return float(x >> 8) / float(0x01000000);
+}
+
+SamplerState init_sampler(uvec2 pixel, int spp) {
+    const uvec2 tile = pixel / SWS_BLUE_NOISE_SIZE;
+    const uvec2 in_tile = pixel % SWS_BLUE_NOISE_SIZE;
+    SamplerState s;
+    s.index = uint(spp - 1) ^ sampler_tables.data[SWS_SOBOL_DIMS * 32 + in_tile.y * SWS_BLUE_NOISE_SIZE + in_tile.x];
+    s.seed = hash_u32(tile.x ^ hash_u32(tile.y));
+    s.bounce_index = s.index;
+    s.bounce_seed = s.seed;
+    return s;
+}
+
+void sampler_start_bounce(inout SamplerState s, int bounce) {
+    s.bounce_seed = hash_u32(s.seed ^ uint(bounce));
+    // 16 bit scramble (the low bits only depend on the low bits), short sobol loops
+    s.bounce_index = nested_uniform_scramble(s.index << 16, s.bounce_seed) >> 16;
+}
+
+float sample_1d(inout uint wseed, in SamplerState s, int dim) {
+    if (Params.sampler_type != SWS_SAMPLER_SOBOL) {
+        return RandomFloat(wseed);
+    }
+    return uint_to_unit_float(nested_uniform_scramble(sobol(s.bounce_index, uint(dim)), hash_u32(s.bounce_seed ^ uint(dim + 1))));
+}
+
+vec2 sample_2d(inout uint wseed, in SamplerState s, int dim) {
+    if (Params.sampler_type != SWS_SAMPLER_SOBOL) {
+        const float r1 = RandomFloat(wseed);
+        const float r2 = RandomFloat(wseed);
+        return vec2(r1, r2);
+    }
+    return vec2(
+        uint_to_unit_float(nested_uniform_scramble(sobol(s.bounce_index, uint(dim)), hash_u32(s.bounce_seed ^ uint(dim + 1)))),
+        uint_to_unit_float(nested_uniform_scramble(sobol(s.bounce_index, uint(dim + 1)), hash_u32(s.bounce_seed ^ uint(dim + 2)))));
+}
+
+// random sampler end
+
+// from ppg
+// x,y,z => theta, z => [0, 1]
+vec2 xyz2thetaphi(in vec3 xyz) {
+    xyz = normalize(xyz);
+    float cos_theta = clamp(xyz.z, -1.0f, 1.0f);
+    float phi = atan(xyz.y, xyz.x);
+    if(phi < 0) { phi += BB_PI2; }
+    return vec2((cos_theta + 1.0f) / 2.0f, phi / BB_PI2);
+}
+
+vec3 thetaphi2xyz(in vec2 tp) {
+    float cos_theta = 2.0f * tp.x - 1.0f;
+    float phi = tp.y * BB_PI2;
+    float sin_theta = sqrt(1 -  cos_theta * cos_theta);
+
+    vec2 sc_phi = vec2(sin(phi), cos(phi));
+    return vec3(sin_theta * sc_phi.y, sin_theta * sc_phi.x, cos_theta);
+}
+
+int get_dtree_index(in vec3 position) {
+    int index = 0;
+    int depth = 0;
+    STree now = sample_stree.data[index];
+    // have child, recursive
+    while (now._child_index[0] != -1) {
+        int sub_time = (depth / 3);
+        int p_index = depth % 3;
+        int c_idx_idx = 1;
+        if (position[p_index] < 1.0f / (2 << sub_time)) {
+            c_idx_idx = 0;
+        }
+        index = now._child_index[c_idx_idx];
+        now = sample_stree.data[index];
+        ++depth;
+    }
+    return index;
+}
+
+// alias method: `u_cell` picks the cell of the (cos theta, phi) square, `u`: the position inside the cell,
+// both from the sampler (the cell is the main decision of the guided lobe, stratified with sobol)
+void sample_direction(inout vec3 direction, in int index, out float pdf, in float u_cell, in vec2 u) {
+    const float x = u_cell * SWS_GUIDE_TABLE_SIZE;
+    const int i = min(int(x), SWS_GUIDE_TABLE_SIZE - 1);
+    const vec4 entry = guide_tables.data[index * SWS_GUIDE_TABLE_SIZE + i];
+    const bool keep = (x - float(i)) < entry.x;
+    const int cell = keep ? i : int(entry.y);
+    pdf = keep ? entry.z : entry.w;
+    direction = thetaphi2xyz((vec2(cell / SWS_GUIDE_TABLE_RES, cell % SWS_GUIDE_TABLE_RES) + u) / float(SWS_GUIDE_TABLE_RES));
+}
+
+void eval_direction(in vec3 direction, in int index, out float pdf) {
+    // xyz2thetaphi(direction) will normalize the direction
+    const ivec2 cell = min(ivec2(xyz2thetaphi(direction) * SWS_GUIDE_TABLE_RES), ivec2(SWS_GUIDE_TABLE_RES - 1));
+    pdf = guide_tables.data[index * SWS_GUIDE_TABLE_SIZE + cell.x * SWS_GUIDE_TABLE_RES + cell.y].z;
+}
+
+void sample_lambertian(in vec2 u, in vec3 normal, out vec3 direction, out float pdf) {
+    const vec3 localDirection = random_cosine_direction(u);
+    pdf = dot(localDirection, vec3(0.0f, 0.0f, 1.0f)) / MY_PI;
+
+    // dirty implement
+    mat3 local2world;
+    const vec3 a = (abs(normal[0]) > 0.9f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    local2world[2] = normal;
+    local2world[1] = normalize(cross(normal, a));
+    local2world[0] = cross(normal, local2world[1]); // left hand
+    // dirty implment
+
+    direction = local2world * localDirection;
+}
+
+void eval_lambertian(in vec3 normal, in vec3 direction, out float pdf) {
+    direction = normalize(direction);
+    pdf = dot(normal, direction) / MY_PI;
+}
+
+// pdf of the direction sampling of a diffuse hit, dindex = -1: BSDF only, otherwise BSDF/SDTree mixture
+float eval_sampling_pdf(in vec3 normal, in vec3 direction, in int dindex) {
+    float bsdf_pdf;
+    eval_lambertian(normal, direction, bsdf_pdf);
+    if (dindex < 0) {
+        return bsdf_pdf;
+    }
+    float guide_pdf;
+    eval_direction(direction, dindex, guide_pdf);
+    return 0.5f * (bsdf_pdf + guide_pdf);
+}
+
+// uniform by area over all the emitter triangles, pdf (area measure) = 1 / Params.emitters_area
+vec3 sample_emitter(in float u, in vec2 u_point, out vec3 normal) {
+    // binary search on the area cdf
+    int lo = 0;
+    int hi = Params.num_emitters - 1;
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (emitters.data[mid].v0.w < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const vec3 v0 = emitters.data[lo].v0.xyz;
+    const vec3 v1 = emitters.data[lo].v1.xyz;
+    const vec3 v2 = emitters.data[lo].v2.xyz;
+
+    const float r1 = sqrt(u_point.x);
+    const float r2 = u_point.y;
+    normal = normalize(cross(v1 - v0, v2 - v0));
+    return v0 * (1.0f - r1) + v1 * (r1 * (1.0f - r2)) + v2 * (r1 * r2);
+}
+
+float power_heuristic(float pdf_a, float pdf_b) {
+    const float a2 = pdf_a * pdf_a;
+    const float b2 = pdf_b * pdf_b;
+    return (a2 + b2 > 0.0f) ? a2 / (a2 + b2) : 0.0f;
+}
+
+// radiance of the environment seen in `direction` (`ray_miss.rmiss` returns the unscaled texel)
+vec3 env_radiance(vec3 direction) {
+    return Params.env_strength * textureLod(EnvTexture, DirToLatLong(direction), 0.0f).rgb;
+}
+
+// the last i in [0, n) with cdf[i] <= u, and u remapped to [0, 1) within the interval
+int sample_env_cdf(uint offset, int n, float u, out float du) {
+    int lo = 0;
+    int hi = n - 1;
+    while (lo < hi) {
+        const int mid = (lo + hi + 1) / 2;
+        if (env_distribution.data[offset + mid] <= u) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    const float cdf0 = env_distribution.data[offset + lo];
+    const float width = env_distribution.data[offset + lo + 1] - cdf0;
+    du = (width > 0.0f) ? (u - cdf0) / width : 0.0f;
+    return lo;
+}
+
+// the same as `EnvDistribution::sample`, pdf: solid angle (0: no sample)
+vec3 sample_env(vec2 u, out float pdf) {
+    const int width = int(env_distribution.data[0]);
+    const int height = int(env_distribution.data[1]);
+    const uint conditional = SWS_ENV_HEADER_SIZE + uint(width * height);
+    const uint marginal = conditional + uint(height * (width + 1));
+
+    float dv, du;
+    const int y = sample_env_cdf(marginal, height, u.y, dv);
+    const int x = sample_env_cdf(conditional + uint(y * (width + 1)), width, u.x, du);
+    const vec2 uv = vec2((float(x) + du) / float(width), (float(y) + dv) / float(height));
+
+    // uv square -> solid angle: d(omega) = 2 pi^2 sin(theta) du dv
+    const float sin_theta = sin(uv.y * MY_PI);
+    pdf = (sin_theta > 0.0f) ? env_distribution.data[SWS_ENV_HEADER_SIZE + uint(y * width + x)] / (2.0f * MY_PI * MY_PI * sin_theta) : 0.0f;
+    return LatLongToDir(uv);
+}
+
+// the same as `EnvDistribution::pdf`
+float eval_env_pdf(vec3 direction) {
+    const int width = int(env_distribution.data[0]);
+    const int height = int(env_distribution.data[1]);
+    const vec2 uv = DirToLatLong(direction);
+    const int x = clamp(int(uv.x * float(width)), 0, width - 1);
+    const int y = clamp(int(uv.y * float(height)), 0, height - 1);
+    const float sin_theta = sqrt(max(0.0f, 1.0f - direction.y * direction.y));
+    return (sin_theta > 0.0f) ? env_distribution.data[SWS_ENV_HEADER_SIZE + uint(y * width + x)] / (2.0f * MY_PI * MY_PI * sin_theta) : 0.0f;
+}
+
+// the next-event estimation has a light to sample: the emitters or the environment
+bool nee_enabled() {
+    return (Params.nee_on == 1) && (Params.num_emitters > 0 || Params.env_light_prob > 0.0f);
+}
+
+// temporal reprojection: the first non-specular vertex (`NormalDepthImage`) is seen by the previous camera,
+// the bilinear taps of the history failing the depth & normal tests are dropped (disocclusion)
+// mirrors: the depth is the path length, the position is the virtual image behind the mirror
+bool reproject_history(vec3 direction, vec4 normal_depth, ivec2 image_size, float aspect, out vec3 history, out vec4 stats) {
+    history = vec3(0.0f);
+    stats = vec4(0.0f);
+    if (normal_depth.w < 0.0f) {
+        return false;
+    }
+    const vec3 position = Params.camPos.xyz + direction * normal_depth.w;
+    const vec3 prev_uv = ProjectToCamera(position, Params.prevCamPos.xyz, Params.prevCamDir.xyz, Params.prevCamUp.xyz, Params.prevCamSide.xyz, Params.prevCamPos.w, aspect);
+    if (prev_uv.z <= 0.0f) {
+        return false;
+    }
+    const float expected_depth = length(position - Params.prevCamPos.xyz);
+    const vec2 prev_pixel = (prev_uv.xy * 0.5f + 0.5f) * vec2(image_size - 1);
+    const ivec2 p0 = ivec2(floor(prev_pixel));
+    const vec2 f = prev_pixel - vec2(p0);
+
+    float sum_weight = 0.0f;
+    float sum_weight2 = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        const ivec2 q = p0 + ivec2(i & 1, i >> 1);
+        if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, image_size))) {
+            continue;
+        }
+        if (!TemporalTapValid(normal_depth, imageLoad(HistoryNormalDepthImage, q), expected_depth)) {
+            continue;
+        }
+        const float w = (((i & 1) != 0) ? f.x : 1.0f - f.x) * (((i >> 1) != 0) ? f.y : 1.0f - f.y);
+        history += w * imageLoad(HistoryColorImage, q).rgb;
+        stats += w * imageLoad(HistoryStatsImage, q);
+        sum_weight += w;
+        sum_weight2 += w * w;
+    }
+    if (sum_weight < SWS_TEMPORAL_MIN_WEIGHT) {
+        history = vec3(0.0f);
+        stats = vec4(0.0f);
+        return false;
+    }
+    history /= sum_weight;
+    stats = ClampHistoryStats(stats / sum_weight);
+    // the bilinear blend averages the noise of the taps
+    stats.y *= sum_weight2 / (sum_weight * sum_weight);
+    return true;
+}
+
+// adaptive sampling: the launch is a row of tiles, look up the pixel in the active tile list
+// dynamic resolution: only the top left part of the images is traced
+// launch_id: gl_LaunchIDEXT of `ray_gen.rgen`, gl_GlobalInvocationID of the tile sized groups of the wavefront
+bool traced_pixel(uvec2 launch_id, ivec2 image_size, out ivec2 pixel, out uint tile_index) {
+    const uint tiles_x = uint(image_size.x + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+    pixel = ivec2(launch_id);
+    tile_index = (launch_id.y / SWS_ADAPTIVE_TILE_SIZE) * tiles_x + launch_id.x / SWS_ADAPTIVE_TILE_SIZE;
+    if (Params.adaptive_on == 1) {
+        tile_index = active_tiles.data[launch_id.x / SWS_ADAPTIVE_TILE_SIZE];
+        pixel = ivec2(uvec2(tile_index % tiles_x, tile_index / tiles_x) * SWS_ADAPTIVE_TILE_SIZE
+            + uvec2(launch_id.x % SWS_ADAPTIVE_TILE_SIZE, launch_id.y));
+    }
+    return pixel.x < image_size.x && pixel.y < image_size.y;
+}
+
+vec3 camera_ray_dir(ivec2 pixel, ivec2 image_size) {
+    const vec2 uv = (vec2(pixel) / vec2(image_size - 1)) * 2.0f - 1.0f;
+    return CalcRayDir(uv, float(image_size.x) / float(image_size.y));
+}
+
+// per-pixel sample count, the same as `accumulate_spp` when every pixel is traced
+// reprojecting: the history is found after the primary hit, the frame is the sample index
+uint pixel_sample_index(ivec2 pixel, out vec4 stats) {
+    stats = (Params.accumulate_spp == 1 || Params.reproject_on == 1) ? vec4(0.0f) : imageLoad(VarianceImage, pixel);
+    return (Params.reproject_on == 1) ? uint(Params.accumulate_spp) : uint(stats.z) + 1;
+}
+
+// the SDTree of the direction sampling, -1: BSDF only
+int guide_dtree_index(vec3 position) {
+    if (Params.ppg_test_on != 1) {
+        return -1;
+    }
+    const int dindex = get_dtree_index(position);
+    return (guide_tables.data[dindex * SWS_GUIDE_TABLE_SIZE].x < 0.0f) ? -1 : dindex;
+}
+
+void mirror_bounce(vec3 hit_pos, vec3 normal, inout vec3 origin, inout vec3 direction) {
+    origin = hit_pos + normal * 0.001f;
+    direction = reflect(direction, normal);
+}
+
+void glass_bounce(vec3 hit_pos, vec3 normal, inout vec3 origin, inout vec3 direction) {
+    const float NdotD = dot(normal, direction);
+    vec3 refrNormal = normal;
+    float refrEta;
+    if (NdotD > 0.0f) {
+        refrNormal = -normal;
+        refrEta = 1.0f / kBunnyRefractionIndex;
+    } else {
+        refrNormal = normal;
+        refrEta = kBunnyRefractionIndex;
+    }
+
+    origin = hit_pos + direction * 0.001f;
+    direction = refract(direction, refrNormal, refrEta);
+    // full reflection
+    // if(dot(direction,direction)==0){break;}
+}
+
+// MIS weight of an emitter hit, the same path could have been found by the shadow ray of the last bounce
+// (shading normal here, the same as the geometric one for flat emitters)
+float emitter_hit_weight(bool last_bounce_nee, float last_bounce_pdf, vec3 normal, vec3 direction, float distance) {
+    if (!last_bounce_nee) {
+        return 1.0f;
+    }
+    const float cos_light = max(abs(dot(normal, direction)), 1e-6f);
+    const float light_pdf = (1.0f - Params.env_light_prob) * distance * distance / (cos_light * Params.emitters_area);
+    return power_heuristic(last_bounce_pdf, light_pdf);
+}
+
+// MIS weight of an escaped path, the same as `emitter_hit_weight` for the environment
+float env_hit_weight(bool last_bounce_nee, float last_bounce_pdf, vec3 direction) {
+    if (!last_bounce_nee || Params.env_light_prob <= 0.0f) {
+        return 1.0f;
+    }
+    return power_heuristic(last_bounce_pdf, Params.env_light_prob * eval_env_pdf(direction));
+}
+
+// next-event estimation: one point on the emitters or one direction of the environment (`env_light_prob`),
+// the contribution (throughput not included) if the shadow ray `position` -> `to_light` (`dist`) is not blocked,
+// false: the light sample is behind the surface
+bool sample_light(vec3 position, vec3 normal, vec3 albedo, int bounce, int dindex, inout uint wseed, in SamplerState s,
+    out vec3 to_light, out float dist, out vec3 contribution) {
+    float u_choice = sample_1d(wseed, s, SWS_DIM_LIGHT_CHOICE);
+    const vec2 u_point = sample_2d(wseed, s, SWS_DIM_LIGHT_POINT);
+    contribution = vec3(0.0f);
+
+    if (u_choice < Params.env_light_prob) {
+        float env_pdf;
+        to_light = sample_env(u_point, env_pdf);
+        // the shadow ray escapes the scene
+        dist = Params.camNearFarFov.y;
+        const float cos_surface = dot(normal, to_light);
+        if (cos_surface <= 0.0f || env_pdf <= 0.0f) {
+            return false;
+        }
+        const float light_pdf = Params.env_light_prob * env_pdf;
+        float mis_weight = 1.0f;
+        if (bounce + 1 < SWS_MAX_RECURSION) {
+            mis_weight = power_heuristic(light_pdf, eval_sampling_pdf(normal, to_light, dindex));
+        }
+        contribution = mis_weight * env_radiance(to_light) * albedo * (cos_surface / MY_PI) / light_pdf;
+        return true;
+    }
+    // the remaining choices pick the emitter triangle
+    u_choice = min((u_choice - Params.env_light_prob) / (1.0f - Params.env_light_prob), 0.99999994f);
+
+    vec3 light_normal;
+    const vec3 light_pos = sample_emitter(u_choice, u_point, light_normal);
+    to_light = light_pos - position;
+    const float dist2 = dot(to_light, to_light);
+    dist = sqrt(dist2);
+    to_light /= dist;
+    const float cos_surface = dot(normal, to_light);
+    const float cos_light = abs(dot(light_normal, to_light));
+    if (cos_surface <= 0.0f || cos_light <= 1e-6f) {
+        return false;
+    }
+
+    const float light_pdf = (1.0f - Params.env_light_prob) * dist2 / (cos_light * Params.emitters_area);
+    // no BSDF sampled ray after the last bounce, nothing to share the path with
+    float mis_weight = 1.0f;
+    if (bounce + 1 < SWS_MAX_RECURSION) {
+        mis_weight = power_heuristic(light_pdf, eval_sampling_pdf(normal, to_light, dindex));
+    }
+    contribution = mis_weight * kLightEmission * albedo * (cos_surface / MY_PI) / light_pdf;
+    return true;
+}
+
+// direction of the next bounce of a diffuse hit: BSDF only, or the one-sample MIS of the BSDF & the SDTree (dindex >= 0)
+// false: the guided direction is below the surface, the path stops
+bool sample_diffuse(vec3 normal, int dindex, inout uint wseed, in SamplerState s, out vec3 direction, out float pdf) {
+    if (dindex < 0) {
+        // only BRDF
+        sample_lambertian(sample_2d(wseed, s, SWS_DIM_BSDF), normal, direction, pdf);
+        return true;
+    }
+
+    float pdf1, pdf2;
+    if (sample_1d(wseed, s, SWS_DIM_GUIDE_CHOICE) < 0.5f) {
+        // the same order as the CPU tracer: the position in the cell, then the cell
+        const vec2 u = sample_2d(wseed, s, SWS_DIM_BSDF);
+        const float u_cell = sample_1d(wseed, s, SWS_DIM_GUIDE_CELL);
+        sample_direction(direction, dindex, pdf1, u_cell, u);
+        if (dot(normal, direction) < 0.0) {
+            // stop if no contribution
+            pdf = 0.0f;
+            return false;
+        }
+        eval_lambertian(normal, direction, pdf2);
+    } else {
+        // only BRDF
+        sample_lambertian(sample_2d(wseed, s, SWS_DIM_BSDF), normal, direction, pdf2);
+        eval_direction(direction, dindex, pdf1);
+    }
+    pdf = 0.5 * (pdf1 + pdf2);
+    return true;
+}
+
+// russian roulette after `rr_depth` bounces, the survival probability follows the path throughput
+// returns the survival probability (the survivors are scaled by its inverse, the estimate stays unbiased), 0: the path stops
+float russian_roulette(int bounce, vec3 throughput, float throughput_pdf, inout uint wseed, in SamplerState s) {
+    if (bounce + 1 < Params.rr_depth) {
+        return 1.0f;
+    }
+    const vec3 beta = throughput / throughput_pdf;
+    const float survival = clamp(max(beta.r, max(beta.g, beta.b)), 0.05f, 0.95f);
+    return (sample_1d(wseed, s, SWS_DIM_RR) < survival) ? survival : 0.0f;
+}
+
+// radiance grid: the first slot & the checksum (never 0) of the cell, two independent hashes of the same key
+// (the same as `RadianceGrid::key`)
+void grid_key(vec3 position, vec3 normal, out uint slot, out uint checksum) {
+    const uvec3 c = uvec3(ivec3(floor(position / SWS_RADIANCE_GRID_CELL_SIZE)));
+    const vec3 a = abs(normal);
+    const uint axis = (a.x >= a.y && a.x >= a.z) ? 0u : ((a.y >= a.z) ? 1u : 2u);
+    const uint bin = 2u * axis + ((normal[axis] < 0.0f) ? 1u : 0u);
+    slot = hash_u32(c.x ^ hash_u32(c.y ^ hash_u32(c.z ^ hash_u32(bin))));
+    checksum = max(hash_u32(bin + hash_u32(c.z + hash_u32(c.y + hash_u32(c.x + 0x9e3779b9u)))), 1u);
+}
+
+// the slot of the cell, -1: not found, claim: an empty slot is taken (-1: the probes are full)
+int grid_find(vec3 position, vec3 normal, bool claim) {
+    uint slot, checksum;
+    grid_key(position, normal, slot, checksum);
+    for (int probe = 0; probe < SWS_RADIANCE_GRID_NUM_PROBES; ++probe) {
+        const uint index = (slot + uint(probe)) & uint(SWS_RADIANCE_GRID_NUM_CELLS - 1);
+        uint stored = radiance_grid.data[index].checksum;
+        if (stored == 0u && claim) {
+            stored = atomicCompSwap(radiance_grid.data[index].checksum, 0u, checksum);
+            if (stored == 0u) {
+                return int(index);
+            }
+        }
+        if (stored == checksum) {
+            return int(index);
+        }
+        if (stored == 0u) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// the cached outgoing radiance of a diffuse vertex, false: no cell or too few samples
+bool grid_query(vec3 position, vec3 normal, out vec3 radiance) {
+    radiance = vec3(0.0f);
+    const int index = grid_find(position, normal, false);
+    if (index < 0) {
+        return false;
+    }
+    const vec4 cell = radiance_grid.data[index].radiance;
+    radiance = cell.rgb;
+    return cell.w >= SWS_RADIANCE_GRID_MIN_SAMPLES;
+}
+
+// a sample of the outgoing radiance of a diffuse vertex, resolved by `radiance_grid_resolve.comp` after the launch
+void grid_update(vec3 position, vec3 normal, vec3 radiance) {
+    if (any(isnan(radiance))) {
+        return;
+    }
+    const int index = grid_find(position, normal, true);
+    if (index < 0) {
+        return;
+    }
+    const uvec3 q = uvec3(clamp(radiance, vec3(0.0f), vec3(SWS_RADIANCE_GRID_MAX_RADIANCE)) * SWS_RADIANCE_GRID_FIXED_POINT + 0.5f);
+    atomicAdd(radiance_grid.data[index].accum.x, q.x);
+    atomicAdd(radiance_grid.data[index].accum.y, q.y);
+    atomicAdd(radiance_grid.data[index].accum.z, q.z);
+    atomicAdd(radiance_grid.data[index].accum.w, 1u);
+}
+
+// the spread of a bounce (Müller et al. 2021): the footprint of the path is the squared sum of the spreads,
+// the first diffuse vertex is the pixel footprint d^2 / (4 pi cos)
+float grid_spread(float distance, float pdf, float cos_theta) {
+    return sqrt(distance * distance / (pdf * max(cos_theta, 1e-4f)));
+}
+
+// one path sample of the pixel: the denoiser guides, the history (reprojected or accumulated),
+// the pixel statistics & the tile error, the accumulated and the result image
+void store_sample(ivec2 pixel, ivec2 image_size, uint tile_index, vec3 color, vec4 albedo, vec4 normal_depth, vec4 stats) {
+    imageStore(AlbedoImage, pixel, albedo);
+    imageStore(NormalDepthImage, pixel, normal_depth);
+
+    vec3 history = vec3(0.0f);
+    if (Params.reproject_on == 1) {
+        const float aspect = float(image_size.x) / float(image_size.y);
+        reproject_history(camera_ray_dir(pixel, image_size), normal_depth, image_size, aspect, history, stats);
+    } else if (stats.z > 0.0f) {
+        history = imageLoad(AccumulatedImage, pixel).rgb;
+    }
+    const uint spp = uint(stats.z) + 1;
+
+    const vec4 new_stats = UpdatePixelStats(stats, color);
+    imageStore(VarianceImage, pixel, new_stats);
+    // only read by adaptive sampling
+    if (Params.adaptive_on == 1) {
+        atomicMax(tile_errors.data[tile_index], floatBitsToUint(PixelRelativeError(new_stats)));
+    }
+
+    if (spp != 1) {
+        color = (color + (spp - 1) * history) / spp;
+    }
+
+    imageStore(AccumulatedImage, pixel, vec4(color, 1.0f));
+    imageStore(ResultImage, pixel, vec4(LinearToSrgb(color) * Params.light_strength, 1.0f));
+}
+
+#endif // PATH_TRACING_GLSL
@@ -0,0 +1,115 @@
+#ifndef WAVEFRONT_GLSL
+#define WAVEFRONT_GLSL
+
+// wavefront path tracing (`RTApp::fill_wavefront_command_buffer`): the paths are kept in buffers between the launches,
+// one path per traced pixel (id: y * trace_width + x), each launch works on a compacted queue of path ids
+//  generate -> per bounce: extension rays -> material queues -> shading (+ shadow rays) -> next extension queue -> resolve
+// the same estimator as `ray_gen.rgen`: the same sample dims and LCG draws in the same order
+
+#include "path_tracing.glsl"
+
+// struct of arrays, the field f of the path p is at f * capacity + p
+layout(std430, set = SWS_WAVEFRONT_PATHS_SET, binding = SWS_WAVEFRONT_PATHS_BINDING) buffer WavefrontPathsBuffer {
+    vec4 data[];
+} paths;
+
+// x: pixel (x | y << 16), y: LCG seed, z: sample index, w: PATH_FLAG_*
+layout(std430, set = SWS_WAVEFRONT_PATH_STATES_SET, binding = SWS_WAVEFRONT_PATH_STATES_BINDING) buffer WavefrontPathStatesBuffer {
+    uvec4 data[];
+} path_states;
+
+// SWS_WAVEFRONT_NUM_QUEUES lists of path ids, `capacity` entries each
+layout(std430, set = SWS_WAVEFRONT_QUEUES_SET, binding = SWS_WAVEFRONT_QUEUES_BINDING) buffer WavefrontQueuesBuffer {
+    uint data[];
+} queues;
+
+// queue sizes & indirect arguments, SWS_WAVEFRONT_*_OFFSET
+layout(std430, set = SWS_WAVEFRONT_COUNTERS_SET, binding = SWS_WAVEFRONT_COUNTERS_BINDING) buffer WavefrontCountersBuffer {
+    uint data[];
+} counters;
+
+layout(push_constant) uniform PushConstants {
+    WavefrontParams Wavefront;
+};
+
+const uint PATH_ORIGIN = 0;             // w: path length (denoiser guides)
+const uint PATH_DIRECTION = 1;          // w: pdf of the last BSDF sample (MIS of the emitter hits)
+const uint PATH_THROUGHPUT = 2;         // w: pdf
+const uint PATH_RADIANCE = 3;
+const uint PATH_HIT_COLOR = 4;          // payload of the extension ray, w: distance (< 0: background)
+const uint PATH_HIT_NORMAL = 5;         // w: object id
+const uint PATH_SHADOW_ORIGIN = 6;      // w: max distance
+const uint PATH_SHADOW_DIRECTION = 7;
+const uint PATH_SHADOW_RADIANCE = 8;    // added to the radiance if the shadow ray is not blocked
+const uint PATH_TAIL_WEIGHT = 9;        // ppg training: product of the vertex weights past the last record
+
+const uint PATH_FLAG_GUIDES_DONE = 1u;
+const uint PATH_FLAG_LAST_BOUNCE_NEE = 2u;
+
+uint wavefront_capacity() {
+    return uint(Params.trace_width * Params.trace_height);
+}
+
+vec4 load_path(uint field, uint path) {
+    return paths.data[field * wavefront_capacity() + path];
+}
+
+void store_path(uint field, uint path, vec4 value) {
+    paths.data[field * wavefront_capacity() + path] = value;
+}
+
+ivec2 path_pixel(uvec4 state) {
+    return ivec2(state.x & 0xFFFFu, state.x >> 16);
+}
+
+SamplerState path_sampler(uvec4 state, int bounce) {
+    SamplerState s = init_sampler(uvec2(path_pixel(state)), int(state.z));
+    sampler_start_bounce(s, bounce);
+    return s;
+}
+
+uint queue_entry(int queue, uint slot) {
+    return queues.data[uint(queue) * wavefront_capacity() + slot];
+}
+
+uint queue_size(int queue) {
+    return counters.data[SWS_WAVEFRONT_COUNT_OFFSET + queue];
+}
+
+// the same order as the branches of `ray_gen.rgen`
+int material_queue(vec4 hit_color, vec4 hit_normal) {
+    if (hit_color.w < 0.0f) {
+        return SWS_QUEUE_EMISSIVE;
+    }
+    const float object_id = hit_normal.w;
+    if (object_id == Params.mirror_id) {
+        return SWS_QUEUE_MIRROR;
+    }
+    if (object_id == Params.glass_id) {
+        return SWS_QUEUE_GLASS;
+    }
+    if (object_id == Params.light_id) {
+        return SWS_QUEUE_EMISSIVE;
+    }
+    return SWS_QUEUE_DIFFUSE;
+}
+
+#ifdef WAVEFRONT_COMPUTE
+// one atomic per subgroup, the active lanes get consecutive slots (the queue stays compact, in lane order)
+void push_queue(int queue, uint path) {
+    const uvec4 ballot = subgroupBallot(true);
+    uint base = 0;
+    if (subgroupElect()) {
+        base = atomicAdd(counters.data[SWS_WAVEFRONT_COUNT_OFFSET + queue], subgroupBallotBitCount(ballot));
+    }
+    base = subgroupBroadcastFirst(base);
+    queues.data[uint(queue) * wavefront_capacity() + base + subgroupBallotExclusiveBitCount(ballot)] = path;
+}
+#else
+void push_queue(int queue, uint path) {
+    const uint slot = atomicAdd(counters.data[SWS_WAVEFRONT_COUNT_OFFSET + queue], 1u);
+    queues.data[uint(queue) * wavefront_capacity() + slot] = path;
+}
+#endif
+
+#endif // WAVEFRONT_GLSL
@@ -1,12 +1,24 @@
 #include <exception>
 #include <iostream>
+#include <cstdlib>
 
 #define main SDL_main
 #include "meshBufferApp.h"
 
 int main(int argc, char **argv) {
+    // the number of objects, culled on the gpu
+    long num_objects = 3;
+    if (argc > 1) {
+        char* end = nullptr;
+        num_objects = std::strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end != '\0' || num_objects <= 0 || num_objects > static_cast<long>(MeshBufferApp::MAX_OBJECTS)) {
+            std::cerr << "usage: " << argv[0] << " [number of objects, 1 to " << MeshBufferApp::MAX_OBJECTS << "]" << std::endl;
+            return -1;
+        }
+    }
+
     try {
-        MeshBufferApp app("buffers", 800, 600, true);
+        MeshBufferApp app("buffers", 800, 600, true, static_cast<uint32_t>(num_objects));
         app.run();
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -1,10 +1,47 @@
 #include "meshBufferApp.h"
 #include "../common/initializers.h"
+#include "../common/shader.h"
 
 #include <glm/gtx/transform.hpp>
 
-MeshBufferApp::MeshBufferApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer) :RasBufferApp(name, width, height, use_validation_layer) {
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    MeshBufferAppTest::GPUCameraData get_camera_data() {
+        glm::vec3 camera_pos = { -2.0f, -1.0f, -7.0f };
+        glm::mat4 view = glm::translate(glm::mat4(1.0f), camera_pos);
+        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 1700.0f / 900.0f, 0.1f, 200.0f);
+        projection[1][1] *= -1;
+        return { view, projection, projection * view };
+    }
+
+    // the planes of the frustum from the rows of P * V (gribb & hartmann), normalized for the sphere tests
+    void get_frustum_planes(const glm::mat4& view_proj, glm::vec4* planes) {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+        }
+        planes[0] = rows[3] + rows[0];  // left
+        planes[1] = rows[3] - rows[0];  // right
+        planes[2] = rows[3] + rows[1];  // bottom
+        planes[3] = rows[3] - rows[1];  // top
+        planes[4] = rows[3] + rows[2];  // near (glm: -1 <= z <= 1)
+        planes[5] = rows[3] - rows[2];  // far
+        for (int i = 0; i < 6; ++i) {
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+        }
+    }
+}
+
+MeshBufferApp::MeshBufferApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer, uint32_t num_objects)
+    :RasBufferApp(name, width, height, use_validation_layer), _num_objects(std::clamp(num_objects, 1U, MAX_OBJECTS)) {
     std::cout << "\tPress `Space` to change the color type!" << std::endl;
+    std::cout << "\tPress `G` to switch between the gpu culling & the draws recorded on all the cores!" << std::endl;
+    // the draws are written by the culling pass, the object is the first instance of its draw
+    _required_device_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    _required_device_features.drawIndirectFirstInstance = VK_TRUE;
 }
 
 MeshBufferApp::~MeshBufferApp() {
@@ -23,6 +60,9 @@ bool MeshBufferApp::deal_with_sdl_event(SDL_Event& e) {
         _key_pressed = true;
         if (e.key.keysym.sym == SDLK_SPACE) {
             _color_type = (_color_type + 1) % COLOR_TYPE;
+        } else if (e.key.keysym.sym == SDLK_g) {
+            _gpu_culling = !_gpu_culling;
+            std::cout << (_gpu_culling ? "[Culling] gpu, one indirect draw" : "[Culling] cpu, a draw per object on all the cores") << std::endl;
         }
     } else if (e.type == SDL_KEYUP) {
         _key_pressed = false;
@@ -32,63 +72,233 @@ bool MeshBufferApp::deal_with_sdl_event(SDL_Event& e) {
 
 void MeshBufferApp::init_pipeline() {
     add_pipeline("04-mesh.vert.spv", "04-mesh.frag.spv", _set_layout.data(), _set_layout.size(), true, _render_pass, 0, _mesh_pipeline, _mesh_pipeline_layout);
+
+    // culling
+    VkShaderModule cull_shader = Shader::load_shader_module(_device, "04-cull.comp.spv");
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(MeshBufferAppTest::CullPushConstant);
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo layout_create_info = vkinit::pipeline_layout_create_info();
+    layout_create_info.setLayoutCount = 1;
+    layout_create_info.pSetLayouts = &_cull_set_layout;
+    layout_create_info.pushConstantRangeCount = 1;
+    layout_create_info.pPushConstantRanges = &push_constant_range;
+    VK_CHECK(vkCreatePipelineLayout(_device, &layout_create_info, nullptr, &_cull_pipeline_layout));
+
+    VkComputePipelineCreateInfo pipeline_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+    pipeline_info.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cull_shader);
+    pipeline_info.layout = _cull_pipeline_layout;
+    auto start = std::chrono::high_resolution_clock::now();
+    VK_CHECK(vkCreateComputePipelines(_device, _pipeline_cache.get(), 1, &pipeline_info, nullptr, &_cull_pipeline));
+    _pipeline_cache.add_creation_time(start);
+
+    vkDestroyShaderModule(_device, cull_shader, nullptr);
+
+    _main_deletion_queue.push_function(
+        [=]() {
+            vkDestroyPipeline(_device, _cull_pipeline, nullptr);
+            vkDestroyPipelineLayout(_device, _cull_pipeline_layout, nullptr);
+        }
+    );
+
+    _vkCmdDrawIndirectCountKHR = (PFN_vkCmdDrawIndirectCountKHR)vkGetDeviceProcAddr(_device, "vkCmdDrawIndirectCountKHR");
+    if (_vkCmdDrawIndirectCountKHR == nullptr) {
+        std::cerr << "[GPU Culling] vkCmdDrawIndirectCountKHR not found (VK_KHR_draw_indirect_count)" << std::endl;
+        abort();
+    }
 }
 
 void MeshBufferApp::init_scenes() {
     _mesh.load_from_obj("bunny.obj");
     upload_mesh(_mesh);
-}
 
-void MeshBufferApp::render() {
-    FrameData& frame = get_current_frame();
-    const int frame_idx = get_current_frame_idx();
+    init_objects();
+    init_culling();
+}
 
+void MeshBufferApp::init_objects() {
     using namespace MeshBufferAppTest;
-    const int padding_size = vkutils::padding(
-        sizeof(GPUUniformData),
-        _physical_device_properties.limits.minUniformBufferOffsetAlignment
+
+    // bounding sphere of the mesh: the center of its box
+    glm::vec3 min_pos = _mesh._vertices[0].position;
+    glm::vec3 max_pos = min_pos;
+    for (const Vertex& vertex : _mesh._vertices) {
+        min_pos = glm::min(min_pos, vertex.position);
+        max_pos = glm::max(max_pos, vertex.position);
+    }
+    const glm::vec3 center = 0.5f * (min_pos + max_pos);
+    float radius = 0.0f;
+    for (const Vertex& vertex : _mesh._vertices) {
+        radius = std::max(radius, glm::length(vertex.position - center));
+    }
+
+    // a grid on x & z, the first row is the original 3 objects
+    std::vector<GPUObjectData> objects(_num_objects);
+    _bounding_spheres.resize(_num_objects);
+    const uint32_t row_size = std::max(3U, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(_num_objects)))));
+    const float scale = 5.0f * 3.0f;
+    glm::mat4 trans = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f));
+    for (uint32_t i = 0; i < _num_objects; ++i) {
+        const uint32_t col = i % row_size;
+        const uint32_t row = i / row_size;
+        objects[i]._model_matrix = glm::scale(
+            glm::translate(trans, glm::vec3(0.5f * (col * 3 / 2), 0, -0.5f * (row * 3 / 2))), glm::vec3(3.0f));
+        objects[i]._bounding_sphere = glm::vec4(glm::vec3(objects[i]._model_matrix * glm::vec4(center, 1.0f)), radius * scale);
+        _bounding_spheres[i] = objects[i]._bounding_sphere;
+    }
+
+    const uint32_t buffer_size = static_cast<uint32_t>(objects.size() * sizeof(GPUObjectData));
+    AllocatedBuffer staging_buffer = create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    void* data;
+    vmaMapMemory(_allocator, staging_buffer._allocation, &data);
+    memcpy(data, objects.data(), buffer_size);
+    vmaUnmapMemory(_allocator, staging_buffer._allocation);
+
+    _object_buffer = create_buffer(buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    immediate_submit(
+        [=](VkCommandBuffer cmd) {
+            VkBufferCopy copy = {};
+            copy.size = buffer_size;
+            vkCmdCopyBuffer(cmd, staging_buffer._buffer, _object_buffer._buffer, 1, &copy);
+        }
     );
 
-    {
-        // set uniform data
-        glm::vec3 camera_pos = { -2.0f, -1.0f, -7.0f };
-        glm::mat4 view = glm::translate(glm::mat4(1.0f), camera_pos);
-        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 1700.0f / 900.0f, 0.1f, 200.0f);
-        projection[1][1] *= -1;
+    vmaDestroyBuffer(_allocator, staging_buffer._buffer, staging_buffer._allocation);
+
+    _main_deletion_queue.push_function(
+        [=]() {
+            vmaDestroyBuffer(_allocator, _object_buffer._buffer, _object_buffer._allocation);
+        }
+    );
 
-        GPUCameraData camera_data = { view, projection, projection * view };
-        GPUUniformData uniform_data = { camera_data };
+    VkDescriptorBufferInfo object_buffer_info = { _object_buffer._buffer, 0, VK_WHOLE_SIZE };
+    DescriptorWriter writer{};
+    writer.write_buffer(_static_object_descriptor_set, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, object_buffer_info);
+    writer.flush(_device);
+}
 
-        char* data = nullptr;
-        vmaMapMemory(_allocator, _uniform_data_buffer._allocation, (void**)(&data));
-        data += frame_idx * padding_size;
-        memcpy(data, &uniform_data, sizeof(GPUUniformData));
-        vmaUnmapMemory(_allocator, _uniform_data_buffer._allocation);
+void MeshBufferApp::init_culling() {
+    // the cpu path
+    init_parallel_recorder();
+
+    const uint32_t draw_buffer_size = static_cast<uint32_t>(_num_objects * sizeof(VkDrawIndirectCommand));
+
+    DescriptorWriter writer{};
+    _cull_frames.resize(_frames_in_flight);
+    for (CullFrame& frame : _cull_frames) {
+        frame._draw_buffer = create_buffer(draw_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        frame._count_buffer = create_buffer(sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+        frame._descriptor_set = _descriptors.create_set(_cull_set_layout);
+        writer.write_buffer(frame._descriptor_set, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { _object_buffer._buffer, 0, VK_WHOLE_SIZE });
+        writer.write_buffer(frame._descriptor_set, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { frame._draw_buffer._buffer, 0, VK_WHOLE_SIZE });
+        writer.write_buffer(frame._descriptor_set, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { frame._count_buffer._buffer, 0, VK_WHOLE_SIZE });
+
+        const CullFrame created = frame;
+        _main_deletion_queue.push_function(
+            [=]() {
+                vmaDestroyBuffer(_allocator, created._draw_buffer._buffer, created._draw_buffer._allocation);
+                vmaDestroyBuffer(_allocator, created._count_buffer._buffer, created._count_buffer._allocation);
+            }
+        );
     }
+    writer.flush(_device);
+}
 
-    const int OBJ_NUM = 3;
+void MeshBufferApp::pre_render() {
+    if (!_gpu_culling) {
+        return;
+    }
+    using namespace MeshBufferAppTest;
+    VkCommandBuffer cmd = get_current_frame()._main_command_buffer;
+    const CullFrame& frame = _cull_frames[get_current_frame_idx()];
+
+    // 1. reset the count
+    vkCmdFillBuffer(cmd, frame._count_buffer._buffer, 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // 2. cull & write the draws
+    CullPushConstant constants = {};
+    get_frustum_planes(get_camera_data()._view_proj, constants._planes);
+    constants._num_objects = _num_objects;
+    constants._vertex_count = static_cast<uint32_t>(_mesh._vertices.size());
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline_layout, 0, 1, &frame._descriptor_set, 0, nullptr);
+    vkCmdPushConstants(cmd, _cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstant), &constants);
+    vkCmdDispatch(cmd, (_num_objects + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // 3. the draws & the count are read by the indirect draw
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void MeshBufferApp::render() {
+    // the fence of this frame is waited
+    _frame_allocator.begin_frame(get_current_frame_idx());
+
+    using namespace MeshBufferAppTest;
+    uint32_t uniform_offset = 0;
     {
-        // set storage data
-        using namespace MeshBufferAppTest;
-        void* data = nullptr;
-        vmaMapMemory(_allocator, frame._object_buffer._allocation, &data);
-        GPUObjectData* object_ssbo = (GPUObjectData*)data;
-        glm::mat4 trans = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f));
-        for (int i = 0; i < OBJ_NUM; ++i) {
-            object_ssbo[i]._model_matrix = glm::scale(glm::translate(trans, glm::vec3(0.5f * (i * OBJ_NUM / 2), 0, 0)), glm::vec3(3.0f));
-        }
-        vmaUnmapMemory(_allocator, frame._object_buffer._allocation);
+        // set uniform data
+        GPUUniformData uniform_data = { get_camera_data() };
+        uniform_offset = _frame_allocator.push_uniform(uniform_data);
     }
 
     VkCommandBuffer& cmd = get_current_frame()._main_command_buffer;
+    if (_gpu_culling) {
+        bind_mesh(cmd, uniform_offset);
+        // the visible objects, written by `pre_render`
+        const CullFrame& frame = _cull_frames[get_current_frame_idx()];
+        _vkCmdDrawIndirectCountKHR(cmd, frame._draw_buffer._buffer, 0, frame._count_buffer._buffer, 0, _num_objects, sizeof(VkDrawIndirectCommand));
+        return;
+    }
+
+    // a draw per visible object, the objects are split over the threads (secondary command buffers)
+    glm::vec4 planes[6];
+    get_frustum_planes(get_camera_data()._view_proj, planes);
+    const uint32_t vertex_count = static_cast<uint32_t>(_mesh._vertices.size());
+    _parallel_recorder.record(cmd, get_current_frame_idx(), get_render_pass_inheritance(), _num_objects,
+        [&](VkCommandBuffer secondary, uint32_t begin, uint32_t end) {
+            bind_mesh(secondary, uniform_offset);
+            for (uint32_t i = begin; i < end; ++i) {
+                const glm::vec4& sphere = _bounding_spheres[i];
+                bool visible = true;
+                for (int p = 0; p < 6 && visible; ++p) {
+                    visible = glm::dot(glm::vec3(planes[p]), glm::vec3(sphere)) + planes[p].w >= -sphere.w;
+                }
+                if (visible) {
+                    vkCmdDraw(secondary, vertex_count, 1, 0, i);
+                }
+            }
+        }
+    );
+}
+
+VkSubpassContents MeshBufferApp::get_subpass_contents() const {
+    return _gpu_culling ? VK_SUBPASS_CONTENTS_INLINE : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+}
+
+void MeshBufferApp::bind_mesh(VkCommandBuffer cmd, uint32_t uniform_offset) {
+    using namespace MeshBufferAppTest;
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline);
 
     // dynamic descriptors(uniform)
-    uint32_t uniform_offset = padding_size * frame_idx;
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline_layout, 0, 1, &frame._uniform_data_descriptor_set, 1, &uniform_offset);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline_layout, 0, 1, &_uniform_data_descriptor_set, 1, &uniform_offset);
 
     // (storage)
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline_layout, 1, 1, &frame._object_descriptor_set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline_layout, 1, 1, &_static_object_descriptor_set, 0, nullptr);
 
     // (push_constant)
     MeshPushConstant mesh_constants = {};
@@ -97,10 +307,6 @@ void MeshBufferApp::render() {
 
     VkDeviceSize offset = 0;
     vkCmdBindVertexBuffers(cmd, 0, 1, &_mesh._vertex_buffer._buffer, &offset);
-
-    for (int i = 0; i < OBJ_NUM; ++i) {
-        vkCmdDraw(cmd, _mesh._vertices.size(), 1, 0, i);
-    }
 }
 
 void MeshBufferApp::set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count) {
@@ -131,10 +337,23 @@ void MeshBufferApp::init_descriptors() {
     // [1] uniform data
     init_descriptors_for_uniform_data(sizeof(MeshBufferAppTest::GPUUniformData));
 
-    // [2] object data
-    init_descriptors_for_object_data(sizeof(MeshBufferAppTest::GPUObjectData));
+    // [2] object data: not per frame, a set on the static buffer (written by `init_objects`)
+    {
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        VkShaderStageFlags stage = VK_SHADER_STAGE_VERTEX_BIT;
+        VkDescriptorSetLayout object_set_layout = _descriptors.create_set_layout(&type, &stage);
+        _static_object_descriptor_set = _descriptors.create_set(object_set_layout);
+        _set_layout.push_back(object_set_layout);
+    }
+
+    // [3] culling: objects, draws, count
+    {
+        VkDescriptorType types[3] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+        VkShaderStageFlags stages[3] = { VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_COMPUTE_BIT };
+        _cull_set_layout = _descriptors.create_set_layout(types, stages, 3);
+    }
 
-    // [3] textures
+    // [4] textures
     // init_descriptors_for_texture();
 
     _main_deletion_queue.push_function([&]() { _descriptors.destroy(); });
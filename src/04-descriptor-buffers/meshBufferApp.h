@@ -4,7 +4,10 @@
 
 class MeshBufferApp :public RasBufferApp {
 public:
-    MeshBufferApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer);
+    // the object buffer, the draw buffers & the grid of the scene are sized by the number of objects
+    static const uint32_t MAX_OBJECTS = 1U << 18;
+
+    MeshBufferApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer, uint32_t num_objects = 3);
     virtual ~MeshBufferApp() override;
 protected:
     // virtual void init_per_frame() override;
@@ -18,17 +21,49 @@ protected:
     // virtual void init_sync_structures() override;
     virtual void init_scenes() override;
     virtual void render() override;
+    virtual void pre_render() override;
+    virtual VkSubpassContents get_subpass_contents() const override;
     virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count) override;
     virtual void init_descriptors() override;
 
 private:
+    void init_objects();
+    void init_culling();
+    // pipeline, sets, push constants & vertex buffer of the mesh
+    void bind_mesh(VkCommandBuffer cmd, uint32_t uniform_offset);
+
     static const int COLOR_TYPE = 3;
+    static const uint32_t CULL_GROUP_SIZE = 64;     // local_size_x of 04-cull.comp
     bool _key_pressed = false;
     int _color_type = 0;
 
     Mesh _mesh{};
     VkPipeline _mesh_pipeline = VK_NULL_HANDLE;
     VkPipelineLayout _mesh_pipeline_layout = VK_NULL_HANDLE;
+
+    // the objects don't move: uploaded once, read by the culling & the vertex shader
+    uint32_t _num_objects{ 3 };
+    std::vector<glm::vec4> _bounding_spheres{};     // the cpu culling
+    AllocatedBuffer _object_buffer{};
+    VkDescriptorSet _static_object_descriptor_set = VK_NULL_HANDLE;
+
+    /// <summary>
+    /// gpu culling: the visible objects are written as indirect draws & counted by a compute pass,
+    /// drawn by one vkCmdDrawIndirectCount whatever the number of objects.
+    /// the buffers are per frame in flight, the draws of the previous frames may still be read
+    /// </summary>
+    struct CullFrame {
+        AllocatedBuffer _draw_buffer{};
+        AllocatedBuffer _count_buffer{};
+        VkDescriptorSet _descriptor_set = VK_NULL_HANDLE;
+    };
+    std::vector<CullFrame> _cull_frames{};
+    VkDescriptorSetLayout _cull_set_layout = VK_NULL_HANDLE;
+    VkPipeline _cull_pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout _cull_pipeline_layout = VK_NULL_HANDLE;
+    PFN_vkCmdDrawIndirectCountKHR _vkCmdDrawIndirectCountKHR = nullptr;
+    // false: culled on the cpu, the draws are recorded by `_parallel_recorder`
+    bool _gpu_culling{ true };
 };
 
 namespace MeshBufferAppTest {
@@ -36,6 +71,12 @@ namespace MeshBufferAppTest {
         int _type;
     };
 
+    struct CullPushConstant {
+        glm::vec4 _planes[6];   // xyz: normal (pointing inside), w: distance
+        uint32_t _num_objects;
+        uint32_t _vertex_count;
+    };
+
     struct GPUCameraData {
         glm::mat4 _view{};
         glm::mat4 _proj{};
@@ -48,5 +89,6 @@ namespace MeshBufferAppTest {
 
     struct GPUObjectData {
         glm::mat4 _model_matrix{};
+        glm::vec4 _bounding_sphere{};   // world space, xyz: center, w: radius
     };
 }
@@ -33,7 +33,9 @@ void MeshTexApp::init_scenes() {
     tex_info.imageView = _bunny.image_view();
     tex_info.sampler = tex_sampler;
 
-    _descriptors.bind(_bunny.descriptor_set(), &tex_info, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0);
+    DescriptorWriter writer{};
+    writer.write_image(_bunny.descriptor_set(), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, tex_info);
+    writer.flush(_device);
 
     _main_deletion_queue.push_function(
         [=]() {
@@ -45,15 +47,12 @@ void MeshTexApp::init_scenes() {
 void MeshTexApp::render() {
     VkCommandBuffer& cmd = get_current_frame()._main_command_buffer;
 
-    FrameData& frame = get_current_frame();
-    const int frame_idx = get_current_frame_idx();
+    // the fence of this frame is waited
+    _frame_allocator.begin_frame(get_current_frame_idx());
 
     using namespace MeshTexAppTest;
-    const int padding_size = vkutils::padding(
-        sizeof(GPUUniformData),
-        _physical_device_properties.limits.minUniformBufferOffsetAlignment
-    );
-
+    uint32_t uniform_offset = 0;
+    uint32_t object_offset = 0;
     {
         // set uniform data
         float aspect = (float)_window_extent.width / (float)_window_extent.height;
@@ -63,31 +62,21 @@ void MeshTexApp::render() {
         GPUCameraData camera_data = { view, projection, projection * view };
         GPUUniformData uniform_data = { camera_data };
 
-        char* data = nullptr;
-        vmaMapMemory(_allocator, _uniform_data_buffer._allocation, (void**)(&data));
-        data += frame_idx * padding_size;
-        memcpy(data, &uniform_data, sizeof(GPUUniformData));
-        vmaUnmapMemory(_allocator, _uniform_data_buffer._allocation);
+        uniform_offset = _frame_allocator.push_uniform(uniform_data);
     }
     {
         // set storage data
-        using namespace MeshTexAppTest;
-        void* data = nullptr;
-        vmaMapMemory(_allocator, frame._object_buffer._allocation, &data);
-        GPUObjectData* object_ssbo = (GPUObjectData*)data;
+        GPUObjectData* object_ssbo = _frame_allocator.allocate_storage<GPUObjectData>(1, object_offset);
         object_ssbo[0]._model_matrix = _bunny._model_matrix;
-
-        vmaUnmapMemory(_allocator, frame._object_buffer._allocation);
     }
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _bunny.pipeline());
     VkPipelineLayout& layout = _bunny.pipeline_layout();
 
     // uniform buffer (dynamic descriptors)
-    uint32_t uniform_offset = padding_size * frame_idx;
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &frame._uniform_data_descriptor_set, 1, &uniform_offset);
-    // storage buffer
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &frame._object_descriptor_set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &_uniform_data_descriptor_set, 1, &uniform_offset);
+    // storage buffer (dynamic descriptors)
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &_object_descriptor_set, 1, &object_offset);
     // texture
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 2, 1, &_bunny.descriptor_set(), 0, nullptr);
 
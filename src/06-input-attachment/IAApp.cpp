@@ -35,7 +35,9 @@ void IAApp::init_scenes() {
     tex_info.imageView = _bunny.image_view();
     tex_info.sampler = tex_sampler;
 
-    _descriptors.bind(_bunny.descriptor_set(), &tex_info, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0);
+    DescriptorWriter writer{};
+    writer.write_image(_bunny.descriptor_set(), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, tex_info);
+    writer.flush(_device);
 
     _main_deletion_queue.push_function(
         [=]() {
@@ -47,15 +49,12 @@ void IAApp::init_scenes() {
 void IAApp::render() {
     VkCommandBuffer& cmd = get_current_frame()._main_command_buffer;
 
-    FrameData& frame = get_current_frame();
-    const int frame_idx = get_current_frame_idx();
+    // the fence of this frame is waited
+    _frame_allocator.begin_frame(get_current_frame_idx());
 
     using namespace IAAppTest;
-    const int padding_size = vkutils::padding(
-        sizeof(GPUUniformData),
-        _physical_device_properties.limits.minUniformBufferOffsetAlignment
-    );
-
+    uint32_t uniform_offset = 0;
+    uint32_t object_offset = 0;
     {
         // set uniform data
         float aspect = (float)_window_extent.width / (float)_window_extent.height;
@@ -65,21 +64,12 @@ void IAApp::render() {
         GPUCameraData camera_data = { view, projection, projection * view };
         GPUUniformData uniform_data = { camera_data };
 
-        char* data = nullptr;
-        vmaMapMemory(_allocator, _uniform_data_buffer._allocation, (void**)(&data));
-        data += frame_idx * padding_size;
-        memcpy(data, &uniform_data, sizeof(GPUUniformData));
-        vmaUnmapMemory(_allocator, _uniform_data_buffer._allocation);
+        uniform_offset = _frame_allocator.push_uniform(uniform_data);
     }
     {
         // set storage data
-        using namespace IAAppTest;
-        void* data = nullptr;
-        vmaMapMemory(_allocator, frame._object_buffer._allocation, &data);
-        GPUObjectData* object_ssbo = (GPUObjectData*)data;
+        GPUObjectData* object_ssbo = _frame_allocator.allocate_storage<GPUObjectData>(1, object_offset);
         object_ssbo[0]._model_matrix = _bunny._model_matrix;
-
-        vmaUnmapMemory(_allocator, frame._object_buffer._allocation);
     }
 
     // [1] subpass 0
@@ -87,10 +77,9 @@ void IAApp::render() {
     VkPipelineLayout& layout = _bunny.pipeline_layout();
 
     // uniform buffer (dynamic descriptors)
-    uint32_t uniform_offset = padding_size * frame_idx;
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &frame._uniform_data_descriptor_set, 1, &uniform_offset);
-    // storage buffer
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &frame._object_descriptor_set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &_uniform_data_descriptor_set, 1, &uniform_offset);
+    // storage buffer (dynamic descriptors)
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &_object_descriptor_set, 1, &object_offset);
     // texture
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 2, 1, &_bunny.descriptor_set(), 0, nullptr);
 
@@ -163,6 +152,7 @@ void IAApp::init_descriptors_for_texture() {
         const uint32_t size = _swapchain_images.size();
         _descriptor_set_subpass1.resize(size);
 
+        DescriptorWriter writer{};
         for (int i = 0; i < size; ++i) {
             // [1] alloc
             VkDescriptorSet desc_set = _descriptors.create_set(subpass_tex_set_layout);;
@@ -174,12 +164,13 @@ void IAApp::init_descriptors_for_texture() {
             attach_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             attach_info.imageView = _color_attachment[i]._image_view;
             attach_info.sampler = VK_NULL_HANDLE;
-            _descriptors.bind(desc_set, &attach_info, types[0], 0);
+            writer.write_image(desc_set, 0, types[0], attach_info);
 
             // depth attachment
             attach_info.imageView = _depth_attachment[i]._image_view;
-            _descriptors.bind(desc_set, &attach_info, types[1], 1);
+            writer.write_image(desc_set, 1, types[1], attach_info);
         }
+        writer.flush(_device);
 
         _subpass_set_layout.push_back(subpass_tex_set_layout);
     }
@@ -194,4 +185,7 @@ void IAApp::draw_ui() {
         _camera.draw_ui();
         ImGui::PopID();
     }
+    if (ImGui::CollapsingHeader("Memory")) {
+        draw_memory_ui();
+    }
 }
@@ -30,7 +30,9 @@ void CAApp::init_scenes() {
     tex_info.imageView = _bunny.image_view();
     tex_info.sampler = tex_sampler;
 
-    _descriptors.bind(_bunny.descriptor_set(), &tex_info, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0);
+    DescriptorWriter writer{};
+    writer.write_image(_bunny.descriptor_set(), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, tex_info);
+    writer.flush(_device);
 
     _main_deletion_queue.push_function(
         [=]() {
@@ -40,15 +42,10 @@ void CAApp::init_scenes() {
 }
 
 void CAApp::render() {
-    FrameData& frame = get_current_frame();
-    VkCommandBuffer& cmd = frame._main_command_buffer;
-    const int frame_idx = get_current_frame_idx();
+    // the fence of this frame is waited
+    _frame_allocator.begin_frame(get_current_frame_idx());
 
     using namespace CAAppTest;
-    const int padding_size = vkutils::padding(
-        sizeof(GPUUniformData),
-        _physical_device_properties.limits.minUniformBufferOffsetAlignment
-    );
 
     // set buffer
     {
@@ -61,31 +58,27 @@ void CAApp::render() {
             GPUCameraData camera_data = { view, projection, projection * view };
             GPUUniformData uniform_data = { camera_data, _CA_strength };
 
-            char* data = nullptr;
-            vmaMapMemory(_allocator, _uniform_data_buffer._allocation, (void**)(&data));
-            data += frame_idx * padding_size;
-            memcpy(data, &uniform_data, sizeof(GPUUniformData));
-            vmaUnmapMemory(_allocator, _uniform_data_buffer._allocation);
+            _uniform_offset = _frame_allocator.push_uniform(uniform_data);
         }
         {
             // set storage data
-            using namespace CAAppTest;
-            void* data = nullptr;
-            vmaMapMemory(_allocator, frame._object_buffer._allocation, &data);
-            GPUObjectData* object_ssbo = (GPUObjectData*)data;
+            GPUObjectData* object_ssbo = _frame_allocator.allocate_storage<GPUObjectData>(1, _object_offset);
             object_ssbo[0]._model_matrix = _bunny._model_matrix;
-            vmaUnmapMemory(_allocator, frame._object_buffer._allocation);
         }
     }
 
-    // pass 0
+    // pass 0, barriers, pass 1
+    RasTwoPassApp::render();
+}
+
+void CAApp::render_pass0(VkCommandBuffer cmd) {
     {
         VkClearValue color_value{};
         color_value.color = { 0.0f, 0.0f, 0.0f, 0.0f };
         VkClearValue depth_value{};
         depth_value.depthStencil.depth = 1.0f; // max
         VkClearValue clear_values[2] = { color_value, depth_value };
-        VkRenderPassBeginInfo rp_begin_info = vkinit::renderpass_begin_info(_render_pass, _window_extent, _framebuffers[_swapchain_image_index]);
+        VkRenderPassBeginInfo rp_begin_info = vkinit::renderpass_begin_info(_render_pass, _window_extent, _framebuffer_pass0);
         rp_begin_info.clearValueCount = 2;
         rp_begin_info.pClearValues = clear_values;
 
@@ -95,10 +88,9 @@ void CAApp::render() {
         VkPipelineLayout& layout = _bunny.pipeline_layout();
 
         // uniform buffer (dynamic descriptors)
-        uint32_t uniform_offset = padding_size * frame_idx;
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &frame._uniform_data_descriptor_set, 1, &uniform_offset);
-        // storage buffer
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &frame._object_descriptor_set, 0, nullptr);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &_uniform_data_descriptor_set, 1, &_uniform_offset);
+        // storage buffer (dynamic descriptors)
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &_object_descriptor_set, 1, &_object_offset);
         // texture
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 2, 1, &_bunny.descriptor_set(), 0, nullptr);
 
@@ -108,32 +100,9 @@ void CAApp::render() {
 
         vkCmdEndRenderPass(cmd);
     }
+}
 
-    // layout transition
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.pNext = nullptr;
-    barrier.srcQueueFamilyIndex = _graphics_queue_family;
-    barrier.dstQueueFamilyIndex = _graphics_queue_family;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.image = _color_attachment[_swapchain_image_index]._image._image;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    vkCmdPipelineBarrier(cmd,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-
-    // pass 1
+void CAApp::render_pass1(VkCommandBuffer cmd) {
     {
         VkClearValue color_value{};
         color_value.color = { 0.0f, 0.0f, 0.0f, 0.0f };
@@ -148,11 +117,9 @@ void CAApp::render() {
 
         // for convenience, we use the same uniform buffer
         // uniform buffer (dynamic descriptors)
-        uint32_t uniform_offset = padding_size * frame_idx;
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &frame._uniform_data_descriptor_set, 1, &uniform_offset);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &_uniform_data_descriptor_set, 1, &_uniform_offset);
         // texture
-        VkDescriptorSet& desc_set = _descriptor_set_pass1[_swapchain_image_index];
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout_pass1, 1, 1, &desc_set, 0, nullptr);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout_pass1, 1, 1, &_descriptor_set_pass1, 0, nullptr);
 
         vkCmdDraw(cmd, 3, 1, 0, 0);
         // GUI (at the end of pass 1)
@@ -212,25 +179,22 @@ void CAApp::init_descriptors_for_texture() {
         };
         VkDescriptorSetLayout pass1_tex_set_layout = _descriptors.create_set_layout(types, stages, SETS_NUM);
 
-        const uint32_t size = _swapchain_images.size();
-        _descriptor_set_pass1.resize(size);
-
         VkSampler tex_sampler = VK_NULL_HANDLE;
         VkSamplerCreateInfo sampler_info = vkinit::sampler_create_info(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER);
         VK_CHECK(vkCreateSampler(_device, &sampler_info, nullptr, &tex_sampler));
 
-        for (int i = 0; i < size; ++i) {
-            // [1] alloc
-            VkDescriptorSet desc_set = _descriptors.create_set(pass1_tex_set_layout);;
-            _descriptor_set_pass1[i] = desc_set;
-
-            // [2] bind
-            VkDescriptorImageInfo attach_info = {};
-            attach_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            attach_info.imageView = _color_attachment[i]._image_view;
-            attach_info.sampler = tex_sampler;
-            _descriptors.bind(desc_set, &attach_info, types[0], 0);
-        }
+        // [1] alloc, one color attachment for all the frames (the render graph orders their passes)
+        _descriptor_set_pass1 = _descriptors.create_set(pass1_tex_set_layout);
+
+        // [2] bind
+        VkDescriptorImageInfo attach_info = {};
+        attach_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        attach_info.imageView = _render_graph.image_view(_color_image);
+        attach_info.sampler = tex_sampler;
+
+        DescriptorWriter writer{};
+        writer.write_image(_descriptor_set_pass1, 0, types[0], attach_info);
+        writer.flush(_device);
 
         _set_layout_pass1.push_back(pass1_tex_set_layout);
 
@@ -18,6 +18,8 @@ protected:
     // virtual void init_sync_structures() override;
     virtual void init_scenes() override;
     virtual void render() override;
+    virtual void render_pass0(VkCommandBuffer cmd) override;
+    virtual void render_pass1(VkCommandBuffer cmd) override;
     // virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count);
     virtual void init_descriptors() override;
 
@@ -27,7 +29,10 @@ private:
 
     float _CA_strength = 0.01f;
     RenderObject _bunny{};
-    std::vector<VkDescriptorSet> _descriptor_set_pass1{};
+    VkDescriptorSet _descriptor_set_pass1 = VK_NULL_HANDLE;
+    // the allocations of this frame, bound by both passes
+    uint32_t _uniform_offset{ 0 };
+    uint32_t _object_offset{ 0 };
     ModelViewerCamera _camera{ 9.0f, 104.0f, 63.0f, -0.046f, 3.41f };
 };
 
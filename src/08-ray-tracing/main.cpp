@@ -10,6 +10,10 @@ int main(int argc, char** argv) {
     try {
         RTApp app("Ray Tracing", 1600, 900, true);
         app._ppg_on = true;
+        // [frames in flight], triple-buffered by default
+        if (argc > 1) {
+            app.set_frames_in_flight(static_cast<uint32_t>(std::stoi(argv[1])));
+        }
         app.run();
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
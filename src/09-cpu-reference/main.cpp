@@ -0,0 +1,179 @@
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#define main SDL_main
+#include <SDL.h>
+#include "../common/config.h"
+#include "../common/rt/camera.h"
+#include "../common/rt/ppg.h"
+#include "../common/rt/ppgSchedule.h"
+#include "../common/rt/cpuScene.h"
+#include "../common/rt/cpuTracer.h"
+#include "../common/rt/cpuDenoiser.h"
+
+// usage: 09_cpu_reference [spp] [width] [height] [ppg training budget spp (0: off)] [nee on] [russian roulette depth] [sampler (0: independent, 1: sobol)] [adaptive error threshold (0: off)] [denoiser iterations (0: off)] [camera motion frames (0: static)] [temporal reprojection on] [environment strength (0: off)] [radiance grid footprint (0: off)]
+int main(int argc, char** argv) {
+    try {
+        const int spp = (argc > 1) ? std::stoi(argv[1]) : 16;
+        const uint32_t width = (argc > 2) ? static_cast<uint32_t>(std::stoi(argv[2])) : 1600;
+        const uint32_t height = (argc > 3) ? static_cast<uint32_t>(std::stoi(argv[3])) : 900;
+        const int train_spp = (argc > 4) ? std::stoi(argv[4]) : 0;
+        const int nee_on = (argc > 5) ? std::stoi(argv[5]) : 1;
+        const int rr_depth = (argc > 6) ? std::stoi(argv[6]) : 3;
+        const int sampler_type = (argc > 7) ? std::stoi(argv[7]) : SWS_SAMPLER_SOBOL;
+        const float adaptive_threshold = (argc > 8) ? std::stof(argv[8]) : 0.0f;
+        const int denoise_iterations = (argc > 9) ? std::min(std::stoi(argv[9]), SWS_DENOISE_MAX_ITERATIONS) : 0;
+        const int motion_frames = (argc > 10) ? std::stoi(argv[10]) : 0;
+        const int temporal_on = (argc > 11) ? std::stoi(argv[11]) : 1;
+        const float env_strength = (argc > 12) ? std::stof(argv[12]) : 1.0f;
+        const float grid_footprint = (argc > 13) ? std::stof(argv[13]) : 0.0f;
+
+        // the bvh is cached across runs
+        ASCache as_cache;
+        as_cache.init(PROJECT_DIRECTORY"/cache", ASCache::host_identity(CPUBVH::FORMAT_VERSION));
+
+        // the same scene & camera as `RTApp::init_scenes`
+        CPUScene scene;
+        if (!scene.load(ASSETS_DIRECTORY"/bear/bear_box-2.obj", &as_cache)) {
+            return -1;
+        }
+        scene.load_env_map(ASSETS_DIRECTORY"/envs/studio_garden_2k.jpg");
+
+        Camera camera;
+        camera.SetViewport({ 0, 0, static_cast<int>(width), static_cast<int>(height) });
+        camera.SetViewPlanes(0.1f, 100.0f);
+        camera.SetFovY(45.0f);
+        camera.LookAt(vec3(0.546f, 0.662f, 2.262f), vec3(0.499f, 0.596f, 1.265f));
+
+        UniformParams params = {};
+        params.camPos = vec4(camera.GetPosition(), 0.0f);
+        params.camDir = vec4(camera.GetDirection(), 0.0f);
+        params.camUp = vec4(camera.GetUp(), 0.0f);
+        params.camSide = vec4(camera.GetSide(), 0.0f);
+        params.camNearFarFov = vec4(camera.GetNearPlane(), camera.GetFarPlane() * 100, Deg2Rad(camera.GetFovY()), 0.0f);
+        params.light_strength = 1.0f;
+        params.light_id = 7;
+        params.glass_id = 10;
+        params.mirror_id = 13;
+
+        scene.build_emitters(params.light_id);
+        params.nee_on = nee_on;
+        params.num_emitters = static_cast<int>(scene._emitters.size());
+        params.emitters_area = scene._emitters_area;
+        params.rr_depth = rr_depth;
+        params.sampler_type = sampler_type;
+        params.env_strength = env_strength;
+        params.env_light_prob = scene._env_distribution.light_probability(env_strength, params.num_emitters);
+        // the same defaults as `RTApp`
+        params.grid_on = (grid_footprint > 0.0f);
+        params.grid_start_bounce = 2;
+        params.grid_footprint = grid_footprint;
+
+        CPUTracer tracer(&scene);
+        tracer.resize(width, height);
+
+        // ppg: the same process as `RTApp` (the iterations of `PPGSchedule` -> test)
+        std::vector<STree> stree;
+        std::vector<DTree> dtree;
+        GuideTables guide_tables;
+        if (train_spp > 0) {
+            stree = std::vector<STree>(STree::MAX_NODE);
+            dtree = std::vector<DTree>(DTree::MAX_NODE * STree::MAX_NODE);
+            STree::__root = dtree.data();
+            DTree::__root = dtree.data();
+
+            STree* s_root = stree.data();
+            DTree* d_root = dtree.data();
+            s_root->initial_split(0, 2);
+            for (int i = 0; i <= STree::__node_index; ++i) {
+                int root_index = DTree::get_root_index_by_STree_index(i);
+                (d_root + root_index)->initial_split(root_index, 2);
+            }
+
+            // every iteration is guided by the previous ones
+            PPGSchedule schedule;
+            schedule.start(d_root, static_cast<uint32_t>(train_spp));
+            params.ppg_train_on = 1;
+            for (int i = 1; schedule.training(); ++i) {
+                params.accumulate_spp = i;
+                tracer.render(params);
+                if (schedule.add_frame(s_root, d_root, tracer._radiance_cache.data(), static_cast<uint32_t>(tracer._radiance_cache.size()), guide_tables)) {
+                    tracer.set_sdtree(s_root, guide_tables);
+                    params.ppg_test_on = 1;
+                }
+            }
+            std::cout << "[SDTree] STree nodes: " << STree::__node_index + 1 << std::endl;
+            params.ppg_train_on = 0;
+        }
+
+        // camera motion: the camera strafes to the position above in `motion_frames` frames,
+        // the history is reprojected (or reset like `RTApp` without the temporal reprojection) every frame
+        const float motion_step = 0.005f;
+        if (motion_frames > 0) {
+            params.prevCamDir = params.camDir;
+            params.prevCamUp = params.camUp;
+            params.prevCamSide = params.camSide;
+            auto motion_start = std::chrono::high_resolution_clock::now();
+            for (int i = 1; i <= motion_frames; ++i) {
+                const float offset = static_cast<float>(motion_frames - i) * motion_step;
+                params.camPos = vec4(camera.GetPosition() + camera.GetSide() * offset, 0.0f);
+                params.accumulate_spp = temporal_on ? i : 1;
+                params.random_seed = i;
+                params.reproject_on = (temporal_on && i > 1) ? 1 : 0;
+                tracer.render(params);
+                params.prevCamPos = vec4(vec3(params.camPos), params.camNearFarFov.z);
+            }
+            params.reproject_on = 0;
+            auto motion_delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - motion_start);
+            std::cout << "[CPU Tracer] camera motion: " << motion_frames << " frames, temporal reprojection "
+                << (temporal_on ? "on" : "off") << ", time: " << motion_delta.count() << "s" << std::endl;
+        }
+
+        // adaptive sampling: the tile list is updated at the same interval as `RTApp`, `spp` is the max per-pixel count
+        const int adaptive_interval = 8;
+        params.adaptive_on = (adaptive_threshold > 0.0f);
+        uint64_t num_samples = 0;
+        int max_spp = 0;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 1; i <= spp; ++i) {
+            params.accumulate_spp = motion_frames + i;
+            params.random_seed = motion_frames + i;
+            params.num_active_tiles = static_cast<int>(tracer._active_tiles.size());
+            tracer.render(params);
+            max_spp = i;
+
+            if (!params.adaptive_on) {
+                num_samples += static_cast<uint64_t>(width) * height;
+                continue;
+            }
+            num_samples += static_cast<uint64_t>(params.num_active_tiles) * SWS_ADAPTIVE_TILE_SIZE * SWS_ADAPTIVE_TILE_SIZE;
+            if (i % adaptive_interval == 0 && tracer.update_active_tiles(adaptive_threshold) == 0) {
+                break;
+            }
+        }
+        auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+        std::cout << "[CPU Tracer] " << max_spp << " spp, " << width << "x" << height << ", "
+            << static_cast<float>(num_samples) / (static_cast<float>(width) * height) << " samples per pixel on average, time: " << delta.count() << "s" << std::endl;
+
+        tracer.save_result_image("cpu_reference.ppm");
+        tracer.save_accumulated_image("cpu_reference.pfm");
+
+        if (denoise_iterations > 0) {
+            CPUDenoiser denoiser;
+            start = std::chrono::high_resolution_clock::now();
+            denoiser.denoise(tracer, denoise_iterations);
+            delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+            std::cout << "[CPU Denoiser] " << denoise_iterations << " iterations, time: " << delta.count() << "s" << std::endl;
+            denoiser.save_result_image("cpu_reference_denoised.pfm");
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+
+#define main SDL_main
+#include <SDL.h>
+#include "../common/config.h"
+#include "../common/rt/cpuScene.h"
+#include "../common/rt/cpuWideBVH.h"
+
+// rays per second of the CPU traversal kernels (single thread)
+//  scenes: cbox, bear, bunny (skipped if missing)
+//  rays: primary (coherent), diffuse bounce (incoherent)
+//  kernels: binary scalar, SSE 4-wide, AVX2 8-wide (single ray & packet)
+
+namespace {
+    const uint32_t RESOLUTION = 512;
+    const int REPEAT = 3;
+
+    std::vector<CPURay> generate_primary_rays() {
+        // scenes are normalized to [0, 1]^3
+        const vec3 eye = vec3(0.5f, 0.5f, 2.2f);
+        const vec3 target = vec3(0.5f, 0.5f, 0.5f);
+        const vec3 dir = glm::normalize(target - eye);
+        const vec3 side = glm::normalize(glm::cross(dir, vec3(0.0f, 1.0f, 0.0f)));
+        const vec3 up = glm::cross(side, dir);
+        const float plane = std::tan(Deg2Rad(45.0f) * 0.5f);
+
+        std::vector<CPURay> rays;
+        rays.reserve(RESOLUTION * RESOLUTION);
+        for (uint32_t y = 0; y < RESOLUTION; ++y) {
+            for (uint32_t x = 0; x < RESOLUTION; ++x) {
+                const float u = (x + 0.5f) / RESOLUTION * 2.0f - 1.0f;
+                const float v = (y + 0.5f) / RESOLUTION * 2.0f - 1.0f;
+                const vec3 d = glm::normalize(dir + side * (u * plane) - up * (v * plane));
+                rays.push_back({ eye, 0.0f, d, 1e4f });
+            }
+        }
+        return rays;
+    }
+
+    // cosine weighted directions around the hit normal
+    std::vector<CPURay> generate_diffuse_rays(const CPUScene& scene, const std::vector<CPURay>& primary) {
+        std::mt19937 engine(1234);
+        std::uniform_real_distribution<float> distrib(0.0f, 1.0f);
+        std::vector<CPURay> rays;
+        for (const CPURay& ray : primary) {
+            CPUHit hit = {};
+            hit._t = ray._tmax;
+            if (!scene._bvh.intersect(ray, hit)) { continue; }
+
+            const vec3* p = scene._positions.data() + 3 * hit._prim_id;
+            vec3 n = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+            if (glm::dot(n, ray._direction) > 0.0f) { n = -n; }
+
+            const float r1 = distrib(engine);
+            const float r2 = distrib(engine);
+            const float phi = BB_PI2 * r1;
+            const vec3 local = vec3(std::cos(phi) * std::sqrt(r2), std::sin(phi) * std::sqrt(r2), std::sqrt(1.0f - r2));
+            const vec3 a = (std::abs(n.x) > 0.9f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+            const vec3 t = glm::normalize(glm::cross(n, a));
+            const vec3 b = glm::cross(n, t);
+            const vec3 d = t * local.x + b * local.y + n * local.z;
+
+            const vec3 pos = ray._origin + ray._direction * hit._t + n * 0.001f;
+            rays.push_back({ pos, 0.0f, d, 1e4f });
+        }
+        return rays;
+    }
+
+    double measure(const std::function<void()>& func, size_t num_rays) {
+        double best = 0.0;
+        for (int i = 0; i < REPEAT; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            func();
+            auto delta = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start);
+            best = std::max(best, num_rays / delta.count());
+        }
+        return best / 1e6;
+    }
+
+    void print(const std::string& name, double mrays) {
+        std::cout << "    " << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2) << mrays << " MRays/s" << std::endl;
+    }
+
+    void benchmark(const CPUScene& scene, const std::vector<CPUWideBVH>& wide_bvhs, const std::string& name, const std::vector<CPURay>& rays) {
+        std::cout << "  [" << name << "] " << rays.size() << " rays" << std::endl;
+        std::vector<CPUHit> hits(rays.size());
+        std::vector<CPUHit> reference(rays.size());
+        std::vector<char> occluded(rays.size());
+        size_t num_hits = 0;
+
+        // binary, scalar
+        print("binary closest", measure([&]() {
+            for (size_t i = 0; i < rays.size(); ++i) {
+                reference[i]._t = rays[i]._tmax;
+                scene._bvh.intersect(rays[i], reference[i]);
+            }
+        }, rays.size()));
+        print("binary any", measure([&]() {
+            for (size_t i = 0; i < rays.size(); ++i) {
+                occluded[i] = scene._bvh.occluded(rays[i]);
+            }
+        }, rays.size()));
+        for (const CPUHit& h : reference) {
+            num_hits += (h._prim_id != -1);
+        }
+
+        for (const CPUWideBVH& wide : wide_bvhs) {
+            const std::string isa = CPUWideBVH::get_isa_name(wide.get_isa());
+            print(isa + " closest", measure([&]() {
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    hits[i]._t = rays[i]._tmax;
+                    wide.intersect(rays[i], hits[i]);
+                }
+            }, rays.size()));
+
+            // sanity check against the binary bvh
+            size_t mismatch = 0;
+            for (size_t i = 0; i < rays.size(); ++i) {
+                if ((hits[i]._prim_id == -1) != (reference[i]._prim_id == -1) ||
+                    (hits[i]._prim_id != -1 && std::abs(hits[i]._t - reference[i]._t) > 1e-4f)) {
+                    ++mismatch;
+                }
+            }
+
+            print(isa + " any", measure([&]() {
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    occluded[i] = wide.occluded(rays[i]);
+                }
+            }, rays.size()));
+            print(isa + " packet closest", measure([&]() {
+                wide.intersect_packet(rays.data(), hits.data(), static_cast<int>(rays.size()));
+            }, rays.size()));
+            print(isa + " packet any", measure([&]() {
+                bool o[wide_kernels::MAX_WIDTH];
+                for (size_t i = 0; i < rays.size(); i += wide_kernels::MAX_WIDTH) {
+                    const int n = static_cast<int>(std::min<size_t>(wide_kernels::MAX_WIDTH, rays.size() - i));
+                    wide.occluded_packet(rays.data() + i, o, n);
+                }
+            }, rays.size()));
+            for (size_t i = 0; i < rays.size(); ++i) {
+                if ((hits[i]._prim_id == -1) != (reference[i]._prim_id == -1)) {
+                    ++mismatch;
+                }
+            }
+            if (mismatch) {
+                std::cout << "    [Warning] " << mismatch << " hits differ from the binary bvh" << std::endl;
+            }
+        }
+        std::cout << "    hit rate: " << std::setprecision(3) << (rays.empty() ? 0.0 : double(num_hits) / rays.size()) << std::endl;
+    }
+}
+
+int main() {
+    try {
+        const std::vector<std::string> paths = {
+            ASSETS_DIRECTORY"/cbox/cbox.obj",
+            ASSETS_DIRECTORY"/bear/bear_box-2.obj",
+            ASSETS_DIRECTORY"/bunny.obj",
+        };
+
+        const CPUWideBVH::ISA isa = CPUWideBVH::detect_isa();
+        std::cout << "[BVH Benchmark] detected: " << CPUWideBVH::get_isa_name(isa) << std::endl;
+
+        for (const std::string& path : paths) {
+            CPUScene scene;
+            if (!scene.load(path)) {
+                std::cout << "[BVH Benchmark] skip " << path << std::endl;
+                continue;
+            }
+
+            std::vector<CPUWideBVH> wide_bvhs;
+            if (isa >= CPUWideBVH::ISA_SSE) {
+                wide_bvhs.emplace_back();
+                wide_bvhs.back().build(scene._bvh, scene._positions.data(), CPUWideBVH::ISA_SSE);
+            }
+            if (isa >= CPUWideBVH::ISA_AVX2) {
+                wide_bvhs.emplace_back();
+                wide_bvhs.back().build(scene._bvh, scene._positions.data(), CPUWideBVH::ISA_AVX2);
+            }
+
+            std::cout << "[BVH Benchmark] " << path << ", " << scene.get_num_triangles() << " triangles" << std::endl;
+            const std::vector<CPURay> primary = generate_primary_rays();
+            benchmark(scene, wide_bvhs, "primary", primary);
+            benchmark(scene, wide_bvhs, "diffuse", generate_diffuse_rays(scene, primary));
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
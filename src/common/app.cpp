@@ -79,6 +79,8 @@ void App::init_vulkan(VkPhysicalDeviceShaderDrawParametersFeatures* _shader_draw
     // 3. VkPhysicalDevice
     vkb::PhysicalDeviceSelector selector(vkb_inst);
     vkb::PhysicalDevice physical_device = selector.set_minimum_version(1, 1)
+        .add_required_extensions(_required_device_extensions)
+        .set_required_features(_required_device_features)
         .set_surface(_surface)
         .select()
         .value();
@@ -111,6 +113,18 @@ void App::init_vulkan(VkPhysicalDeviceShaderDrawParametersFeatures* _shader_draw
             vmaDestroyAllocator(_allocator);
         }
     );
+
+    // 7. Pipeline Cache
+    init_pipeline_cache();
+}
+
+void App::init_pipeline_cache() {
+    _pipeline_cache.init(_device, _physical_device_properties, PROJECT_DIRECTORY"/cache", _name);
+    _main_deletion_queue.push_function(
+        [=]() {
+            _pipeline_cache.destroy();
+        }
+    );
 }
 
 App::~App() {
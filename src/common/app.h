@@ -13,6 +13,7 @@
 
 #include "types.h"
 #include "utils.h"
+#include "pipelineCache.h"
 
 class App {
 public:
@@ -36,6 +37,8 @@ protected:
 
     void init_vulkan(VkPhysicalDeviceShaderDrawParametersFeatures* _shader_draw_parameters_feature = nullptr);
     void init_swapchain();
+    // after the device: loads `cache/<name>.pipeline`, saved when the deletion queue is flushed
+    void init_pipeline_cache();
 
     // must be called at the end of the cleanup (deconstructor)
     void flush_deletion_queue_and_vulkan_resources();
@@ -57,6 +60,9 @@ protected:
     VkSurfaceKHR _surface = VK_NULL_HANDLE;                     // Vulkan window surface
     VmaAllocator _allocator = VK_NULL_HANDLE;                   // Memory allocator
     bool _use_validation_layer;
+    // set by the derived apps before `init_vulkan`, the device is only selected if it supports them
+    std::vector<const char*> _required_device_extensions{};
+    VkPhysicalDeviceFeatures _required_device_features{};
 
     // swapchain
     VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
@@ -67,6 +73,9 @@ protected:
 
     // resource management
     DeletionQueue _main_deletion_queue{};
+
+    // given to every pipeline creation
+    PipelineCache _pipeline_cache{};
     
     // command queue
     VkQueue _graphics_queue = VK_NULL_HANDLE;              // queue we will submit to
@@ -10,12 +10,5 @@ struct FrameData {
     // command
     VkCommandPool _command_pool = VK_NULL_HANDLE;          // the command pool for our commands
     VkCommandBuffer _main_command_buffer = VK_NULL_HANDLE; // the buffer we will record into
-
-    // descriptors
-    // gather all uniform variables in different frames into one buffer (fixed size)
-    VkDescriptorSet _uniform_data_descriptor_set = VK_NULL_HANDLE;
-    // one buffer per frame (unfixed size)
-    VkDescriptorSet _object_descriptor_set = VK_NULL_HANDLE;
-    AllocatedBuffer _object_buffer{};
 };
 
@@ -3,96 +3,101 @@
 #include "app.h"
 
 #include <vector>
-#include <numeric>
+#include <algorithm>
 
 Descriptor::Descriptor() {
-    _types = {
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-        VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+    // the descriptors of a new pool per set, scaled by the number of sets of the pool
+    _ratios = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1.0f },
+        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4.0f },
     };
-    _free_space = (MAX_SIZE * _types.size());
 }
 
-void Descriptor::init_pool(VkDevice device) {
+void Descriptor::init_pool(VkDevice device, uint32_t initial_sets_per_pool) {
     _device = device;
-    const int type_num = _types.size();
-    _count.resize(type_num, 0);
+    _sets_per_pool = initial_sets_per_pool;
+    _current_pool = create_pool(_sets_per_pool, {});
+}
 
-    std::vector<VkDescriptorPoolSize> sizes{};
-    for (auto t : _types) {
-        sizes.push_back({ t, MAX_SIZE });
+void Descriptor::destroy() {
+    for (auto& [key, layout] : _layout_cache) {
+        vkDestroyDescriptorSetLayout(_device, layout, nullptr);
     }
+    _layout_cache.clear();
+    _layouts.clear();
 
-    VkDescriptorPoolCreateInfo pool_info = vkinit::descriptor_pool_create_info();
-    pool_info.flags = 0; // only set FREE_BIT, can call the vkFreeDescritorSet (free set individually)
-    pool_info.maxSets = MAX_SIZE * type_num;
-    pool_info.poolSizeCount = (uint32_t)sizes.size();
-    pool_info.pPoolSizes = sizes.data();
-    VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr, &_descriptor_pool));
+    if (_current_pool != VK_NULL_HANDLE) {
+        _full_pools.push_back(_current_pool);
+        _current_pool = VK_NULL_HANDLE;
+    }
+    for (VkDescriptorPool pool : _full_pools) {
+        vkDestroyDescriptorPool(_device, pool, nullptr);
+    }
+    for (VkDescriptorPool pool : _free_pools) {
+        vkDestroyDescriptorPool(_device, pool, nullptr);
+    }
+    _full_pools.clear();
+    _free_pools.clear();
 }
 
-void Descriptor::destroy() {
-    for (VkDescriptorSetLayout& layout : _layouts) {
-        vkDestroyDescriptorSetLayout(_device, layout, nullptr);
+void Descriptor::reset() {
+    if (_current_pool != VK_NULL_HANDLE) {
+        _full_pools.push_back(_current_pool);
+        _current_pool = VK_NULL_HANDLE;
+    }
+    for (VkDescriptorPool pool : _full_pools) {
+        VK_CHECK(vkResetDescriptorPool(_device, pool, 0));
+        _free_pools.push_back(pool);
     }
-    vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
+    _full_pools.clear();
 }
 
 VkDescriptorSetLayout Descriptor::create_set_layout(VkDescriptorType* type, VkShaderStageFlags* stage_flags, uint32_t binding_num,
     uint32_t* descriptor_count, VkDescriptorSetLayoutBindingFlagsCreateInfo* binding_flags
 ) {
-    {
-        // check size
-        // TODO: 1 means what?
-        std::vector<int> count_clone = _count;
-        for (int i = 0; i < binding_num; ++i) {
-            uint32_t index = std::find(_types.begin(), _types.end(), *type) - _types.begin();
-            if (index == _types.size()) {
-                std::cerr << "[Desctiptor Set] VkDescriptorType not found: " << *type << std::endl;
-                return VK_NULL_HANDLE;
-            }
-            if (++count_clone[index] >= MAX_SIZE) {
-                std::cerr << "[Desctiptor Set] No free : " << *type << std::endl;
-                return VK_NULL_HANDLE;
-            }
+    LayoutInfo layout_info{};
+    std::vector<uint32_t> key{};
+    for (uint32_t i = 0; i < binding_num; ++i) {
+        VkDescriptorSetLayoutBinding binding = vkinit::descriptor_set_layout_binding(type[i], stage_flags[i], i);
+        if (descriptor_count != nullptr) {
+            binding.descriptorCount = descriptor_count[i];
         }
-        _count = count_clone;
-    }
-
-    VkDescriptorSetLayoutCreateInfo info = vkinit::descriptor_set_layout_create_info();
-    info.bindingCount = binding_num;
-
-    std::vector<VkDescriptorSetLayoutBinding> bindings{};
-    for (int i = 0; i < binding_num; ++i) {
-        bindings.push_back(vkinit::descriptor_set_layout_binding(type[i], stage_flags[i], i));
+        const VkDescriptorBindingFlags flags = (binding_flags != nullptr && i < binding_flags->bindingCount) ? binding_flags->pBindingFlags[i] : 0;
+        if (flags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT) {
+            layout_info.variable_binding = static_cast<int>(i);
+        }
+        layout_info.bindings.push_back(binding);
+        key.insert(key.end(), { binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount, binding.stageFlags, flags });
     }
 
-    if (descriptor_count != nullptr) {
-        for (int i = 0; i < binding_num; ++i) {
-            bindings[i].descriptorCount = descriptor_count[i];
-        }
+    auto it = _layout_cache.find(key);
+    if (it != _layout_cache.end()) {
+        return it->second;
     }
 
+    VkDescriptorSetLayoutCreateInfo info = vkinit::descriptor_set_layout_create_info();
+    info.bindingCount = binding_num;
     info.pNext = binding_flags;
-
-    info.pBindings = bindings.data();
+    info.pBindings = layout_info.bindings.data();
     VkDescriptorSetLayout layout = VK_NULL_HANDLE;
     VK_CHECK(vkCreateDescriptorSetLayout(_device, &info, nullptr, &layout));
-    _layouts.push_back(layout);
+
+    _layout_cache[key] = layout;
+    _layouts[layout] = std::move(layout_info);
     return layout;
 }
 
 void Descriptor::create_set(VkDescriptorSet* descriptor_set, VkDescriptorSetLayout* layout, uint32_t* descriptors_cnt, uint32_t num) {
-    uint32_t alloc_num = std::accumulate(descriptors_cnt, descriptors_cnt + num, 0);
-    if ((_free_space - alloc_num) < 0) {
-        std::cerr << "[Desctiptor Set] No free Set!" << std::endl;
-        return;
+    std::vector<VkDescriptorPoolSize> needs{};
+    for (uint32_t i = 0; i < num; ++i) {
+        add_needs(layout[i], descriptors_cnt[i], needs);
     }
-    _free_space -= alloc_num;
 
     VkDescriptorSetVariableDescriptorCountAllocateInfo num_info = {
         VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
@@ -103,56 +108,165 @@ void Descriptor::create_set(VkDescriptorSet* descriptor_set, VkDescriptorSetLayo
 
     VkDescriptorSetAllocateInfo info = vkinit::descriptor_set_allocate_info();
     info.pNext = &num_info;
-    info.descriptorPool = _descriptor_pool;
     info.descriptorSetCount = num;
     info.pSetLayouts = layout;
 
-    VK_CHECK(vkAllocateDescriptorSets(_device, &info, descriptor_set));
+    allocate(info, descriptor_set, needs);
 }
 
 VkDescriptorSet Descriptor::create_set(VkDescriptorSetLayout layout) {
+    std::vector<VkDescriptorPoolSize> needs{};
+    add_needs(layout, 0, needs);
 
-    if ((_free_space-1) < 0) {
-        std::cerr << "[Desctiptor Set] No free Set!" << std::endl;
-        return VK_NULL_HANDLE;
-    }
-    --_free_space;
     VkDescriptorSetAllocateInfo info = vkinit::descriptor_set_allocate_info();
-    info.descriptorPool = _descriptor_pool;
     info.descriptorSetCount = 1;
     info.pSetLayouts = &layout;
 
-    VkDescriptorSet descriptor_set;
-    VK_CHECK(vkAllocateDescriptorSets(_device, &info, &descriptor_set));
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    allocate(info, &descriptor_set, needs);
     return descriptor_set;
 }
 
-void Descriptor::bind(VkDescriptorSet descriptor_set, VkDescriptorBufferInfo* info, VkDescriptorType type, int binding) {
-    uint32_t index = std::find(_types.begin(), _types.end(), type) - _types.begin();
-    if (index == _types.size()) {
-        std::cerr << "[Desctiptor Set] VkDescriptorType not found: " << type << std::endl;
-        return;
+bool Descriptor::allocate(VkDescriptorSetAllocateInfo& info, VkDescriptorSet* descriptor_set, const std::vector<VkDescriptorPoolSize>& needs) {
+    // the current pool, the reset ones (may be too small), then a new one that fits `needs`
+    const size_t max_attempts = _free_pools.size() + 2;
+    for (size_t attempt = 0; attempt < max_attempts; ++attempt) {
+        if (_current_pool == VK_NULL_HANDLE) {
+            _current_pool = grab_pool(info.descriptorSetCount, needs);
+        }
+        info.descriptorPool = _current_pool;
+        const VkResult result = vkAllocateDescriptorSets(_device, &info, descriptor_set);
+        if (result == VK_SUCCESS) {
+            return true;
+        }
+        if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+            VK_CHECK(result);
+        }
+        _full_pools.push_back(_current_pool);
+        _current_pool = VK_NULL_HANDLE;
     }
-    if (_count[index] >= MAX_SIZE) {
-        std::cerr << "[Desctiptor Set] No free : " << type << std::endl;
+    std::cerr << "[Desctiptor Set] Failed to allocate " << info.descriptorSetCount << " sets" << std::endl;
+    return false;
+}
+
+VkDescriptorPool Descriptor::grab_pool(uint32_t num_sets, const std::vector<VkDescriptorPoolSize>& needs) {
+    if (!_free_pools.empty()) {
+        VkDescriptorPool pool = _free_pools.back();
+        _free_pools.pop_back();
+        return pool;
+    }
+    VkDescriptorPool pool = create_pool(std::max(_sets_per_pool, num_sets), needs);
+    // the next pool is bigger
+    _sets_per_pool = std::min(_sets_per_pool + _sets_per_pool / 2, MAX_SETS_PER_POOL);
+    return pool;
+}
+
+VkDescriptorPool Descriptor::create_pool(uint32_t max_sets, const std::vector<VkDescriptorPoolSize>& needs) {
+    std::vector<VkDescriptorPoolSize> sizes{};
+    for (const PoolSizeRatio& r : _ratios) {
+        sizes.push_back({ r.type, static_cast<uint32_t>(r.ratio * max_sets) });
+    }
+    // at least what the failed allocation needs (large variable sized bindings)
+    for (const VkDescriptorPoolSize& need : needs) {
+        auto it = std::find_if(sizes.begin(), sizes.end(), [&](const VkDescriptorPoolSize& s) { return s.type == need.type; });
+        if (it == sizes.end()) {
+            sizes.push_back(need);
+        } else {
+            it->descriptorCount = std::max(it->descriptorCount, need.descriptorCount);
+        }
+    }
+
+    VkDescriptorPoolCreateInfo pool_info = vkinit::descriptor_pool_create_info();
+    pool_info.flags = 0; // no FREE_BIT: the sets are given back by resetting the whole pool
+    pool_info.maxSets = max_sets;
+    pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+    pool_info.pPoolSizes = sizes.data();
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr, &pool));
+    return pool;
+}
+
+void Descriptor::add_needs(VkDescriptorSetLayout layout, uint32_t variable_count, std::vector<VkDescriptorPoolSize>& needs) const {
+    auto it = _layouts.find(layout);
+    if (it == _layouts.end()) {
         return;
     }
+    const LayoutInfo& info = it->second;
+    for (size_t i = 0; i < info.bindings.size(); ++i) {
+        const VkDescriptorSetLayoutBinding& binding = info.bindings[i];
+        const uint32_t count = (static_cast<int>(i) == info.variable_binding) ? variable_count : binding.descriptorCount;
+        auto need = std::find_if(needs.begin(), needs.end(), [&](const VkDescriptorPoolSize& s) { return s.type == binding.descriptorType; });
+        if (need == needs.end()) {
+            needs.push_back({ binding.descriptorType, count });
+        } else {
+            need->descriptorCount += count;
+        }
+    }
+}
+
+VkWriteDescriptorSet& DescriptorWriter::add_write(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, uint32_t count) {
+    VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.descriptorCount = count;
+    write.descriptorType = type;
+    _writes.push_back(write);
+    return _writes.back();
+}
 
-    VkWriteDescriptorSet write_set = vkinit::write_descriptor_buffer(
-        type, descriptor_set, info, binding
-    );
+void DescriptorWriter::write_buffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& info) {
+    write_buffers(set, binding, type, &info, 1);
+}
 
-    vkUpdateDescriptorSets(_device, 1, &write_set, 0, nullptr);
+void DescriptorWriter::write_buffers(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo* infos, uint32_t count) {
+    _buffer_infos.emplace_back(infos, infos + count);
+    add_write(set, binding, type, count).pBufferInfo = _buffer_infos.back().data();
 }
 
-void Descriptor::bind(VkDescriptorSet descriptor_set, VkDescriptorImageInfo* info, VkDescriptorType type, int binding) {
-    VkWriteDescriptorSet write_set = vkinit::write_descriptor_image(
-        type, descriptor_set, info, binding
-    );
+void DescriptorWriter::write_image(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& info) {
+    write_images(set, binding, type, &info, 1);
+}
 
-    vkUpdateDescriptorSets(_device, 1, &write_set, 0, nullptr);
+void DescriptorWriter::write_images(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* infos, uint32_t count) {
+    _image_infos.emplace_back(infos, infos + count);
+    add_write(set, binding, type, count).pImageInfo = _image_infos.back().data();
 }
 
-void Descriptor::bind(VkWriteDescriptorSet* write_set, uint32_t count) {
-    vkUpdateDescriptorSets(_device, count, write_set, 0, nullptr);
-}
\ No newline at end of file
+void DescriptorWriter::write_acceleration_structure(VkDescriptorSet set, uint32_t binding, VkAccelerationStructureKHR acceleration_structure) {
+    _acceleration_structures.push_back(acceleration_structure);
+
+    VkWriteDescriptorSetAccelerationStructureKHR as_info = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR, nullptr };
+    as_info.accelerationStructureCount = 1;
+    as_info.pAccelerationStructures = &_acceleration_structures.back();
+    _acceleration_structure_infos.push_back(as_info);
+
+    add_write(set, binding, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1).pNext = &_acceleration_structure_infos.back(); // extension
+}
+
+void DescriptorWriter::copy(VkDescriptorSet src_set, VkDescriptorSet dst_set, uint32_t binding, uint32_t count) {
+    VkCopyDescriptorSet copy = { VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET };
+    copy.srcSet = src_set;
+    copy.srcBinding = binding;
+    copy.dstSet = dst_set;
+    copy.dstBinding = binding;
+    copy.descriptorCount = count;
+    _copies.push_back(copy);
+}
+
+void DescriptorWriter::flush(VkDevice device) {
+    if (!_writes.empty() || !_copies.empty()) {
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(_writes.size()), _writes.data(),
+            static_cast<uint32_t>(_copies.size()), _copies.data());
+    }
+    clear();
+}
+
+void DescriptorWriter::clear() {
+    _writes.clear();
+    _copies.clear();
+    _buffer_infos.clear();
+    _image_infos.clear();
+    _acceleration_structures.clear();
+    _acceleration_structure_infos.clear();
+}
@@ -1,29 +1,84 @@
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <map>
 #include "types.h"
 
-
+/// <summary>
+/// descriptor sets from a list of pools: a new pool (bigger than the last one) is created when vkAllocateDescriptorSets
+/// runs out of pool memory, so there is no fixed number of sets or descriptors.
+/// `reset` gives back all the sets at once (a per-frame allocator), the layouts are cached by their bindings
+/// </summary>
 class Descriptor {
 public:
     Descriptor();
-    void init_pool(VkDevice device);
+    void init_pool(VkDevice device, uint32_t initial_sets_per_pool = 64);
     void destroy();
+    // the sets allocated so far are invalid, the pools are kept for the next allocations
+    void reset();
+
+    // the same bindings return the same layout, the layouts are destroyed with the allocator
     VkDescriptorSetLayout create_set_layout(VkDescriptorType* type, VkShaderStageFlags* stage_flags, uint32_t binding_num = 1,
         uint32_t* descriptor_count = nullptr, VkDescriptorSetLayoutBindingFlagsCreateInfo* binding_flags = nullptr);
     VkDescriptorSet create_set(VkDescriptorSetLayout layout);
+    // `descriptors_cnt`: the count of the variable sized binding of each set
     void create_set(VkDescriptorSet* descriptor_set, VkDescriptorSetLayout* layout, uint32_t* descriptors_cnt, uint32_t num);
 
-    void bind(VkDescriptorSet descriptor_set, VkDescriptorBufferInfo* info, VkDescriptorType type, int binding);
-    void bind(VkDescriptorSet descriptor_set, VkDescriptorImageInfo* info, VkDescriptorType type, int binding);
-    void bind(VkWriteDescriptorSet* write_set, uint32_t count);
-
 private:
-    static const int MAX_SIZE = 100;
+    struct PoolSizeRatio {
+        VkDescriptorType type;
+        float ratio;    // descriptors per set
+    };
+    struct LayoutInfo {
+        std::vector<VkDescriptorSetLayoutBinding> bindings{};
+        int variable_binding{ -1 };     // the index of the binding with VARIABLE_DESCRIPTOR_COUNT
+    };
+
+    bool allocate(VkDescriptorSetAllocateInfo& info, VkDescriptorSet* descriptor_set, const std::vector<VkDescriptorPoolSize>& needs);
+    VkDescriptorPool grab_pool(uint32_t num_sets, const std::vector<VkDescriptorPoolSize>& needs);
+    VkDescriptorPool create_pool(uint32_t max_sets, const std::vector<VkDescriptorPoolSize>& needs);
+    void add_needs(VkDescriptorSetLayout layout, uint32_t variable_count, std::vector<VkDescriptorPoolSize>& needs) const;
+
+    static const uint32_t MAX_SETS_PER_POOL = 4096;
     VkDevice _device = VK_NULL_HANDLE;
-    std::vector<VkDescriptorType> _types;
-    int _free_space{0};
-    std::vector<int> _count{};
-    VkDescriptorPool _descriptor_pool = VK_NULL_HANDLE;
-    std::vector<VkDescriptorSetLayout> _layouts{};
-};
\ No newline at end of file
+    std::vector<PoolSizeRatio> _ratios{};
+    uint32_t _sets_per_pool{ 64 };
+
+    VkDescriptorPool _current_pool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> _full_pools{};
+    std::vector<VkDescriptorPool> _free_pools{};    // reset, ready to be used again
+
+    // (binding, type, count, stages, flags) of every binding -> layout
+    std::map<std::vector<uint32_t>, VkDescriptorSetLayout> _layout_cache{};
+    std::map<VkDescriptorSetLayout, LayoutInfo> _layouts{};
+};
+
+/// <summary>
+/// accumulates the writes (& copies) of descriptor sets, `flush` applies them in one vkUpdateDescriptorSets.
+/// the infos are copied: the caller's may go out of scope before the flush
+/// </summary>
+class DescriptorWriter {
+public:
+    void write_buffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& info);
+    void write_buffers(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo* infos, uint32_t count);
+    void write_image(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& info);
+    void write_images(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* infos, uint32_t count);
+    void write_acceleration_structure(VkDescriptorSet set, uint32_t binding, VkAccelerationStructureKHR acceleration_structure);
+    // the copies are applied after all the writes of the same flush
+    void copy(VkDescriptorSet src_set, VkDescriptorSet dst_set, uint32_t binding, uint32_t count = 1);
+
+    void flush(VkDevice device);
+    void clear();
+
+private:
+    VkWriteDescriptorSet& add_write(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, uint32_t count);
+
+    std::vector<VkWriteDescriptorSet> _writes{};
+    std::vector<VkCopyDescriptorSet> _copies{};
+    // deques: the addresses stay valid while more writes are added
+    std::deque<std::vector<VkDescriptorBufferInfo>> _buffer_infos{};
+    std::deque<std::vector<VkDescriptorImageInfo>> _image_infos{};
+    std::deque<VkAccelerationStructureKHR> _acceleration_structures{};
+    std::deque<VkWriteDescriptorSetAccelerationStructureKHR> _acceleration_structure_infos{};
+};
@@ -0,0 +1,66 @@
+#include "frameAllocator.h"
+#include "initializers.h"
+#include "utils.h"
+
+#include <algorithm>
+
+namespace {
+    VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void FrameAllocator::init(VmaAllocator allocator, const VkPhysicalDeviceLimits& limits, uint32_t frames_in_flight,
+    VkDeviceSize frame_size, VkDeviceSize max_range
+) {
+    _allocator = allocator;
+    _uniform_alignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+    _storage_alignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+    // every region starts at an offset valid for both kinds of descriptors
+    _frame_size = align_up(frame_size, std::max(_uniform_alignment, _storage_alignment));
+    _max_range = max_range;
+
+    const VkDeviceSize size = _frame_size * frames_in_flight + _max_range;
+    VkBufferCreateInfo buffer_info = vkinit::buffer_create_info(static_cast<uint32_t>(size),
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    // coherent: the writes are visible to the next submit without a flush
+    VmaAllocationCreateInfo vma_create_info = {};
+    vma_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    vma_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    vma_create_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VmaAllocationInfo allocation_info = {};
+    VK_CHECK(vmaCreateBuffer(_allocator, &buffer_info, &vma_create_info, &_buffer._buffer, &_buffer._allocation, &allocation_info));
+    _buffer._size = size;
+    _mapped = static_cast<uint8_t*>(allocation_info.pMappedData);
+
+    _begin = 0;
+    _head = 0;
+}
+
+void FrameAllocator::destroy() {
+    if (_buffer._buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    vmaDestroyBuffer(_allocator, _buffer._buffer, _buffer._allocation);
+    _buffer = {};
+    _mapped = nullptr;
+}
+
+void FrameAllocator::begin_frame(uint32_t frame_idx) {
+    _begin = _frame_size * frame_idx;
+    _head = _begin;
+}
+
+void* FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t& dynamic_offset) {
+    const VkDeviceSize offset = align_up(_head, alignment);
+    if (offset + size > _begin + _frame_size) {
+        std::cerr << "[Frame Allocator] Out of space: " << size << " bytes, "
+            << (_head - _begin) << "/" << _frame_size << " used this frame" << std::endl;
+        abort();
+    }
+    _head = offset + size;
+    dynamic_offset = static_cast<uint32_t>(offset);
+    return _mapped + offset;
+}
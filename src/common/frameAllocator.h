@@ -0,0 +1,64 @@
+#pragma once
+
+#include "types.h"
+
+/// <summary>
+/// per-frame uploads (uniforms, per-object data) in one persistently mapped host-visible buffer:
+///  a region per frame in flight, allocated linearly & recycled as a whole when the fence of the frame is waited.
+///  an allocation is a pointer to write to & the dynamic offset of the descriptor bind, no map/unmap per frame
+/// </summary>
+class FrameAllocator {
+public:
+    /// <summary>
+    /// `max_range`: the range of the dynamic descriptors over the buffer,
+    /// the buffer has that much space after the last region so that any offset + range stays inside of it
+    /// </summary>
+    void init(VmaAllocator allocator, const VkPhysicalDeviceLimits& limits, uint32_t frames_in_flight,
+        VkDeviceSize frame_size, VkDeviceSize max_range);
+    void destroy();
+
+    // the fence of `frame_idx` is waited: its region is reused from the start
+    void begin_frame(uint32_t frame_idx);
+
+    /// <summary>
+    /// one uniform block, aligned to minUniformBufferOffsetAlignment
+    /// </summary>
+    template <typename T>
+    T* allocate_uniform(uint32_t& dynamic_offset) {
+        return static_cast<T*>(allocate(sizeof(T), _uniform_alignment, dynamic_offset));
+    }
+
+    template <typename T>
+    uint32_t push_uniform(const T& value) {
+        uint32_t dynamic_offset = 0;
+        *allocate_uniform<T>(dynamic_offset) = value;
+        return dynamic_offset;
+    }
+
+    /// <summary>
+    /// `count` elements of a storage buffer, aligned to minStorageBufferOffsetAlignment
+    /// </summary>
+    template <typename T>
+    T* allocate_storage(uint32_t count, uint32_t& dynamic_offset) {
+        return static_cast<T*>(allocate(sizeof(T) * count, _storage_alignment, dynamic_offset));
+    }
+
+    VkBuffer buffer() const { return _buffer._buffer; }
+    VkDeviceSize max_range() const { return _max_range; }
+
+private:
+    // aborts when the region of the frame is full
+    void* allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t& dynamic_offset);
+
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    AllocatedBuffer _buffer{};
+    uint8_t* _mapped = nullptr;
+
+    VkDeviceSize _uniform_alignment{ 1 };
+    VkDeviceSize _storage_alignment{ 1 };
+    VkDeviceSize _frame_size{ 0 };
+    VkDeviceSize _max_range{ 0 };
+
+    VkDeviceSize _begin{ 0 };   // the region of the current frame
+    VkDeviceSize _head{ 0 };
+};
@@ -0,0 +1,121 @@
+#include "parallelRecorder.h"
+#include "initializers.h"
+#include "utils.h"
+
+#include <algorithm>
+
+void ParallelRecorder::init(VkDevice device, uint32_t queue_family, uint32_t frames_in_flight, uint32_t num_threads) {
+    _device = device;
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    _num_threads = num_threads;
+
+    // resettable as a whole: the secondary command buffers are re-recorded every frame
+    VkCommandPoolCreateInfo pool_info = vkinit::command_pool_create_info(queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    _thread_frames.assign(frames_in_flight, std::vector<ThreadFrame>(_num_threads));
+    for (std::vector<ThreadFrame>& frame : _thread_frames) {
+        for (ThreadFrame& thread_frame : frame) {
+            VK_CHECK(vkCreateCommandPool(_device, &pool_info, nullptr, &thread_frame._command_pool));
+            VkCommandBufferAllocateInfo alloc_info = vkinit::command_buffer_allocate_info(thread_frame._command_pool, 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+            VK_CHECK(vkAllocateCommandBuffers(_device, &alloc_info, &thread_frame._command_buffer));
+        }
+    }
+
+    _quit = false;
+    for (uint32_t i = 1; i < _num_threads; ++i) {
+        _workers.emplace_back(&ParallelRecorder::worker_loop, this, i);
+    }
+    std::cout << "[Parallel Recorder] " << _num_threads << " threads" << std::endl;
+}
+
+void ParallelRecorder::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _start_cv.notify_all();
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+    _workers.clear();
+
+    for (std::vector<ThreadFrame>& frame : _thread_frames) {
+        for (ThreadFrame& thread_frame : frame) {
+            vkDestroyCommandPool(_device, thread_frame._command_pool, nullptr);
+        }
+    }
+    _thread_frames.clear();
+}
+
+void ParallelRecorder::record(VkCommandBuffer primary, uint32_t frame_idx, const VkCommandBufferInheritanceInfo& inheritance,
+    uint32_t num_items, const RecordFunction& function
+) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _function = &function;
+        _inheritance = &inheritance;
+        _frame_idx = frame_idx;
+        _num_items = num_items;
+        _num_pending = _num_threads - 1;
+        ++_job_id;
+    }
+    _start_cv.notify_all();
+
+    record_range(0);
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done_cv.wait(lock, [&]() { return _num_pending == 0; });
+    }
+
+    // in the order of the ranges, the same order as a single threaded recording
+    std::vector<VkCommandBuffer> command_buffers(_num_threads);
+    for (uint32_t i = 0; i < _num_threads; ++i) {
+        command_buffers[i] = _thread_frames[frame_idx][i]._command_buffer;
+    }
+    vkCmdExecuteCommands(primary, _num_threads, command_buffers.data());
+}
+
+void ParallelRecorder::worker_loop(uint32_t thread_idx) {
+    uint64_t last_job_id = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start_cv.wait(lock, [&]() { return _quit || _job_id != last_job_id; });
+            if (_quit) {
+                return;
+            }
+            last_job_id = _job_id;
+        }
+
+        record_range(thread_idx);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            --_num_pending;
+        }
+        _done_cv.notify_one();
+    }
+}
+
+void ParallelRecorder::record_range(uint32_t thread_idx) {
+    ThreadFrame& thread_frame = _thread_frames[_frame_idx][thread_idx];
+    // the fence of the frame is waited, nothing of this pool is in flight
+    VK_CHECK(vkResetCommandPool(_device, thread_frame._command_pool, 0));
+
+    VkCommandBufferBeginInfo begin_info = vkinit::command_buffer_begin_info(
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    begin_info.pInheritanceInfo = _inheritance;
+    VK_CHECK(vkBeginCommandBuffer(thread_frame._command_buffer, &begin_info));
+
+    // an empty range is still a valid (empty) command buffer
+    const uint64_t num_items = _num_items;
+    const uint32_t begin = static_cast<uint32_t>(num_items * thread_idx / _num_threads);
+    const uint32_t end = static_cast<uint32_t>(num_items * (thread_idx + 1) / _num_threads);
+    if (begin < end) {
+        (*_function)(thread_frame._command_buffer, begin, end);
+    }
+
+    VK_CHECK(vkEndCommandBuffer(thread_frame._command_buffer));
+}
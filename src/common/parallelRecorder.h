@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "types.h"
+
+/// <summary>
+/// records a draw list on several threads: [0, num_items) is split in contiguous ranges,
+///  each thread records its range into a secondary command buffer, the primary executes them in the order of the ranges.
+///  a command pool per thread & frame in flight (a pool is only used by one thread), reset when the fence of the frame is waited.
+///  the calling thread records the first range, the workers are kept alive between the frames
+/// </summary>
+class ParallelRecorder {
+public:
+    // `cmd`: a secondary command buffer inside of the render pass, nothing is bound yet
+    using RecordFunction = std::function<void(VkCommandBuffer cmd, uint32_t begin, uint32_t end)>;
+
+    // `num_threads` = 0: one per core
+    void init(VkDevice device, uint32_t queue_family, uint32_t frames_in_flight, uint32_t num_threads = 0);
+    // the device is idle
+    void destroy();
+
+    /// <summary>
+    /// `primary` is in a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS,
+    /// `function` is called from all the threads at the same time (only reads shared data)
+    /// </summary>
+    void record(VkCommandBuffer primary, uint32_t frame_idx, const VkCommandBufferInheritanceInfo& inheritance,
+        uint32_t num_items, const RecordFunction& function);
+
+    uint32_t num_threads() const { return _num_threads; }
+
+private:
+    struct ThreadFrame {
+        VkCommandPool _command_pool = VK_NULL_HANDLE;
+        VkCommandBuffer _command_buffer = VK_NULL_HANDLE;
+    };
+
+    void worker_loop(uint32_t thread_idx);
+    void record_range(uint32_t thread_idx);
+
+    VkDevice _device = VK_NULL_HANDLE;
+    uint32_t _num_threads{ 1 };
+    std::vector<std::vector<ThreadFrame>> _thread_frames{};   // [frame in flight][thread]
+
+    std::vector<std::thread> _workers{};
+    std::mutex _mutex{};
+    std::condition_variable _start_cv{};
+    std::condition_variable _done_cv{};
+    uint64_t _job_id{ 0 };      // a new recording for the workers
+    uint32_t _num_pending{ 0 }; // the workers still recording
+    bool _quit{ false };
+
+    // the current recording
+    const RecordFunction* _function = nullptr;
+    const VkCommandBufferInheritanceInfo* _inheritance = nullptr;
+    uint32_t _frame_idx{ 0 };
+    uint32_t _num_items{ 0 };
+};
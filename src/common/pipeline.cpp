@@ -3,7 +3,7 @@
 
 #include <iostream>
 
-VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass, bool use_z_buffer, uint32_t subpass) {
+VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass, bool use_z_buffer, uint32_t subpass, PipelineCache* cache) {
     // make viewport state from our stored viewport and scissor.
     // at the moment we won't support multiple viewports or scissors
     VkPipelineViewportStateCreateInfo viewport_info =
@@ -39,7 +39,11 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass, b
     }
 
     VkPipeline new_pipeline;
-    VkResult result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &new_pipeline);
+    auto start = std::chrono::high_resolution_clock::now();
+    VkResult result = vkCreateGraphicsPipelines(device, cache ? cache->get() : VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &new_pipeline);
+    if (cache) {
+        cache->add_creation_time(start);
+    }
     if (result != VK_SUCCESS) {
         // failed to create graphics pipeline
         std::cout << "[ERROR] failed to create pipeline\n" << std::endl;
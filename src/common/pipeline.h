@@ -3,6 +3,7 @@
 #include <vector> 
 
 #include "types.h"
+#include "pipelineCache.h"
 
 class PipelineBuilder {
 public:
@@ -17,7 +18,8 @@ public:
     VkPipelineLayout _pipeline_layout = VK_NULL_HANDLE;
 
     VkPipelineDepthStencilStateCreateInfo _depth_stencil = {};
-    VkPipeline build_pipeline(VkDevice device, VkRenderPass pass, bool use_z_buffer, uint32_t subpass);
+    // cache: optional, the creation time is added to it
+    VkPipeline build_pipeline(VkDevice device, VkRenderPass pass, bool use_z_buffer, uint32_t subpass, PipelineCache* cache = nullptr);
 
     // shaders
     void reset_shaders();
@@ -0,0 +1,178 @@
+#include "pipelineCache.h"
+#include "utils.h"
+
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <cstring>
+
+namespace {
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        uint64_t data_hash;     // catches truncated/partially written files
+    };
+
+    // FNV-1a
+    uint64_t hash(const void* data, size_t size) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= bytes[i];
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+}
+
+void PipelineCache::init(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& directory, const std::string& name) {
+    _device = device;
+    _properties = properties;
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cout << "[Pipeline Cache] Failed to create " << directory << ", the cache is not saved" << std::endl;
+        _path.clear();
+    } else {
+        _path = directory + "/" + name + ".pipeline";
+    }
+
+    std::vector<uint8_t> blob;
+    _warm = load(blob);
+
+    VkPipelineCacheCreateInfo cache_info = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, nullptr };
+    cache_info.initialDataSize = _warm ? blob.size() : 0;
+    cache_info.pInitialData = _warm ? blob.data() : nullptr;
+    VK_CHECK(vkCreatePipelineCache(_device, &cache_info, nullptr, &_cache));
+    std::cout << "[Pipeline Cache] " << (_warm ? "warm, " + std::to_string(blob.size()) + " bytes" : std::string("cold")) << std::endl;
+}
+
+void PipelineCache::destroy() {
+    if (_cache == VK_NULL_HANDLE) {
+        return;
+    }
+    save();
+    vkDestroyPipelineCache(_device, _cache, nullptr);
+    _cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::load(std::vector<uint8_t>& blob) const {
+    if (_path.empty()) { return false; }
+
+    std::ifstream file(_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) { return false; }
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    FileHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+    if (!file ||
+        header.magic != MAGIC ||
+        header.version != VERSION ||
+        header.vendor_id != _properties.vendorID ||
+        header.device_id != _properties.deviceID ||
+        header.driver_version != _properties.driverVersion ||
+        std::memcmp(header.pipeline_cache_uuid, _properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "[Pipeline Cache] device/driver changed, start empty" << std::endl;
+        return false;
+    }
+
+    // a corrupted size must not allocate more than the file holds
+    if (header.data_size != file_size - sizeof(FileHeader)) {
+        std::cout << "[Pipeline Cache] corrupted, start empty" << std::endl;
+        return false;
+    }
+    blob.resize(header.data_size);
+    file.read(reinterpret_cast<char*>(blob.data()), header.data_size);
+    if (!file || hash(blob.data(), blob.size()) != header.data_hash) {
+        std::cout << "[Pipeline Cache] corrupted, start empty" << std::endl;
+        blob.clear();
+        return false;
+    }
+
+    // the header written by the driver itself
+    VkPipelineCacheHeaderVersionOne driver_header = {};
+    if (blob.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        blob.clear();
+        return false;
+    }
+    std::memcpy(&driver_header, blob.data(), sizeof(VkPipelineCacheHeaderVersionOne));
+    if (driver_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driver_header.vendorID != _properties.vendorID ||
+        driver_header.deviceID != _properties.deviceID ||
+        std::memcmp(driver_header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "[Pipeline Cache] unknown driver header, start empty" << std::endl;
+        blob.clear();
+        return false;
+    }
+    return true;
+}
+
+bool PipelineCache::save() const {
+    if (_path.empty()) { return false; }
+
+    // the pipelines created by this run are merged in the cache object already
+    // on the shutdown path: a failure skips the save, nothing aborts
+    size_t size = 0;
+    VkResult result = vkGetPipelineCacheData(_device, _cache, &size, nullptr);
+    std::vector<uint8_t> blob(size);
+    if (result == VK_SUCCESS) {
+        result = vkGetPipelineCacheData(_device, _cache, &size, blob.data());
+    }
+    if (result != VK_SUCCESS) {
+        std::cout << "[Pipeline Cache] Failed to get the cache data (" << result << "), not saved" << std::endl;
+        return false;
+    }
+    blob.resize(size);
+
+    FileHeader header = {};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vendor_id = _properties.vendorID;
+    header.device_id = _properties.deviceID;
+    header.driver_version = _properties.driverVersion;
+    std::memcpy(header.pipeline_cache_uuid, _properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = size;
+    header.data_hash = hash(blob.data(), size);
+
+    // write to a temporary file first, a crash never leaves a half written cache behind
+    const std::string tmp_path = _path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "[Pipeline Cache] Failed to write " << tmp_path << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+        file.write(reinterpret_cast<const char*>(blob.data()), size);
+        if (!file) {
+            std::cout << "[Pipeline Cache] Failed to write " << tmp_path << std::endl;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, _path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    std::cout << "[Pipeline Cache] " << size << " bytes -> " << _path << std::endl;
+    return true;
+}
+
+void PipelineCache::add_creation_time(std::chrono::high_resolution_clock::time_point start) {
+    auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+    _creation_seconds += delta.count();
+    ++_num_pipelines;
+}
+
+void PipelineCache::log_creation_times() const {
+    std::cout << "[Pipeline Cache] " << (_warm ? "warm" : "cold") << ": " << _num_pipelines
+        << " pipelines, creation time: " << _creation_seconds << "s" << std::endl;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "types.h"
+
+/// <summary>
+/// VkPipelineCache across runs: one file per app, `<directory>/<name>.pipeline`
+///  the blob is only given to the driver if the vendor, device, driver version & pipeline cache uuid match,
+///  otherwise the cache starts empty (cold). the merged data is written back by `destroy`
+/// </summary>
+class PipelineCache {
+public:
+    static const uint32_t MAGIC = 0x43504C50; // "PLPC"
+    static const uint32_t VERSION = 1;
+
+    void init(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& directory, const std::string& name);
+    // before the device is destroyed
+    void destroy();
+
+    VkPipelineCache get() const { return _cache; }
+    bool is_warm() const { return _warm; }
+
+    /// <summary>
+    /// time of a vkCreate*Pipelines call started at `start`, summed to compare cold & warm runs
+    /// </summary>
+    void add_creation_time(std::chrono::high_resolution_clock::time_point start);
+    void log_creation_times() const;
+
+private:
+    bool load(std::vector<uint8_t>& blob) const;
+    bool save() const;
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPipelineCache _cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties _properties{};
+    std::string _path{};
+    bool _warm{ false };
+
+    uint32_t _num_pipelines{ 0 };
+    float _creation_seconds{ 0.0f };
+};
@@ -0,0 +1,231 @@
+#include "profiler.h"
+#include "utils.h"
+
+#include <imgui.h>
+
+#include <fstream>
+#include <algorithm>
+
+namespace {
+    // the weight of the last frame in the rolling averages
+    const float AVERAGE_WEIGHT = 0.05f;
+
+    // the name of the zones are literals, only '"' & '\' would break the json
+    void write_json_string(std::ofstream& out, const char* s) {
+        out << '"';
+        for (; *s; ++s) {
+            if (*s == '"' || *s == '\\') {
+                out << '\\';
+            }
+            out << *s;
+        }
+        out << '"';
+    }
+}
+
+void Profiler::init(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, uint32_t frames_in_flight) {
+    _device = device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    _timestamp_period = properties.limits.timestampPeriod;
+
+    uint32_t num_families = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &num_families, nullptr);
+    std::vector<VkQueueFamilyProperties> families(num_families);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &num_families, families.data());
+    const uint32_t valid_bits = families[queue_family].timestampValidBits;
+    _timestamp_mask = (valid_bits >= 64) ? ~0ull : ((1ull << valid_bits) - 1);
+    if (valid_bits == 0) {
+        std::cout << "[Profiler] no timestamps on the queue, cpu zones only" << std::endl;
+    }
+    _origin = Clock::now();
+    _frames.assign(frames_in_flight, FrameZones{});
+    if (valid_bits == 0) {
+        // no query pool: vkCmdWriteTimestamp is invalid on the queue
+        return;
+    }
+
+    VkQueryPoolCreateInfo query_pool_info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, nullptr };
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = frames_in_flight * MAX_GPU_ZONES * 2;
+    VK_CHECK(vkCreateQueryPool(_device, &query_pool_info, nullptr, &_query_pool));
+}
+
+void Profiler::destroy() {
+    if (_query_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(_device, _query_pool, nullptr);
+        _query_pool = VK_NULL_HANDLE;
+    }
+}
+
+double Profiler::now_us() const {
+    return std::chrono::duration<double, std::micro>(Clock::now() - _origin).count();
+}
+
+void Profiler::begin_frame(VkCommandBuffer cmd, uint32_t frame_idx) {
+    if (_query_pool == VK_NULL_HANDLE) {
+        return;
+    }
+    resolve(frame_idx);
+
+    _frame_idx = frame_idx;
+    FrameZones& frame = _frames[frame_idx];
+    frame.zones.clear();
+    frame.cpu_begin_us = now_us();
+    frame.recorded = true;
+    _open_zones.clear();
+    vkCmdResetQueryPool(cmd, _query_pool, frame_idx * MAX_GPU_ZONES * 2, MAX_GPU_ZONES * 2);
+}
+
+void Profiler::begin_gpu_zone(VkCommandBuffer cmd, const char* name) {
+    if (_query_pool == VK_NULL_HANDLE) {
+        return;
+    }
+    FrameZones& frame = _frames[_frame_idx];
+    if (frame.zones.size() >= MAX_GPU_ZONES) {
+        _open_zones.push_back(-1);
+        return;
+    }
+    const uint32_t base = _frame_idx * MAX_GPU_ZONES * 2;
+    const uint32_t query = base + static_cast<uint32_t>(frame.zones.size()) * 2;
+    _open_zones.push_back(static_cast<int>(frame.zones.size()));
+    frame.zones.push_back({ name, query, UINT32_MAX, static_cast<int>(_open_zones.size()) - 1 });
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _query_pool, query);
+}
+
+void Profiler::end_gpu_zone(VkCommandBuffer cmd) {
+    if (_query_pool == VK_NULL_HANDLE || _open_zones.empty()) {
+        return;
+    }
+    const int zone = _open_zones.back();
+    _open_zones.pop_back();
+    if (zone < 0) {
+        return;
+    }
+    GpuZone& z = _frames[_frame_idx].zones[zone];
+    z.end_query = z.begin_query + 1;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _query_pool, z.end_query);
+}
+
+void Profiler::resolve(uint32_t frame_idx) {
+    FrameZones& frame = _frames[frame_idx];
+    if (!frame.recorded || frame.zones.empty()) {
+        return;
+    }
+    frame.recorded = false;
+
+    // the fence is waited, no VK_QUERY_RESULT_WAIT_BIT: (value, availability) pairs, an unclosed zone is not available
+    uint64_t results[MAX_GPU_ZONES * 2 * 2] = {};
+    const uint32_t num_queries = static_cast<uint32_t>(frame.zones.size()) * 2;
+    const VkResult result = vkGetQueryPoolResults(_device, _query_pool, frame_idx * MAX_GPU_ZONES * 2, num_queries,
+        sizeof(results), results, 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        return;
+    }
+
+    // no calibrated timestamps: the gpu track starts when the frame began to be recorded,
+    // at the first available zone (the outermost one, written first)
+    const uint32_t num_zones = static_cast<uint32_t>(frame.zones.size());
+    uint32_t first_zone = 0;
+    while (first_zone < num_zones && results[first_zone * 4 + 1] == 0) {
+        ++first_zone;
+    }
+    if (first_zone == num_zones) {
+        return;
+    }
+    const uint64_t first = results[first_zone * 4];
+    for (uint32_t i = first_zone; i < num_zones; ++i) {
+        const uint64_t* begin = results + i * 4;
+        const uint64_t* end = begin + 2;
+        if (frame.zones[i].end_query == UINT32_MAX || begin[1] == 0 || end[1] == 0) {
+            continue;
+        }
+        // only the low timestampValidBits are meaningful
+        const double begin_us = static_cast<double>((begin[0] - first) & _timestamp_mask) * _timestamp_period * 1e-3;
+        const double dur_us = static_cast<double>((end[0] - begin[0]) & _timestamp_mask) * _timestamp_period * 1e-3;
+        add_event(frame.zones[i].name, true, frame.zones[i].depth, frame.cpu_begin_us + begin_us, dur_us);
+    }
+}
+
+void Profiler::add_event(const char* name, bool gpu, int depth, double ts_us, double dur_us) {
+    const float ms = static_cast<float>(dur_us * 1e-3);
+    auto it = std::find_if(_stages.begin(), _stages.end(), [&](const Stage& s) { return s.gpu == gpu && std::string(s.name) == name; });
+    if (it == _stages.end()) {
+        _stages.push_back({ name, gpu, ms, ms });
+    } else {
+        it->average_ms += AVERAGE_WEIGHT * (ms - it->average_ms);
+        it->last_ms = ms;
+    }
+
+    _events.push_back({ name, gpu, depth, ts_us, dur_us });
+    while (_events.size() > MAX_EVENTS) {
+        _events.pop_front();
+    }
+}
+
+Profiler::CpuZone::CpuZone(Profiler& profiler, const char* name)
+    : _profiler(profiler), _name(name), _depth(profiler._cpu_depth++), _start(Clock::now()) {}
+
+Profiler::CpuZone::~CpuZone() {
+    const auto end = Clock::now();
+    --_profiler._cpu_depth;
+    const double ts_us = std::chrono::duration<double, std::micro>(_start - _profiler._origin).count();
+    const double dur_us = std::chrono::duration<double, std::micro>(end - _start).count();
+    _profiler.add_event(_name, false, _depth, ts_us, dur_us);
+}
+
+void Profiler::draw_imgui() {
+    if (ImGui::BeginTable("Stages", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("Average (ms)");
+        ImGui::TableSetupColumn("Last (ms)");
+        ImGui::TableHeadersRow();
+        for (int gpu = 1; gpu >= 0; --gpu) {
+            for (const Stage& s : _stages) {
+                if (s.gpu != (gpu == 1)) { continue; }
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s %s", s.gpu ? "[GPU]" : "[CPU]", s.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", s.average_ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", s.last_ms);
+            }
+        }
+        ImGui::EndTable();
+    }
+    if (ImGui::Button("Export Trace")) {
+        const std::string path = "profile.json";
+        _export_message = write_chrome_trace(path) ? "saved " + path : "failed to save " + path;
+    }
+    if (!_export_message.empty()) {
+        ImGui::SameLine();
+        ImGui::Text("%s", _export_message.c_str());
+    }
+}
+
+bool Profiler::write_chrome_trace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "[Profiler] cannot open " << path << std::endl;
+        return false;
+    }
+
+    // complete events ("ph": "X"), one thread per timeline
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (const Event& e : _events) {
+        out << ",\n{\"name\":";
+        write_json_string(out, e.name);
+        out << ",\"cat\":\"" << (e.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (e.gpu ? 1 : 0)
+            << ",\"ts\":" << e.ts_us << ",\"dur\":" << e.dur_us << ",\"args\":{\"depth\":" << e.depth << "}}";
+    }
+    out << "\n]}\n";
+
+    std::cout << "[Profiler] " << _events.size() << " events -> " << path << std::endl;
+    return static_cast<bool>(out);
+}
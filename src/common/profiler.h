@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+
+#include "types.h"
+
+/// <summary>
+/// gpu timestamps around the recorded stages (a range of queries per frame in flight, resolved when the fence of
+/// that frame is waited again: no stall) & scoped cpu zones of the main thread.
+/// rolling averages per stage for the ui, the last events are exported as a chrome trace (chrome://tracing, ui.perfetto.dev)
+/// the zone names are string literals
+/// </summary>
+class Profiler {
+public:
+    static const uint32_t MAX_GPU_ZONES = 32;   // per frame
+    static const size_t MAX_EVENTS = 1 << 16;
+
+    // the timestamps of `queue_family` (period & valid bits), the gpu zones are ignored if it has none
+    void init(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, uint32_t frames_in_flight);
+    void destroy();
+
+    /// <summary>
+    /// the fence of `frame_idx` is waited: the zones it recorded last time are resolved, its queries are reset in `cmd`
+    /// (outside of a render pass)
+    /// </summary>
+    void begin_frame(VkCommandBuffer cmd, uint32_t frame_idx);
+
+    /// <summary>
+    /// nested zones of the current frame, ignored past MAX_GPU_ZONES
+    /// </summary>
+    void begin_gpu_zone(VkCommandBuffer cmd, const char* name);
+    void end_gpu_zone(VkCommandBuffer cmd);
+
+    class CpuZone {
+    public:
+        CpuZone(Profiler& profiler, const char* name);
+        ~CpuZone();
+
+    private:
+        Profiler& _profiler;
+        const char* _name;
+        int _depth;
+        std::chrono::high_resolution_clock::time_point _start;
+    };
+
+    /// <summary>
+    /// the averages of the stages & the export button, inside the caller's window
+    /// </summary>
+    void draw_imgui();
+
+    bool write_chrome_trace(const std::string& path) const;
+
+private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct GpuZone {
+        const char* name;
+        uint32_t begin_query;
+        uint32_t end_query;     // UINT32_MAX: not closed
+        int depth;
+    };
+    struct FrameZones {
+        std::vector<GpuZone> zones{};
+        double cpu_begin_us{ 0.0 };
+        bool recorded{ false };
+    };
+    struct Stage {
+        const char* name;
+        bool gpu;
+        float average_ms;
+        float last_ms;
+    };
+    struct Event {
+        const char* name;
+        bool gpu;
+        int depth;
+        double ts_us;
+        double dur_us;
+    };
+
+    double now_us() const;
+    void add_event(const char* name, bool gpu, int depth, double ts_us, double dur_us);
+    void resolve(uint32_t frame_idx);
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueryPool _query_pool = VK_NULL_HANDLE;
+    float _timestamp_period{ 1.0f };    // ns per tick
+    uint64_t _timestamp_mask{ ~0ull };  // timestampValidBits, the deltas wrap around
+    Clock::time_point _origin{};
+
+    std::vector<FrameZones> _frames{};
+    uint32_t _frame_idx{ 0 };
+    std::vector<int> _open_zones{};     // -1: over MAX_GPU_ZONES
+    int _cpu_depth{ 0 };
+
+    std::vector<Stage> _stages{};
+    std::deque<Event> _events{};
+    std::string _export_message{};
+};
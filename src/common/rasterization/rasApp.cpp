@@ -5,6 +5,13 @@
 #include "../mesh.h"
 #include "../shader.h"
 
+#include <algorithm>
+
+void RasApp::set_frames_in_flight(uint32_t frames_in_flight) {
+    _frames_in_flight = std::clamp(frames_in_flight, 1u, MAX_FRAMES_IN_FLIGHT);
+    _frames.assign(_frames_in_flight, FrameData{});
+}
+
 RasApp::~RasApp() {
     // must do it!
     // the resources of this derived class may be freed when the base class call it
@@ -23,6 +30,7 @@ void RasApp::init() {
     init_commands();
 
     init_pipeline();
+    _pipeline_cache.log_creation_times();
 
     init_sync_structures();
 
@@ -44,23 +52,26 @@ void RasApp::draw() {
     // blocked or timeout
     // wait until the GPU has finished rendering the last frame.
     // timeout of 1 second
-    VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
-    VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    {
+        Profiler::CpuZone zone(_profiler, "wait fence");
+        VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
+        VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    }
 
-    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+    {
+        Profiler::CpuZone zone(_profiler, "acquire");
+        acquire_swapchain_image(frame);
+    }
 
     // 2. prepare command buffer
 
-    // begin the command buffer recording.
-    VkCommandBuffer cmd = frame._main_command_buffer;
-    VK_CHECK(vkResetCommandBuffer(cmd, 0));
-
-    // We will use this command buffer exactly once
-    VkCommandBufferBeginInfo cmd_begin_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    // begin the command buffer recording & the profiler frame
+    VkCommandBuffer cmd = begin_frame_commands(frame);
 
     // 3. add commands
+    // outside of the render pass (compute...)
+    pre_render();
+
     VkClearValue color_value{};
     color_value.color = { 0.0f, 0.0f, 0.0f, 0.0f };
 
@@ -69,16 +80,22 @@ void RasApp::draw() {
     rp_begin_info.clearValueCount = 1;
     rp_begin_info.pClearValues = &color_value;
 
-    vkCmdBeginRenderPass(cmd, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    // the timestamps are outside of the render pass: only secondary command buffers may be in it
+    _profiler.begin_gpu_zone(cmd, "render");
+    vkCmdBeginRenderPass(cmd, &rp_begin_info, get_subpass_contents());
 
     // rendering
-    render();
+    {
+        Profiler::CpuZone zone(_profiler, "render");
+        render();
+    }
 
     // finalize the render pass
     vkCmdEndRenderPass(cmd);
+    _profiler.end_gpu_zone(cmd);
     // finalize the command buffer
     // (we can no longer add commands, but it can now be executed)
-    VK_CHECK(vkEndCommandBuffer(cmd));
+    end_frame_commands(cmd);
 
     // 4. submit the cmd to GPU
     VkSubmitInfo submit_info = vkinit::submit_info(&cmd);
@@ -94,7 +111,10 @@ void RasApp::draw() {
 
     // submit command buffer to the queue and execute it.
     // _renderFence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    {
+        Profiler::CpuZone zone(_profiler, "submit");
+        VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    }
 
     // 5. display to the screen
     VkPresentInfoKHR present_info = vkinit::present_info();
@@ -106,7 +126,10 @@ void RasApp::draw() {
     present_info.waitSemaphoreCount = 1;
     present_info.pWaitSemaphores = &frame._render_semaphore;
 
-    VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    {
+        Profiler::CpuZone zone(_profiler, "present");
+        VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    }
 
     ++_frame_number;
 }
@@ -162,7 +185,7 @@ void RasApp::add_pipeline_no_input (
     // set layout
     set_shader_input(pipeline_builder, layout, set_layout, set_layout_count);
     pipeline_builder._pipeline_layout = layout;
-    pipeline = pipeline_builder.build_pipeline(_device, renderpass, use_z_buffer, subpass);
+    pipeline = pipeline_builder.build_pipeline(_device, renderpass, use_z_buffer, subpass, &_pipeline_cache);
     // cleanup
     _main_deletion_queue.push_function(
         [=]() {
@@ -187,7 +210,7 @@ void RasApp::init_commands_for_graphics_pipeline() {
         VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
     );
 
-    for (int i = 0; i < FRAME_OVERLAP; ++i) {
+    for (uint32_t i = 0; i < _frames_in_flight; ++i) {
         FrameData& frame = _frames[i];
         VK_CHECK(vkCreateCommandPool(_device, &cmd_pool_info, nullptr, &frame._command_pool));
         // Create Command Buffer
@@ -198,8 +221,7 @@ void RasApp::init_commands_for_graphics_pipeline() {
     // resources
     _main_deletion_queue.push_function(
         [&]() {
-            for (int i = 0; i < FRAME_OVERLAP; ++i) {
-                FrameData& frame = _frames[i];
+            for (FrameData& frame : _frames) {
                 // destroying their parent pool will destroy all of the command buffers allocated from it
                 vkDestroyCommandPool(_device, frame._command_pool, nullptr);
             }
@@ -212,7 +234,7 @@ void RasApp::init_sync_structures_for_graphics_pass() {
     // so we can wait on it before using it on a GPU command (for the first frame)
     // initialized with signaled state
     VkFenceCreateInfo fence_create_info = vkinit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
-    for (int i = 0; i < FRAME_OVERLAP; ++i) {
+    for (uint32_t i = 0; i < _frames_in_flight; ++i) {
         FrameData& frame = _frames[i];
         VK_CHECK(vkCreateFence(_device, &fence_create_info, nullptr, &frame._render_fence));
 
@@ -230,24 +252,87 @@ void RasApp::init_sync_structures_for_graphics_pass() {
             }
         }
     );
+
+    _profiler.init(_physical_device, _device, _graphics_queue_family, _frames_in_flight);
+    _main_deletion_queue.push_function(
+        [&]() {
+            _profiler.destroy();
+        }
+    );
 }
 
 inline uint32_t RasApp::get_current_frame_idx() const {
-    return _frame_number % FRAME_OVERLAP;
+    return _frame_number % _frames_in_flight;
+}
+
+void RasApp::acquire_swapchain_image(FrameData& frame) {
+    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+
+    // more frames in flight than swapchain images: the image may still be rendered by another frame
+    // (its own fence was waited & reset already)
+    if (_images_in_flight.size() != _swapchain_images.size()) {
+        _images_in_flight.assign(_swapchain_images.size(), VK_NULL_HANDLE);
+    }
+    VkFence& image_fence = _images_in_flight[_swapchain_image_index];
+    if (image_fence != VK_NULL_HANDLE && image_fence != frame._render_fence) {
+        VK_CHECK(vkWaitForFences(_device, 1, &image_fence, true, 1'000'000'000));
+    }
+    image_fence = frame._render_fence;
 }
 
 void RasApp::basic_clean_up() {
     if (_is_initialized) {
-        for (int i = 0; i < FRAME_OVERLAP; ++i) {
-            FrameData& frame = _frames[i];
+        for (FrameData& frame : _frames) {
             VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
         }
         VK_CHECK(vkDeviceWaitIdle(_device));
+        if (_profile_trace_on_exit) {
+            _profiler.write_chrome_trace(_name + "_profile.json");
+        }
         flush_deletion_queue_and_vulkan_resources();
         _is_initialized = false;
     }
 }
 
+VkCommandBuffer RasApp::begin_frame_commands(FrameData& frame) {
+    VkCommandBuffer cmd = frame._main_command_buffer;
+    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+
+    // We will use this command buffer exactly once
+    VkCommandBufferBeginInfo cmd_begin_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    // the queries of this frame in flight were resolved, reused from here
+    _profiler.begin_frame(cmd, get_current_frame_idx());
+    _profiler.begin_gpu_zone(cmd, "frame");
+    return cmd;
+}
+
+void RasApp::end_frame_commands(VkCommandBuffer cmd) {
+    _profiler.end_gpu_zone(cmd);
+    VK_CHECK(vkEndCommandBuffer(cmd));
+}
+
+void RasApp::render_with_zones(VkCommandBuffer cmd) {
+    Profiler::CpuZone zone(_profiler, "render");
+    _profiler.begin_gpu_zone(cmd, "render");
+    render();
+    _profiler.end_gpu_zone(cmd);
+}
+
+void RasApp::init_parallel_recorder(uint32_t num_threads) {
+    _parallel_recorder.init(_device, _graphics_queue_family, _frames_in_flight, num_threads);
+    _main_deletion_queue.push_function([&]() { _parallel_recorder.destroy(); });
+}
+
+VkCommandBufferInheritanceInfo RasApp::get_render_pass_inheritance(uint32_t subpass) const {
+    VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO, nullptr };
+    inheritance.renderPass = _render_pass;
+    inheritance.subpass = subpass;
+    inheritance.framebuffer = _framebuffers[_swapchain_image_index];
+    return inheritance;
+}
+
 FrameData& RasApp::get_current_frame() {
     return _frames[get_current_frame_idx()];
 }
@@ -3,12 +3,19 @@
 #include "../app.h"
 #include "../data.h"
 #include "../pipeline.h"
+#include "../profiler.h"
+#include "../parallelRecorder.h"
 
 class RasApp :public App {
 public:
     RasApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer) :App(name, width, height, use_validation_layer) {}
     virtual ~RasApp() override;
 
+    // before `run`, clamped to [1, MAX_FRAMES_IN_FLIGHT]
+    void set_frames_in_flight(uint32_t frames_in_flight);
+    // the chrome trace of the last frames is written to `<name>_profile.json` when the app is closed, off by default
+    void set_profile_trace_on_exit(bool on) { _profile_trace_on_exit = on; }
+
 protected:
     // virtual void init_per_frame() override;
     virtual void init() override;
@@ -24,6 +31,10 @@ protected:
     virtual void init_sync_structures();
     virtual void init_scenes() = 0;
     virtual void render() = 0;
+    // recorded before the render pass begins
+    virtual void pre_render() {}
+    // SECONDARY_COMMAND_BUFFERS: `render` only executes secondary command buffers (`_parallel_recorder`)
+    virtual VkSubpassContents get_subpass_contents() const { return VK_SUBPASS_CONTENTS_INLINE; }
     virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count);
 
     void init_commands_for_graphics_pipeline();
@@ -37,15 +48,34 @@ protected:
         VkPipeline& pipeline, VkPipelineLayout& layout
     );
     void init_sync_structures_for_graphics_pass();
+    // after `init_commands`, `num_threads` = 0: one per core
+    void init_parallel_recorder(uint32_t num_threads = 0);
+    // the render pass & framebuffer of this frame, for the secondary command buffers
+    VkCommandBufferInheritanceInfo get_render_pass_inheritance(uint32_t subpass = 0) const;
+    // resets & begins the command buffer of `frame`, begins the profiler frame & its "frame" zone
+    VkCommandBuffer begin_frame_commands(FrameData& frame);
+    // ends the "frame" zone & the command buffer
+    void end_frame_commands(VkCommandBuffer cmd);
+    // `render` in the cpu & gpu "render" zones (inline contents only, no timestamps among secondary command buffers)
+    void render_with_zones(VkCommandBuffer cmd);
     FrameData& get_current_frame();
     uint32_t get_current_frame_idx() const;
     void basic_clean_up();
 
     // frame Data
-    static const uint32_t FRAME_OVERLAP = 2U;
-    FrameData _frames[FRAME_OVERLAP]{};
+    static const uint32_t MAX_FRAMES_IN_FLIGHT = 4U;
+    uint32_t _frames_in_flight{ 3U };
+    std::vector<FrameData> _frames = std::vector<FrameData>(_frames_in_flight);
+    // the fence of the frame that rendered each swapchain image last, the acquired image may still be in flight
+    std::vector<VkFence> _images_in_flight{};
+    void acquire_swapchain_image(FrameData& frame);
     // render pass
     VkRenderPass _render_pass = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> _framebuffers = {};
+    // the stages of `draw`
+    Profiler _profiler{};
+    bool _profile_trace_on_exit{ false };
+    // the secondary command buffers of the threads, per frame in flight
+    ParallelRecorder _parallel_recorder{};
 private:
 };
\ No newline at end of file
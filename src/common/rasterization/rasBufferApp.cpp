@@ -2,6 +2,8 @@
 #include "../types.h"
 #include "../initializers.h"
 
+#include <algorithm>
+
 RasBufferApp::~RasBufferApp() {
     // must do it!
     // the resources of this derived class may be freed when the base class call it
@@ -23,9 +25,12 @@ void RasBufferApp::init() {
 
     init_commands();
 
+    init_frame_allocator();
+
     init_descriptors();
 
     init_pipeline();
+    _pipeline_cache.log_creation_times();
 
     init_sync_structures();
 
@@ -47,6 +52,11 @@ void RasBufferApp::set_shader_input(PipelineBuilder& builder, VkPipelineLayout&
     builder._pipeline_layout = layout;
 }
 
+void RasBufferApp::init_frame_allocator() {
+    _frame_allocator.init(_allocator, _physical_device_properties.limits, _frames_in_flight, UPLOAD_SIZE_PER_FRAME, MAX_UPLOAD_RANGE);
+    _main_deletion_queue.push_function([&]() { _frame_allocator.destroy(); });
+}
+
 void RasBufferApp::init_descriptors() {
     std::cerr << "You should implement the init_descriptor() funciton "
         "as this is just a sample code(size = 0 will error)"
@@ -71,70 +81,41 @@ void RasBufferApp::init_descriptors_for_uniform_data(uint32_t buffer_size) {
     VkShaderStageFlags stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     VkDescriptorSetLayout unifrom_data_set_layout = _descriptors.create_set_layout(&type, &stage);
 
-    // allocate buffers
-    const uint32_t padding_buffer_size = vkutils::padding(buffer_size, _physical_device_properties.limits.minUniformBufferOffsetAlignment);
-    const uint32_t total_buffer_size = padding_buffer_size * FRAME_OVERLAP;
-    _uniform_data_buffer = create_buffer(total_buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    for (int i = 0; i < FRAME_OVERLAP; ++i) {
-        FrameData& frame = _frames[i];
+    // allcote the descriptor set (uniform data), the data of a frame is allocated from `_frame_allocator`
+    _uniform_data_descriptor_set = _descriptors.create_set(unifrom_data_set_layout);
 
-        // allcote the descriptor set (uniform data)
-        frame._uniform_data_descriptor_set = _descriptors.create_set(unifrom_data_set_layout);
+    VkDescriptorBufferInfo uniform_buffer_info = {};
+    uniform_buffer_info.buffer = _frame_allocator.buffer();
+    uniform_buffer_info.offset = 0; // dynamic
+    uniform_buffer_info.range = buffer_size;
 
-        // point to the buffers, allocate the buffers
-        VkDescriptorBufferInfo uniform_buffer_info = {};
-        uniform_buffer_info.buffer = _uniform_data_buffer._buffer;
-        uniform_buffer_info.offset = 0; // dynamic
-        uniform_buffer_info.range = buffer_size;
-
-        _descriptors.bind(frame._uniform_data_descriptor_set, &uniform_buffer_info, type, 0);
-    }
+    DescriptorWriter writer{};
+    writer.write_buffer(_uniform_data_descriptor_set, 0, type, uniform_buffer_info);
+    writer.flush(_device);
 
     _set_layout.push_back(unifrom_data_set_layout);
-
-    _main_deletion_queue.push_function(
-        [&]() {
-            vmaDestroyBuffer(_allocator, _uniform_data_buffer._buffer, _uniform_data_buffer._allocation);
-        }
-    );
 }
 
 void RasBufferApp::init_descriptors_for_object_data(uint32_t size_per_object) {
-    VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
     VkShaderStageFlags stage = VK_SHADER_STAGE_VERTEX_BIT;
     VkDescriptorSetLayout object_set_layout = _descriptors.create_set_layout(&type, &stage);
 
-    for (int i = 0; i < FRAME_OVERLAP; ++i) {
-        FrameData& frame = _frames[i];
+    // allcote the descriptor set (object data)
+    _object_descriptor_set = _descriptors.create_set(object_set_layout);
 
-        // allocate buffers
-        const int MAX_OBJECTS = 10'000;
-        frame._object_buffer = create_buffer(
-            size_per_object * MAX_OBJECTS,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            VMA_MEMORY_USAGE_CPU_TO_GPU
-        );
+    // the objects of one bind, the range stays inside of the buffer from any dynamic offset
+    const VkDeviceSize MAX_OBJECTS = 10'000;
+    const VkDeviceSize max_objects = std::min<VkDeviceSize>(MAX_OBJECTS, _frame_allocator.max_range() / size_per_object);
 
-        // allcote the descriptor set (object data)
-        frame._object_descriptor_set = _descriptors.create_set(object_set_layout);
+    VkDescriptorBufferInfo object_buffer_info = {};
+    object_buffer_info.buffer = _frame_allocator.buffer();
+    object_buffer_info.offset = 0; // dynamic
+    object_buffer_info.range = size_per_object * max_objects;
 
-        VkDescriptorBufferInfo object_buffer_info = {};
-        object_buffer_info.buffer = frame._object_buffer._buffer;
-        object_buffer_info.offset = 0;
-        object_buffer_info.range = size_per_object * MAX_OBJECTS;
-
-        _descriptors.bind(frame._object_descriptor_set, &object_buffer_info, type, 0);
-    }
+    DescriptorWriter writer{};
+    writer.write_buffer(_object_descriptor_set, 0, type, object_buffer_info);
+    writer.flush(_device);
 
     _set_layout.push_back(object_set_layout);
-
-    _main_deletion_queue.push_function(
-        [&]() {
-            for (int i = 0; i < FRAME_OVERLAP; i++) {
-                FrameData& frame = _frames[i];
-                vmaDestroyBuffer(_allocator, frame._object_buffer._buffer, frame._object_buffer._allocation);
-            }
-        }
-    );
 }
\ No newline at end of file
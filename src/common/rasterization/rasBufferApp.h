@@ -3,6 +3,7 @@
 #include "rasVertexApp.h"
 #include "../render.h"
 #include "../descriptor.h"
+#include "../frameAllocator.h"
 
 class RasBufferApp :public RasVertexApp {
 public:
@@ -23,13 +24,20 @@ protected:
     virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count) override;
 
     virtual void init_descriptors();
+    void init_frame_allocator();
 
     void init_descriptors_for_uniform_data(uint32_t buffer_size);
     void init_descriptors_for_object_data(uint32_t size_per_object);
 
     // descriptors
     Descriptor _descriptors{};
-    AllocatedBuffer _uniform_data_buffer{};
     std::vector<VkDescriptorSetLayout> _set_layout{};
+
+    // uniform & object data of all frames, one set each: the dynamic offsets of the allocations select the data
+    static const uint32_t UPLOAD_SIZE_PER_FRAME = 2 << 20;
+    static const uint32_t MAX_UPLOAD_RANGE = 1 << 20;
+    FrameAllocator _frame_allocator{};
+    VkDescriptorSet _uniform_data_descriptor_set = VK_NULL_HANDLE;
+    VkDescriptorSet _object_descriptor_set = VK_NULL_HANDLE;
 private:
 };
\ No newline at end of file
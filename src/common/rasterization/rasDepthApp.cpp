@@ -21,21 +21,21 @@ void RasDepthApp::draw() {
     // blocked or timeout
     // wait until the GPU has finished rendering the last frame.
     // timeout of 1 second
-    VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
-    VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    {
+        Profiler::CpuZone zone(_profiler, "wait fence");
+        VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
+        VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    }
 
-    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+    {
+        Profiler::CpuZone zone(_profiler, "acquire");
+        acquire_swapchain_image(frame);
+    }
 
     // 2. prepare command buffer
 
-    // begin the command buffer recording.
-    VkCommandBuffer cmd = frame._main_command_buffer;
-    VK_CHECK(vkResetCommandBuffer(cmd, 0));
-
-    // We will use this command buffer exactly once
-    VkCommandBufferBeginInfo cmd_begin_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    // begin the command buffer recording & the profiler frame
+    VkCommandBuffer cmd = begin_frame_commands(frame);
 
     // 3. add commands
     VkClearValue color_value{};
@@ -52,13 +52,13 @@ void RasDepthApp::draw() {
     vkCmdBeginRenderPass(cmd, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
     // rendering
-    render();
+    render_with_zones(cmd);
 
     // finalize the render pass
     vkCmdEndRenderPass(cmd);
     // finalize the command buffer
     // (we can no longer add commands, but it can now be executed)
-    VK_CHECK(vkEndCommandBuffer(cmd));
+    end_frame_commands(cmd);
 
     // 4. submit the cmd to GPU
     VkSubmitInfo submit_info = vkinit::submit_info(&cmd);
@@ -74,7 +74,10 @@ void RasDepthApp::draw() {
 
     // submit command buffer to the queue and execute it.
     // _renderFence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    {
+        Profiler::CpuZone zone(_profiler, "submit");
+        VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    }
 
     // 5. display to the screen
     VkPresentInfoKHR present_info = vkinit::present_info();
@@ -86,7 +89,10 @@ void RasDepthApp::draw() {
     present_info.waitSemaphoreCount = 1;
     present_info.pWaitSemaphores = &frame._render_semaphore;
 
-    VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    {
+        Profiler::CpuZone zone(_profiler, "present");
+        VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    }
 
     ++_frame_number;
 }
@@ -199,7 +205,7 @@ void RasDepthApp::init_framebuffers() {
     );
 }
 
-void RasDepthApp::add_attchment(FrameBufferAttachment* attachments, VkFormat format, VkImageUsageFlags usage_flag) {
+void RasDepthApp::add_attchment(FrameBufferAttachment* attachments, VkFormat format, VkImageUsageFlags usage_flag, bool transient) {
     uint32_t swapchain_cnt = _swapchain_images.size();
 
     VkExtent3D image_extent = {
@@ -208,6 +214,30 @@ void RasDepthApp::add_attchment(FrameBufferAttachment* attachments, VkFormat for
         1
     };
 
+    if (transient) {
+        usage_flag |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+
+    VmaAllocationCreateInfo alloc_info = {};
+    // only in GPU
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    bool lazily_allocated = false;
+    if (transient) {
+        // desktop GPUs usually have no lazily allocated memory type
+        VkImageCreateInfo image_info = vkinit::image_create_info(format, usage_flag, image_extent);
+        VmaAllocationCreateInfo lazy_alloc_info = {};
+        lazy_alloc_info.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+        uint32_t memory_type_idx = 0;
+        if (vmaFindMemoryTypeIndexForImageInfo(_allocator, &image_info, &lazy_alloc_info, &memory_type_idx) == VK_SUCCESS) {
+            alloc_info = lazy_alloc_info;
+            lazily_allocated = true;
+        }
+        std::cout << "[Attachment] transient format " << format << ": "
+            << (lazily_allocated ? "lazily allocated memory" : "no lazily allocated memory, device local memory") << std::endl;
+    }
+
     for (int i = 0; i < swapchain_cnt; ++i) {
         FrameBufferAttachment& attach = attachments[i];
         AllocatedImage& image = attach._image;
@@ -223,12 +253,8 @@ void RasDepthApp::add_attchment(FrameBufferAttachment* attachments, VkFormat for
         }
 
         VkImageCreateInfo image_info = vkinit::image_create_info(format, usage_flag, image_extent);
-
-        VmaAllocationCreateInfo alloc_info = {};
-        // only in GPU
-        alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-        alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
         VK_CHECK(vmaCreateImage(_allocator, &image_info, &alloc_info, &image._image, &image._allocation, nullptr));
+        attach._lazily_allocated = lazily_allocated;
 
         VkImageViewCreateInfo image_view_info = vkinit::image_view_create_info(format, image._image, aspect_mask);
         VK_CHECK(vkCreateImageView(_device, &image_view_info, nullptr, &attach._image_view));
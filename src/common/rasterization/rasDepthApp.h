@@ -19,7 +19,12 @@ protected:
     virtual void render() override = 0;
     // virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count) override;
 
-    void add_attchment(FrameBufferAttachment* attachments, VkFormat format, VkImageUsageFlags usage_flag);
+    /// <summary>
+    /// `transient`: the content never leaves the render pass (load: CLEAR/DONT_CARE, store: DONT_CARE),
+    /// the images are VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT in lazily allocated memory if the device has some
+    /// (tile-based GPUs), otherwise in ordinary device local memory
+    /// </summary>
+    void add_attchment(FrameBufferAttachment* attachments, VkFormat format, VkImageUsageFlags usage_flag, bool transient = false);
 
     // depth
     const VkFormat _DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
@@ -31,6 +31,7 @@ void RasTexApp::init() {
     init_descriptors();
 
     init_pipeline();
+    _pipeline_cache.log_creation_times();
 
     init_sync_structures();
 
@@ -93,8 +94,10 @@ void RasTexApp::init_imgui(uint32_t subpass, VkRenderPass render_pass) {
     init_info.Device = _device;
     init_info.Queue = _graphics_queue;
     init_info.DescriptorPool = imgui_pool;
+    init_info.PipelineCache = _pipeline_cache.get();
     init_info.MinImageCount = 3;
-    init_info.ImageCount = 3;
+    // the vertex & index buffers of imgui are cycled by this count, one per frame in flight
+    init_info.ImageCount = std::max(_frames_in_flight, init_info.MinImageCount);
     init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     init_info.Subpass = subpass;
 
@@ -97,7 +97,7 @@ void RasVertexApp::add_pipeline(
     pipeline_builder.add_shaders(VK_SHADER_STAGE_VERTEX_BIT, shader.vertex());
     pipeline_builder.add_shaders(VK_SHADER_STAGE_FRAGMENT_BIT, shader.fragment());
 
-    pipeline = pipeline_builder.build_pipeline(_device, _render_pass, use_z_buffer, subpass);
+    pipeline = pipeline_builder.build_pipeline(_device, _render_pass, use_z_buffer, subpass, &_pipeline_cache);
 
     // cleanup
 
@@ -28,6 +28,7 @@ void RasSubpassApp::init() {
     init_descriptors();
 
     init_pipeline();
+    _pipeline_cache.log_creation_times();
 
     init_sync_structures();
 
@@ -35,6 +36,8 @@ void RasSubpassApp::init() {
 
     init_scenes();
 
+    log_memory_stats();
+
     // everything went fine
     _is_initialized = true;
 }
@@ -51,21 +54,21 @@ void RasSubpassApp::draw() {
     // blocked or timeout
     // wait until the GPU has finished rendering the last frame.
     // timeout of 1 second
-    VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
-    VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    {
+        Profiler::CpuZone zone(_profiler, "wait fence");
+        VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
+        VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    }
 
-    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+    {
+        Profiler::CpuZone zone(_profiler, "acquire");
+        acquire_swapchain_image(frame);
+    }
 
     // 2. prepare command buffer
 
-    // begin the command buffer recording.
-    VkCommandBuffer cmd = frame._main_command_buffer;
-    VK_CHECK(vkResetCommandBuffer(cmd, 0));
-
-    // We will use this command buffer exactly once
-    VkCommandBufferBeginInfo cmd_begin_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    // begin the command buffer recording & the profiler frame
+    VkCommandBuffer cmd = begin_frame_commands(frame);
 
     // 3. add commands
     VkClearValue color_value{};
@@ -82,13 +85,13 @@ void RasSubpassApp::draw() {
     vkCmdBeginRenderPass(cmd, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
     // rendering
-    render();
+    render_with_zones(cmd);
 
     // finalize the render pass
     vkCmdEndRenderPass(cmd);
     // finalize the command buffer
     // (we can no longer add commands, but it can now be executed)
-    VK_CHECK(vkEndCommandBuffer(cmd));
+    end_frame_commands(cmd);
 
     // 4. submit the cmd to GPU
     VkSubmitInfo submit_info = vkinit::submit_info(&cmd);
@@ -104,7 +107,10 @@ void RasSubpassApp::draw() {
 
     // submit command buffer to the queue and execute it.
     // _renderFence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    {
+        Profiler::CpuZone zone(_profiler, "submit");
+        VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    }
 
     // 5. display to the screen
     VkPresentInfoKHR present_info = vkinit::present_info();
@@ -116,7 +122,10 @@ void RasSubpassApp::draw() {
     present_info.waitSemaphoreCount = 1;
     present_info.pWaitSemaphores = &frame._render_semaphore;
 
-    VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    {
+        Profiler::CpuZone zone(_profiler, "present");
+        VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    }
 
     ++_frame_number;
 }
@@ -138,7 +147,7 @@ void RasSubpassApp::init_render_pass() {
     depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
     depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // subpass optimize, may not VK_ATTACHMENT_STORE_OP_STORE
-    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // do not use, VK_ATTACHMENT_STORE_OP_DONT_CARE is ok
+    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // no stencil
     depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -244,9 +253,10 @@ void RasSubpassApp::init_framebuffers() {
     const uint32_t swapchain_image_count = (uint32_t)_swapchain_images.size();
     _depth_attachment = std::vector<FrameBufferAttachment>(swapchain_image_count);
     // VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT flag is required for input attachments
-    add_attchment(_depth_attachment.data(), _DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT);
+    // transient: written in subpass 0, read in subpass 1, never stored (VK_ATTACHMENT_STORE_OP_DONT_CARE)
+    add_attchment(_depth_attachment.data(), _DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, true);
     _color_attachment = std::vector<FrameBufferAttachment>(swapchain_image_count);
-    add_attchment(_color_attachment.data(), _COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT);
+    add_attchment(_color_attachment.data(), _COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, true);
 
     // create the framebuffers for the swapchain images.
     // This will connect the render-pass to the images for rendering
@@ -279,4 +289,47 @@ void RasSubpassApp::init_framebuffers() {
             }
         }
     );
-}
\ No newline at end of file
+}
+
+void RasSubpassApp::log_memory_stats() {
+    VmaStats stats{};
+    vmaCalculateStats(_allocator, &stats);
+    const VkPhysicalDeviceMemoryProperties* memory_properties = nullptr;
+    vmaGetMemoryProperties(_allocator, &memory_properties);
+
+    for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+        const VmaStatInfo& info = stats.memoryHeap[i];
+        if (info.blockCount == 0) {
+            continue;
+        }
+        std::cout << "[Memory] heap " << i << ": " << info.blockCount << " blocks, "
+            << info.allocationCount << " allocations, "
+            << info.usedBytes / 1024 << " KiB used, " << info.unusedBytes / 1024 << " KiB unused" << std::endl;
+    }
+
+    VkDeviceSize size = 0;
+    VkDeviceSize committed = 0;
+    for (const std::vector<FrameBufferAttachment>* attachments : { &_color_attachment, &_depth_attachment }) {
+        for (const FrameBufferAttachment& attach : *attachments) {
+            VmaAllocationInfo alloc_info{};
+            vmaGetAllocationInfo(_allocator, attach._image._allocation, &alloc_info);
+            size += alloc_info.size;
+            if (attach._lazily_allocated) {
+                VkDeviceSize attach_committed = 0;
+                vkGetDeviceMemoryCommitment(_device, alloc_info.deviceMemory, &attach_committed);
+                committed += attach_committed;
+            } else {
+                committed += alloc_info.size;
+            }
+        }
+    }
+    std::cout << "[Memory] subpass attachments: " << committed / 1024 << " KiB committed / "
+        << size / 1024 << " KiB allocated" << std::endl;
+}
+
+void RasSubpassApp::draw_memory_ui() {
+    // lazily allocated memory is committed on demand, the commitment can grow while rendering
+    if (ImGui::Button("Log memory stats")) {
+        log_memory_stats();
+    }
+}
@@ -26,6 +26,10 @@ protected:
     // virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count) override;
     // virtual void init_descriptors() override;
 
+    // the VMA statistics per heap & the memory of the transient attachments actually committed
+    void log_memory_stats();
+    void draw_memory_ui();
+
     const VkFormat _COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
     std::vector<FrameBufferAttachment> _color_attachment{};
 
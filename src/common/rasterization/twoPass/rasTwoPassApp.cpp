@@ -26,6 +26,7 @@ void RasTwoPassApp::init() {
     init_descriptors();
 
     init_pipeline();
+    _pipeline_cache.log_creation_times();
 
     init_sync_structures();
 
@@ -49,25 +50,26 @@ void RasTwoPassApp::draw() {
     // blocked or timeout
     // wait until the GPU has finished rendering the last frame.
     // timeout of 1 second
-    VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
-    VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    {
+        Profiler::CpuZone zone(_profiler, "wait fence");
+        VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
+        VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    }
 
-    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+    {
+        Profiler::CpuZone zone(_profiler, "acquire");
+        acquire_swapchain_image(frame);
+    }
 
     // 2. prepare command buffer
 
-    // begin the command buffer recording.
-    VkCommandBuffer cmd = frame._main_command_buffer;
-    VK_CHECK(vkResetCommandBuffer(cmd, 0));
-
-    // We will use this command buffer exactly once
-    VkCommandBufferBeginInfo cmd_begin_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    // begin the command buffer recording & the profiler frame
+    VkCommandBuffer cmd = begin_frame_commands(frame);
 
-    render();
+    // rendering
+    render_with_zones(cmd);
 
-    VK_CHECK(vkEndCommandBuffer(cmd));
+    end_frame_commands(cmd);
 
     // 4. submit the cmd to GPU
     VkSubmitInfo submit_info = vkinit::submit_info(&cmd);
@@ -83,7 +85,10 @@ void RasTwoPassApp::draw() {
 
     // submit command buffer to the queue and execute it.
     // _renderFence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    {
+        Profiler::CpuZone zone(_profiler, "submit");
+        VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    }
 
     // 5. display to the screen
     VkPresentInfoKHR present_info = vkinit::present_info();
@@ -95,7 +100,10 @@ void RasTwoPassApp::draw() {
     present_info.waitSemaphoreCount = 1;
     present_info.pWaitSemaphores = &frame._render_semaphore;
 
-    VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    {
+        Profiler::CpuZone zone(_profiler, "present");
+        VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    }
 
     ++_frame_number;
 }
@@ -111,17 +119,18 @@ void RasTwoPassApp::init_render_pass() {
         color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // save it
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // the layouts are transitioned by the render graph
+        color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
         VkAttachmentDescription depth_attachment = {};
         depth_attachment.format = _DEPTH_FORMAT;
         depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
         depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;  // save it
+        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // only used in this pass
         depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // do not use, VK_ATTACHMENT_STORE_OP_DONT_CARE is ok
         depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
         depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
         // [2] add subpass
@@ -167,8 +176,9 @@ void RasTwoPassApp::init_render_pass() {
         color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // save it
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // the render graph transitions it to present
+        color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
         // [2] add subpass
         // subpass 0
@@ -205,33 +215,44 @@ void RasTwoPassApp::init_render_pass() {
     );
 }
 
+void RasTwoPassApp::init_render_graph() {
+    // set sampled bit (pass 1 will sample it)
+    _color_image = _render_graph.create_image("color", _COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, _window_extent);
+    _depth_image = _render_graph.create_image("depth", _DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, _window_extent);
+    _swapchain_image = _render_graph.import_image("swapchain");
+
+    _render_graph.add_pass("pass 0",
+        { { _color_image, rg::color_attachment() }, { _depth_image, rg::depth_attachment() } },
+        [this](VkCommandBuffer cmd) { render_pass0(cmd); }
+    );
+    _render_graph.add_pass("pass 1",
+        { { _color_image, rg::sampled(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) }, { _swapchain_image, rg::color_attachment() } },
+        [this](VkCommandBuffer cmd) { render_pass1(cmd); }
+    );
+    _render_graph.set_final_access(_swapchain_image, rg::present());
+
+    _render_graph.compile(_device, _allocator);
+    _main_deletion_queue.push_function([&]() { _render_graph.destroy(); });
+}
+
 void RasTwoPassApp::init_framebuffers() {
     const uint32_t swapchain_image_count = (uint32_t)_swapchain_images.size();
 
-    // add attachment
-    _depth_attachment = std::vector<FrameBufferAttachment>(swapchain_image_count);
-    add_attchment(_depth_attachment.data(), _DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
-    // set sampled bit (pass 2 will sample it)
-    _color_attachment = std::vector<FrameBufferAttachment>(swapchain_image_count);
-    add_attchment(_color_attachment.data(), _COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    // the attachments of pass 0
+    init_render_graph();
 
     // pass 0
     {
         VkFramebufferCreateInfo fb_info = vkinit::framebuffer_create_info(_render_pass, _window_extent);
-        _framebuffers = std::vector<VkFramebuffer>(swapchain_image_count);
-        // create framebuffers for each of the swapchain image views
-        for (uint32_t i = 0; i < swapchain_image_count; ++i) {
-            VkImageView iv[2] = {
-                _color_attachment[i]._image_view,
-                _depth_attachment[i]._image_view
-            };
+        VkImageView iv[2] = {
+            _render_graph.image_view(_color_image),
+            _render_graph.image_view(_depth_image)
+        };
 
-            fb_info.attachmentCount = 2;
-            fb_info.pAttachments = iv;
+        fb_info.attachmentCount = 2;
+        fb_info.pAttachments = iv;
 
-            VkFramebuffer& framebuffer = _framebuffers[i];
-            VK_CHECK(vkCreateFramebuffer(_device, &fb_info, nullptr, &framebuffer));
-        }
+        VK_CHECK(vkCreateFramebuffer(_device, &fb_info, nullptr, &_framebuffer_pass0));
     }
 
     // pass 1
@@ -255,13 +276,15 @@ void RasTwoPassApp::init_framebuffers() {
             for (VkFramebuffer& framebuffer : _framebuffers_pass1) {
                 vkDestroyFramebuffer(_device, framebuffer, nullptr);
             }
-            for (VkFramebuffer& framebuffer : _framebuffers) {
-                vkDestroyFramebuffer(_device, framebuffer, nullptr);
-            }
+            vkDestroyFramebuffer(_device, _framebuffer_pass0, nullptr);
         }
     );
 }
 
 void RasTwoPassApp::render() {
-    std::cout << "You may have to implement render(), you have to invoke vkCmdBeginRenderPass() & vkCmdEndRenderPass()" << std::endl;
+    // acquired: the semaphore is waited at the color attachment output
+    VkCommandBuffer cmd = get_current_frame()._main_command_buffer;
+    ImageAccess acquired = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+    _render_graph.set_imported_image(_swapchain_image, _swapchain_images[_swapchain_image_index], _swapchain_image_views[_swapchain_image_index], acquired);
+    _render_graph.execute(cmd);
 }
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "../rasTexApp.h"
+#include "../../renderGraph.h"
 
 // pass 0 (output: color + depth)
-// pass 1 (output: color)
+// pass 1 (input: color, output: swapchain image)
+// the barriers between the passes & the attachments of pass 0 are in `_render_graph`
 class RasTwoPassApp :public RasTexApp {
 public:
     RasTwoPassApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer) :RasTexApp(name, width, height, use_validation_layer) {}
@@ -20,11 +22,19 @@ protected:
     // virtual void init_sync_structures() override;
     virtual void init_scenes() override = 0;
     virtual void render() override;
+    // the commands of each render pass, the graph records the barriers in between
+    virtual void render_pass0(VkCommandBuffer cmd) = 0;
+    virtual void render_pass1(VkCommandBuffer cmd) = 0;
+    void init_render_graph();
     // virtual void set_shader_input(PipelineBuilder& builder, VkPipelineLayout& layout, VkDescriptorSetLayout* set_layout, uint32_t set_layout_count) override;
     // virtual void init_descriptors override();
 
     const VkFormat _COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
-    std::vector<FrameBufferAttachment> _color_attachment{};
+    RenderGraph _render_graph{};
+    RenderGraph::ImageHandle _color_image{ 0 };     // transient, the attachments of pass 0 (one for all the frames)
+    RenderGraph::ImageHandle _depth_image{ 0 };
+    RenderGraph::ImageHandle _swapchain_image{ 0 }; // imported every frame
+    VkFramebuffer _framebuffer_pass0 = VK_NULL_HANDLE;
 
     VkPipeline _pipeline_pass1 = VK_NULL_HANDLE;
     VkPipelineLayout _pipeline_layout_pass1 = VK_NULL_HANDLE;
@@ -0,0 +1,368 @@
+#include "renderGraph.h"
+#include "initializers.h"
+#include "utils.h"
+
+#include <algorithm>
+
+namespace {
+    const VkAccessFlags WRITE_ACCESS =
+        VK_ACCESS_SHADER_WRITE_BIT |
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_TRANSFER_WRITE_BIT |
+        VK_ACCESS_HOST_WRITE_BIT |
+        VK_ACCESS_MEMORY_WRITE_BIT;
+
+    VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    VkImageAspectFlags get_aspect(VkFormat format, VkImageUsageFlags usage) {
+        if (!(usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) {
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+        switch (format) {
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        }
+    }
+}
+
+ImageAccess rg::color_attachment() {
+    return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+}
+
+ImageAccess rg::depth_attachment() {
+    return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+}
+
+ImageAccess rg::sampled(VkPipelineStageFlags stages) {
+    return { stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+}
+
+ImageAccess rg::storage_read(VkPipelineStageFlags stages) {
+    return { stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+}
+
+ImageAccess rg::storage_write(VkPipelineStageFlags stages) {
+    return { stages, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+}
+
+ImageAccess rg::storage_read_write(VkPipelineStageFlags stages) {
+    return { stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+}
+
+ImageAccess rg::transfer_src() {
+    return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+}
+
+ImageAccess rg::transfer_dst() {
+    return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+}
+
+ImageAccess rg::present() {
+    // the presentation engine waits for the semaphore, nothing to make visible
+    return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+}
+
+RenderGraph::ImageHandle RenderGraph::create_image(const char* name, VkFormat format, VkImageUsageFlags usage, VkExtent2D extent) {
+    Image image{};
+    image._name = name;
+    image._transient = true;
+    image._format = format;
+    image._usage = usage;
+    image._extent = extent;
+    image._aspect = get_aspect(format, usage);
+    _images.push_back(image);
+    return static_cast<ImageHandle>(_images.size() - 1);
+}
+
+RenderGraph::ImageHandle RenderGraph::import_image(const char* name, VkImageAspectFlags aspect) {
+    Image image{};
+    image._name = name;
+    image._aspect = aspect;
+    _images.push_back(image);
+    return static_cast<ImageHandle>(_images.size() - 1);
+}
+
+void RenderGraph::add_pass(const char* name, std::vector<ImageUse> uses, RecordFunction record) {
+    if (_compiled) {
+        std::cerr << "[Render Graph] " << name << " added after the compilation" << std::endl;
+        abort();
+    }
+    _passes.push_back({ name, std::move(uses), std::move(record) });
+}
+
+void RenderGraph::set_final_access(ImageHandle image, ImageAccess access) {
+    _images[image]._has_final_access = true;
+    _images[image]._final_access = access;
+}
+
+void RenderGraph::compile(VkDevice device, VmaAllocator allocator) {
+    _device = device;
+    _allocator = allocator;
+
+    // lifetimes of the transient images
+    for (int i = 0; i < static_cast<int>(_passes.size()); ++i) {
+        for (const ImageUse& use : _passes[i]._uses) {
+            Image& image = _images[use._image];
+            if (image._first_pass < 0) {
+                image._first_pass = i;
+            }
+            image._last_pass = i;
+        }
+    }
+
+    std::vector<VkMemoryRequirements> requirements(_images.size());
+    for (uint32_t i = 0; i < _images.size(); ++i) {
+        Image& image = _images[i];
+        if (!image._transient) {
+            continue;
+        }
+        if (image._first_pass < 0) {
+            // never used: alive for the whole frame, aliased with nothing
+            image._first_pass = 0;
+            image._last_pass = static_cast<int>(_passes.size());
+        }
+        VkImageCreateInfo image_info = vkinit::image_create_info(image._format, image._usage, { image._extent.width, image._extent.height, 1 });
+        VK_CHECK(vkCreateImage(_device, &image_info, nullptr, &image._image));
+        vkGetImageMemoryRequirements(_device, image._image, &requirements[i]);
+        image._size = requirements[i].size;
+        _unaliased_memory_size += requirements[i].size;
+    }
+
+    place_transient_images(requirements);
+
+    uint32_t num_transient = 0;
+    for (Image& image : _images) {
+        if (!image._transient) {
+            continue;
+        }
+        ++num_transient;
+        VkImageViewCreateInfo view_info = vkinit::image_view_create_info(image._format, image._image, image._aspect);
+        VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &image._view));
+    }
+
+    _compiled = true;
+    std::cout << "[Render Graph] " << _passes.size() << " passes, " << num_transient << " transient images: "
+        << (_transient_memory_size >> 10) << " KiB (" << (_unaliased_memory_size >> 10) << " KiB without aliasing)" << std::endl;
+}
+
+void RenderGraph::place_transient_images(const std::vector<VkMemoryRequirements>& requirements) {
+    // the biggest first, each at the lowest offset free of the images alive at the same time
+    std::vector<ImageHandle> order;
+    for (ImageHandle i = 0; i < _images.size(); ++i) {
+        if (_images[i]._transient) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](ImageHandle a, ImageHandle b) { return requirements[a].size > requirements[b].size; });
+
+    auto lifetimes_overlap = [&](const Image& a, const Image& b) {
+        return a._first_pass <= b._last_pass && b._first_pass <= a._last_pass;
+    };
+
+    std::vector<ImageHandle> placed;
+    std::vector<ImageHandle> own_memory;
+    uint32_t memory_type_bits = ~0u;
+    VkDeviceSize alignment = 1;
+    VkDeviceSize heap_size = 0;
+    for (ImageHandle handle : order) {
+        Image& image = _images[handle];
+        const VkMemoryRequirements& requirement = requirements[handle];
+        // can't be in the same memory as the others
+        if ((memory_type_bits & requirement.memoryTypeBits) == 0) {
+            own_memory.push_back(handle);
+            continue;
+        }
+        memory_type_bits &= requirement.memoryTypeBits;
+        alignment = std::max(alignment, requirement.alignment);
+
+        VkDeviceSize offset = 0;
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (ImageHandle other_handle : placed) {
+                const Image& other = _images[other_handle];
+                if (lifetimes_overlap(image, other) && offset < other._offset + other._size && other._offset < offset + image._size) {
+                    offset = align_up(other._offset + other._size, requirement.alignment);
+                    moved = true;
+                }
+            }
+        }
+        image._offset = offset;
+        heap_size = std::max(heap_size, offset + image._size);
+
+        for (ImageHandle other_handle : placed) {
+            Image& other = _images[other_handle];
+            if (offset < other._offset + other._size && other._offset < offset + image._size) {
+                image._aliases.push_back(other_handle);
+                other._aliases.push_back(handle);
+            }
+        }
+        placed.push_back(handle);
+    }
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (!placed.empty()) {
+        VkMemoryRequirements heap_requirements = { heap_size, alignment, memory_type_bits };
+        VK_CHECK(vmaAllocateMemory(_allocator, &heap_requirements, &alloc_info, &_shared_allocation, nullptr));
+        for (ImageHandle handle : placed) {
+            VK_CHECK(vmaBindImageMemory2(_allocator, _shared_allocation, _images[handle]._offset, _images[handle]._image, nullptr));
+        }
+        _transient_memory_size += heap_size;
+    }
+    for (ImageHandle handle : own_memory) {
+        Image& image = _images[handle];
+        VK_CHECK(vmaAllocateMemoryForImage(_allocator, image._image, &alloc_info, &image._allocation, nullptr));
+        VK_CHECK(vmaBindImageMemory(_allocator, image._allocation, image._image));
+        _transient_memory_size += image._size;
+    }
+}
+
+void RenderGraph::destroy() {
+    for (Image& image : _images) {
+        if (!image._transient) {
+            continue;
+        }
+        vkDestroyImageView(_device, image._view, nullptr);
+        vkDestroyImage(_device, image._image, nullptr);
+        if (image._allocation != VK_NULL_HANDLE) {
+            vmaFreeMemory(_allocator, image._allocation);
+        }
+    }
+    if (_shared_allocation != VK_NULL_HANDLE) {
+        vmaFreeMemory(_allocator, _shared_allocation);
+    }
+    _images.clear();
+    _passes.clear();
+    _shared_allocation = VK_NULL_HANDLE;
+    _compiled = false;
+}
+
+void RenderGraph::set_imported_image(ImageHandle handle, VkImage vk_image, VkImageView view, ImageAccess access) {
+    Image& image = _images[handle];
+    image._image = vk_image;
+    image._view = view;
+
+    ImageState& state = image._state;
+    state = {};
+    state._layout = access._layout;
+    state._write_stages = access._stages;
+    state._write_access = access._access & WRITE_ACCESS;
+}
+
+void RenderGraph::add_barrier(ImageHandle handle, const ImageAccess& access, bool first_use,
+    std::vector<VkImageMemoryBarrier>& barriers, VkPipelineStageFlags& src_stages, VkPipelineStageFlags& dst_stages
+) {
+    Image& image = _images[handle];
+    ImageState& state = image._state;
+    const bool writes = (access._access & WRITE_ACCESS) != 0;
+
+    VkImageLayout old_layout = state._layout;
+    VkPipelineStageFlags src = 0;
+    VkAccessFlags src_access = 0;
+    bool transition = true;     // a write or a layout transition: the next accesses wait for it
+    if (image._transient && first_use) {
+        // the content of the last frame is discarded,
+        // the memory is free once the uses of this image & of the images aliasing it are done
+        old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        src = state._write_stages | state._read_stages;
+        src_access = state._write_access;
+        for (ImageHandle alias : image._aliases) {
+            const ImageState& alias_state = _images[alias]._state;
+            src |= alias_state._write_stages | alias_state._read_stages;
+            src_access |= alias_state._write_access;
+        }
+    } else if (old_layout == access._layout && !writes) {
+        // a read: only waits for the last write if it isn't visible to it yet
+        const bool visible = state._write_stages == 0 ||
+            ((access._stages & ~state._visible_stages) == 0 && (access._access & ~state._visible_access) == 0);
+        state._read_stages |= access._stages;
+        if (visible) {
+            return;
+        }
+        src = state._write_stages;
+        src_access = state._write_access;
+        transition = false;
+    } else {
+        // write after write / read, or a new layout
+        src = state._write_stages | state._read_stages;
+        src_access = state._write_access;
+    }
+
+    VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = access._access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = access._layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image._image;
+    barrier.subresourceRange = { image._aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+    barriers.push_back(barrier);
+
+    // nothing to wait for (first use)
+    src_stages |= (src != 0) ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    dst_stages |= access._stages;
+
+    if (transition) {
+        state._layout = access._layout;
+        state._write_stages = access._stages;
+        state._write_access = access._access & WRITE_ACCESS;
+        state._read_stages = writes ? 0 : access._stages;
+        state._visible_stages = access._stages;
+        state._visible_access = access._access;
+    } else {
+        state._visible_stages |= access._stages;
+        state._visible_access |= access._access;
+    }
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd) {
+    std::vector<bool> used(_images.size(), false);
+    std::vector<VkImageMemoryBarrier> barriers;
+
+    auto flush_barriers = [&](VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages) {
+        if (barriers.empty()) {
+            return;
+        }
+        vkCmdPipelineBarrier(cmd, src_stages, dst_stages, 0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+        barriers.clear();
+    };
+
+    for (Pass& pass : _passes) {
+        // the barriers of all the images of the pass at once
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+        for (const ImageUse& use : pass._uses) {
+            add_barrier(use._image, use._access, !used[use._image], barriers, src_stages, dst_stages);
+            used[use._image] = true;
+        }
+        flush_barriers(src_stages, dst_stages);
+
+        pass._record(cmd);
+    }
+
+    VkPipelineStageFlags src_stages = 0;
+    VkPipelineStageFlags dst_stages = 0;
+    for (ImageHandle i = 0; i < _images.size(); ++i) {
+        if (_images[i]._has_final_access) {
+            add_barrier(i, _images[i]._final_access, !used[i], barriers, src_stages, dst_stages);
+        }
+    }
+    flush_barriers(src_stages, dst_stages);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "types.h"
+
+/// <summary>
+/// how a pass uses an image: the stages & accesses of the pass, the layout the image must be in
+/// </summary>
+struct ImageAccess {
+    VkPipelineStageFlags _stages = 0;
+    VkAccessFlags _access = 0;
+    VkImageLayout _layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+namespace rg {
+    ImageAccess color_attachment();
+    ImageAccess depth_attachment();
+    ImageAccess sampled(VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    ImageAccess storage_read(VkPipelineStageFlags stages);
+    ImageAccess storage_write(VkPipelineStageFlags stages);
+    ImageAccess storage_read_write(VkPipelineStageFlags stages);
+    ImageAccess transfer_src();
+    ImageAccess transfer_dst();
+    ImageAccess present();
+}
+
+/// <summary>
+/// a frame as a list of passes that declare the images they read & write.
+///  the barriers between the passes are computed from the declared accesses (only the stages & accesses involved,
+///  batched in one vkCmdPipelineBarrier per pass), the reads of the same layout after a barrier need none.
+///  transient images: created by the graph, their content is discarded at the first use of each frame,
+///  the images whose lifetimes (first to last pass) don't overlap share memory.
+///  imported images: owned by the app (e.g. the swapchain image), their state is given every frame.
+///  the graph is built once (`add_pass` ... `compile`), `execute` records it every frame
+/// </summary>
+class RenderGraph {
+public:
+    using ImageHandle = uint32_t;
+    using RecordFunction = std::function<void(VkCommandBuffer cmd)>;
+
+    struct ImageUse {
+        ImageHandle _image{ 0 };
+        ImageAccess _access{};
+    };
+
+    ImageHandle create_image(const char* name, VkFormat format, VkImageUsageFlags usage, VkExtent2D extent);
+    ImageHandle import_image(const char* name, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+    void add_pass(const char* name, std::vector<ImageUse> uses, RecordFunction record);
+    // the state of the image after the last pass (e.g. present)
+    void set_final_access(ImageHandle image, ImageAccess access);
+
+    // creates & binds the transient images, no pass can be added afterwards
+    void compile(VkDevice device, VmaAllocator allocator);
+    void destroy();
+
+    /// <summary>
+    /// `access`: the last (or pending) use of the image before this frame,
+    /// e.g. UNDEFINED at COLOR_ATTACHMENT_OUTPUT for a swapchain image acquired with a semaphore waited at that stage
+    /// </summary>
+    void set_imported_image(ImageHandle image, VkImage vk_image, VkImageView view, ImageAccess access);
+    void execute(VkCommandBuffer cmd);
+
+    VkImage image(ImageHandle image) const { return _images[image]._image; }
+    VkImageView image_view(ImageHandle image) const { return _images[image]._view; }
+    // the memory of the transient images, with & without aliasing
+    VkDeviceSize transient_memory_size() const { return _transient_memory_size; }
+    VkDeviceSize unaliased_memory_size() const { return _unaliased_memory_size; }
+
+private:
+    struct ImageState {
+        VkImageLayout _layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags _write_stages = 0;     // the last write (or layout transition)
+        VkAccessFlags _write_access = 0;
+        VkPipelineStageFlags _read_stages = 0;      // the reads since, waited by the next write
+        VkPipelineStageFlags _visible_stages = 0;   // the last write is visible to these
+        VkAccessFlags _visible_access = 0;
+    };
+
+    struct Image {
+        std::string _name{};
+        bool _transient{ false };
+        VkFormat _format = VK_FORMAT_UNDEFINED;
+        VkImageUsageFlags _usage = 0;
+        VkExtent2D _extent{};
+        VkImageAspectFlags _aspect = 0;
+
+        VkImage _image = VK_NULL_HANDLE;
+        VkImageView _view = VK_NULL_HANDLE;
+        VmaAllocation _allocation = VK_NULL_HANDLE;  // owned if the image is not aliased in the shared allocation
+
+        // transient: the first & last pass using it, the transient images sharing memory with it
+        int _first_pass{ -1 };
+        int _last_pass{ -1 };
+        VkDeviceSize _offset{ 0 };
+        VkDeviceSize _size{ 0 };
+        std::vector<ImageHandle> _aliases{};
+
+        bool _has_final_access{ false };
+        ImageAccess _final_access{};
+        ImageState _state{};
+    };
+
+    struct Pass {
+        std::string _name{};
+        std::vector<ImageUse> _uses{};
+        RecordFunction _record{};
+    };
+
+    void place_transient_images(const std::vector<VkMemoryRequirements>& requirements);
+    // appends the barrier (if any) of `access` to the image & updates its state
+    void add_barrier(ImageHandle handle, const ImageAccess& access, bool first_use,
+        std::vector<VkImageMemoryBarrier>& barriers, VkPipelineStageFlags& src_stages, VkPipelineStageFlags& dst_stages);
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    std::vector<Image> _images{};
+    std::vector<Pass> _passes{};
+    VmaAllocation _shared_allocation = VK_NULL_HANDLE;
+    VkDeviceSize _transient_memory_size{ 0 };
+    VkDeviceSize _unaliased_memory_size{ 0 };
+    bool _compiled{ false };
+};
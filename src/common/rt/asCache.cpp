@@ -0,0 +1,129 @@
+#include "asCache.h"
+
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <cstring>
+
+namespace {
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        ASCache::Identity identity;
+        uint64_t geometry_hash;
+        uint64_t payload_size;
+        uint64_t payload_hash;  // catches truncated/partially written files
+    };
+}
+
+uint64_t ASCache::hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+ASCache::Identity ASCache::host_identity(uint32_t format_version) {
+    Identity identity;
+    identity._format_version = format_version;
+    // the layout of the node arrays depends on the pointer size & endianness
+    identity._driver_version = static_cast<uint32_t>(sizeof(void*));
+    return identity;
+}
+
+void ASCache::init(const std::string& directory, const Identity& identity) {
+    _identity = identity;
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cout << "[AS Cache] Failed to create " << directory << ", cache disabled" << std::endl;
+        _directory.clear();
+        return;
+    }
+    _directory = directory;
+}
+
+std::string ASCache::get_path(const std::string& name) const {
+    return _directory + "/" + name + ".as";
+}
+
+bool ASCache::load(const std::string& name, uint64_t geometry_hash, std::vector<uint8_t>& payload) const {
+    if (!is_enabled()) { return false; }
+
+    std::ifstream file(get_path(name), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) { return false; }
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    FileHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+    if (!file) {
+        std::cout << "[AS Cache] " << name << ": truncated header, rebuild" << std::endl;
+        return false;
+    }
+    if (header.magic != MAGIC || header.version != VERSION) {
+        std::cout << "[AS Cache] " << name << ": unknown format, rebuild" << std::endl;
+        return false;
+    }
+    if (std::memcmp(&header.identity, &_identity, sizeof(Identity)) != 0) {
+        std::cout << "[AS Cache] " << name << ": device/driver changed, rebuild" << std::endl;
+        return false;
+    }
+    if (header.geometry_hash != geometry_hash) {
+        std::cout << "[AS Cache] " << name << ": geometry changed, rebuild" << std::endl;
+        return false;
+    }
+
+    // a corrupted size must not allocate more than the file holds
+    if (header.payload_size != file_size - sizeof(FileHeader)) {
+        std::cout << "[AS Cache] " << name << ": corrupted, rebuild" << std::endl;
+        return false;
+    }
+    payload.resize(header.payload_size);
+    file.read(reinterpret_cast<char*>(payload.data()), header.payload_size);
+    if (!file || hash(payload.data(), payload.size()) != header.payload_hash) {
+        std::cout << "[AS Cache] " << name << ": corrupted, rebuild" << std::endl;
+        payload.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ASCache::save(const std::string& name, uint64_t geometry_hash, const void* payload, size_t size) const {
+    if (!is_enabled()) { return false; }
+
+    FileHeader header = {};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.identity = _identity;
+    header.geometry_hash = geometry_hash;
+    header.payload_size = size;
+    header.payload_hash = hash(payload, size);
+
+    // write to a temporary file first, a crash never leaves a half written entry behind
+    const std::string path = get_path(name);
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "[AS Cache] Failed to write " << tmp_path << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+        file.write(reinterpret_cast<const char*>(payload), size);
+        if (!file) {
+            std::cout << "[AS Cache] Failed to write " << tmp_path << std::endl;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/// <summary>
+/// on-disk cache of built acceleration structures (GPU serialized BLAS / CPU BVH node arrays)
+///  one file per entry: `<directory>/<name>.as`
+///  a file is only used if the identity (device & driver) and the geometry hash both match,
+///  otherwise it is rebuilt and overwritten
+/// </summary>
+class ASCache {
+public:
+    static const uint32_t MAGIC = 0x43534142; // "BASC"
+    static const uint32_t VERSION = 1;
+    static const uint32_t UUID_SIZE = 16;     // VK_UUID_SIZE
+
+    struct Identity {
+        uint8_t _device_uuid[UUID_SIZE]{};
+        uint8_t _driver_uuid[UUID_SIZE]{};
+        uint32_t _driver_version{ 0 };
+        uint32_t _format_version{ 0 };        // layout of the payload (bump when the builder changes)
+    };
+
+    // FNV-1a, chain with `seed` to hash several arrays
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+    /// <summary>
+    /// host-only identity, for the CPU BVH the payload only depends on our own code
+    /// </summary>
+    static Identity host_identity(uint32_t format_version);
+
+    void init(const std::string& directory, const Identity& identity);
+    bool is_enabled() const { return !_directory.empty(); }
+
+    /// <summary>
+    /// false if missing, from another device/driver, stale geometry or corrupted
+    /// </summary>
+    bool load(const std::string& name, uint64_t geometry_hash, std::vector<uint8_t>& payload) const;
+    bool save(const std::string& name, uint64_t geometry_hash, const void* payload, size_t size) const;
+
+private:
+    std::string get_path(const std::string& name) const;
+
+    std::string _directory{};
+    Identity _identity{};
+};
@@ -0,0 +1,284 @@
+#include "cpuBVH.h"
+#include "asCache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+namespace {
+    float surface_area(const vec3& bmin, const vec3& bmax) {
+        const vec3 e = bmax - bmin;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // slab test, return the entry distance (FLT_MAX when miss)
+    float intersect_aabb(const CPURay& ray, const vec3& inv_dir, const vec3& bmin, const vec3& bmax, const float tmax) {
+        const vec3 t0 = (bmin - ray._origin) * inv_dir;
+        const vec3 t1 = (bmax - ray._origin) * inv_dir;
+        const vec3 t_near = glm::min(t0, t1);
+        const vec3 t_far = glm::max(t0, t1);
+        const float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, ray._tmin));
+        const float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, tmax));
+        return (t_enter <= t_exit) ? t_enter : FLT_MAX;
+    }
+}
+
+void CPUBVH::build(const vec3* positions, uint32_t num_triangles) {
+    _positions = positions;
+    _num_triangles = num_triangles;
+
+    _prim_indices.resize(num_triangles);
+    std::vector<vec3> centroids(num_triangles);
+    for (uint32_t i = 0; i < num_triangles; ++i) {
+        _prim_indices[i] = i;
+        centroids[i] = (positions[3 * i + 0] + positions[3 * i + 1] + positions[3 * i + 2]) / 3.0f;
+    }
+
+    _nodes.clear();
+    _nodes.reserve(2 * static_cast<size_t>(num_triangles) + 1);
+    CPUBVHNode root = {};
+    root._left_or_first = 0;
+    root._count = static_cast<int>(num_triangles);
+    _nodes.push_back(root);
+    update_bounds(_nodes[0]);
+    if (num_triangles == 0) { return; }
+    subdivide(0, 0, centroids);
+}
+
+void CPUBVH::update_bounds(CPUBVHNode& node) const {
+    node._min = vec3(FLT_MAX);
+    node._max = vec3(-FLT_MAX);
+    for (int i = 0; i < node._count; ++i) {
+        const uint32_t tri = _prim_indices[node._left_or_first + i];
+        for (int j = 0; j < 3; ++j) {
+            node._min = glm::min(node._min, _positions[3 * tri + j]);
+            node._max = glm::max(node._max, _positions[3 * tri + j]);
+        }
+    }
+}
+
+void CPUBVH::subdivide(int node_index, int depth, std::vector<vec3>& centroids) {
+    const int first = _nodes[node_index]._left_or_first;
+    const int count = _nodes[node_index]._count;
+    // the traversal stack is bounded by the depth
+    if (count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH) { return; }
+
+    // centroid bounds
+    vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+    for (int i = 0; i < count; ++i) {
+        const vec3& c = centroids[_prim_indices[first + i]];
+        cmin = glm::min(cmin, c);
+        cmax = glm::max(cmax, c);
+    }
+
+    // binned SAH
+    int best_axis = -1, best_split = -1;
+    float best_cost = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float extent = cmax[axis] - cmin[axis];
+        if (extent <= 0.0f) { continue; }
+
+        vec3 bin_min[SAH_BINS], bin_max[SAH_BINS];
+        int bin_count[SAH_BINS] = {};
+        for (int b = 0; b < SAH_BINS; ++b) {
+            bin_min[b] = vec3(FLT_MAX);
+            bin_max[b] = vec3(-FLT_MAX);
+        }
+        const float scale = SAH_BINS / extent;
+        for (int i = 0; i < count; ++i) {
+            const uint32_t tri = _prim_indices[first + i];
+            const int b = std::min(SAH_BINS - 1, static_cast<int>((centroids[tri][axis] - cmin[axis]) * scale));
+            ++bin_count[b];
+            for (int j = 0; j < 3; ++j) {
+                bin_min[b] = glm::min(bin_min[b], _positions[3 * tri + j]);
+                bin_max[b] = glm::max(bin_max[b], _positions[3 * tri + j]);
+            }
+        }
+
+        // sweep from the right, then from the left
+        float right_area[SAH_BINS - 1];
+        int right_count[SAH_BINS - 1];
+        vec3 rmin(FLT_MAX), rmax(-FLT_MAX);
+        int rcount = 0;
+        for (int b = SAH_BINS - 1; b > 0; --b) {
+            rcount += bin_count[b];
+            rmin = glm::min(rmin, bin_min[b]);
+            rmax = glm::max(rmax, bin_max[b]);
+            right_count[b - 1] = rcount;
+            right_area[b - 1] = rcount ? surface_area(rmin, rmax) : 0.0f;
+        }
+        vec3 lmin(FLT_MAX), lmax(-FLT_MAX);
+        int lcount = 0;
+        for (int b = 0; b < SAH_BINS - 1; ++b) {
+            lcount += bin_count[b];
+            lmin = glm::min(lmin, bin_min[b]);
+            lmax = glm::max(lmax, bin_max[b]);
+            if (lcount == 0 || right_count[b] == 0) { continue; }
+            const float cost = lcount * surface_area(lmin, lmax) + right_count[b] * right_area[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    CPUBVHNode& node = _nodes[node_index];
+    const float leaf_cost = count * surface_area(node._min, node._max);
+    int mid = first;
+    if (best_axis == -1 || best_cost >= leaf_cost) {
+        // all centroids are the same or splitting is not better, fallback to median split when too large
+        if (count <= 4 * MAX_LEAF_SIZE) { return; }
+        mid = first + count / 2;
+    } else {
+        const float scale = SAH_BINS / (cmax[best_axis] - cmin[best_axis]);
+        auto it = std::partition(_prim_indices.begin() + first, _prim_indices.begin() + first + count,
+            [&](uint32_t tri) {
+                const int b = std::min(SAH_BINS - 1, static_cast<int>((centroids[tri][best_axis] - cmin[best_axis]) * scale));
+                return b <= best_split;
+            }
+        );
+        mid = static_cast<int>(it - _prim_indices.begin());
+    }
+
+    const int left_count = mid - first;
+    if (left_count == 0 || left_count == count) { return; }
+
+    // children are stored next to each other
+    const int left_index = static_cast<int>(_nodes.size());
+    CPUBVHNode left = {}, right = {};
+    left._left_or_first = first;
+    left._count = left_count;
+    right._left_or_first = mid;
+    right._count = count - left_count;
+    _nodes.push_back(left);
+    _nodes.push_back(right);
+    update_bounds(_nodes[left_index]);
+    update_bounds(_nodes[left_index + 1]);
+
+    // `node` may be invalid after push_back
+    _nodes[node_index]._left_or_first = left_index;
+    _nodes[node_index]._count = 0;
+
+    subdivide(left_index, depth + 1, centroids);
+    subdivide(left_index + 1, depth + 1, centroids);
+}
+
+std::vector<uint8_t> CPUBVH::serialize() const {
+    // [num_triangles, num_nodes][nodes][prim indices]
+    const uint64_t counts[2] = { _num_triangles, _nodes.size() };
+    const size_t nodes_size = _nodes.size() * sizeof(CPUBVHNode);
+    const size_t prims_size = _prim_indices.size() * sizeof(uint32_t);
+
+    std::vector<uint8_t> data(sizeof(counts) + nodes_size + prims_size);
+    std::memcpy(data.data(), counts, sizeof(counts));
+    std::memcpy(data.data() + sizeof(counts), _nodes.data(), nodes_size);
+    std::memcpy(data.data() + sizeof(counts) + nodes_size, _prim_indices.data(), prims_size);
+    return data;
+}
+
+bool CPUBVH::deserialize(const vec3* positions, uint32_t num_triangles, const std::vector<uint8_t>& data) {
+    uint64_t counts[2];
+    if (data.size() < sizeof(counts)) { return false; }
+    std::memcpy(counts, data.data(), sizeof(counts));
+
+    const size_t nodes_size = counts[1] * sizeof(CPUBVHNode);
+    const size_t prims_size = static_cast<size_t>(num_triangles) * sizeof(uint32_t);
+    if (counts[0] != num_triangles || counts[1] == 0 || data.size() != sizeof(counts) + nodes_size + prims_size) {
+        return false;
+    }
+
+    _positions = positions;
+    _num_triangles = num_triangles;
+    _nodes.resize(counts[1]);
+    _prim_indices.resize(num_triangles);
+    std::memcpy(_nodes.data(), data.data() + sizeof(counts), nodes_size);
+    std::memcpy(_prim_indices.data(), data.data() + sizeof(counts) + nodes_size, prims_size);
+    return true;
+}
+
+uint64_t CPUBVH::get_build_hash(uint64_t seed) {
+    const int params[3] = { MAX_LEAF_SIZE, SAH_BINS, MAX_DEPTH };
+    return ASCache::hash(params, sizeof(params), seed);
+}
+
+bool CPUBVH::intersect(const CPURay& ray, CPUHit& hit) const {
+    hit._prim_id = -1;
+    if (_nodes.empty() || _num_triangles == 0) { return false; }
+
+    const vec3 inv_dir = 1.0f / ray._direction;
+    int stack[MAX_DEPTH + 2];
+    int stack_ptr = 0;
+    int node_index = 0;
+    if (intersect_aabb(ray, inv_dir, _nodes[0]._min, _nodes[0]._max, hit._t) == FLT_MAX) { return false; }
+
+    while (true) {
+        const CPUBVHNode& node = _nodes[node_index];
+        if (node._count > 0) {
+            for (int i = 0; i < node._count; ++i) {
+                const uint32_t tri = _prim_indices[node._left_or_first + i];
+                if (intersect_triangle(ray, _positions[3 * tri + 0], _positions[3 * tri + 1], _positions[3 * tri + 2], hit._t, hit._barycentrics)) {
+                    hit._prim_id = static_cast<int>(tri);
+                }
+            }
+        } else {
+            // visit the nearer child first
+            int c0 = node._left_or_first;
+            int c1 = c0 + 1;
+            float d0 = intersect_aabb(ray, inv_dir, _nodes[c0]._min, _nodes[c0]._max, hit._t);
+            float d1 = intersect_aabb(ray, inv_dir, _nodes[c1]._min, _nodes[c1]._max, hit._t);
+            if (d0 > d1) {
+                std::swap(d0, d1);
+                std::swap(c0, c1);
+            }
+            if (d0 != FLT_MAX) {
+                if (d1 != FLT_MAX) {
+                    stack[stack_ptr++] = c1;
+                }
+                node_index = c0;
+                continue;
+            }
+        }
+
+        // pop, skip the nodes farther than the current hit
+        bool found = false;
+        while (stack_ptr > 0) {
+            node_index = stack[--stack_ptr];
+            if (intersect_aabb(ray, inv_dir, _nodes[node_index]._min, _nodes[node_index]._max, hit._t) != FLT_MAX) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) { break; }
+    }
+    return hit._prim_id != -1;
+}
+
+bool CPUBVH::occluded(const CPURay& ray) const {
+    if (_nodes.empty() || _num_triangles == 0) { return false; }
+
+    const vec3 inv_dir = 1.0f / ray._direction;
+    int stack[MAX_DEPTH + 2];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = 0;
+    float t = ray._tmax;
+    vec2 bary;
+
+    while (stack_ptr > 0) {
+        const CPUBVHNode& node = _nodes[stack[--stack_ptr]];
+        if (intersect_aabb(ray, inv_dir, node._min, node._max, ray._tmax) == FLT_MAX) { continue; }
+        if (node._count > 0) {
+            for (int i = 0; i < node._count; ++i) {
+                const uint32_t tri = _prim_indices[node._left_or_first + i];
+                // terminate on first hit
+                if (intersect_triangle(ray, _positions[3 * tri + 0], _positions[3 * tri + 1], _positions[3 * tri + 2], t, bary)) {
+                    return true;
+                }
+            }
+        } else {
+            stack[stack_ptr++] = node._left_or_first;
+            stack[stack_ptr++] = node._left_or_first + 1;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// host side ray, same convention as traceRayEXT(origin, tmin, direction, tmax)
+/// </summary>
+struct CPURay {
+    vec3 _origin;
+    float _tmin;
+    vec3 _direction;
+    float _tmax;
+};
+
+/// <summary>
+/// _prim_id == -1 means miss
+/// _barycentrics is the same as `hitAttributeEXT vec2`
+/// </summary>
+struct CPUHit {
+    float _t;
+    int _prim_id;
+    vec2 _barycentrics;
+};
+
+struct CPUBVHNode {
+    vec3 _min;
+    int _left_or_first; // leaf: first primitive, inner: left child (right child = left + 1)
+    vec3 _max;
+    int _count;         // 0 means inner node
+};
+
+// Moller-Trumbore, t in (tmin, tmax)
+inline bool intersect_triangle(const CPURay& ray, const vec3& v0, const vec3& v1, const vec3& v2, float& t, vec2& bary) {
+    const vec3 e1 = v1 - v0;
+    const vec3 e2 = v2 - v0;
+    const vec3 p = glm::cross(ray._direction, e2);
+    const float det = glm::dot(e1, p);
+    // no culling, the same as gl_RayFlagsOpaqueEXT without cull flags
+    if (std::abs(det) < 1e-12f) { return false; }
+    const float inv_det = 1.0f / det;
+
+    const vec3 s = ray._origin - v0;
+    const float u = glm::dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) { return false; }
+
+    const vec3 q = glm::cross(s, e1);
+    const float v = glm::dot(ray._direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) { return false; }
+
+    const float tt = glm::dot(e2, q) * inv_det;
+    if (tt <= ray._tmin || tt >= t) { return false; }
+
+    t = tt;
+    bary = vec2(u, v);
+    return true;
+}
+
+/// <summary>
+/// binary BVH (binned SAH) over a triangle soup, 3 vertices per triangle
+/// </summary>
+class CPUBVH {
+public:
+    static const int MAX_LEAF_SIZE = 4;
+    static const int SAH_BINS = 12;
+    static const int MAX_DEPTH = 62;
+    // bump when the builder or the node layout changes, invalidates the `ASCache` entries
+    static const uint32_t FORMAT_VERSION = 1;
+
+    void build(const vec3* positions, uint32_t num_triangles);
+
+    /// <summary>
+    /// node arrays as a flat blob (for `ASCache`), `deserialize` returns false on a size mismatch
+    /// </summary>
+    std::vector<uint8_t> serialize() const;
+    bool deserialize(const vec3* positions, uint32_t num_triangles, const std::vector<uint8_t>& data);
+
+    // the build parameters, folded into the cache key
+    static uint64_t get_build_hash(uint64_t seed);
+
+    /// <summary>
+    /// closest hit, hit._t should be initialized as ray._tmax
+    /// </summary>
+    bool intersect(const CPURay& ray, CPUHit& hit) const;
+
+    /// <summary>
+    /// any hit (shadow ray)
+    /// </summary>
+    bool occluded(const CPURay& ray) const;
+
+    uint32_t get_num_triangles() const { return _num_triangles; }
+
+    std::vector<CPUBVHNode> _nodes{};
+    std::vector<uint32_t> _prim_indices{};
+
+private:
+    void subdivide(int node_index, int depth, std::vector<vec3>& centroids);
+    void update_bounds(CPUBVHNode& node) const;
+
+    const vec3* _positions{ nullptr };
+    uint32_t _num_triangles{ 0 };
+};
@@ -0,0 +1,130 @@
+#include "cpuDenoiser.h"
+#include "cpuTracer.h"
+#include "cpuParallel.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    vec3 demodulate(vec3 color, vec3 albedo) {
+        return color / glm::max(albedo, vec3(1e-3f));
+    }
+}
+
+void CPUDenoiser::denoise(const CPUTracer& tracer, int num_iterations, uint32_t num_threads) {
+    _width = tracer.get_width();
+    _height = tracer.get_height();
+    const size_t num_pixels = static_cast<size_t>(_width) * _height;
+    _ping.resize(num_pixels);
+    _pong.resize(num_pixels);
+    _result_image.resize(num_pixels);
+
+    // the same passes as `RTApp::fill_denoise_command_buffer`
+    cpu_parallel::parallel_for(_height, num_threads, [&](uint32_t y) { prepare_row(tracer, y); });
+    for (int i = 1; i <= num_iterations; ++i) {
+        const std::vector<vec4>& src = (i % 2 == 1) ? _ping : _pong;
+        std::vector<vec4>& dst = (i % 2 == 1) ? _pong : _ping;
+        cpu_parallel::parallel_for(_height, num_threads, [&](uint32_t y) { atrous_row(tracer, src, dst, i, y); });
+    }
+
+    // remodulation
+    const std::vector<vec4>& filtered = (num_iterations % 2 == 1) ? _pong : _ping;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        if (tracer._normal_depth_image[i].w < 0.0f) {
+            _result_image[i] = tracer._accumulated_image[i];
+        } else {
+            _result_image[i] = vec4(vec3(filtered[i]) * vec3(tracer._albedo_image[i]), 1.0f);
+        }
+    }
+}
+
+void CPUDenoiser::prepare_row(const CPUTracer& tracer, uint32_t y) {
+    for (uint32_t x = 0; x < _width; ++x) {
+        const size_t p = static_cast<size_t>(y) * _width + x;
+        const vec3 albedo = vec3(tracer._albedo_image[p]);
+        const vec3 color = demodulate(vec3(tracer._accumulated_image[p]), albedo);
+        const vec4 stats = tracer._variance_image[p];
+
+        // the variance of the pixel mean: per-pixel statistics, or the neighbors while there are too few samples
+        float variance = 0.0f;
+        if (stats.z >= float(SWS_DENOISE_MIN_TEMPORAL_SPP)) {
+            const float albedo_lum = std::max(Luminance(albedo), 1e-3f);
+            variance = stats.y / (stats.z * (stats.z - 1.0f)) / (albedo_lum * albedo_lum);
+        } else {
+            float sum = 0.0f, sum2 = 0.0f, count = 0.0f;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const int qx = static_cast<int>(x) + dx;
+                    const int qy = static_cast<int>(y) + dy;
+                    if (qx < 0 || qy < 0 || qx >= static_cast<int>(_width) || qy >= static_cast<int>(_height)) { continue; }
+                    const size_t q = static_cast<size_t>(qy) * _width + qx;
+                    if (tracer._normal_depth_image[q].w < 0.0f) { continue; }
+                    const float lum = Luminance(demodulate(vec3(tracer._accumulated_image[q]), vec3(tracer._albedo_image[q])));
+                    sum += lum;
+                    sum2 += lum * lum;
+                    count += 1.0f;
+                }
+            }
+            if (count > 0.0f) {
+                variance = std::max(sum2 / count - (sum / count) * (sum / count), 0.0f);
+            }
+        }
+        _ping[p] = vec4(color, variance);
+    }
+}
+
+void CPUDenoiser::atrous_row(const CPUTracer& tracer, const std::vector<vec4>& src, std::vector<vec4>& dst, int iteration, uint32_t y) const {
+    const int step = 1 << (iteration - 1);
+    const int w = static_cast<int>(_width);
+    const int h = static_cast<int>(_height);
+
+    for (int x = 0; x < w; ++x) {
+        const size_t p = static_cast<size_t>(y) * _width + x;
+        const vec4 normal_depth_p = tracer._normal_depth_image[p];
+        const vec4 center = src[p];
+        if (normal_depth_p.w < 0.0f) {
+            dst[p] = center;
+            continue;
+        }
+
+        // 3x3 gaussian of the variance, less noisy luminance edges
+        float variance = 0.0f, variance_weight = 0.0f;
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                const int qx = x + dx;
+                const int qy = static_cast<int>(y) + dy;
+                if (qx < 0 || qy < 0 || qx >= w || qy >= h) { continue; }
+                const float k = ((dx == 0) ? 2.0f : 1.0f) * ((dy == 0) ? 2.0f : 1.0f);
+                variance += k * src[static_cast<size_t>(qy) * _width + qx].w;
+                variance_weight += k;
+            }
+        }
+        const float lum_std = std::sqrt(variance / variance_weight);
+        const float lum_p = Luminance(vec3(center));
+
+        vec3 sum_color = vec3(0.0f);
+        float sum_variance = 0.0f;
+        float sum_weight = 0.0f;
+        for (int dy = -2; dy <= 2; ++dy) {
+            const int qy = static_cast<int>(y) + dy * step;
+            if (qy < 0 || qy >= h) { continue; }
+            for (int dx = -2; dx <= 2; ++dx) {
+                const int qx = x + dx * step;
+                if (qx < 0 || qx >= w) { continue; }
+                const size_t q = static_cast<size_t>(qy) * _width + qx;
+                const vec4 tap = src[q];
+                const float weight = AtrousKernelWeight(dx) * AtrousKernelWeight(dy)
+                    * DenoiseEdgeWeight(normal_depth_p, tracer._normal_depth_image[q], lum_p, Luminance(vec3(tap)), lum_std, float(step));
+                sum_color += weight * vec3(tap);
+                sum_variance += weight * weight * tap.w;
+                sum_weight += weight;
+            }
+        }
+        dst[p] = (sum_weight > 0.0f) ? vec4(sum_color / sum_weight, sum_variance / (sum_weight * sum_weight)) : center;
+    }
+}
+
+bool CPUDenoiser::save_result_image(const std::string& path) const {
+    return CPUTracer::save_pfm(path, _result_image, _width, _height);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class CPUTracer;
+
+/// <summary>
+/// CPU version of `atrous.comp` for the headless runs: the same passes & weights (`DenoiseEdgeWeight`)
+/// multithreaded by rows, the inner loops are plain float math the compiler vectorizes
+/// </summary>
+class CPUDenoiser {
+public:
+    /// <summary>
+    /// prepare pass (demodulation + variance) and `num_iterations` a-trous passes
+    /// on the accumulated, albedo, normal & depth and variance images of `tracer`
+    /// num_threads = 0: use all the hardware threads
+    /// </summary>
+    void denoise(const CPUTracer& tracer, int num_iterations, uint32_t num_threads = 0);
+
+    /// <summary>
+    /// denoised image (linear, rgba32f) -> *.pfm
+    /// </summary>
+    bool save_result_image(const std::string& path) const;
+
+    // row major: y * width + x, linear (remodulated)
+    std::vector<vec4> _result_image{};
+
+private:
+    void prepare_row(const CPUTracer& tracer, uint32_t y);
+    void atrous_row(const CPUTracer& tracer, const std::vector<vec4>& src, std::vector<vec4>& dst, int iteration, uint32_t y) const;
+
+    uint32_t _width{ 0 };
+    uint32_t _height{ 0 };
+    // demodulated color, w: variance
+    std::vector<vec4> _ping{};
+    std::vector<vec4> _pong{};
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+// the threading of the CPU reference: the tiles of `CPUTracer`, the rows of the denoiser & the tables
+namespace cpu_parallel {
+    /// <summary>
+    /// calls `fn(i)` for i in [0, num_items), the items are fetched in order until all the items are done
+    /// `num_threads` = 0: one per core, the calling thread is one of them
+    /// </summary>
+    template <typename Fn>
+    void parallel_for(uint32_t num_items, uint32_t num_threads, Fn&& fn) {
+        if (num_threads == 0) {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        num_threads = std::max(1u, std::min(num_threads, num_items));
+
+        std::atomic<uint32_t> next_item{ 0 };
+        auto worker = [&]() {
+            uint32_t i;
+            while ((i = next_item.fetch_add(1)) < num_items) {
+                fn(i);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+        for (uint32_t i = 1; i < num_threads; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+}
@@ -0,0 +1,249 @@
+#include "cpuScene.h"
+#include "ppg.h"
+
+#include "tiny_obj_loader.h"
+#include "stb_image.h"
+
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+    // sRGB -> linear, the same as sampling a `VK_FORMAT_R8G8B8A8_SRGB` image
+    struct SrgbTable {
+        float v[256];
+        SrgbTable() {
+            for (int i = 0; i < 256; ++i) {
+                const float c = i / 255.0f;
+                v[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+    const SrgbTable s_srgb_table;
+
+    int wrap(int x, int size) {
+        x %= size;
+        return x < 0 ? x + size : x;
+    }
+}
+
+vec3 CPUTexture::sample(vec2 uv) const {
+    if (_width == 0 || _height == 0) { return vec3(0.0f); }
+
+    // texel center at 0.5
+    const float x = uv.x * _width - 0.5f;
+    const float y = uv.y * _height - 0.5f;
+    const float fx0 = std::floor(x);
+    const float fy0 = std::floor(y);
+    const float wx = x - fx0;
+    const float wy = y - fy0;
+    const int x0 = wrap(static_cast<int>(fx0), _width);
+    const int y0 = wrap(static_cast<int>(fy0), _height);
+    const int x1 = wrap(x0 + 1, _width);
+    const int y1 = wrap(y0 + 1, _height);
+
+    auto fetch = [&](int px, int py) {
+        const uint8_t* p = _pixels.data() + 4 * (static_cast<size_t>(py) * _width + px);
+        return vec3(s_srgb_table.v[p[0]], s_srgb_table.v[p[1]], s_srgb_table.v[p[2]]);
+    };
+
+    const vec3 c0 = Lerp(fetch(x0, y0), fetch(x1, y0), wx);
+    const vec3 c1 = Lerp(fetch(x0, y1), fetch(x1, y1), wx);
+    return Lerp(c0, c1, wy);
+}
+
+bool CPUScene::load(const std::string& path, const ASCache* cache) {
+    // 1. tinyobj loading
+    tinyobj::attrib_t attrib;                       // vertex
+    std::vector<tinyobj::shape_t> shapes;           // objects
+    std::vector<tinyobj::material_t> materials;     // materials
+    std::string warn, err;                          // loading info
+
+    // assume the *.mtl file is in the same dir
+    std::string base_dir = std::string(path);
+    {
+        size_t idx = base_dir.rfind('/');
+        if (idx == std::string::npos) {
+            base_dir = "";
+        } else {
+            base_dir = base_dir.substr(0, idx);
+        }
+    }
+
+    // trianglulate = true by default
+    const bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), base_dir.c_str(), true);
+    if (!warn.empty()) {
+        std::cout << "[Obj Loading] " << path << ", Warning: " << warn << std::endl;
+    }
+    if (!err.empty()) {
+        std::cout << "[Obj Loading] " << path << ", Error: " << err << std::endl;
+    }
+    if (!ret) {
+        return false;
+    }
+
+    // 2. aabb, the scene is normalized to [0, 1]^3 (the same as the STree domain)
+    const float inf = 1e5;
+    Interval3D aabb = { inf,-inf, inf,-inf, inf,-inf, };
+    for (const tinyobj::shape_t& shape : shapes) {
+        for (const tinyobj::index_t& i : shape.mesh.indices) {
+            for (int k = 0; k < 3; ++k) {
+                const float v = attrib.vertices[3 * i.vertex_index + k];
+                aabb.v[k][0] = std::min(v, aabb.v[k][0]);
+                aabb.v[k][1] = std::max(v, aabb.v[k][1]);
+            }
+        }
+    }
+    auto get_position = [&](int vertex_index) {
+        vec3 pos;
+        for (int k = 0; k < 3; ++k) {
+            pos[k] = (attrib.vertices[3 * vertex_index + k] - aabb.v[k][0]) / (aabb.v[k][1] - aabb.v[k][0]);
+        }
+        return pos;
+    };
+
+    _positions.clear();
+    _attribs.clear();
+    _mat_IDs.clear();
+
+    // 3. per mesh data, vertex normals are averaged inside each mesh
+    for (const tinyobj::shape_t& shape : shapes) {
+        const size_t num_faces = shape.mesh.num_face_vertices.size();
+
+        std::vector<vec3> normal_sum(attrib.vertices.size() / 3 + 1, vec3(0.0f));
+        std::vector<int> normal_count(normal_sum.size(), 0);
+        for (size_t f = 0; f < num_faces; ++f) {
+            assert(shape.mesh.num_face_vertices[f] == 3); // triangulate
+            const tinyobj::index_t* idx = &shape.mesh.indices[3 * f];
+            const vec3 p0 = get_position(idx[0].vertex_index);
+            const vec3 p1 = get_position(idx[1].vertex_index);
+            const vec3 p2 = get_position(idx[2].vertex_index);
+            const vec3 ab_normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+            for (int j = 0; j < 3; ++j) {
+                normal_sum[idx[j].vertex_index] += ab_normal;
+                ++normal_count[idx[j].vertex_index];
+            }
+        }
+
+        for (size_t f = 0; f < num_faces; ++f) {
+            for (int j = 0; j < 3; ++j) {
+                const tinyobj::index_t& i = shape.mesh.indices[3 * f + j];
+                VertexAttribute attr = {};
+                attr.normal = vec4(normal_sum[i.vertex_index] / static_cast<float>(normal_count[i.vertex_index]), 0.0f);
+                if (i.texcoord_index == -1) {
+                    attr.uv = vec4(0.0f);
+                } else {
+                    attr.uv = vec4(attrib.texcoords[2 * i.texcoord_index + 0], attrib.texcoords[2 * i.texcoord_index + 1], 0.0f, 0.0f);
+                }
+                _positions.push_back(get_position(i.vertex_index));
+                _attribs.push_back(attr);
+            }
+            _mat_IDs.push_back(static_cast<uint32_t>(shape.mesh.material_ids[f]));
+        }
+    }
+
+    // 4. textures, the materials failed to load are removed (the same as the GPU texture array)
+    _textures.clear();
+    for (const tinyobj::material_t& src_mat : materials) {
+        std::string full_texture_path = base_dir + "/" + src_mat.diffuse_texname;
+        CPUTexture texture;
+        int channels;
+        stbi_uc* pixels = stbi_load(full_texture_path.c_str(), &texture._width, &texture._height, &channels, STBI_rgb_alpha); // force RGBA
+        if (!pixels) {
+            std::cout << "[Image]: Failed to load " << full_texture_path << std::endl;
+            continue;
+        }
+        texture._pixels.assign(pixels, pixels + 4 * static_cast<size_t>(texture._width) * texture._height);
+        stbi_image_free(pixels);
+        _textures.push_back(std::move(texture));
+    }
+
+    // 5. bvh, the binary one comes from the cache if possible (collapsing it to the wide one is cheap)
+    auto start = std::chrono::high_resolution_clock::now();
+    bool cached = false;
+    std::string cache_name;
+    uint64_t geometry_hash = 0;
+    if (cache && cache->is_enabled()) {
+        std::stringstream ss;
+        ss << "cpu_bvh_" << std::hex << std::setw(16) << std::setfill('0') << ASCache::hash(path.data(), path.size());
+        cache_name = ss.str();
+        geometry_hash = CPUBVH::get_build_hash(ASCache::hash(_positions.data(), _positions.size() * sizeof(vec3)));
+
+        std::vector<uint8_t> payload;
+        cached = cache->load(cache_name, geometry_hash, payload) && _bvh.deserialize(_positions.data(), get_num_triangles(), payload);
+    }
+    if (!cached) {
+        _bvh.build(_positions.data(), get_num_triangles());
+        if (!cache_name.empty()) {
+            const std::vector<uint8_t> payload = _bvh.serialize();
+            cache->save(cache_name, geometry_hash, payload.data(), payload.size());
+        }
+    }
+    _wide_bvh.build(_bvh, _positions.data());
+    auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+    std::cout << "[CPU Scene] " << get_num_triangles() << " triangles, " << _bvh._nodes.size() << " bvh nodes" << (cached ? " (cached)" : "") << ", "
+        << _wide_bvh.get_num_nodes() << " wide nodes (" << CPUWideBVH::get_isa_name(_wide_bvh.get_isa()) << "), build time: " << delta.count() << "s" << std::endl;
+
+    std::cout << "[Obj Loading] successfully load \"" << path << "\"" << std::endl;
+    return true;
+}
+
+bool CPUScene::load_env_map(const std::string& path) {
+    int channels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &_env_texture._width, &_env_texture._height, &channels, STBI_rgb_alpha); // force RGBA
+    if (!pixels) {
+        std::cout << "[Image]: Failed to load " << path << std::endl;
+        _env_texture = CPUTexture();
+        return false;
+    }
+    _env_texture._pixels.assign(pixels, pixels + 4 * static_cast<size_t>(_env_texture._width) * _env_texture._height);
+    stbi_image_free(pixels);
+
+    _env_distribution.build(_env_texture._pixels.data(), _env_texture._width, _env_texture._height);
+    return true;
+}
+
+void CPUScene::build_emitters(int light_id) {
+    _emitters.clear();
+    for (uint32_t i = 0; i < get_num_triangles(); ++i) {
+        if (_mat_IDs[i] != static_cast<uint32_t>(light_id)) { continue; }
+        EmitterTriangle emitter;
+        emitter.v0 = vec4(_positions[3 * i + 0], 0.0f);
+        emitter.v1 = vec4(_positions[3 * i + 1], 0.0f);
+        emitter.v2 = vec4(_positions[3 * i + 2], 0.0f);
+        _emitters.push_back(emitter);
+    }
+    _emitters_area = BuildEmitterCdf(_emitters.data(), static_cast<uint32_t>(_emitters.size()));
+    std::cout << "[CPU Scene] " << _emitters.size() << " emitter triangles, area: " << _emitters_area << std::endl;
+}
+
+RayPayload CPUScene::closest_hit(const CPUHit& hit) const {
+    const vec3 barycentrics = vec3(1.0f - hit._barycentrics.x - hit._barycentrics.y, hit._barycentrics.x, hit._barycentrics.y);
+
+    const uint32_t matID = _mat_IDs[hit._prim_id];
+    const VertexAttribute& v0 = _attribs[3 * hit._prim_id + 0];
+    const VertexAttribute& v1 = _attribs[3 * hit._prim_id + 1];
+    const VertexAttribute& v2 = _attribs[3 * hit._prim_id + 2];
+
+    // interpolate our vertex attribs
+    const vec3 normal = glm::normalize(BaryLerp(vec3(v0.normal), vec3(v1.normal), vec3(v2.normal), barycentrics));
+    const vec2 uv = BaryLerp(vec2(v0.uv), vec2(v1.uv), vec2(v2.uv), barycentrics);
+
+    const vec3 texel = (matID < _textures.size()) ? _textures[matID].sample(uv) : vec3(0.0f);
+
+    RayPayload payload;
+    payload.colorAndDist = vec4(texel, hit._t);
+    payload.normalAndObjId = vec4(normal, static_cast<float>(matID));
+    return payload;
+}
+
+RayPayload CPUScene::miss(const CPURay& ray) const {
+    RayPayload payload;
+    payload.colorAndDist = vec4(_env_texture.sample(EnvDistribution::direction_to_uv(ray._direction)), -1.0f);
+    payload.normalAndObjId = vec4(0.0f);
+    return payload;
+}
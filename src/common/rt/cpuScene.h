@@ -0,0 +1,76 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+#include "cpuBVH.h"
+#include "cpuWideBVH.h"
+#include "asCache.h"
+#include "envDistribution.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/// <summary>
+/// RGBA8 sRGB texture, sampled as `VK_FORMAT_R8G8B8A8_SRGB` + `VK_FILTER_LINEAR` + `REPEAT`
+/// </summary>
+struct CPUTexture {
+    int _width{ 0 };
+    int _height{ 0 };
+    std::vector<uint8_t> _pixels{};
+
+    vec3 sample(vec2 uv) const;
+};
+
+/// <summary>
+/// host side copy of the scene in `RTApp::init_scenes`, all the meshes are merged into one triangle soup
+/// </summary>
+class CPUScene {
+public:
+    /// <summary>
+    /// the same loading process as `RTApp::init_scenes`
+    /// (positions normalized to [0, 1]^3, averaged vertex normals)
+    /// the binary bvh is read from `cache` when the geometry is unchanged (nullptr: always build)
+    /// </summary>
+    bool load(const std::string& path, const ASCache* cache = nullptr);
+
+    // wide bvh, falls back to the binary one when there is no SIMD support
+    bool intersect(const CPURay& ray, CPUHit& hit) const { return _wide_bvh.intersect(ray, hit); }
+    bool occluded(const CPURay& ray) const { return _wide_bvh.occluded(ray); }
+
+    /// <summary>
+    /// the same as `ray_chit.rchit`
+    /// </summary>
+    RayPayload closest_hit(const CPUHit& hit) const;
+
+    /// <summary>
+    /// the same as `ray_miss.rmiss`
+    /// </summary>
+    RayPayload miss(const CPURay& ray) const;
+
+    /// <summary>
+    /// lat-long environment map & its sampling distribution, the same as `RTApp::init_scenes`
+    /// </summary>
+    bool load_env_map(const std::string& path);
+
+    /// <summary>
+    /// emitter triangles (area cdf) of the material `light_id`, the same as `RTApp::init_scenes`
+    /// </summary>
+    void build_emitters(int light_id);
+
+    uint32_t get_num_triangles() const { return static_cast<uint32_t>(_mat_IDs.size()); }
+
+    // 3 per triangle
+    std::vector<vec3> _positions{};
+    std::vector<VertexAttribute> _attribs{};
+    // 1 per triangle
+    std::vector<uint32_t> _mat_IDs{};
+    std::vector<CPUTexture> _textures{};
+    CPUTexture _env_texture{};
+    EnvDistribution _env_distribution{};
+
+    std::vector<EmitterTriangle> _emitters{};
+    float _emitters_area{ 0.0f };
+
+    CPUBVH _bvh{};
+    CPUWideBVH _wide_bvh{};
+};
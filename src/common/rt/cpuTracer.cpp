@@ -0,0 +1,738 @@
+#include "cpuTracer.h"
+#include "cpuParallel.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const float kBunnyRefractionIndex = 1.0f / 1.31f; // ice
+    const vec3 kLightEmission = vec3(30.0f);
+    const float MY_PI = 3.1415926535897932384626433832795f;
+
+    // random sampler start (the same as `ray_gen.rgen`)
+    uint32_t InitRandomSeed(uint32_t val0, uint32_t val1) {
+        uint32_t v0 = val0, v1 = val1, s0 = 0;
+
+        for (uint32_t n = 0; n < 16; n++) {
+            s0 += 0x9e3779b9;
+            v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+            v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+        }
+        return v0;
+    }
+
+    uint32_t RandomInt(uint32_t& seed) {
+        // LCG values from Numerical Recipes
+        return (seed = 1664525 * seed + 1013904223);
+    }
+
+    float RandomFloat(uint32_t& seed) {
+        return (float(RandomInt(seed) & 0x00FFFFFF) / float(0x01000000));
+    }
+
+    vec3 random_cosine_direction(const vec2& u) {
+        float r1 = u.x;
+        float r2 = u.y;
+        float z = std::sqrt(1 - r2);
+
+        float phi = MY_PI * 2 * r1;
+        float x = std::cos(phi) * std::sqrt(r2);
+        float y = std::sin(phi) * std::sqrt(r2);
+        return vec3(x, y, z);
+    }
+
+    // low-discrepancy sampler (the same as `ray_gen.rgen`)
+    struct SamplerState {
+        uint32_t index;
+        uint32_t seed;
+        uint32_t bounce_index;
+        uint32_t bounce_seed;
+        int type;
+        const SamplerTables* tables;
+    };
+
+    uint32_t hash_u32(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32_t bitfield_reverse(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1u;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return x;
+    }
+
+    uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return bitfield_reverse(laine_karras_permutation(bitfield_reverse(x), seed));
+    }
+
+    uint32_t sobol(const SamplerTables& tables, uint32_t index, uint32_t dim) {
+        uint32_t x = 0;
+        for (uint32_t bit = 0; index != 0; index >>= 1, ++bit) {
+            if (index & 1u) {
+                x ^= tables.get_sobol_column(dim, bit);
+            }
+        }
+        return x;
+    }
+
+    float uint_to_unit_float(uint32_t x) {
+        return float(x >> 8) / float(0x01000000);
+    }
+
+    SamplerState init_sampler(const SamplerTables& tables, int type, uint32_t x, uint32_t y, int spp) {
+        const uint32_t tile_x = x / SWS_BLUE_NOISE_SIZE;
+        const uint32_t tile_y = y / SWS_BLUE_NOISE_SIZE;
+        SamplerState s;
+        s.index = static_cast<uint32_t>(spp - 1) ^ tables.get_blue_noise_rank(x, y);
+        s.seed = hash_u32(tile_x ^ hash_u32(tile_y));
+        s.bounce_index = s.index;
+        s.bounce_seed = s.seed;
+        s.type = type;
+        s.tables = &tables;
+        return s;
+    }
+
+    void sampler_start_bounce(SamplerState& s, int bounce) {
+        s.bounce_seed = hash_u32(s.seed ^ static_cast<uint32_t>(bounce));
+        s.bounce_index = nested_uniform_scramble(s.index << 16, s.bounce_seed) >> 16;
+    }
+
+    float sample_1d(uint32_t& wseed, const SamplerState& s, int dim) {
+        if (s.type != SWS_SAMPLER_SOBOL) {
+            return RandomFloat(wseed);
+        }
+        return uint_to_unit_float(nested_uniform_scramble(sobol(*s.tables, s.bounce_index, dim), hash_u32(s.bounce_seed ^ (dim + 1))));
+    }
+
+    vec2 sample_2d(uint32_t& wseed, const SamplerState& s, int dim) {
+        if (s.type != SWS_SAMPLER_SOBOL) {
+            const float r1 = RandomFloat(wseed);
+            const float r2 = RandomFloat(wseed);
+            return vec2(r1, r2);
+        }
+        return vec2(
+            uint_to_unit_float(nested_uniform_scramble(sobol(*s.tables, s.bounce_index, dim), hash_u32(s.bounce_seed ^ (dim + 1)))),
+            uint_to_unit_float(nested_uniform_scramble(sobol(*s.tables, s.bounce_index, dim + 1), hash_u32(s.bounce_seed ^ (dim + 2)))));
+    }
+    // random sampler end
+
+    vec2 xyz2thetaphi(vec3 xyz) {
+        xyz = glm::normalize(xyz);
+        float cos_theta = Clamp(xyz.z, -1.0f, 1.0f);
+        float phi = std::atan2(xyz.y, xyz.x);
+        if (phi < 0) { phi += BB_PI2; }
+        return vec2((cos_theta + 1.0f) / 2.0f, phi / BB_PI2);
+    }
+
+    int get_dtree_index(const vec3& position, const STree* s_root) {
+        int index = 0;
+        int depth = 0;
+        const STree* now = s_root + index;
+        // have child, recursive
+        while (now->_child_index[0] != -1) {
+            int sub_time = (depth / 3);
+            int p_index = depth % 3;
+            int c_idx_idx = 1;
+            if (position[p_index] < 1.0f / (2 << sub_time)) {
+                c_idx_idx = 0;
+            }
+            index = now->_child_index[c_idx_idx];
+            now = s_root + index;
+            ++depth;
+        }
+        return index;
+    }
+
+    void sample_lambertian(const vec2& u, const vec3& normal, vec3& direction, float& pdf) {
+        const vec3 localDirection = random_cosine_direction(u);
+        pdf = localDirection.z / MY_PI;
+
+        // the same frame as the shader (left hand)
+        const vec3 a = (std::abs(normal[0]) > 0.9f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+        const vec3 c1 = glm::normalize(glm::cross(normal, a));
+        const vec3 c0 = glm::cross(normal, c1);
+
+        direction = c0 * localDirection.x + c1 * localDirection.y + normal * localDirection.z;
+    }
+
+    void eval_lambertian(const vec3& normal, const vec3& direction, float& pdf) {
+        pdf = glm::dot(normal, glm::normalize(direction)) / MY_PI;
+    }
+
+    float eval_sampling_pdf(const vec3& normal, const vec3& direction, int dindex, const GuideTables& guide_tables) {
+        float bsdf_pdf;
+        eval_lambertian(normal, direction, bsdf_pdf);
+        if (dindex < 0) {
+            return bsdf_pdf;
+        }
+        return 0.5f * (bsdf_pdf + guide_tables.pdf(dindex, direction));
+    }
+
+    vec3 sample_emitter(float u, const vec2& u_point, const std::vector<EmitterTriangle>& emitters, int num_emitters, vec3& normal) {
+        // binary search on the area cdf
+        int lo = 0;
+        int hi = num_emitters - 1;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            if (emitters[mid].v0.w < u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        const vec3 v0 = vec3(emitters[lo].v0);
+        const vec3 v1 = vec3(emitters[lo].v1);
+        const vec3 v2 = vec3(emitters[lo].v2);
+
+        const float r1 = std::sqrt(u_point.x);
+        const float r2 = u_point.y;
+        normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+        return v0 * (1.0f - r1) + v1 * (r1 * (1.0f - r2)) + v2 * (r1 * r2);
+    }
+
+    float power_heuristic(float pdf_a, float pdf_b) {
+        const float a2 = pdf_a * pdf_a;
+        const float b2 = pdf_b * pdf_b;
+        return (a2 + b2 > 0.0f) ? a2 / (a2 + b2) : 0.0f;
+    }
+}
+
+CPUTracer::CPUTracer(const CPUScene* scene) : _scene(scene) {
+    _sampler_tables.build();
+}
+
+void CPUTracer::resize(uint32_t width, uint32_t height) {
+    _width = width;
+    _height = height;
+    _tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    _tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    const size_t num_pixels = static_cast<size_t>(width) * height;
+    _result_image.assign(num_pixels, vec4(0.0f));
+    _accumulated_image.assign(num_pixels, vec4(0.0f));
+    _variance_image.assign(num_pixels, vec4(0.0f));
+    _albedo_image.assign(num_pixels, vec4(0.0f));
+    _normal_depth_image.assign(num_pixels, vec4(0.0f, 0.0f, 0.0f, -1.0f));
+    _radiance_cache.assign(num_pixels, RecordPerPixel{});
+
+    _adaptive_tiles_x = (width + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+    _adaptive_tiles_y = (height + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+    reset_active_tiles();
+}
+
+void CPUTracer::reset_active_tiles() {
+    _active_tiles.resize(_adaptive_tiles_x * _adaptive_tiles_y);
+    for (uint32_t i = 0; i < _active_tiles.size(); ++i) {
+        _active_tiles[i] = i;
+    }
+}
+
+uint32_t CPUTracer::update_active_tiles(float threshold) {
+    uint32_t num_active = 0;
+    for (uint32_t tile_index : _active_tiles) {
+        const uint32_t x0 = (tile_index % _adaptive_tiles_x) * SWS_ADAPTIVE_TILE_SIZE;
+        const uint32_t y0 = (tile_index / _adaptive_tiles_x) * SWS_ADAPTIVE_TILE_SIZE;
+        const uint32_t x1 = std::min(x0 + SWS_ADAPTIVE_TILE_SIZE, _width);
+        const uint32_t y1 = std::min(y0 + SWS_ADAPTIVE_TILE_SIZE, _height);
+
+        float tile_error = 0.0f;
+        for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+                tile_error = std::max(tile_error, PixelRelativeError(_variance_image[static_cast<size_t>(y) * _width + x]));
+            }
+        }
+        if (tile_error > threshold) {
+            _active_tiles[num_active++] = tile_index;
+        }
+    }
+    _active_tiles.resize(num_active);
+    return num_active;
+}
+
+void CPUTracer::set_sdtree(const STree* s_root, const GuideTables& guide_tables) {
+    _stree = s_root;
+    _guide_on = (s_root != nullptr);
+    if (_guide_on) {
+        _guide_tables = guide_tables;
+    }
+}
+
+void CPUTracer::render(const UniformParams& params, uint32_t num_threads) {
+    // adaptive sampling: the work items are the active tiles
+    const bool adaptive = (params.adaptive_on == 1);
+    const uint32_t num_tiles = adaptive ? static_cast<uint32_t>(_active_tiles.size()) : _tiles_x * _tiles_y;
+
+    // temporal reprojection: the previous frame, the same as the copy before `vkCmdTraceRaysKHR`
+    if (params.reproject_on == 1) {
+        _history_color = _accumulated_image;
+        _history_stats = _variance_image;
+        _history_normal_depth = _normal_depth_image;
+    }
+
+    // tile scheduler: tiles are fetched in scanline order
+    cpu_parallel::parallel_for(num_tiles, num_threads, [&](uint32_t i) {
+        if (adaptive) {
+            const uint32_t tile_index = _active_tiles[i];
+            render_tile(params, (tile_index % _adaptive_tiles_x) * SWS_ADAPTIVE_TILE_SIZE, (tile_index / _adaptive_tiles_x) * SWS_ADAPTIVE_TILE_SIZE, SWS_ADAPTIVE_TILE_SIZE);
+        } else {
+            render_tile(params, (i % _tiles_x) * TILE_SIZE, (i / _tiles_x) * TILE_SIZE, TILE_SIZE);
+        }
+    });
+
+    // the same as `RTApp::fill_radiance_grid_command_buffer`
+    if (params.grid_on == 1) {
+        _radiance_grid.resolve();
+    }
+}
+
+void CPUTracer::render_tile(const UniformParams& params, uint32_t x0, uint32_t y0, uint32_t tile_size) {
+    const uint32_t x1 = std::min(x0 + tile_size, _width);
+    const uint32_t y1 = std::min(y0 + tile_size, _height);
+
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            const size_t pixel = static_cast<size_t>(y) * _width + x;
+
+            // per-pixel sample count, the same as `accumulate_spp` when every pixel is traced
+            // reprojecting: the history is found after the primary hit, the frame is the sample index
+            vec4 stats = (params.accumulate_spp == 1 || params.reproject_on == 1) ? vec4(0.0f) : _variance_image[pixel];
+            const uint32_t sample_index = (params.reproject_on == 1) ? static_cast<uint32_t>(params.accumulate_spp) : static_cast<uint32_t>(stats.z) + 1;
+
+            vec3 finalColor = trace_path(params, x, y, sample_index, _albedo_image[pixel], _normal_depth_image[pixel]);
+
+            vec3 history = vec3(0.0f);
+            if (params.reproject_on == 1) {
+                reproject_history(params, x, y, _normal_depth_image[pixel], history, stats);
+            } else if (stats.z > 0.0f) {
+                history = vec3(_accumulated_image[pixel]);
+            }
+            const uint32_t spp = static_cast<uint32_t>(stats.z) + 1;
+            _variance_image[pixel] = UpdatePixelStats(stats, finalColor);
+
+            if (spp != 1) {
+                finalColor = (finalColor + float(spp - 1) * history) / float(spp);
+            }
+
+            _accumulated_image[pixel] = vec4(finalColor, 1.0f);
+            finalColor = LinearToSrgb(finalColor);
+            _result_image[pixel] = vec4(finalColor * params.light_strength, 1.0f);
+        }
+    }
+}
+
+vec3 CPUTracer::camera_ray_dir(const UniformParams& params, uint32_t x, uint32_t y) const {
+    // CalcRayDir
+    const vec2 uv = (vec2(float(x), float(y)) / vec2(float(_width - 1), float(_height - 1))) * 2.0f - 1.0f;
+    const float aspect = float(_width) / float(_height);
+    const float planeWidth = std::tan(params.camNearFarFov.z * 0.5f);
+    const vec3 u = vec3(params.camSide) * (planeWidth * aspect);
+    const vec3 v = vec3(params.camUp) * planeWidth;
+    return glm::normalize(vec3(params.camDir) + (u * uv.x) - (v * uv.y));
+}
+
+bool CPUTracer::reproject_history(const UniformParams& params, uint32_t x, uint32_t y, const vec4& normal_depth, vec3& history, vec4& stats) const {
+    history = vec3(0.0f);
+    stats = vec4(0.0f);
+    if (normal_depth.w < 0.0f) {
+        return false;
+    }
+    const float aspect = float(_width) / float(_height);
+    const vec3 position = vec3(params.camPos) + camera_ray_dir(params, x, y) * normal_depth.w;
+    const vec3 prev_uv = ProjectToCamera(position, vec3(params.prevCamPos), vec3(params.prevCamDir), vec3(params.prevCamUp), vec3(params.prevCamSide), params.prevCamPos.w, aspect);
+    if (prev_uv.z <= 0.0f) {
+        return false;
+    }
+    const float expected_depth = glm::length(position - vec3(params.prevCamPos));
+    const vec2 prev_pixel = (vec2(prev_uv) * 0.5f + 0.5f) * vec2(float(_width - 1), float(_height - 1));
+    const vec2 p0 = glm::floor(prev_pixel);
+    const vec2 f = prev_pixel - p0;
+
+    float sum_weight = 0.0f;
+    float sum_weight2 = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        const int qx = static_cast<int>(p0.x) + (i & 1);
+        const int qy = static_cast<int>(p0.y) + (i >> 1);
+        if (qx < 0 || qy < 0 || qx >= static_cast<int>(_width) || qy >= static_cast<int>(_height)) {
+            continue;
+        }
+        const size_t q = static_cast<size_t>(qy) * _width + qx;
+        if (!TemporalTapValid(normal_depth, _history_normal_depth[q], expected_depth)) {
+            continue;
+        }
+        const float w = (((i & 1) != 0) ? f.x : 1.0f - f.x) * (((i >> 1) != 0) ? f.y : 1.0f - f.y);
+        history += w * vec3(_history_color[q]);
+        stats += w * _history_stats[q];
+        sum_weight += w;
+        sum_weight2 += w * w;
+    }
+    if (sum_weight < SWS_TEMPORAL_MIN_WEIGHT) {
+        history = vec3(0.0f);
+        stats = vec4(0.0f);
+        return false;
+    }
+    history /= sum_weight;
+    stats = ClampHistoryStats(stats / sum_weight);
+    // the bilinear blend averages the noise of the taps
+    stats.y *= sum_weight2 / (sum_weight * sum_weight);
+    return true;
+}
+
+vec3 CPUTracer::trace_path(const UniformParams& params, uint32_t x, uint32_t y, uint32_t spp, vec4& albedo, vec4& normal_depth) {
+    const float tmin = 0.0f;
+    const float tmax = params.camNearFarFov.y;
+
+    vec3 finalColor = vec3(0.0f, 0.0f, 0.0f);
+
+    uint32_t wseed = InitRandomSeed(InitRandomSeed(x, y), spp);
+    SamplerState ld_sampler = init_sampler(_sampler_tables, params.sampler_type, x, y, static_cast<int>(spp));
+
+    const uint32_t rc_index = x * _height + y;
+    RecordPerPixel& rc = _radiance_cache[rc_index];
+
+    vec3 origin = vec3(params.camPos);
+    vec3 direction = camera_ray_dir(params, x, y);
+    vec3 throughput = vec3(1.0f, 1.0f, 1.0f);
+    float throughout_pdf = 1.0f;
+
+    vec3 weight_iter[SWS_MAX_RECURSION];
+    vec3 position_iter[SWS_MAX_RECURSION];
+    vec2 direction_iter[SWS_MAX_RECURSION];
+
+    const bool ppg_test_on = (params.ppg_test_on == 1) && _guide_on;
+
+    // next-event estimation
+    const int num_emitters = std::min(params.num_emitters, static_cast<int>(_scene->_emitters.size()));
+    const float env_light_prob = (_scene->_env_distribution.get_integral() > 0.0f) ? params.env_light_prob : 0.0f;
+    const bool nee_on = (params.nee_on == 1) && (num_emitters > 0 || env_light_prob > 0.0f);
+    bool last_bounce_nee = false;
+    float last_bounce_pdf = 1.0f;
+
+    // denoiser guides of the first non-specular vertex, the specular chains are followed
+    albedo = vec4(1.0f);
+    normal_depth = vec4(0.0f, 0.0f, 0.0f, -1.0f);
+    bool guides_done = false;
+    float path_length = 0.0f;
+
+    // radiance grid: the diffuse vertices of the path, the footprint of the path & the distance since the last diffuse vertex
+    const bool grid_on = (params.grid_on == 1);
+    vec3 grid_position[SWS_MAX_RECURSION];
+    vec3 grid_normal[SWS_MAX_RECURSION];
+    vec3 grid_weight[SWS_MAX_RECURSION];
+    vec3 grid_color[SWS_MAX_RECURSION];
+    int grid_num = 0;
+    float grid_footprint0 = 0.0f;
+    float grid_spread_sum = 0.0f;
+    float grid_distance = 0.0f;
+
+    // guard
+    rc.num = 0;
+
+    // ppg training: the radiance `li` reaching the vertex `length` is walked back to the camera
+    auto record_radiance = [&](int length, vec3 li) {
+        rc.num = std::min(length, RECORD_NUM);
+        for (int j = length - 1; j >= 0; --j) {
+            li *= weight_iter[j];
+            if (j < RECORD_NUM) {
+                rc.record[j].p = vec4(position_iter[j], (li.x + li.y + li.z) / 3.0f);
+                rc.record[j].d = vec4(direction_iter[j], 0.0f, 0.0f);
+            }
+        }
+    };
+
+    for (int i = 0; i < SWS_MAX_RECURSION; ++i) {
+        weight_iter[i] = vec3(1.0f, 1.0f, 1.0f);
+        sampler_start_bounce(ld_sampler, i);
+
+        // traceRayEXT
+        RayPayload PrimaryRay;
+        {
+            CPURay ray = { origin, tmin, direction, tmax };
+            CPUHit hit = {};
+            hit._t = tmax;
+            // total internal reflection gives a zero direction
+            if (glm::dot(direction, direction) > 0.0f && _scene->intersect(ray, hit)) {
+                PrimaryRay = _scene->closest_hit(hit);
+            } else {
+                PrimaryRay = _scene->miss(ray);
+            }
+        }
+
+        const vec3 hitColor = vec3(PrimaryRay.colorAndDist);
+        const float hitDistance = PrimaryRay.colorAndDist.w;
+
+        // if hit background - quit
+        if (hitDistance < 0.0f) {
+            const vec3 env_color = params.env_strength * hitColor;
+            float mis_weight = 1.0f;
+            if (last_bounce_nee && env_light_prob > 0.0f) {
+                mis_weight = power_heuristic(last_bounce_pdf, env_light_prob * _scene->_env_distribution.pdf(direction));
+            }
+            finalColor += mis_weight * env_color * throughput / throughout_pdf;
+
+            if (params.ppg_train_on == 1) {
+                record_radiance(i, env_color);
+            }
+            break;
+        }
+
+        const vec3 hitNormal = vec3(PrimaryRay.normalAndObjId);
+        const float objectId = PrimaryRay.normalAndObjId.w;
+
+        const vec3 hitPos = origin + direction * hitDistance;
+        path_length += hitDistance;
+        grid_distance += hitDistance;
+
+        if (objectId == float(params.mirror_id)) {
+            origin = hitPos + hitNormal * 0.001f;
+            direction = glm::reflect(direction, hitNormal);
+            last_bounce_nee = false;
+        } else if (objectId == float(params.glass_id)) {
+            const float NdotD = glm::dot(hitNormal, direction);
+            vec3 refrNormal = hitNormal;
+            float refrEta;
+            if (NdotD > 0.0f) {
+                refrNormal = -hitNormal;
+                refrEta = 1.0f / kBunnyRefractionIndex;
+            } else {
+                refrNormal = hitNormal;
+                refrEta = kBunnyRefractionIndex;
+            }
+
+            origin = hitPos + direction * 0.001f;
+            direction = glm::refract(direction, refrNormal, refrEta);
+            last_bounce_nee = false;
+        } else if (objectId == float(params.light_id)) {
+            // hit light
+            vec3 fixed_light_color = kLightEmission;
+            // noise free, passed through by the denoiser like the background
+            guides_done = true;
+            float mis_weight = 1.0f;
+            if (last_bounce_nee) {
+                const float cos_light = std::max(std::abs(glm::dot(hitNormal, direction)), 1e-6f);
+                const float light_pdf = (1.0f - env_light_prob) * hitDistance * hitDistance / (cos_light * params.emitters_area);
+                mis_weight = power_heuristic(last_bounce_pdf, light_pdf);
+            }
+            finalColor += mis_weight * fixed_light_color * throughput / throughout_pdf;
+
+            if (params.ppg_train_on == 1) {
+                record_radiance(i, fixed_light_color);
+            }
+            break;
+        } else {
+            // we hit diffuse primitive - simple lambertian
+            float pdf;
+
+            if (!guides_done) {
+                albedo = vec4(hitColor, 1.0f);
+                normal_depth = vec4(hitNormal, path_length);
+                guides_done = true;
+            }
+
+            if (grid_on) {
+                const float cos_in = std::max(std::abs(glm::dot(hitNormal, direction)), 1e-4f);
+                if (grid_num == 0) {
+                    grid_footprint0 = grid_distance * grid_distance / (4.0f * MY_PI * cos_in);
+                } else {
+                    grid_spread_sum += std::sqrt(grid_distance * grid_distance / (last_bounce_pdf * cos_in));
+                }
+                grid_distance = 0.0f;
+
+                // the path is wide enough, the cached radiance ends it
+                vec3 cached;
+                if (i >= params.grid_start_bounce && grid_spread_sum * grid_spread_sum > params.grid_footprint * grid_footprint0
+                    && _radiance_grid.query(hitPos, hitNormal, cached)) {
+                    finalColor += cached * throughput / throughout_pdf;
+                    if (params.ppg_train_on == 1) {
+                        record_radiance(i, cached);
+                    }
+                    break;
+                }
+                grid_position[grid_num] = hitPos;
+                grid_normal[grid_num] = hitNormal;
+                grid_weight[grid_num] = throughput / throughout_pdf;
+                grid_color[grid_num] = finalColor;
+                ++grid_num;
+            }
+
+            int dindex = -1;
+            if (ppg_test_on) {
+                dindex = get_dtree_index(hitPos, _stree);
+                if (!_guide_tables.valid(dindex)) {
+                    dindex = -1;
+                }
+            }
+
+            // next-event estimation: the emitters or the environment (`env_light_prob`)
+            if (nee_on) {
+                float u_choice = sample_1d(wseed, ld_sampler, SWS_DIM_LIGHT_CHOICE);
+                const vec2 u_point = sample_2d(wseed, ld_sampler, SWS_DIM_LIGHT_POINT);
+                vec3 toLight;
+                float dist, light_pdf;
+                vec3 light_color;
+                bool valid;
+                if (u_choice < env_light_prob) {
+                    float env_pdf;
+                    toLight = _scene->_env_distribution.sample(u_point, env_pdf);
+                    // the shadow ray escapes the scene
+                    dist = tmax;
+                    light_pdf = env_light_prob * env_pdf;
+                    light_color = params.env_strength * vec3(_scene->miss({ hitPos, tmin, toLight, tmax }).colorAndDist);
+                    valid = env_pdf > 0.0f;
+                } else {
+                    // the remaining choices pick the emitter triangle
+                    u_choice = std::min((u_choice - env_light_prob) / (1.0f - env_light_prob), 0.99999994f);
+                    vec3 lightNormal;
+                    const vec3 lightPos = sample_emitter(u_choice, u_point, _scene->_emitters, num_emitters, lightNormal);
+                    toLight = lightPos - hitPos;
+                    const float dist2 = glm::dot(toLight, toLight);
+                    dist = std::sqrt(dist2);
+                    toLight /= dist;
+                    const float cos_light = std::abs(glm::dot(lightNormal, toLight));
+                    light_pdf = (1.0f - env_light_prob) * dist2 / (cos_light * params.emitters_area);
+                    light_color = kLightEmission;
+                    valid = cos_light > 1e-6f;
+                }
+                const float cos_surface = glm::dot(hitNormal, toLight);
+
+                if (cos_surface > 0.0f && valid) {
+                    const CPURay shadow_ray = { hitPos + hitNormal * 0.001f, tmin, toLight, dist - 0.002f };
+                    if (!_scene->occluded(shadow_ray)) {
+                        float mis_weight = 1.0f;
+                        if (i + 1 < SWS_MAX_RECURSION) {
+                            mis_weight = power_heuristic(light_pdf, eval_sampling_pdf(hitNormal, toLight, dindex, _guide_tables));
+                        }
+                        finalColor += mis_weight * light_color * throughput / throughout_pdf * hitColor * (cos_surface / MY_PI) / light_pdf;
+                    }
+                }
+            }
+
+            if (ppg_test_on) {
+                // MIS
+                if (dindex < 0) {
+                    // only BRDF
+                    sample_lambertian(sample_2d(wseed, ld_sampler, SWS_DIM_BSDF), hitNormal, direction, pdf);
+                } else {
+                    float pdf1, pdf2;
+                    if (sample_1d(wseed, ld_sampler, SWS_DIM_GUIDE_CHOICE) < 0.5f) {
+                        // the same order as the shader: the position in the cell, then the cell
+                        const vec2 u = sample_2d(wseed, ld_sampler, SWS_DIM_BSDF);
+                        const float u_cell = sample_1d(wseed, ld_sampler, SWS_DIM_GUIDE_CELL);
+                        direction = _guide_tables.sample(dindex, u_cell, u, pdf1);
+                        if (glm::dot(hitNormal, direction) < 0.0) {
+                            // stop if no contribution
+                            break;
+                        } else {
+                            eval_lambertian(hitNormal, direction, pdf2);
+                        }
+                    } else {
+                        // only BRDF
+                        sample_lambertian(sample_2d(wseed, ld_sampler, SWS_DIM_BSDF), hitNormal, direction, pdf2);
+                        pdf1 = _guide_tables.pdf(dindex, direction);
+                    }
+                    pdf = 0.5f * (pdf1 + pdf2);
+                }
+            } else {
+                // only BRDF
+                sample_lambertian(sample_2d(wseed, ld_sampler, SWS_DIM_BSDF), hitNormal, direction, pdf);
+            }
+
+            float bsdf_val;
+            eval_lambertian(hitNormal, direction, bsdf_val);
+
+            origin = hitPos + hitNormal * 0.001f;
+            throughput *= bsdf_val * hitColor;
+            throughout_pdf *= pdf;
+            last_bounce_nee = nee_on;
+            last_bounce_pdf = pdf;
+
+            if (params.ppg_train_on == 1) {
+                position_iter[i] = hitPos;
+                direction_iter[i] = xyz2thetaphi(direction);
+                weight_iter[i] = bsdf_val * hitColor / pdf;
+            }
+        }
+
+        // russian roulette
+        if (i + 1 >= params.rr_depth) {
+            const vec3 beta = throughput / throughout_pdf;
+            const float survival = Clamp(std::max(beta.r, std::max(beta.g, beta.b)), 0.05f, 0.95f);
+            if (sample_1d(wseed, ld_sampler, SWS_DIM_RR) >= survival) {
+                break;
+            }
+            throughput /= survival;
+            weight_iter[i] /= survival;
+        }
+    }
+
+    // the outgoing radiance of the recorded vertices (the paths ended by the grid included)
+    for (int j = 0; j < grid_num; ++j) {
+        _radiance_grid.update(grid_position[j], grid_normal[j], (finalColor - grid_color[j]) / glm::max(grid_weight[j], vec3(1e-6f)));
+    }
+
+    return finalColor;
+}
+
+bool CPUTracer::save_result_image(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "[CPU Tracer] Failed to open " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << _width << " " << _height << "\n255\n";
+    std::vector<uint8_t> row(3 * static_cast<size_t>(_width));
+    for (uint32_t y = 0; y < _height; ++y) {
+        for (uint32_t x = 0; x < _width; ++x) {
+            const vec4& c = _result_image[static_cast<size_t>(y) * _width + x];
+            for (int k = 0; k < 3; ++k) {
+                // unorm store
+                row[3 * x + k] = static_cast<uint8_t>(Clamp(c[k], 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return true;
+}
+
+bool CPUTracer::save_accumulated_image(const std::string& path) const {
+    return save_pfm(path, _accumulated_image, _width, _height);
+}
+
+bool CPUTracer::save_pfm(const std::string& path, const std::vector<vec4>& pixels, uint32_t width, uint32_t height) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "[CPU Tracer] Failed to open " << path << std::endl;
+        return false;
+    }
+    // negative scale: little endian
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::vector<float> row(3 * static_cast<size_t>(width));
+    // pfm is stored bottom to top
+    for (uint32_t y = height; y-- > 0; ) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const vec4& c = pixels[static_cast<size_t>(y) * width + x];
+            row[3 * x + 0] = c.r;
+            row[3 * x + 1] = c.g;
+            row[3 * x + 2] = c.b;
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+    return true;
+}
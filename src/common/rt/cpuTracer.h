@@ -0,0 +1,110 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+#include "cpuScene.h"
+#include "ppg.h"
+#include "samplerTables.h"
+#include "radianceGrid.h"
+#include "guideTables.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/// <summary>
+/// CPU reference of `ray_gen.rgen`: the same material branches, random numbers and SDTree guiding
+/// multithreaded, every thread fetches TILE_SIZE x TILE_SIZE tiles until all the tiles are done
+/// </summary>
+class CPUTracer {
+public:
+    static const uint32_t TILE_SIZE = 16;
+
+    CPUTracer(const CPUScene* scene);
+
+    void resize(uint32_t width, uint32_t height);
+
+    /// <summary>
+    /// the trained SDTree & its DTrees compiled by `PPGSchedule` (the same as the GPU), nullptr means ppg testing is unavailable
+    /// </summary>
+    void set_sdtree(const STree* s_root, const GuideTables& guide_tables);
+
+    /// <summary>
+    /// the same as one `vkCmdTraceRaysKHR` call, accumulated by the per-pixel sample count (`params.accumulate_spp` = 1: reset)
+    /// params.adaptive_on: only the active SWS_ADAPTIVE_TILE_SIZE tiles are traced
+    /// params.reproject_on: the history of the previous call is reprojected from the `params.prevCam*` camera
+    /// params.grid_on: the radiance grid is queried & updated by the paths, resolved after the launch
+    /// num_threads = 0: use all the hardware threads
+    /// </summary>
+    void render(const UniformParams& params, uint32_t num_threads = 0);
+
+    /// <summary>
+    /// radiance grid: all the cells are empty (a new accumulation after the settings changed)
+    /// </summary>
+    void clear_radiance_grid() { _radiance_grid.clear(); }
+
+    /// <summary>
+    /// adaptive sampling: all the tiles are active again
+    /// </summary>
+    void reset_active_tiles();
+
+    /// <summary>
+    /// adaptive sampling: removes the tiles whose pixels are all below `threshold` (`PixelRelativeError`),
+    /// the same as `RTApp::update_active_tiles`, returns the number of active tiles
+    /// </summary>
+    uint32_t update_active_tiles(float threshold);
+
+    /// <summary>
+    /// result image (sRGB, rgba8 like the swapchain) -> *.ppm
+    /// </summary>
+    bool save_result_image(const std::string& path) const;
+
+    /// <summary>
+    /// accumulated image (linear, rgba32f) -> *.pfm
+    /// </summary>
+    bool save_accumulated_image(const std::string& path) const;
+
+    /// <summary>
+    /// row major linear image -> *.pfm (rgb)
+    /// </summary>
+    static bool save_pfm(const std::string& path, const std::vector<vec4>& pixels, uint32_t width, uint32_t height);
+
+    uint32_t get_width() const { return _width; }
+    uint32_t get_height() const { return _height; }
+
+    // row major: y * width + x
+    std::vector<vec4> _result_image{};
+    std::vector<vec4> _accumulated_image{};
+    // `UpdatePixelStats`
+    std::vector<vec4> _variance_image{};
+    // denoiser guides of the first non-specular vertex, rgb: albedo / xyz: normal, w: depth (< 0: background & emitters, not filtered)
+    std::vector<vec4> _albedo_image{};
+    std::vector<vec4> _normal_depth_image{};
+    std::vector<uint32_t> _active_tiles{};
+    // the same index as the GPU: x * height + y
+    std::vector<RecordPerPixel> _radiance_cache{};
+
+private:
+    void render_tile(const UniformParams& params, uint32_t x0, uint32_t y0, uint32_t tile_size);
+    vec3 trace_path(const UniformParams& params, uint32_t x, uint32_t y, uint32_t spp, vec4& albedo, vec4& normal_depth);
+    vec3 camera_ray_dir(const UniformParams& params, uint32_t x, uint32_t y) const;
+    bool reproject_history(const UniformParams& params, uint32_t x, uint32_t y, const vec4& normal_depth, vec3& history, vec4& stats) const;
+
+    const CPUScene* _scene{ nullptr };
+    const STree* _stree{ nullptr };
+    GuideTables _guide_tables{};
+    bool _guide_on{ false };
+    SamplerTables _sampler_tables{};
+    RadianceGrid _radiance_grid{};
+
+    // temporal reprojection: the previous frame
+    std::vector<vec4> _history_color{};
+    std::vector<vec4> _history_stats{};
+    std::vector<vec4> _history_normal_depth{};
+
+    uint32_t _width{ 0 };
+    uint32_t _height{ 0 };
+    uint32_t _tiles_x{ 0 };
+    uint32_t _tiles_y{ 0 };
+    uint32_t _adaptive_tiles_x{ 0 };
+    uint32_t _adaptive_tiles_y{ 0 };
+};
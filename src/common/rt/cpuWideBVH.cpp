@@ -0,0 +1,304 @@
+#include "cpuWideBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if CPU_WIDE_BVH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+#if CPU_WIDE_BVH_X86
+    void cpuid(int regs[4], int leaf, int sub_leaf) {
+#ifdef _MSC_VER
+        __cpuidex(regs, leaf, sub_leaf);
+#else
+        unsigned int a, b, c, d;
+        __cpuid_count(leaf, sub_leaf, a, b, c, d);
+        regs[0] = static_cast<int>(a);
+        regs[1] = static_cast<int>(b);
+        regs[2] = static_cast<int>(c);
+        regs[3] = static_cast<int>(d);
+#endif
+    }
+
+    // XCR0, whether the OS saves the ymm registers
+    unsigned long long xgetbv0() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+#endif
+
+    float surface_area(const CPUBVHNode& node) {
+        const vec3 e = node._max - node._min;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    wide_kernels::Ray to_kernel_ray(const CPURay& ray) {
+        wide_kernels::Ray r;
+        for (int k = 0; k < 3; ++k) {
+            r.o[k] = ray._origin[k];
+            r.d[k] = ray._direction[k];
+        }
+        r.tmin = ray._tmin;
+        r.tmax = ray._tmax;
+        return r;
+    }
+}
+
+CPUWideBVH::ISA CPUWideBVH::detect_isa() {
+#if CPU_WIDE_BVH_X86
+    int regs[4];
+    cpuid(regs, 0, 0);
+    const int max_leaf = regs[0];
+
+    cpuid(regs, 1, 0);
+    const bool osxsave = (regs[2] >> 27) & 1;
+    const bool avx = (regs[2] >> 28) & 1;
+    bool avx2 = false;
+    if (max_leaf >= 7) {
+        cpuid(regs, 7, 0);
+        avx2 = (regs[1] >> 5) & 1;
+    }
+    // xmm & ymm state enabled by the OS
+    if (osxsave && avx && avx2 && ((xgetbv0() & 0x6) == 0x6)) {
+        return ISA_AVX2;
+    }
+    return ISA_SSE;
+#else
+    return ISA_NONE;
+#endif
+}
+
+const char* CPUWideBVH::get_isa_name(ISA isa) {
+    switch (isa) {
+    case ISA_SSE:
+        return "SSE (4-wide)";
+    case ISA_AVX2:
+        return "AVX2 (8-wide)";
+    case ISA_NONE:
+    default:
+        return "Scalar (binary)";
+    }
+}
+
+void CPUWideBVH::build(const CPUBVH& bvh, const vec3* positions, ISA isa) {
+    _bvh = &bvh;
+    _isa = (isa == ISA_AUTO) ? detect_isa() : isa;
+#if !CPU_WIDE_BVH_X86
+    _isa = ISA_NONE;
+#endif
+
+    _bounds.clear();
+    _children.clear();
+    _tris.clear();
+    _prims.clear();
+    switch (_isa) {
+    case ISA_AVX2:
+        _width = 8;
+        break;
+    case ISA_SSE:
+        _width = 4;
+        break;
+    default:
+        // binary fallback, nothing to build
+        _width = 0;
+        return;
+    }
+
+    if (bvh._nodes.empty() || bvh.get_num_triangles() == 0) {
+        _isa = ISA_NONE;
+        _width = 0;
+        return;
+    }
+    collapse(0, positions);
+}
+
+int CPUWideBVH::collapse(int binary_index, const vec3* positions) {
+    const int W = _width;
+    const std::vector<CPUBVHNode>& nodes = _bvh->_nodes;
+
+    // (1) allocate, empty slots are at +inf (never hit)
+    const int wide_index = static_cast<int>(_children.size() / (2 * W));
+    _bounds.resize(_bounds.size() + 6 * W, FLT_MAX);
+    _children.resize(_children.size() + 2 * W, 0);
+    for (int i = 0; i < W; ++i) {
+        _children[wide_index * 2 * W + i] = -1;
+    }
+
+    // (2) open the largest inner node until there are W children
+    std::vector<int> slots;
+    const CPUBVHNode& root = nodes[binary_index];
+    if (root._count > 0) {
+        slots.push_back(binary_index);
+    } else {
+        slots.push_back(root._left_or_first);
+        slots.push_back(root._left_or_first + 1);
+    }
+    while (static_cast<int>(slots.size()) < W) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < static_cast<int>(slots.size()); ++i) {
+            const CPUBVHNode& n = nodes[slots[i]];
+            if (n._count == 0 && surface_area(n) > best_area) {
+                best_area = surface_area(n);
+                best = i;
+            }
+        }
+        if (best == -1) { break; }
+        const int left = nodes[slots[best]]._left_or_first;
+        slots[best] = left;
+        slots.push_back(left + 1);
+    }
+
+    // (3) fill the slots (recursion may resize the arrays, always write by index)
+    for (int i = 0; i < static_cast<int>(slots.size()); ++i) {
+        const CPUBVHNode& n = nodes[slots[i]];
+        for (int k = 0; k < 3; ++k) {
+            _bounds[wide_index * 6 * W + k * W + i] = n._min[k];
+            _bounds[wide_index * 6 * W + (3 + k) * W + i] = n._max[k];
+        }
+
+        int child = 0, count = 0;
+        if (n._count > 0) {
+            // leaf, W triangles per block (padded by degenerate triangles)
+            const int first_block = static_cast<int>(_prims.size() / W);
+            const int num_blocks = (n._count + W - 1) / W;
+            _tris.resize(_tris.size() + static_cast<size_t>(num_blocks) * 9 * W, 0.0f);
+            _prims.resize(_prims.size() + static_cast<size_t>(num_blocks) * W, -1);
+            for (int j = 0; j < n._count; ++j) {
+                const uint32_t tri = _bvh->_prim_indices[n._left_or_first + j];
+                const int blk = first_block + j / W;
+                const int lane = j % W;
+                const vec3& v0 = positions[3 * tri + 0];
+                const vec3 e1 = positions[3 * tri + 1] - v0;
+                const vec3 e2 = positions[3 * tri + 2] - v0;
+                float* dst = _tris.data() + static_cast<size_t>(blk) * 9 * W;
+                for (int k = 0; k < 3; ++k) {
+                    dst[(0 + k) * W + lane] = v0[k];
+                    dst[(3 + k) * W + lane] = e1[k];
+                    dst[(6 + k) * W + lane] = e2[k];
+                }
+                _prims[static_cast<size_t>(blk) * W + lane] = static_cast<int>(tri);
+            }
+            child = first_block;
+            count = num_blocks;
+        } else {
+            child = collapse(slots[i], positions);
+        }
+        _children[wide_index * 2 * W + i] = child;
+        _children[wide_index * 2 * W + W + i] = count;
+    }
+    return wide_index;
+}
+
+wide_kernels::BVHView CPUWideBVH::get_view() const {
+    wide_kernels::BVHView view;
+    view.width = _width;
+    view.bounds = _bounds.data();
+    view.children = _children.data();
+    view.tris = _tris.data();
+    view.prims = _prims.data();
+    return view;
+}
+
+bool CPUWideBVH::intersect(const CPURay& ray, CPUHit& hit) const {
+#if CPU_WIDE_BVH_X86
+    if (_isa != ISA_NONE) {
+        wide_kernels::Hit h;
+        h.t = hit._t;
+        const wide_kernels::Ray r = to_kernel_ray(ray);
+        const bool ret = (_isa == ISA_AVX2) ?
+            wide_kernels::avx2::intersect(get_view(), r, h) :
+            wide_kernels::sse::intersect(get_view(), r, h);
+        hit._prim_id = h.prim;
+        if (ret) {
+            hit._t = h.t;
+            hit._barycentrics = vec2(h.u, h.v);
+        }
+        return ret;
+    }
+#endif
+    return _bvh->intersect(ray, hit);
+}
+
+bool CPUWideBVH::occluded(const CPURay& ray) const {
+#if CPU_WIDE_BVH_X86
+    if (_isa != ISA_NONE) {
+        const wide_kernels::Ray r = to_kernel_ray(ray);
+        return (_isa == ISA_AVX2) ?
+            wide_kernels::avx2::occluded(get_view(), r) :
+            wide_kernels::sse::occluded(get_view(), r);
+    }
+#endif
+    return _bvh->occluded(ray);
+}
+
+void CPUWideBVH::intersect_packet(const CPURay* rays, CPUHit* hits, int count) const {
+#if CPU_WIDE_BVH_X86
+    if (_isa != ISA_NONE) {
+        const wide_kernels::BVHView view = get_view();
+        wide_kernels::Ray r[wide_kernels::MAX_WIDTH];
+        wide_kernels::Hit h[wide_kernels::MAX_WIDTH];
+        for (int start = 0; start < count; start += _width) {
+            const int n = std::min(_width, count - start);
+            for (int i = 0; i < n; ++i) {
+                r[i] = to_kernel_ray(rays[start + i]);
+            }
+            if (_isa == ISA_AVX2) {
+                wide_kernels::avx2::intersect_packet(view, r, h, n);
+            } else {
+                wide_kernels::sse::intersect_packet(view, r, h, n);
+            }
+            for (int i = 0; i < n; ++i) {
+                CPUHit& hit = hits[start + i];
+                hit._prim_id = h[i].prim;
+                hit._t = h[i].t;
+                hit._barycentrics = vec2(h[i].u, h[i].v);
+            }
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < count; ++i) {
+        hits[i]._t = rays[i]._tmax;
+        _bvh->intersect(rays[i], hits[i]);
+    }
+}
+
+void CPUWideBVH::occluded_packet(const CPURay* rays, bool* occluded, int count) const {
+#if CPU_WIDE_BVH_X86
+    if (_isa != ISA_NONE) {
+        const wide_kernels::BVHView view = get_view();
+        wide_kernels::Ray r[wide_kernels::MAX_WIDTH];
+        int o[wide_kernels::MAX_WIDTH];
+        for (int start = 0; start < count; start += _width) {
+            const int n = std::min(_width, count - start);
+            for (int i = 0; i < n; ++i) {
+                r[i] = to_kernel_ray(rays[start + i]);
+            }
+            if (_isa == ISA_AVX2) {
+                wide_kernels::avx2::occluded_packet(view, r, o, n);
+            } else {
+                wide_kernels::sse::occluded_packet(view, r, o, n);
+            }
+            for (int i = 0; i < n; ++i) {
+                occluded[start + i] = o[i] != 0;
+            }
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < count; ++i) {
+        occluded[i] = _bvh->occluded(rays[i]);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cpuBVH.h"
+#include "cpuWideKernels.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// 4/8-wide BVH collapsed from `CPUBVH`, traversed by SIMD kernels
+///  AVX2 -> 8-wide, SSE -> 4-wide, selected at runtime
+///  NONE (not x86) -> falls back to the binary `CPUBVH`
+/// </summary>
+class CPUWideBVH {
+public:
+    enum ISA {
+        ISA_AUTO = -1,
+        ISA_NONE = 0,
+        ISA_SSE = 1,
+        ISA_AVX2 = 2,
+    };
+
+    static ISA detect_isa();
+    static const char* get_isa_name(ISA isa);
+
+    /// <summary>
+    /// isa = ISA_AUTO: use `detect_isa()`
+    /// `bvh` should outlive this
+    /// </summary>
+    void build(const CPUBVH& bvh, const vec3* positions, ISA isa = ISA_AUTO);
+
+    /// <summary>
+    /// closest hit, hit._t should be initialized as ray._tmax
+    /// </summary>
+    bool intersect(const CPURay& ray, CPUHit& hit) const;
+    bool occluded(const CPURay& ray) const;
+
+    /// <summary>
+    /// coherent rays, all the rays of a packet traverse the tree together
+    /// any count is allowed, split into packets of `get_width()` rays
+    /// </summary>
+    void intersect_packet(const CPURay* rays, CPUHit* hits, int count) const;
+    void occluded_packet(const CPURay* rays, bool* occluded, int count) const;
+
+    ISA get_isa() const { return _isa; }
+    int get_width() const { return _width; }
+    size_t get_num_nodes() const { return _width ? _children.size() / (2 * _width) : 0; }
+
+    // node & triangle block layout: see `wide_kernels::BVHView`
+    std::vector<float> _bounds{};
+    std::vector<int> _children{};
+    std::vector<float> _tris{};
+    std::vector<int> _prims{};
+
+private:
+    int collapse(int binary_index, const vec3* positions);
+    wide_kernels::BVHView get_view() const;
+
+    const CPUBVH* _bvh{ nullptr };
+    ISA _isa{ ISA_NONE };
+    int _width{ 0 };
+};
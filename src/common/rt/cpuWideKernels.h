@@ -0,0 +1,72 @@
+#pragma once
+
+// SIMD kernels of `CPUWideBVH`, one translation unit per instruction set:
+//  cpuWideKernelsSSE.cpp  -> 4-wide (SSE2, x64 baseline)
+//  cpuWideKernelsAVX2.cpp -> 8-wide (compiled with /arch:AVX2 or -mavx2)
+// the kernel units only use plain structs below (no glm / std inline functions),
+// so nothing compiled with AVX2 can be picked by the linker for the other units
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_WIDE_BVH_X86 1
+#else
+#define CPU_WIDE_BVH_X86 0
+#endif
+
+namespace wide_kernels {
+    static const int MAX_WIDTH = 8;
+    static const int STACK_SIZE = 512;
+
+    /// <summary>
+    /// node (W = width):
+    ///  bounds:   min_x[W], min_y[W], min_z[W], max_x[W], max_y[W], max_z[W]
+    ///  children: child[W], count[W]
+    ///   count > 0: leaf, triangle blocks [child, child + count)
+    ///   count = 0 & child >= 0: inner node
+    ///   child = -1: empty slot (bounds at +inf, never hit)
+    /// triangle block:
+    ///  tris:  v0_x[W], v0_y[W], v0_z[W], e1_x[W], e1_y[W], e1_z[W], e2_x[W], e2_y[W], e2_z[W]
+    ///  prims: prim[W] (-1: padding, degenerate triangle)
+    /// </summary>
+    struct BVHView {
+        int width;
+        const float* bounds;
+        const int* children;
+        const float* tris;
+        const int* prims;
+    };
+
+    struct Ray {
+        float o[3];
+        float d[3];
+        float tmin;
+        float tmax;
+    };
+
+    /// <summary>
+    /// prim = -1 means miss, (u, v) is the same as `hitAttributeEXT vec2`
+    /// </summary>
+    struct Hit {
+        float t;
+        int prim;
+        float u;
+        float v;
+    };
+
+#if CPU_WIDE_BVH_X86
+    namespace sse {
+        bool intersect(const BVHView& bvh, const Ray& ray, Hit& hit);
+        bool occluded(const BVHView& bvh, const Ray& ray);
+        // count <= 4
+        void intersect_packet(const BVHView& bvh, const Ray* rays, Hit* hits, int count);
+        void occluded_packet(const BVHView& bvh, const Ray* rays, int* occluded, int count);
+    }
+
+    namespace avx2 {
+        bool intersect(const BVHView& bvh, const Ray& ray, Hit& hit);
+        bool occluded(const BVHView& bvh, const Ray& ray);
+        // count <= 8
+        void intersect_packet(const BVHView& bvh, const Ray* rays, Hit* hits, int count);
+        void occluded_packet(const BVHView& bvh, const Ray* rays, int* occluded, int count);
+    }
+#endif
+}
@@ -0,0 +1,355 @@
+// shared body of the wide BVH kernels, included by cpuWideKernelsSSE.cpp & cpuWideKernelsAVX2.cpp
+// the including unit defines `simd` (WIDTH, vf and the operations) in an anonymous namespace
+// only plain C++ and intrinsics here, see cpuWideKernels.h
+
+namespace {
+    const int W = simd::WIDTH;
+    const float DET_EPS = 1e-12f;
+
+    struct StackEntry {
+        int node;   // node index or first triangle block
+        int count;  // 0: inner node, > 0: number of triangle blocks
+        float dist; // entry distance, skipped when farther than the closest hit
+    };
+
+    struct RayVec {
+        simd::vf o[3];
+        simd::vf d[3];
+        simd::vf inv_d[3];
+        simd::vf o_inv_d[3];
+        simd::vf tmin;
+    };
+
+    // Moller-Trumbore, the same as `intersect_triangle` in cpuBVH.h
+    // return the mask of (tmin < t < tmax)
+    inline simd::vf intersect_triangles(
+        const simd::vf o[3], const simd::vf d[3],
+        const simd::vf v0[3], const simd::vf e1[3], const simd::vf e2[3],
+        const simd::vf& tmin, const simd::vf& tmax,
+        simd::vf& t, simd::vf& u, simd::vf& v) {
+        // p = cross(d, e2)
+        const simd::vf px = simd::sub(simd::mul(d[1], e2[2]), simd::mul(d[2], e2[1]));
+        const simd::vf py = simd::sub(simd::mul(d[2], e2[0]), simd::mul(d[0], e2[2]));
+        const simd::vf pz = simd::sub(simd::mul(d[0], e2[1]), simd::mul(d[1], e2[0]));
+        const simd::vf det = simd::add(simd::add(simd::mul(e1[0], px), simd::mul(e1[1], py)), simd::mul(e1[2], pz));
+        const simd::vf inv_det = simd::div(simd::set1(1.0f), det);
+
+        const simd::vf sx = simd::sub(o[0], v0[0]);
+        const simd::vf sy = simd::sub(o[1], v0[1]);
+        const simd::vf sz = simd::sub(o[2], v0[2]);
+        u = simd::mul(simd::add(simd::add(simd::mul(sx, px), simd::mul(sy, py)), simd::mul(sz, pz)), inv_det);
+
+        // q = cross(s, e1)
+        const simd::vf qx = simd::sub(simd::mul(sy, e1[2]), simd::mul(sz, e1[1]));
+        const simd::vf qy = simd::sub(simd::mul(sz, e1[0]), simd::mul(sx, e1[2]));
+        const simd::vf qz = simd::sub(simd::mul(sx, e1[1]), simd::mul(sy, e1[0]));
+        v = simd::mul(simd::add(simd::add(simd::mul(d[0], qx), simd::mul(d[1], qy)), simd::mul(d[2], qz)), inv_det);
+        t = simd::mul(simd::add(simd::add(simd::mul(e2[0], qx), simd::mul(e2[1], qy)), simd::mul(e2[2], qz)), inv_det);
+
+        const simd::vf zero = simd::set1(0.0f);
+        const simd::vf one = simd::set1(1.0f);
+        simd::vf mask = simd::ge(simd::abs(det), simd::set1(DET_EPS));
+        mask = simd::and_(mask, simd::and_(simd::ge(u, zero), simd::le(u, one)));
+        mask = simd::and_(mask, simd::and_(simd::ge(v, zero), simd::le(simd::add(u, v), one)));
+        mask = simd::and_(mask, simd::and_(simd::gt(t, tmin), simd::lt(t, tmax)));
+        return mask;
+    }
+
+    // single ray vs W boxes, return the hit mask and the entry distances
+    inline int intersect_boxes(const float* b, const RayVec& r, float tmax, simd::vf& t_near) {
+        const simd::vf tx0 = simd::sub(simd::mul(simd::loadu(b + 0 * W), r.inv_d[0]), r.o_inv_d[0]);
+        const simd::vf ty0 = simd::sub(simd::mul(simd::loadu(b + 1 * W), r.inv_d[1]), r.o_inv_d[1]);
+        const simd::vf tz0 = simd::sub(simd::mul(simd::loadu(b + 2 * W), r.inv_d[2]), r.o_inv_d[2]);
+        const simd::vf tx1 = simd::sub(simd::mul(simd::loadu(b + 3 * W), r.inv_d[0]), r.o_inv_d[0]);
+        const simd::vf ty1 = simd::sub(simd::mul(simd::loadu(b + 4 * W), r.inv_d[1]), r.o_inv_d[1]);
+        const simd::vf tz1 = simd::sub(simd::mul(simd::loadu(b + 5 * W), r.inv_d[2]), r.o_inv_d[2]);
+        t_near = simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)), simd::max(simd::min(tz0, tz1), r.tmin));
+        const simd::vf t_far = simd::min(simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)), simd::min(simd::max(tz0, tz1), simd::set1(tmax)));
+        return simd::movemask(simd::le(t_near, t_far));
+    }
+
+    // W rays vs 1 box (packet)
+    inline int intersect_box_packet(const float* b, int lane, const RayVec& r, const simd::vf& tmax) {
+        const simd::vf tx0 = simd::sub(simd::mul(simd::set1(b[0 * W + lane]), r.inv_d[0]), r.o_inv_d[0]);
+        const simd::vf ty0 = simd::sub(simd::mul(simd::set1(b[1 * W + lane]), r.inv_d[1]), r.o_inv_d[1]);
+        const simd::vf tz0 = simd::sub(simd::mul(simd::set1(b[2 * W + lane]), r.inv_d[2]), r.o_inv_d[2]);
+        const simd::vf tx1 = simd::sub(simd::mul(simd::set1(b[3 * W + lane]), r.inv_d[0]), r.o_inv_d[0]);
+        const simd::vf ty1 = simd::sub(simd::mul(simd::set1(b[4 * W + lane]), r.inv_d[1]), r.o_inv_d[1]);
+        const simd::vf tz1 = simd::sub(simd::mul(simd::set1(b[5 * W + lane]), r.inv_d[2]), r.o_inv_d[2]);
+        const simd::vf t_near = simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)), simd::max(simd::min(tz0, tz1), r.tmin));
+        const simd::vf t_far = simd::min(simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)), simd::min(simd::max(tz0, tz1), tmax));
+        return simd::movemask(simd::le(t_near, t_far));
+    }
+
+    inline void load_triangles(const float* tri, simd::vf v0[3], simd::vf e1[3], simd::vf e2[3]) {
+        for (int k = 0; k < 3; ++k) {
+            v0[k] = simd::loadu(tri + (0 + k) * W);
+            e1[k] = simd::loadu(tri + (3 + k) * W);
+            e2[k] = simd::loadu(tri + (6 + k) * W);
+        }
+    }
+
+    inline void broadcast_triangle(const float* tri, int lane, simd::vf v0[3], simd::vf e1[3], simd::vf e2[3]) {
+        for (int k = 0; k < 3; ++k) {
+            v0[k] = simd::set1(tri[(0 + k) * W + lane]);
+            e1[k] = simd::set1(tri[(3 + k) * W + lane]);
+            e2[k] = simd::set1(tri[(6 + k) * W + lane]);
+        }
+    }
+
+    // axis aligned rays (d = 0) would give inf * inf - inf = NaN in the slab test,
+    // and a NaN passes the test, even for the empty slots (at FLT_MAX) of a node
+    inline float safe_rcp(float d) {
+        // plain comparisons, not std::abs / std::copysign (see cpuWideKernels.h), -0 goes to +eps
+        const float eps = 1e-20f;
+        if (d >= 0.0f && d < eps) {
+            d = eps;
+        } else if (d < 0.0f && d > -eps) {
+            d = -eps;
+        }
+        return 1.0f / d;
+    }
+
+    inline RayVec setup_single(const Ray& ray) {
+        RayVec r;
+        for (int k = 0; k < 3; ++k) {
+            const float inv_d = safe_rcp(ray.d[k]);
+            r.o[k] = simd::set1(ray.o[k]);
+            r.d[k] = simd::set1(ray.d[k]);
+            r.inv_d[k] = simd::set1(inv_d);
+            r.o_inv_d[k] = simd::set1(ray.o[k] * inv_d);
+        }
+        r.tmin = simd::set1(ray.tmin);
+        return r;
+    }
+
+    // lanes >= count never hit (tmax < tmin)
+    inline RayVec setup_packet(const Ray* rays, int count, simd::vf& tmax) {
+        float o[3][MAX_WIDTH], d[3][MAX_WIDTH], inv_d[3][MAX_WIDTH], o_inv_d[3][MAX_WIDTH];
+        float tmin_lanes[MAX_WIDTH], tmax_lanes[MAX_WIDTH];
+        for (int i = 0; i < W; ++i) {
+            const bool valid = i < count;
+            for (int k = 0; k < 3; ++k) {
+                o[k][i] = valid ? rays[i].o[k] : 0.0f;
+                d[k][i] = valid ? rays[i].d[k] : 1.0f;
+                inv_d[k][i] = safe_rcp(d[k][i]);
+                o_inv_d[k][i] = o[k][i] * inv_d[k][i];
+            }
+            tmin_lanes[i] = valid ? rays[i].tmin : 0.0f;
+            tmax_lanes[i] = valid ? rays[i].tmax : -1.0f;
+        }
+        RayVec r;
+        for (int k = 0; k < 3; ++k) {
+            r.o[k] = simd::loadu(o[k]);
+            r.d[k] = simd::loadu(d[k]);
+            r.inv_d[k] = simd::loadu(inv_d[k]);
+            r.o_inv_d[k] = simd::loadu(o_inv_d[k]);
+        }
+        r.tmin = simd::loadu(tmin_lanes);
+        tmax = simd::loadu(tmax_lanes);
+        return r;
+    }
+}
+
+bool intersect(const BVHView& bvh, const Ray& ray, Hit& hit) {
+    hit.prim = -1;
+    float t_best = hit.t;
+    const RayVec r = setup_single(ray);
+
+    StackEntry stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = { 0, 0, ray.tmin };
+
+    while (sp > 0) {
+        const StackEntry e = stack[--sp];
+        if (e.dist > t_best) { continue; }
+
+        if (e.count > 0) {
+            // leaf: W triangles at once
+            for (int blk = e.node; blk < e.node + e.count; ++blk) {
+                simd::vf v0[3], e1[3], e2[3], t, u, v;
+                load_triangles(bvh.tris + blk * 9 * W, v0, e1, e2);
+                const int mask = simd::movemask(intersect_triangles(r.o, r.d, v0, e1, e2, r.tmin, simd::set1(t_best), t, u, v));
+                if (!mask) { continue; }
+                float ts[MAX_WIDTH], us[MAX_WIDTH], vs[MAX_WIDTH];
+                simd::storeu(ts, t);
+                simd::storeu(us, u);
+                simd::storeu(vs, v);
+                for (int i = 0; i < W; ++i) {
+                    if (((mask >> i) & 1) && ts[i] < t_best) {
+                        t_best = ts[i];
+                        hit.prim = bvh.prims[blk * W + i];
+                        hit.u = us[i];
+                        hit.v = vs[i];
+                    }
+                }
+            }
+            continue;
+        }
+
+        // inner: W boxes at once
+        simd::vf t_near;
+        const int mask = intersect_boxes(bvh.bounds + e.node * 6 * W, r, t_best, t_near);
+        if (!mask) { continue; }
+        float dist[MAX_WIDTH];
+        simd::storeu(dist, t_near);
+
+        // sort the hit children by distance (descending), the nearest is popped first
+        const int* children = bvh.children + e.node * 2 * W;
+        int order[MAX_WIDTH];
+        int n = 0;
+        for (int i = 0; i < W; ++i) {
+            if (!((mask >> i) & 1)) { continue; }
+            int k = n++;
+            while (k > 0 && dist[order[k - 1]] < dist[i]) {
+                order[k] = order[k - 1];
+                --k;
+            }
+            order[k] = i;
+        }
+        for (int k = 0; k < n; ++k) {
+            const int i = order[k];
+            stack[sp++] = { children[i], children[W + i], dist[i] };
+        }
+    }
+
+    hit.t = t_best;
+    return hit.prim != -1;
+}
+
+bool occluded(const BVHView& bvh, const Ray& ray) {
+    const RayVec r = setup_single(ray);
+    const simd::vf tmax = simd::set1(ray.tmax);
+
+    StackEntry stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = { 0, 0, ray.tmin };
+
+    while (sp > 0) {
+        const StackEntry e = stack[--sp];
+        if (e.count > 0) {
+            for (int blk = e.node; blk < e.node + e.count; ++blk) {
+                simd::vf v0[3], e1[3], e2[3], t, u, v;
+                load_triangles(bvh.tris + blk * 9 * W, v0, e1, e2);
+                // terminate on first hit
+                if (simd::movemask(intersect_triangles(r.o, r.d, v0, e1, e2, r.tmin, tmax, t, u, v))) {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        simd::vf t_near;
+        const int mask = intersect_boxes(bvh.bounds + e.node * 6 * W, r, ray.tmax, t_near);
+        const int* children = bvh.children + e.node * 2 * W;
+        for (int i = 0; i < W; ++i) {
+            if ((mask >> i) & 1) {
+                stack[sp++] = { children[i], children[W + i], 0.0f };
+            }
+        }
+    }
+    return false;
+}
+
+void intersect_packet(const BVHView& bvh, const Ray* rays, Hit* hits, int count) {
+    simd::vf t_best;
+    const RayVec r = setup_packet(rays, count, t_best);
+    simd::vf u_best = simd::set1(0.0f);
+    simd::vf v_best = simd::set1(0.0f);
+    int prim_best[MAX_WIDTH];
+    for (int i = 0; i < W; ++i) { prim_best[i] = -1; }
+
+    StackEntry stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = { 0, 0, 0.0f };
+
+    while (sp > 0) {
+        const StackEntry e = stack[--sp];
+        if (e.count > 0) {
+            // leaf: 1 triangle vs W rays
+            for (int blk = e.node; blk < e.node + e.count; ++blk) {
+                const float* tri = bvh.tris + blk * 9 * W;
+                for (int j = 0; j < W; ++j) {
+                    const int prim = bvh.prims[blk * W + j];
+                    if (prim < 0) { continue; }
+                    simd::vf v0[3], e1[3], e2[3], t, u, v;
+                    broadcast_triangle(tri, j, v0, e1, e2);
+                    const simd::vf m = intersect_triangles(r.o, r.d, v0, e1, e2, r.tmin, t_best, t, u, v);
+                    const int mask = simd::movemask(m);
+                    if (!mask) { continue; }
+                    t_best = simd::select(m, t, t_best);
+                    u_best = simd::select(m, u, u_best);
+                    v_best = simd::select(m, v, v_best);
+                    for (int i = 0; i < W; ++i) {
+                        if ((mask >> i) & 1) { prim_best[i] = prim; }
+                    }
+                }
+            }
+            continue;
+        }
+
+        // inner: 1 box vs W rays, pushed in reverse order
+        const float* b = bvh.bounds + e.node * 6 * W;
+        const int* children = bvh.children + e.node * 2 * W;
+        for (int j = W - 1; j >= 0; --j) {
+            if (children[j] < 0) { continue; }
+            if (intersect_box_packet(b, j, r, t_best)) {
+                stack[sp++] = { children[j], children[W + j], 0.0f };
+            }
+        }
+    }
+
+    float ts[MAX_WIDTH], us[MAX_WIDTH], vs[MAX_WIDTH];
+    simd::storeu(ts, t_best);
+    simd::storeu(us, u_best);
+    simd::storeu(vs, v_best);
+    for (int i = 0; i < count; ++i) {
+        hits[i].prim = prim_best[i];
+        hits[i].t = ts[i];
+        hits[i].u = us[i];
+        hits[i].v = vs[i];
+    }
+}
+
+void occluded_packet(const BVHView& bvh, const Ray* rays, int* occluded, int count) {
+    simd::vf tmax;
+    const RayVec r = setup_packet(rays, count, tmax);
+    // finished lanes: occluded or padding
+    int done = 0;
+    for (int i = count; i < W; ++i) { done |= (1 << i); }
+    const int all = (1 << W) - 1;
+
+    StackEntry stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = { 0, 0, 0.0f };
+
+    while (sp > 0 && done != all) {
+        const StackEntry e = stack[--sp];
+        if (e.count > 0) {
+            for (int blk = e.node; blk < e.node + e.count && done != all; ++blk) {
+                const float* tri = bvh.tris + blk * 9 * W;
+                for (int j = 0; j < W; ++j) {
+                    if (bvh.prims[blk * W + j] < 0) { continue; }
+                    simd::vf v0[3], e1[3], e2[3], t, u, v;
+                    broadcast_triangle(tri, j, v0, e1, e2);
+                    done |= simd::movemask(intersect_triangles(r.o, r.d, v0, e1, e2, r.tmin, tmax, t, u, v));
+                }
+            }
+            continue;
+        }
+
+        const float* b = bvh.bounds + e.node * 6 * W;
+        const int* children = bvh.children + e.node * 2 * W;
+        for (int j = W - 1; j >= 0; --j) {
+            if (children[j] < 0) { continue; }
+            // only the unfinished lanes
+            if (intersect_box_packet(b, j, r, tmax) & ~done) {
+                stack[sp++] = { children[j], children[W + j], 0.0f };
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        occluded[i] = (done >> i) & 1;
+    }
+}
@@ -0,0 +1,40 @@
+#include "cpuWideKernels.h"
+
+// this unit is compiled with /arch:AVX2 (-mavx2), only called when the CPU supports AVX2
+#if CPU_WIDE_BVH_X86
+#include <immintrin.h>
+
+namespace {
+    struct simd {
+        static const int WIDTH = 8;
+        typedef __m256 vf;
+
+        static inline vf set1(float a) { return _mm256_set1_ps(a); }
+        static inline vf loadu(const float* p) { return _mm256_loadu_ps(p); }
+        static inline void storeu(float* p, const vf& a) { _mm256_storeu_ps(p, a); }
+
+        static inline vf add(const vf& a, const vf& b) { return _mm256_add_ps(a, b); }
+        static inline vf sub(const vf& a, const vf& b) { return _mm256_sub_ps(a, b); }
+        static inline vf mul(const vf& a, const vf& b) { return _mm256_mul_ps(a, b); }
+        static inline vf div(const vf& a, const vf& b) { return _mm256_div_ps(a, b); }
+        static inline vf min(const vf& a, const vf& b) { return _mm256_min_ps(a, b); }
+        static inline vf max(const vf& a, const vf& b) { return _mm256_max_ps(a, b); }
+        static inline vf abs(const vf& a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+        static inline vf le(const vf& a, const vf& b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static inline vf lt(const vf& a, const vf& b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static inline vf ge(const vf& a, const vf& b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static inline vf gt(const vf& a, const vf& b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static inline vf and_(const vf& a, const vf& b) { return _mm256_and_ps(a, b); }
+        // mask ? a : b
+        static inline vf select(const vf& mask, const vf& a, const vf& b) { return _mm256_blendv_ps(b, a, mask); }
+        static inline int movemask(const vf& a) { return _mm256_movemask_ps(a); }
+    };
+}
+
+namespace wide_kernels {
+    namespace avx2 {
+#include "cpuWideKernels.inl"
+    }
+}
+#endif
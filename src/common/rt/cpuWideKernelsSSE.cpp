@@ -0,0 +1,40 @@
+#include "cpuWideKernels.h"
+
+#if CPU_WIDE_BVH_X86
+#include <emmintrin.h>
+
+namespace {
+    // SSE2 only, available on every x64 CPU
+    struct simd {
+        static const int WIDTH = 4;
+        typedef __m128 vf;
+
+        static inline vf set1(float a) { return _mm_set1_ps(a); }
+        static inline vf loadu(const float* p) { return _mm_loadu_ps(p); }
+        static inline void storeu(float* p, const vf& a) { _mm_storeu_ps(p, a); }
+
+        static inline vf add(const vf& a, const vf& b) { return _mm_add_ps(a, b); }
+        static inline vf sub(const vf& a, const vf& b) { return _mm_sub_ps(a, b); }
+        static inline vf mul(const vf& a, const vf& b) { return _mm_mul_ps(a, b); }
+        static inline vf div(const vf& a, const vf& b) { return _mm_div_ps(a, b); }
+        static inline vf min(const vf& a, const vf& b) { return _mm_min_ps(a, b); }
+        static inline vf max(const vf& a, const vf& b) { return _mm_max_ps(a, b); }
+        static inline vf abs(const vf& a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+        static inline vf le(const vf& a, const vf& b) { return _mm_cmple_ps(a, b); }
+        static inline vf lt(const vf& a, const vf& b) { return _mm_cmplt_ps(a, b); }
+        static inline vf ge(const vf& a, const vf& b) { return _mm_cmpge_ps(a, b); }
+        static inline vf gt(const vf& a, const vf& b) { return _mm_cmpgt_ps(a, b); }
+        static inline vf and_(const vf& a, const vf& b) { return _mm_and_ps(a, b); }
+        // mask ? a : b
+        static inline vf select(const vf& mask, const vf& a, const vf& b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+        static inline int movemask(const vf& a) { return _mm_movemask_ps(a); }
+    };
+}
+
+namespace wide_kernels {
+    namespace sse {
+#include "cpuWideKernels.inl"
+    }
+}
+#endif
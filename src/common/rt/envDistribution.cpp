@@ -0,0 +1,138 @@
+#include "envDistribution.h"
+#include "cpuParallel.h"
+
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+    const float PI = 3.1415926535897932384626433832795f;
+
+    float srgb_to_linear(uint8_t value) {
+        const float c = value / 255.0f;
+        return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // cdf[0] = 0 ... cdf[n] = 1, returns the integral of the function (the average of `func`)
+    float build_cdf(const float* func, int n, float* cdf) {
+        cdf[0] = 0.0f;
+        for (int i = 0; i < n; ++i) {
+            cdf[i + 1] = cdf[i] + func[i] / n;
+        }
+        const float integral = cdf[n];
+        for (int i = 1; i <= n; ++i) {
+            // black rows: uniform
+            cdf[i] = (integral > 0.0f) ? cdf[i] / integral : static_cast<float>(i) / n;
+        }
+        cdf[n] = 1.0f;
+        return integral;
+    }
+
+    // the last i in [0, n) with cdf[i] <= u, and u remapped to [0, 1) within the interval
+    int sample_cdf(const float* cdf, int n, float u, float& du) {
+        const int i = std::max(0, std::min(static_cast<int>(std::upper_bound(cdf, cdf + n + 1, u) - cdf) - 1, n - 1));
+        const float width = cdf[i + 1] - cdf[i];
+        du = (width > 0.0f) ? (u - cdf[i]) / width : 0.0f;
+        return i;
+    }
+}
+
+void EnvDistribution::build(const uint8_t* pixels, int width, int height, uint32_t num_threads) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    _width = width;
+    _height = height;
+    const size_t num_texels = static_cast<size_t>(width) * height;
+    _data.assign(SWS_ENV_HEADER_SIZE + num_texels + static_cast<size_t>(height) * (width + 1) + (height + 1), 0.0f);
+    float* pdf = _data.data() + SWS_ENV_HEADER_SIZE;
+    float* conditional = pdf + num_texels;
+    float* marginal = conditional + static_cast<size_t>(height) * (width + 1);
+
+    // 1. luminance * sin(theta) (the lat-long area of the texel) & the conditional cdf of each row
+    std::vector<float> row_integrals(height);
+    cpu_parallel::parallel_for(static_cast<uint32_t>(height), num_threads, [&](uint32_t y) {
+        const float sin_theta = std::sin(PI * (y + 0.5f) / height);
+        float* func = pdf + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* p = pixels + 4 * (static_cast<size_t>(y) * width + x);
+            func[x] = Luminance(vec3(srgb_to_linear(p[0]), srgb_to_linear(p[1]), srgb_to_linear(p[2]))) * sin_theta;
+        }
+        row_integrals[y] = build_cdf(func, width, conditional + static_cast<size_t>(y) * (width + 1));
+    });
+
+    // 2. marginal cdf of the rows
+    const float integral = build_cdf(row_integrals.data(), height, marginal);
+
+    // 3. the function -> the pdf over the uv square
+    cpu_parallel::parallel_for(static_cast<uint32_t>(height), num_threads, [&](uint32_t y) {
+        float* func = pdf + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            func[x] = (integral > 0.0f) ? func[x] / integral : 0.0f;
+        }
+    });
+
+    _data[0] = static_cast<float>(width);
+    _data[1] = static_cast<float>(height);
+    _data[2] = integral;
+
+    auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+    std::cout << "[EnvMap] " << width << "x" << height << " distribution, integral: " << integral << ", build time: " << delta.count() << "s" << std::endl;
+}
+
+vec3 EnvDistribution::sample(vec2 u, float& pdf) const {
+    pdf = 0.0f;
+    if (get_integral() <= 0.0f) {
+        return vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    const float* texel_pdf = _data.data() + SWS_ENV_HEADER_SIZE;
+    const float* conditional = texel_pdf + static_cast<size_t>(_width) * _height;
+    const float* marginal = conditional + static_cast<size_t>(_height) * (_width + 1);
+
+    float dv, du;
+    const int y = sample_cdf(marginal, _height, u.y, dv);
+    const int x = sample_cdf(conditional + static_cast<size_t>(y) * (_width + 1), _width, u.x, du);
+    const vec2 uv = vec2((x + du) / _width, (y + dv) / _height);
+
+    // uv square -> solid angle: d(omega) = 2 pi^2 sin(theta) du dv
+    const float sin_theta = std::sin(uv.y * PI);
+    if (sin_theta > 0.0f) {
+        pdf = texel_pdf[static_cast<size_t>(y) * _width + x] / (2.0f * PI * PI * sin_theta);
+    }
+    return uv_to_direction(uv);
+}
+
+float EnvDistribution::pdf(vec3 direction) const {
+    if (get_integral() <= 0.0f) {
+        return 0.0f;
+    }
+    const vec2 uv = direction_to_uv(direction);
+    const int x = std::max(0, std::min(static_cast<int>(uv.x * _width), _width - 1));
+    const int y = std::max(0, std::min(static_cast<int>(uv.y * _height), _height - 1));
+    const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - direction.y * direction.y));
+    if (sin_theta <= 0.0f) {
+        return 0.0f;
+    }
+    return _data[SWS_ENV_HEADER_SIZE + static_cast<size_t>(y) * _width + x] / (2.0f * PI * PI * sin_theta);
+}
+
+float EnvDistribution::light_probability(float env_strength, int num_emitters) const {
+    if (env_strength <= 0.0f || get_integral() <= 0.0f) {
+        return 0.0f;
+    }
+    return (num_emitters > 0) ? SWS_ENV_LIGHT_PROB : 1.0f;
+}
+
+vec2 EnvDistribution::direction_to_uv(vec3 direction) {
+    const float phi = std::atan2(direction.x, direction.z);
+    const float theta = std::acos(std::max(-1.0f, std::min(direction.y, 1.0f)));
+    return vec2((PI + phi) * (0.5f / PI), theta / PI);
+}
+
+vec3 EnvDistribution::uv_to_direction(vec2 uv) {
+    const float phi = uv.x * 2.0f * PI - PI;
+    const float theta = uv.y * PI;
+    const float sin_theta = std::sin(theta);
+    return vec3(sin_theta * std::sin(phi), std::cos(theta), sin_theta * std::cos(phi));
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// importance sampling of the lat-long environment map (`ray_miss.rmiss`): a piecewise constant 2d distribution
+/// of the texel luminance * sin(theta), marginal cdf of the rows & conditional cdf of each row (pbrt's Distribution2D)
+/// built once on the CPU (the rows in parallel), uploaded to `SWS_ENV_DISTRIBUTION_BINDING` and read by the CPU tracer as well
+/// </summary>
+class EnvDistribution {
+public:
+    /// <summary>
+    /// RGBA8 sRGB texels (the same as the `VK_FORMAT_R8G8B8A8_SRGB` image), row 0: theta = 0 (+y)
+    /// num_threads = 0: use all the hardware threads
+    /// </summary>
+    void build(const uint8_t* pixels, int width, int height, uint32_t num_threads = 0);
+
+    /// <summary>
+    /// a direction for u in [0, 1)^2, pdf: solid angle (0: no sample)
+    /// </summary>
+    vec3 sample(vec2 u, float& pdf) const;
+
+    /// <summary>
+    /// solid angle pdf of `sample`
+    /// </summary>
+    float pdf(vec3 direction) const;
+
+    /// <summary>
+    /// probability of sampling the environment instead of the emitters (`UniformParams::env_light_prob`)
+    /// </summary>
+    float light_probability(float env_strength, int num_emitters) const;
+
+    float get_integral() const { return _data.empty() ? 0.0f : _data[2]; }
+    const std::vector<float>& get_data() const { return _data; }
+    uint32_t get_size_in_bytes() const { return static_cast<uint32_t>(_data.size() * sizeof(float)); }
+
+    /// <summary>
+    /// the same mapping as `DirToLatLong` of `ray_miss.rmiss`
+    /// </summary>
+    static vec2 direction_to_uv(vec3 direction);
+    static vec3 uv_to_direction(vec2 uv);
+
+private:
+    // SWS_ENV_HEADER_SIZE, pdf, conditional cdf, marginal cdf
+    std::vector<float> _data{};
+    int _width{ 0 };
+    int _height{ 0 };
+};
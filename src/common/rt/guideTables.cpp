@@ -0,0 +1,139 @@
+#include "guideTables.h"
+#include "cpuParallel.h"
+
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+    const float PI = 3.1415926535897932384626433832795f;
+
+    // the probability of a DTree node is spread over its square of cells, the same child order as the tree walk
+    // (0: (t1, p1), 1: (t1, p2), 2: (t2, p1), 3: (t2, p2)), the nodes deeper than the table are summed up
+    void fill_cells(const DTree* d_root, int node, int size, int t0, int p0, float prob, float* cells) {
+        const DTree& now = d_root[node];
+        if (now._child_index[0] == -1 || size == 1) {
+            const float cell_prob = prob / static_cast<float>(size * size);
+            for (int t = t0; t < t0 + size; ++t) {
+                for (int p = p0; p < p0 + size; ++p) {
+                    cells[t * SWS_GUIDE_TABLE_RES + p] = cell_prob;
+                }
+            }
+            return;
+        }
+
+        float total_flux = 0.0f;
+        for (int i = 0; i < DTREE_CHILD_NODE; ++i) {
+            total_flux += d_root[now._child_index[i]]._flux;
+        }
+        const int half = size / 2;
+        for (int i = 0; i < DTREE_CHILD_NODE; ++i) {
+            const float child_prob = (total_flux > 0.0f) ? prob * d_root[now._child_index[i]]._flux / total_flux : prob / DTREE_CHILD_NODE;
+            fill_cells(d_root, now._child_index[i], half, t0 + (i >> 1) * half, p0 + (i & 1) * half, child_prob, cells);
+        }
+    }
+
+    // alias table (Vose): x: the probability of keeping the cell, y: the alias cell, z & w: the pdfs of both
+    void build_alias(const float* cells, vec4* table) {
+        const int n = SWS_GUIDE_TABLE_SIZE;
+        // uniform over the (cos theta, phi) square -> uniform over the sphere
+        const float to_solid_angle = n / (4.0f * PI);
+
+        float scaled[SWS_GUIDE_TABLE_SIZE];
+        int small[SWS_GUIDE_TABLE_SIZE], large[SWS_GUIDE_TABLE_SIZE];
+        int num_small = 0, num_large = 0;
+        for (int i = 0; i < n; ++i) {
+            scaled[i] = cells[i] * n;
+            if (scaled[i] < 1.0f) {
+                small[num_small++] = i;
+            } else {
+                large[num_large++] = i;
+            }
+        }
+        while (num_small > 0 && num_large > 0) {
+            const int s = small[--num_small];
+            const int l = large[--num_large];
+            table[s] = vec4(scaled[s], static_cast<float>(l), 0.0f, 0.0f);
+            scaled[l] -= 1.0f - scaled[s];
+            if (scaled[l] < 1.0f) {
+                small[num_small++] = l;
+            } else {
+                large[num_large++] = l;
+            }
+        }
+        // rounding: the rest keep their cell
+        while (num_large > 0) {
+            const int l = large[--num_large];
+            table[l] = vec4(1.0f, static_cast<float>(l), 0.0f, 0.0f);
+        }
+        while (num_small > 0) {
+            const int s = small[--num_small];
+            table[s] = vec4(1.0f, static_cast<float>(s), 0.0f, 0.0f);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            table[i].z = cells[i] * to_solid_angle;
+            table[i].w = cells[static_cast<int>(table[i].y)] * to_solid_angle;
+        }
+    }
+}
+
+void GuideTables::build(const DTree* d_root, int num_nodes, uint32_t num_threads) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    _data.assign(static_cast<size_t>(num_nodes) * SWS_GUIDE_TABLE_SIZE, vec4(0.0f));
+    cpu_parallel::parallel_for(static_cast<uint32_t>(num_nodes), num_threads, [&](uint32_t node) {
+        const int root = GET_DTREE_ROOT_INDEX_BY_STREE_INDEX(static_cast<int>(node));
+        vec4* table = _data.data() + static_cast<size_t>(node) * SWS_GUIDE_TABLE_SIZE;
+
+        std::vector<float> cells(SWS_GUIDE_TABLE_SIZE);
+        fill_cells(d_root, root, SWS_GUIDE_TABLE_RES, 0, 0, 1.0f, cells.data());
+        build_alias(cells.data(), table);
+
+        // no flux: BSDF sampling only, the same threshold as the training
+        if (d_root[root]._flux <= 1e-6f) {
+            table[0].x = -1.0f;
+        }
+    });
+
+    auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+    std::cout << "[SDTree] " << num_nodes << " guide tables, build time: " << delta.count() << "s" << std::endl;
+}
+
+bool GuideTables::valid(int index) const {
+    return _data[static_cast<size_t>(index) * SWS_GUIDE_TABLE_SIZE].x >= 0.0f;
+}
+
+vec3 GuideTables::sample(int index, float u_cell, vec2 u, float& pdf) const {
+    const float x = u_cell * SWS_GUIDE_TABLE_SIZE;
+    const int i = std::min(static_cast<int>(x), SWS_GUIDE_TABLE_SIZE - 1);
+    const vec4& entry = _data[static_cast<size_t>(index) * SWS_GUIDE_TABLE_SIZE + i];
+    const bool keep = (x - static_cast<float>(i)) < entry.x;
+    const int cell = keep ? i : static_cast<int>(entry.y);
+    pdf = keep ? entry.z : entry.w;
+    const vec2 tp = (vec2(static_cast<float>(cell / SWS_GUIDE_TABLE_RES), static_cast<float>(cell % SWS_GUIDE_TABLE_RES)) + u) / static_cast<float>(SWS_GUIDE_TABLE_RES);
+    return tp_to_direction(tp);
+}
+
+float GuideTables::pdf(int index, vec3 direction) const {
+    const vec2 tp = direction_to_tp(direction);
+    const int t = std::min(static_cast<int>(tp.x * SWS_GUIDE_TABLE_RES), SWS_GUIDE_TABLE_RES - 1);
+    const int p = std::min(static_cast<int>(tp.y * SWS_GUIDE_TABLE_RES), SWS_GUIDE_TABLE_RES - 1);
+    return _data[static_cast<size_t>(index) * SWS_GUIDE_TABLE_SIZE + t * SWS_GUIDE_TABLE_RES + p].z;
+}
+
+vec2 GuideTables::direction_to_tp(vec3 direction) {
+    direction = glm::normalize(direction);
+    const float cos_theta = std::min(std::max(direction.z, -1.0f), 1.0f);
+    float phi = std::atan2(direction.y, direction.x);
+    if (phi < 0.0f) { phi += BB_PI2; }
+    return vec2((cos_theta + 1.0f) / 2.0f, phi / BB_PI2);
+}
+
+vec3 GuideTables::tp_to_direction(vec2 tp) {
+    const float cos_theta = 2.0f * tp.x - 1.0f;
+    const float phi = tp.y * BB_PI2;
+    const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+    return vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+}
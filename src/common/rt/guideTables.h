@@ -0,0 +1,49 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+#include "ppg.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// ppg guiding: the directional distribution of every STree node (its DTree) flattened after the training into a
+/// piecewise constant SWS_GUIDE_TABLE_RES^2 distribution over the (cos theta, phi) square & its alias table,
+/// uploaded to `SWS_GUIDE_TABLES_BINDING` and read by the CPU tracer as well (one lookup to sample or to evaluate)
+/// </summary>
+class GuideTables {
+public:
+    /// <summary>
+    /// the DTrees of the STree nodes [0, num_nodes), the nodes in parallel
+    /// num_threads = 0: use all the hardware threads
+    /// </summary>
+    void build(const DTree* d_root, int num_nodes, uint32_t num_threads = 0);
+
+    /// <summary>
+    /// false: the DTree has no flux, BSDF sampling only (`guide_dtree_index`)
+    /// </summary>
+    bool valid(int index) const;
+
+    /// <summary>
+    /// u_cell picks the cell, u is the position inside the cell, pdf: solid angle (`sample_direction`)
+    /// </summary>
+    vec3 sample(int index, float u_cell, vec2 u, float& pdf) const;
+
+    /// <summary>
+    /// solid angle pdf of `sample` (`eval_direction`)
+    /// </summary>
+    float pdf(int index, vec3 direction) const;
+
+    const std::vector<vec4>& get_data() const { return _data; }
+    uint32_t get_size_in_bytes() const { return static_cast<uint32_t>(_data.size() * sizeof(vec4)); }
+
+    /// <summary>
+    /// the same mapping as `xyz2thetaphi` & `thetaphi2xyz` of the shaders
+    /// </summary>
+    static vec2 direction_to_tp(vec3 direction);
+    static vec3 tp_to_direction(vec2 tp);
+
+private:
+    // SWS_GUIDE_TABLE_SIZE entries per node, see SWS_GUIDE_TABLE_RES
+    std::vector<vec4> _data{};
+};
@@ -1,11 +1,13 @@
 #include "ppg.h"
+#include "shared_with_shaders.h"
 
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 
 const int STree::MAX_NODE = 10000;
 int STree::__node_index = 0;
-int STree::__trained_spp = 0;
 
 std::vector<int> STree::__flux(STree::MAX_NODE, 0);
 DTree* STree::__root = nullptr;
@@ -223,6 +225,44 @@ void DTree::initial_split(int index, int depth) {
     }
 }
 
+void DTree::rebuild(const int index) {
+    const float total_flux = _flux;
+    if (total_flux <= 0.0f) { return; }
+
+    // breadth first: the node budget goes to the coarse levels first, the children of a node are consecutive
+    // src: the node of the old tree (-1: below an old leaf, the flux is spread evenly)
+    struct Entry { int src; int dst; };
+    std::vector<DTree> nodes(1);
+    nodes[0]._flux = total_flux;
+    std::vector<Entry> queue = { { index, 0 } };
+    for (size_t q = 0; q < queue.size(); ++q) {
+        const Entry e = queue[q];
+        const float flux = nodes[e.dst]._flux;
+        if (flux / total_flux <= __rho || nodes.size() + DTREE_CHILD_NODE > static_cast<size_t>(MAX_NODE)) { continue; }
+
+        const DTree* src = (e.src == -1) ? nullptr : this + (e.src - index);
+        const bool src_split = (src != nullptr) && (src->_child_index[0] != -1);
+        const int first = static_cast<int>(nodes.size());
+        for (int i = 0; i < DTREE_CHILD_NODE; ++i) {
+            DTree child;
+            child._flux = src_split ? (this + (src->_child_index[i] - index))->_flux : flux / DTREE_CHILD_NODE;
+            nodes.push_back(child);
+            nodes[e.dst]._child_index[i] = index + first + i;
+            queue.push_back({ src_split ? src->_child_index[i] : -1, first + i });
+        }
+    }
+
+    std::copy(nodes.begin(), nodes.end(), this);
+    __node_index[GET_DTREE_INDEX(index)] = static_cast<int>(nodes.size()) - 1;
+}
+
+void DTree::reset_flux(const int index) {
+    const int num_nodes = __node_index[GET_DTREE_INDEX(index)] + 1;
+    for (int i = 0; i < num_nodes; ++i) {
+        this[i]._flux = 0.0f;
+    }
+}
+
 void DTree::print(int index, int depth, DInterval degrees) {
     std::cout << std::string(static_cast<int>(depth << 1), ' ') << index
         << ": flux = " << _flux
@@ -253,8 +293,9 @@ int DTree::get_root_index_by_STree_index(int index) {
 }
 
 void DTree::copy(int src_index, int dst_index) {
-    int node_num = __node_index[src_index];
-    __node_index[dst_index] = node_num;
+    // the last used node included
+    int node_num = __node_index[src_index] + 1;
+    __node_index[dst_index] = node_num - 1;
 
     assert(__root != nullptr);
     DTree* src_addr = __root + get_root_index_by_STree_index(src_index);
@@ -272,4 +313,24 @@ void DTree::copy(int src_index, int dst_index) {
         }
         ++dst_addr;
     }
-}
\ No newline at end of file
+}
+
+bool fill_sdtree(STree* s_root, DTree* d_root, const RecordPerPixel* records, uint32_t num_records) {
+    bool filled = false;
+    const RecordPerPixel* d = records;
+    for (uint32_t i = 0; i < num_records; ++i) {
+        if (d->num != 0) {
+            filled = true;
+            for (int num_idx = 0; num_idx < d->num; ++num_idx) {
+                auto& pos = d->record[num_idx].p;
+                auto& dir = d->record[num_idx].d;
+                int index = s_root->find_index(0, 0, { pos[0],pos[1],pos[2] });
+                int dtree_index = DTree::get_root_index_by_STree_index(index);
+                // the radiance estimate (divided by the pdf of the sample), not the count of the records
+                d_root[dtree_index].fill(dtree_index, dir[0], dir[1], pos[3], { {0.0,1.0f},{0.0f,1.0f} });
+            }
+        }
+        ++d;
+    }
+    return filled;
+}
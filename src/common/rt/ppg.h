@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <iostream>
+#include <cstdint>
 #define STREE_CHILD_NODE 2
 #define DTREE_CHILD_NODE 4
 
@@ -32,7 +33,6 @@ public:
     static DTree* __root;
     static int __node_index;
     static std::vector<int> __flux;
-    static int __trained_spp;
 
     STree();
 
@@ -89,6 +89,17 @@ public:
     void fill(const int index, const float theta, const float phi, const float Li, const DInterval angles);
     void initial_split(int index, int depth);
 
+    /// <summary>
+    /// only called by the root: the tree is built again from its flux, a node is split while it holds more than
+    /// `__rho` of the total flux, the nodes below are merged (the flux is kept)
+    /// </summary>
+    void rebuild(const int index);
+
+    /// <summary>
+    /// only called by the root: the same nodes, no flux (the records of the next iteration)
+    /// </summary>
+    void reset_flux(const int index);
+
     void copy(int src_index, int dst_index);
 
     void print(int index, int depth, DInterval degrees = { 0.0,1.0f,0.0,1.0f });
@@ -102,4 +113,12 @@ public:
     int _child_index[DTREE_CHILD_NODE];
     float _flux;
     float ___padding[3];
-};
\ No newline at end of file
+};
+
+struct RecordPerPixel;
+
+/// <summary>
+/// fill the records (read back from the radiance cache) into the SDTree, the trees are refined by `PPGSchedule`
+/// return false if there is no record
+/// </summary>
+bool fill_sdtree(STree* s_root, DTree* d_root, const RecordPerPixel* records, uint32_t num_records);
@@ -0,0 +1,119 @@
+#include "ppgSchedule.h"
+
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+    // the records per STree leaf before a split: c * sqrt(2^k) (the paper's c)
+    const float STREE_THRESHOLD_C = 12000.0f;
+}
+
+void PPGSchedule::start(DTree* d_root, uint32_t budget_spp) {
+    // the structure is kept, the first iteration is not guided
+    for (int i = 0; i <= STree::__node_index; ++i) {
+        const int root_index = DTree::get_root_index_by_STree_index(i);
+        d_root[root_index].reset_flux(root_index);
+    }
+    _training = true;
+    _iteration = 0;
+    _budget_spp = budget_spp;
+    _frames_left = 1;
+    _trained_spp = 0;
+    _variances.clear();
+    _moments.clear();
+    _num_frames = 0;
+}
+
+bool PPGSchedule::add_frame(STree* s_root, DTree* d_root, const RecordPerPixel* records, uint32_t num_records, GuideTables& guide_tables) {
+    if (!_training) {
+        return false;
+    }
+    if (!fill_sdtree(s_root, d_root, records, num_records)) {
+        std::cout << "[SDTree] No record this frame!" << std::endl;
+    }
+
+    // dynamic resolution: a new trace extent starts the statistics again
+    if (_moments.size() != num_records) {
+        _moments.assign(num_records, vec2(0.0f));
+        _num_frames = 0;
+    }
+    for (uint32_t i = 0; i < num_records; ++i) {
+        const float li = (records[i].num != 0) ? records[i].record[0].p[3] : 0.0f;
+        _moments[i] += vec2(li, li * li);
+    }
+    ++_num_frames;
+    ++_trained_spp;
+
+    if (--_frames_left > 0) {
+        return false;
+    }
+    end_iteration(s_root, d_root, guide_tables);
+    return true;
+}
+
+void PPGSchedule::end_iteration(STree* s_root, DTree* d_root, GuideTables& guide_tables) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // 1. the variance of the iteration: the mean of the per-pixel sample variance
+    float variance = 0.0f;
+    if (_num_frames > 1 && !_moments.empty()) {
+        const float n = static_cast<float>(_num_frames);
+        double sum = 0.0;
+        for (const vec2& m : _moments) {
+            sum += std::max(0.0f, (m.y - m.x * m.x / n) / (n - 1.0f));
+        }
+        variance = static_cast<float>(sum / _moments.size());
+    }
+    _variances.push_back(variance);
+
+    // 2. spatial split by the records of this iteration, the children get a copy of the DTree
+    const uint32_t iteration_spp = 1u << _iteration;
+    s_root->update(0, 0, static_cast<int>(STREE_THRESHOLD_C * std::sqrt(static_cast<float>(iteration_spp))));
+    std::fill(STree::__flux.begin(), STree::__flux.end(), 0);
+
+    // 3. the DTrees follow the flux of this iteration, compiled for the next one, then emptied
+    for (int i = 0; i <= STree::__node_index; ++i) {
+        const int root_index = DTree::get_root_index_by_STree_index(i);
+        d_root[root_index].rebuild(root_index);
+    }
+    guide_tables.build(d_root, STree::__node_index + 1);
+    for (int i = 0; i <= STree::__node_index; ++i) {
+        const int root_index = DTree::get_root_index_by_STree_index(i);
+        d_root[root_index].reset_flux(root_index);
+    }
+
+    auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+    std::cout << "[PPG] iteration " << _iteration << ": " << iteration_spp << " spp, variance: " << variance
+        << ", STree nodes: " << STree::__node_index + 1 << ", update time: " << delta.count() << "s" << std::endl;
+
+    if (should_stop()) {
+        _training = false;
+        std::cout << "[PPG] training done, " << _trained_spp << " spp" << std::endl;
+        return;
+    }
+    ++_iteration;
+    _frames_left = 1u << _iteration;
+    _moments.clear();
+    _num_frames = 0;
+}
+
+bool PPGSchedule::should_stop() const {
+    // the spp of the whole budget after this iteration & after the next one
+    const uint32_t next_spp = 1u << (_iteration + 1);
+    if (_trained_spp + next_spp >= _budget_spp) {
+        return true;
+    }
+    const size_t k = _variances.size() - 1;
+    if (k < 1 || _variances[k - 1] <= 0.0f || _variances[k] <= 0.0f) {
+        return false;
+    }
+
+    // the next iteration improves the variance by the same ratio as this one,
+    // it pays off if the rest of the budget rendered with it is less noisy than with the current distribution
+    const float ratio = std::min(_variances[k] / _variances[k - 1], 1.0f);
+    const float variance_now = _variances[k] / static_cast<float>(_budget_spp - _trained_spp);
+    const float variance_next = _variances[k] * ratio / static_cast<float>(_budget_spp - _trained_spp - next_spp);
+    return variance_next >= variance_now;
+}
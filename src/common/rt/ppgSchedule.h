@@ -0,0 +1,54 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+#include "ppg.h"
+#include "guideTables.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// ppg training in iterations of doubling spp (Mueller et al. 2017): iteration k collects the records of 2^k frames,
+/// then the STree is split by c * sqrt(2^k) records per leaf, the DTrees are rebuilt from the flux of the iteration,
+/// compiled into the guide tables (the next iteration is guided by them) and emptied.
+/// the training stops when one more iteration is not expected to lower the variance of the whole budget
+/// </summary>
+class PPGSchedule {
+public:
+    /// <summary>
+    /// budget_spp: the training & the guided rendering after it, the flux of the DTrees is emptied
+    /// </summary>
+    void start(DTree* d_root, uint32_t budget_spp);
+    void stop() { _training = false; }
+
+    /// <summary>
+    /// the records of one frame (`fill_sdtree`) & the variance of the iteration (the radiance of the first vertex),
+    /// return true at the end of an iteration: `guide_tables` is rebuilt, `training()` is false after the last one
+    /// </summary>
+    bool add_frame(STree* s_root, DTree* d_root, const RecordPerPixel* records, uint32_t num_records, GuideTables& guide_tables);
+
+    bool training() const { return _training; }
+    int get_iteration() const { return _iteration; }
+    uint32_t get_frames_left() const { return _frames_left; }
+    uint32_t get_trained_spp() const { return _trained_spp; }
+
+    /// <summary>
+    /// the mean per-pixel variance of each finished iteration (0: one frame, not measured)
+    /// </summary>
+    const std::vector<float>& get_variances() const { return _variances; }
+
+private:
+    void end_iteration(STree* s_root, DTree* d_root, GuideTables& guide_tables);
+    bool should_stop() const;
+
+    bool _training{ false };
+    int _iteration{ 0 };
+    uint32_t _budget_spp{ 0 };
+    uint32_t _frames_left{ 0 };
+    uint32_t _trained_spp{ 0 };
+    std::vector<float> _variances{};
+
+    // per pixel: sum & squared sum of the radiance of this iteration
+    std::vector<vec2> _moments{};
+    uint32_t _num_frames{ 0 };
+};
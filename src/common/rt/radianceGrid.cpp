@@ -0,0 +1,124 @@
+#include "radianceGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // lowbias32, the same as `hash_u32`
+    uint32_t hash_u32(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+}
+
+RadianceGrid::RadianceGrid() {
+    _checksums.reset(new std::atomic<uint32_t>[SWS_RADIANCE_GRID_NUM_CELLS]);
+    _accum.reset(new std::atomic<uint32_t>[4 * SWS_RADIANCE_GRID_NUM_CELLS]);
+    _radiance.resize(SWS_RADIANCE_GRID_NUM_CELLS);
+    _age.resize(SWS_RADIANCE_GRID_NUM_CELLS);
+    clear();
+}
+
+void RadianceGrid::clear() {
+    for (uint32_t i = 0; i < SWS_RADIANCE_GRID_NUM_CELLS; ++i) {
+        _checksums[i].store(0, std::memory_order_relaxed);
+        for (uint32_t k = 0; k < 4; ++k) {
+            _accum[4 * i + k].store(0, std::memory_order_relaxed);
+        }
+    }
+    std::fill(_radiance.begin(), _radiance.end(), vec4(0.0f));
+    std::fill(_age.begin(), _age.end(), 0u);
+}
+
+void RadianceGrid::key(vec3 position, vec3 normal, uint32_t& slot, uint32_t& checksum) {
+    const uint32_t cx = static_cast<uint32_t>(static_cast<int32_t>(std::floor(position.x / SWS_RADIANCE_GRID_CELL_SIZE)));
+    const uint32_t cy = static_cast<uint32_t>(static_cast<int32_t>(std::floor(position.y / SWS_RADIANCE_GRID_CELL_SIZE)));
+    const uint32_t cz = static_cast<uint32_t>(static_cast<int32_t>(std::floor(position.z / SWS_RADIANCE_GRID_CELL_SIZE)));
+    const vec3 a = glm::abs(normal);
+    const int axis = (a.x >= a.y && a.x >= a.z) ? 0 : ((a.y >= a.z) ? 1 : 2);
+    const uint32_t bin = 2u * axis + ((normal[axis] < 0.0f) ? 1u : 0u);
+    slot = hash_u32(cx ^ hash_u32(cy ^ hash_u32(cz ^ hash_u32(bin))));
+    checksum = std::max(hash_u32(bin + hash_u32(cz + hash_u32(cy + hash_u32(cx + 0x9e3779b9u)))), 1u);
+}
+
+int RadianceGrid::find(vec3 position, vec3 normal, bool claim) const {
+    uint32_t slot, checksum;
+    key(position, normal, slot, checksum);
+    for (int probe = 0; probe < SWS_RADIANCE_GRID_NUM_PROBES; ++probe) {
+        const uint32_t index = (slot + probe) & (SWS_RADIANCE_GRID_NUM_CELLS - 1);
+        uint32_t stored = _checksums[index].load(std::memory_order_relaxed);
+        if (stored == 0 && claim) {
+            // atomicCompSwap, `stored` is the current value on failure
+            if (_checksums[index].compare_exchange_strong(stored, checksum)) {
+                return static_cast<int>(index);
+            }
+        }
+        if (stored == checksum) {
+            return static_cast<int>(index);
+        }
+        if (stored == 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+bool RadianceGrid::query(vec3 position, vec3 normal, vec3& radiance) const {
+    radiance = vec3(0.0f);
+    const int index = find(position, normal, false);
+    if (index < 0) {
+        return false;
+    }
+    const vec4 cell = _radiance[index];
+    radiance = vec3(cell);
+    return cell.w >= SWS_RADIANCE_GRID_MIN_SAMPLES;
+}
+
+void RadianceGrid::update(vec3 position, vec3 normal, vec3 radiance) {
+    if (std::isnan(radiance.x) || std::isnan(radiance.y) || std::isnan(radiance.z)) {
+        return;
+    }
+    const int index = find(position, normal, true);
+    if (index < 0) {
+        return;
+    }
+    for (int k = 0; k < 3; ++k) {
+        const float value = Clamp(radiance[k], 0.0f, SWS_RADIANCE_GRID_MAX_RADIANCE);
+        _accum[4 * index + k].fetch_add(static_cast<uint32_t>(value * SWS_RADIANCE_GRID_FIXED_POINT + 0.5f), std::memory_order_relaxed);
+    }
+    _accum[4 * index + 3].fetch_add(1, std::memory_order_relaxed);
+}
+
+void RadianceGrid::resolve() {
+    for (uint32_t i = 0; i < SWS_RADIANCE_GRID_NUM_CELLS; ++i) {
+        if (_checksums[i].load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        const uint32_t num = _accum[4 * i + 3].load(std::memory_order_relaxed);
+        if (num == 0) {
+            if (++_age[i] > SWS_RADIANCE_GRID_MAX_AGE) {
+                _radiance[i] = vec4(0.0f);
+                _checksums[i].store(0, std::memory_order_relaxed);
+                _age[i] = 0;
+            }
+            continue;
+        }
+
+        const float count = static_cast<float>(num);
+        const vec3 mean = vec3(
+            static_cast<float>(_accum[4 * i + 0].load(std::memory_order_relaxed)),
+            static_cast<float>(_accum[4 * i + 1].load(std::memory_order_relaxed)),
+            static_cast<float>(_accum[4 * i + 2].load(std::memory_order_relaxed))) / (SWS_RADIANCE_GRID_FIXED_POINT * count);
+        const vec4 history = _radiance[i];
+        const float n = std::min(history.w + count, SWS_RADIANCE_GRID_MAX_SAMPLES);
+        _radiance[i] = vec4(glm::mix(vec3(history), mean, std::min(count / n, 1.0f)), n);
+        for (uint32_t k = 0; k < 4; ++k) {
+            _accum[4 * i + k].store(0, std::memory_order_relaxed);
+        }
+        _age[i] = 0;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// CPU reference of the radiance grid (`SWS_RADIANCE_GRID_BINDING`): the same hash table of `RadianceGridCell`,
+/// `update` is called by the tracing threads (atomics), `resolve` once after the launch like `radiance_grid_resolve.comp`
+/// </summary>
+class RadianceGrid {
+public:
+    RadianceGrid();
+
+    /// <summary>
+    /// all the cells are empty, the same as the `vkCmdFillBuffer` of `RTApp::fill_rt_command_buffer`
+    /// </summary>
+    void clear();
+
+    /// <summary>
+    /// the cached outgoing radiance of a diffuse vertex, false: no cell or too few samples (`grid_query`)
+    /// </summary>
+    bool query(vec3 position, vec3 normal, vec3& radiance) const;
+
+    /// <summary>
+    /// a sample of the outgoing radiance of a diffuse vertex (`grid_update`), thread safe
+    /// </summary>
+    void update(vec3 position, vec3 normal, vec3 radiance);
+
+    /// <summary>
+    /// the samples -> the history of the cells, the old cells are evicted
+    /// </summary>
+    void resolve();
+
+    /// <summary>
+    /// the first slot & the checksum (never 0) of the cell, the same as `grid_key`
+    /// </summary>
+    static void key(vec3 position, vec3 normal, uint32_t& slot, uint32_t& checksum);
+
+private:
+    int find(vec3 position, vec3 normal, bool claim) const;
+
+    // RadianceGridCell, the fields written by `update` are atomics
+    std::unique_ptr<std::atomic<uint32_t>[]> _checksums{};
+    std::unique_ptr<std::atomic<uint32_t>[]> _accum{};  // 4 per cell
+    std::vector<vec4> _radiance{};
+    std::vector<uint32_t> _age{};
+};
@@ -21,6 +21,9 @@ static const float sRotateSpeed = 0.25f;
 static const vec3 sSunPos = vec3(0.4f, 0.45f, 0.55f);
 static const float sAmbientLight = 0.1f;
 
+// SWS_DENOISE_*_BINDING -> offscreen image
+static const int sDenoiseImages[SWS_DENOISE_NUM_BINDINGS] = { 1, 3, 4, 2, 5, 6, 0 };
+
 void RTApp::init_imgui() {
     // 1: create descriptor pool for IMGUI
     // the size of the pool is very oversize, but it'mesh_idx copied from imgui demo itself.
@@ -62,8 +65,10 @@ void RTApp::init_imgui() {
     init_info.Device = _device;
     init_info.Queue = _graphics_queue;
     init_info.DescriptorPool = imgui_pool;
+    init_info.PipelineCache = _pipeline_cache.get();
     init_info.MinImageCount = 3;
-    init_info.ImageCount = 3;
+    // the vertex & index buffers of imgui are cycled by this count, one per frame in flight
+    init_info.ImageCount = std::max(_frames_in_flight, init_info.MinImageCount);
     init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     init_info.Subpass = 0;
 
@@ -101,6 +106,7 @@ void RTApp::draw_imgui(VkCommandBuffer cmd) {
     vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
     // ui start
+    const uint32_t temp_spp = _spp;
     ImGui::Text("FPS: %.2f", fps());
     ImGui::Text("SPP: %d", _spp);
     using Duration = std::chrono::duration<float>;
@@ -112,6 +118,14 @@ void RTApp::draw_imgui(VkCommandBuffer cmd) {
         ++id;
         ImGui::PushID(id);
         ImGui::Checkbox("Enable Camera", &mCameraEnable);
+        // off: the accumulation is reset when the camera moves
+        ImGui::Checkbox("Temporal Reprojection", &_temporal_on);
+        // the trace extent is scaled to the budget while the camera moves
+        ImGui::Checkbox("Dynamic Resolution", &_dynamic_resolution_on);
+        ImGui::SliderFloat("Trace Budget (ms)", &_target_trace_ms, 1.0f, 100.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Min Scale", &_min_resolution_scale, 0.1f, 1.0f);
+        ImGui::SliderFloat("Max Scale", &_max_resolution_scale, _min_resolution_scale, 1.0f);
+        ImGui::Text("Trace: %ux%u, %.2f ms", _trace_extent.width, _trace_extent.height, _trace_ms);
         ImGui::Text("position: %.3f, %.3f, %.3f", mCamera.GetPosition()[0], mCamera.GetPosition()[1], mCamera.GetPosition()[2]);
         ImGui::Text("target: %.3f, %.3f, %.3f", mCamera.GetDirection()[0] + mCamera.GetPosition()[0], mCamera.GetDirection()[1] + mCamera.GetPosition()[1], mCamera.GetDirection()[2] + mCamera.GetPosition()[2]);
         ImGui::Text("direction: %.3f, %.3f, %.3f", mCamera.GetDirection()[0], mCamera.GetDirection()[1], mCamera.GetDirection()[2]);
@@ -123,6 +137,13 @@ void RTApp::draw_imgui(VkCommandBuffer cmd) {
         ++id;
         ImGui::PushID(id);
         ImGui::SliderFloat("Light Strength", &_light_strength, 0.1f, 10.0f);
+        bool temp_nee_on = _nee_on;
+        ImGui::Checkbox("Next Event Estimation", &_nee_on);
+        if (temp_nee_on != _nee_on) { _spp = 1;  _time_start = _frame_time_samples.back(); }
+        // 0: no environment light
+        const float temp_env_strength = _env_strength;
+        ImGui::SliderFloat("Environment Strength", &_env_strength, 0.0f, 4.0f);
+        if (temp_env_strength != _env_strength) { _spp = 1;  _time_start = _frame_time_samples.back(); }
         int temp = _light_id;
         ImGui::SliderInt("Light ID", &_light_id, 0, 20);
         if (temp != _light_id) { _spp = 1;  _time_start = _frame_time_samples.back(); }
@@ -135,17 +156,65 @@ void RTApp::draw_imgui(VkCommandBuffer cmd) {
         if (temp != _mirror_id) { _spp = 1;  _time_start = _frame_time_samples.back(); }
         ImGui::PopID();
     }
+    if (ImGui::CollapsingHeader("Sampling")) {
+        ++id;
+        ImGui::PushID(id);
+        // max: no russian roulette
+        int temp = _rr_depth;
+        ImGui::SliderInt("Russian Roulette Depth", &_rr_depth, 1, SWS_MAX_RECURSION);
+        if (temp != _rr_depth) { _spp = 1;  _time_start = _frame_time_samples.back(); }
+        temp = _sampler_type;
+        ImGui::RadioButton("Independent", &_sampler_type, SWS_SAMPLER_INDEPENDENT);
+        ImGui::SameLine(); ImGui::RadioButton("Sobol", &_sampler_type, SWS_SAMPLER_SOBOL);
+        if (temp != _sampler_type) { _spp = 1;  _time_start = _frame_time_samples.back(); }
+
+        // adaptive sampling is off while the ppg is training (every pixel records its radiance)
+        const bool temp_adaptive_on = _adaptive_on;
+        const float temp_threshold = _adaptive_threshold;
+        ImGui::Checkbox("Adaptive Sampling", &_adaptive_on);
+        ImGui::SliderFloat("Error Threshold", &_adaptive_threshold, 0.005f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic);
+        if (temp_adaptive_on != _adaptive_on || temp_threshold != _adaptive_threshold) { _spp = 1;  _time_start = _frame_time_samples.back(); }
+        if (adaptive_sampling_on()) {
+            ImGui::Text("Active Tiles: %d / %d%s", static_cast<int>(_active_tiles.size()), _num_tiles, adaptive_sampling_converged() ? " (converged)" : "");
+        }
+        // the same estimator, the accumulation goes on
+        if (_wavefront_supported) {
+            ImGui::Checkbox("Wavefront", &_wavefront_on);
+        }
+        // biased: the paths stop at the cached radiance (the megakernel only)
+        const bool temp_grid_on = _grid_on;
+        const int temp_grid_start_bounce = _grid_start_bounce;
+        const float temp_grid_footprint = _grid_footprint;
+        ImGui::Checkbox("Radiance Grid", &_grid_on);
+        ImGui::SliderInt("Grid Start Bounce", &_grid_start_bounce, 1, SWS_MAX_RECURSION - 1);
+        ImGui::SliderFloat("Grid Footprint", &_grid_footprint, 1e-4f, 1.0f, "%.4f", ImGuiSliderFlags_Logarithmic);
+        if (temp_grid_on != _grid_on || temp_grid_start_bounce != _grid_start_bounce || temp_grid_footprint != _grid_footprint) { _spp = 1;  _time_start = _frame_time_samples.back(); }
+        ImGui::PopID();
+    }
+    if (ImGui::CollapsingHeader("Denoiser")) {
+        ++id;
+        ImGui::PushID(id);
+        // only filters the displayed image, the accumulation goes on
+        ImGui::Checkbox("Denoiser On", &_denoise_on);
+        ImGui::SliderInt("Iterations", &_denoise_iterations, 1, SWS_DENOISE_MAX_ITERATIONS);
+        ImGui::PopID();
+    }
     if (ImGui::CollapsingHeader("PPG")) {
         ImGui::Checkbox("PPG On", &_ppg_on);
-        //if (STree::__trained_spp > 200) {
-        // if (STree::__node_index > 2000) {
-            //_ppg_train_on = false;
-        //}
+        // the budget: the training & the guided rendering after it (the stopping rule of the schedule)
+        ImGui::SliderInt("Budget spp", &_ppg_budget_spp, 16, 8192, "%d", ImGuiSliderFlags_Logarithmic);
         bool temp_train_on = _ppg_train_on;
         ImGui::Checkbox("PPG Training", &_ppg_train_on);
         if (!temp_train_on && _ppg_train_on) {
-            STree::__trained_spp = 200;
-            _ppg_skip_first_data_obtain = 1;
+            // the first iteration is not guided
+            _ppg_schedule.start(_dtree.data(), static_cast<uint32_t>(_ppg_budget_spp));
+            // the records still in flight were traced before the start
+            for (RTFrameData& rt_frame : _rt_frames) {
+                rt_frame._radiance_cache_copied = false;
+            }
+            _ppg_test_on = false;
+        } else if (temp_train_on && !_ppg_train_on) {
+            _ppg_schedule.stop();
         }
 
         bool temp_test_on = _ppg_test_on;
@@ -155,7 +224,17 @@ void RTApp::draw_imgui(VkCommandBuffer cmd) {
         }
 
         ImGui::Text("STree nodes: %d", STree::__node_index + 1);
-        if (_ppg_train_on) { _ppg_test_on = false; }
+        if (_ppg_train_on) {
+            ImGui::Text("Iteration %d: %u frames left", _ppg_schedule.get_iteration(), _ppg_schedule.get_frames_left());
+        }
+        const std::vector<float>& variances = _ppg_schedule.get_variances();
+        for (size_t i = 0; i < variances.size(); ++i) {
+            ImGui::Text("Iteration %d: %u spp, variance %.4g", static_cast<int>(i), 1u << i, variances[i]);
+        }
+    }
+    if (ImGui::CollapsingHeader("Profiler")) {
+        // rolling averages, the gpu stages of `_frames_in_flight` frames ago
+        _profiler.draw_imgui();
     }
     if (ImGui::CollapsingHeader("Test")) {
         const bool temp_test_start = _test_start && !check_test_end();
@@ -176,6 +255,10 @@ void RTApp::draw_imgui(VkCommandBuffer cmd) {
         }
         if (temp_test_start) { ImGui::EndDisabled(); }
     }
+    // the settings restarted the accumulation, the cached radiance is stale
+    if (_spp == 1 && temp_spp != 1) {
+        _radiance_grid_clear = true;
+    }
     // ui end
 
     ImGui::Render();
@@ -240,91 +323,73 @@ void RTApp::init_render_pass_for_imgui() {
 }
 
 void RTApp::fill_rt_command_buffer(VkCommandBuffer cmd) {
+    RTFrameData& rt_frame = get_current_rt_frame();
     if (_ppg_on) {
         // update tree
-        if (_ppg_train_on) {
-            if (_ppg_skip_first_data_obtain >= 0) {
-                --_ppg_skip_first_data_obtain;
-            } else {
-                VkBufferCopy copy = {};
-                copy.srcOffset = 0;
-                copy.dstOffset = 0;
-                copy.size = _radiance_cache_buffer_size;
-                //std::vector<float> li_record;
-                vkCmdCopyBuffer(cmd, _radiance_cache_gpu._buffer, _radiance_cache_cpu._buffer, 1, &copy);
-                {
-                    void* data;
-                    vmaMapMemory(_allocator, _radiance_cache_cpu._allocation, &data);
-                    STree* s_root = _stree.data();
-                    DTree* d_root = _dtree.data();
-                    RecordPerPixel* d = static_cast<RecordPerPixel*>(data);
-                    const uint32_t windows_size = _window_extent.width * _window_extent.height;
-                    bool should_update_sdtree = false;
-                    for (uint32_t i = 0; i < windows_size; ++i) {
-                        if (d->num != 0) {
-                            should_update_sdtree = true;
-                            for (int num_idx = 0; num_idx < d->num; ++num_idx) {
-                                auto& pos = d->record[num_idx].p;
-                                auto& dir = d->record[num_idx].d;
-                                int index = s_root->find_index(0, 0, { pos[0],pos[1],pos[2] });
-                                int dtree_index = DTree::get_root_index_by_STree_index(index);
-                                //li_record.push_back(pos[3]);
-                                d_root[dtree_index].fill(dtree_index, dir[0], dir[1], 1.0f, { {0.0,1.0f},{0.0f,1.0f} });
-                            }
-                        }
-                        ++d;
-                    }
-                    if (should_update_sdtree) {
-                        for (int i = 0; i <= STree::__node_index; ++i) {
-                            int dtree_index = DTree::get_root_index_by_STree_index(i);
-                            if (d_root[dtree_index]._flux) {
-                                d_root[dtree_index].update(dtree_index, 0);
-                            }
-                        }
-                        s_root->update(0, 0, 20000);
-                    } else {
-                        std::cout << "[SDTree] No update this iteration!" << std::endl;
-                    }
-                    vmaUnmapMemory(_allocator, _radiance_cache_cpu._allocation);
-
-                    //if (li_record.begin() != li_record.end()) {
-                    //    sort(li_record.begin(), li_record.end());
-                    //    std::cout << *li_record.begin() << std::endl;
-                    //    std::cout << *li_record.rbegin() << std::endl;
-                    //}
-                }
-                if (--STree::__trained_spp <= 0) {
-                    _ppg_train_on = false;
+        if (_ppg_train_on && rt_frame._radiance_cache_copied) {
+            // the records copied by this frame in flight last time, its fence is waited
+            Profiler::CpuZone zone(_profiler, "ppg training");
+            void* data;
+            vmaMapMemory(_allocator, rt_frame._radiance_cache_cpu._allocation, &data);
+            STree* s_root = _stree.data();
+            DTree* d_root = _dtree.data();
+            const RecordPerPixel* d = static_cast<const RecordPerPixel*>(data);
+            // dynamic resolution: the records of the traced pixels are packed at the front
+            const uint32_t windows_size = rt_frame._trace_extent.width * rt_frame._trace_extent.height;
+            if (_ppg_schedule.add_frame(s_root, d_root, d, windows_size, _guide_tables)) {
+                // the end of an iteration: the next one (or the rendering) is guided by the new tables,
+                // the records of the other frames in flight are dropped (the old tables) & the image starts again
+                _ppg_update_gpu_sdtree = true;
+                _ppg_test_on = true;
+                _ppg_train_on = _ppg_schedule.training();
+                for (RTFrameData& other : _rt_frames) {
+                    other._radiance_cache_copied = false;
                 }
+                _spp = 1;
+                _time_start = _frame_time_samples.back();
             }
+            vmaUnmapMemory(_allocator, rt_frame._radiance_cache_cpu._allocation);
         }
+        rt_frame._radiance_cache_copied = false;
         if (_ppg_update_gpu_sdtree) {
             _ppg_update_gpu_sdtree = false;
+            Profiler::CpuZone zone(_profiler, "sdtree upload");
+            _profiler.begin_gpu_zone(cmd, "sdtree upload");
+            // the earlier frames in flight may still trace with the old trees
+            rt_utils::buffer_barrier(cmd, _guide_tables_gpu._buffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            rt_utils::buffer_barrier(cmd, _stree_gpu._buffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
             {
-                auto s_root = _stree.data();
-                auto d_root = _dtree.data();
+                // compiled by the schedule, the initial DTrees if there is no training yet
+                if (_guide_tables.get_data().empty()) {
+                    _guide_tables.build(_dtree.data(), STree::__node_index + 1);
+                }
                 void* data;
-                vmaMapMemory(_allocator, _dtree_cpu._allocation, &data);
-                memcpy(data, _dtree.data(), _dtree_buffer_size);
-                vmaUnmapMemory(_allocator, _dtree_cpu._allocation);
+                // the staging buffers of this frame in flight: its fence is waited, no copy out of them is pending
+                vmaMapMemory(_allocator, rt_frame._guide_tables_staging._allocation, &data);
+                memcpy(data, _guide_tables.get_data().data(), _guide_tables.get_size_in_bytes());
+                vmaUnmapMemory(_allocator, rt_frame._guide_tables_staging._allocation);
 
                 VkBufferCopy copy = {};
                 copy.srcOffset = 0;
                 copy.dstOffset = 0;
-                copy.size = _dtree_buffer_size;
-                vkCmdCopyBuffer(cmd, _dtree_cpu._buffer, _dtree_gpu._buffer, 1, &copy);
+                copy.size = _guide_tables.get_size_in_bytes();
+                vkCmdCopyBuffer(cmd, rt_frame._guide_tables_staging._buffer, _guide_tables_gpu._buffer, 1, &copy);
             }
             {
                 void* data;
-                vmaMapMemory(_allocator, _stree_cpu._allocation, &data);
+                vmaMapMemory(_allocator, rt_frame._stree_staging._allocation, &data);
                 memcpy(data, _stree.data(), _stree_buffer_size);
-                vmaUnmapMemory(_allocator, _stree_cpu._allocation);
+                vmaUnmapMemory(_allocator, rt_frame._stree_staging._allocation);
                 VkBufferCopy copy = {};
                 copy.srcOffset = 0;
                 copy.dstOffset = 0;
                 copy.size = _stree_buffer_size;
-                vkCmdCopyBuffer(cmd, _stree_cpu._buffer, _stree_gpu._buffer, 1, &copy);
+                vkCmdCopyBuffer(cmd, rt_frame._stree_staging._buffer, _stree_gpu._buffer, 1, &copy);
             }
+            // visible to the trace rays & the wavefront passes of this frame
+            rt_utils::buffer_barrier(cmd, _guide_tables_gpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+            rt_utils::buffer_barrier(cmd, _stree_gpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+            _profiler.end_gpu_zone(cmd);
         }
     }
     // update params
@@ -351,16 +416,32 @@ void RTApp::fill_rt_command_buffer(VkCommandBuffer cmd) {
     moveDelta *= sMoveSpeed * dt * (mCtrlDown ? sAccelMult : 1.0f);
     mCamera.Move(moveDelta.x, moveDelta.y);
 
+    // dynamic resolution: a new trace extent resets the accumulation (`_spp` = 1, no reprojection)
+    read_trace_time();
+    update_trace_extent(mCamera.IsCameraChanged());
+
+    // temporal reprojection: the history follows the camera instead of being reset, every tile is traced again
+    const bool reproject = mCamera.IsCameraChanged() && _temporal_on && _spp > 1;
     if (mCamera.IsCameraChanged()) {
-        _spp = 1;
+        if (reproject) {
+            _adaptive_last_spp = 0;
+        } else {
+            _spp = 1;
+        }
         _time_start = _frame_time_samples.back();
     }
 
+    update_active_tiles(cmd);
+
     uniform_data.camPos = vec4(mCamera.GetPosition(), 0.0f);
     uniform_data.camDir = vec4(mCamera.GetDirection(), 0.0f);
     uniform_data.camUp = vec4(mCamera.GetUp(), 0.0f);
     uniform_data.camSide = vec4(mCamera.GetSide(), 0.0f);
     uniform_data.camNearFarFov = vec4(mCamera.GetNearPlane(), mCamera.GetFarPlane() * 100, Deg2Rad(mCamera.GetFovY()), 0.0f);
+    uniform_data.prevCamPos = vec4(vec3(_prev_uniform_data.camPos), _prev_uniform_data.camNearFarFov.z);
+    uniform_data.prevCamDir = _prev_uniform_data.camDir;
+    uniform_data.prevCamUp = _prev_uniform_data.camUp;
+    uniform_data.prevCamSide = _prev_uniform_data.camSide;
     uniform_data.accumulate_spp = _spp;
     uniform_data.random_seed = rand();
     uniform_data.light_strength = _light_strength;
@@ -369,72 +450,157 @@ void RTApp::fill_rt_command_buffer(VkCommandBuffer cmd) {
     uniform_data.mirror_id = _mirror_id;
     uniform_data.ppg_train_on = _ppg_on && _ppg_train_on;
     uniform_data.ppg_test_on = _ppg_on && _ppg_test_on;
+    uniform_data.nee_on = _nee_on;
+    // the emitters are built for one light id
+    uniform_data.num_emitters = (_light_id == _emitters_light_id) ? static_cast<int>(_num_emitters) : 0;
+    uniform_data.emitters_area = _emitters_area;
+    uniform_data.rr_depth = _rr_depth;
+    uniform_data.sampler_type = _sampler_type;
+    uniform_data.adaptive_on = adaptive_sampling_on();
+    uniform_data.num_active_tiles = static_cast<int>(_active_tiles.size());
+    uniform_data.reproject_on = reproject;
+    uniform_data.trace_width = static_cast<int>(_trace_extent.width);
+    uniform_data.trace_height = static_cast<int>(_trace_extent.height);
+    uniform_data.env_strength = _env_strength;
+    uniform_data.env_light_prob = _env_distribution.light_probability(_env_strength, uniform_data.num_emitters);
+    uniform_data.grid_on = radiance_grid_on();
+    uniform_data.grid_start_bounce = _grid_start_bounce;
+    uniform_data.grid_footprint = _grid_footprint;
     mLastRec = _frame_time_samples.back();
+    _prev_uniform_data = uniform_data;
 
-    char* data = nullptr;
-    vmaMapMemory(_allocator, _uniform_data_buffer._allocation, (void**)(&data));
-    memcpy(data, &uniform_data, sizeof(UniformParams));
-    vmaUnmapMemory(_allocator, _uniform_data_buffer._allocation);
+    // the slice of this frame, the previous frames may still read theirs
+    memcpy(_uniform_data_mapped + get_current_frame_idx() * _uniform_data_stride, &uniform_data, sizeof(UniformParams));
 
     VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
     // wait for offscreen image
-    // TODO: need more specific cmd stage
+    // the contents are kept across frames (adaptive sampling only writes the active tiles), undefined only in the first frame
+    // the blit of the last frame -> written by the ray tracing & the compute passes (wavefront, denoiser)
+    const bool first_frame = (_frame_number == 0);
+    const VkPipelineStageFlags shader_stages = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     rt_utils::image_barrier(cmd,
         _offscreen_image[0]._image._image,
         subresource_range,
-        0,
+        first_frame ? 0 : VK_ACCESS_TRANSFER_READ_BIT,
         VK_ACCESS_SHADER_WRITE_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL
+        first_frame ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_LAYOUT_GENERAL,
+        first_frame ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+        shader_stages
     );
 
-    rt_utils::image_barrier(cmd,
-        _offscreen_image[1]._image._image,
-        subresource_range,
-        0,
-        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL
-    );
+    for (int i = 1; i < static_cast<int>(_offscreen_image.size()); ++i) {
+        rt_utils::image_barrier(cmd,
+            _offscreen_image[i]._image._image,
+            subresource_range,
+            first_frame ? 0 : VK_ACCESS_SHADER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            first_frame ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_GENERAL
+        );
+    }
 
-    /// ray tracing
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rt_pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rt_pipeline_layout, 0, static_cast<uint32_t>(_rt_set.size()), _rt_set.data(), 0, 0);
+    if (reproject) {
+        _profiler.begin_gpu_zone(cmd, "reproject history");
+        copy_history_images(cmd);
+        _profiler.end_gpu_zone(cmd);
+    }
 
-    VkStridedDeviceAddressRegionKHR raygen_region = {
-        _SBT.get_SBT_address(_device) + _SBT.get_raygen_offset(),
-        _SBT.get_groups_stride(),
-        _SBT.get_raygen_size()
-    };
+    // radiance grid: empty in the first frame & after the settings changed, the cells stay valid while the camera moves
+    if (_radiance_grid_clear && radiance_grid_on()) {
+        _radiance_grid_clear = false;
+        rt_utils::buffer_barrier(cmd, _radiance_grid_gpu._buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdFillBuffer(cmd, _radiance_grid_gpu._buffer, 0, VK_WHOLE_SIZE, 0);
+        rt_utils::buffer_barrier(cmd, _radiance_grid_gpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
 
-    VkStridedDeviceAddressRegionKHR missRegion = {
-        _SBT.get_SBT_address(_device) + _SBT.get_miss_groups_offset(),
-        _SBT.get_groups_stride(),
-        _SBT.get_miss_groups_size()
-    };
+    // trace time (with the denoiser), read back when this frame's fence is waited again
+    const uint32_t query = get_current_frame_idx() * 2;
+    vkCmdResetQueryPool(cmd, _timestamp_query_pool, query, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestamp_query_pool, query);
 
-    VkStridedDeviceAddressRegionKHR hitRegion = {
-       _SBT.get_SBT_address(_device) + _SBT.get_hit_groups_offset(),
-        _SBT.get_groups_stride(),
-        _SBT.get_hit_groups_size()
-    };
+    /// ray tracing
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rt_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rt_pipeline_layout, 0, static_cast<uint32_t>(rt_frame._rt_set.size()), rt_frame._rt_set.data(), 0, 0);
+
+    VkStridedDeviceAddressRegionKHR raygen_region, missRegion, hitRegion;
+    _SBT.get_regions(_device, raygen_region, missRegion, hitRegion);
 
     VkStridedDeviceAddressRegionKHR callable_region = {};
     if (!(_test_start && check_test_end())) {
-        _loader_manager->vkCmdTraceRaysKHR(cmd, &raygen_region, &missRegion, &hitRegion, &callable_region, _window_extent.width, _window_extent.height, 1u);
+        _profiler.begin_gpu_zone(cmd, "trace rays");
+        if (_wavefront_on) {
+            // one path per traced pixel (the same mapping as the ray generation shader)
+            const bool adaptive = adaptive_sampling_on();
+            if (!adaptive || !_active_tiles.empty()) {
+                const uint32_t groups_x = adaptive ? static_cast<uint32_t>(_active_tiles.size()) : (_trace_extent.width + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+                const uint32_t groups_y = adaptive ? 1u : (_trace_extent.height + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+                fill_wavefront_command_buffer(cmd, groups_x, groups_y);
+            }
+        } else if (adaptive_sampling_on()) {
+            // a row of the active tiles
+            if (!_active_tiles.empty()) {
+                _loader_manager->vkCmdTraceRaysKHR(cmd, &raygen_region, &missRegion, &hitRegion, &callable_region,
+                    static_cast<uint32_t>(_active_tiles.size()) * SWS_ADAPTIVE_TILE_SIZE, SWS_ADAPTIVE_TILE_SIZE, 1u);
+            }
+        } else {
+            _loader_manager->vkCmdTraceRaysKHR(cmd, &raygen_region, &missRegion, &hitRegion, &callable_region, _trace_extent.width, _trace_extent.height, 1u);
+        }
+        _profiler.end_gpu_zone(cmd);
+        if (radiance_grid_on()) {
+            _profiler.begin_gpu_zone(cmd, "radiance grid");
+            fill_radiance_grid_command_buffer(cmd);
+            _profiler.end_gpu_zone(cmd);
+        }
+        if (_ppg_on && _ppg_train_on) {
+            // read back when the fence of this frame is waited again, the next frame writes the records after the copy
+            _profiler.begin_gpu_zone(cmd, "ppg readback");
+            VkBufferCopy copy = {};
+            copy.srcOffset = 0;
+            copy.dstOffset = 0;
+            copy.size = sizeof(RecordPerPixel) * _trace_extent.width * _trace_extent.height;
+            rt_utils::buffer_barrier(cmd, _radiance_cache_gpu._buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            vkCmdCopyBuffer(cmd, _radiance_cache_gpu._buffer, rt_frame._radiance_cache_cpu._buffer, 1, &copy);
+            rt_utils::buffer_barrier(cmd, _radiance_cache_gpu._buffer, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+            rt_utils::buffer_barrier(cmd, rt_frame._radiance_cache_cpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+            _profiler.end_gpu_zone(cmd);
+            rt_frame._radiance_cache_copied = true;
+        }
+    }
+
+    if (_adaptive_measure) {
+        // read back in `update_active_tiles` after `_frames_in_flight` frames
+        rt_utils::buffer_barrier(cmd, _tile_errors_gpu._buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        VkBufferCopy copy = {};
+        copy.srcOffset = 0;
+        copy.dstOffset = 0;
+        copy.size = _num_tiles * sizeof(uint32_t);
+        vkCmdCopyBuffer(cmd, _tile_errors_gpu._buffer, _tile_errors_cpu._buffer, 1, &copy);
+        rt_utils::buffer_barrier(cmd, _tile_errors_cpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    }
+
+    if (_denoise_on) {
+        _profiler.begin_gpu_zone(cmd, "denoise");
+        fill_denoise_command_buffer(cmd);
+        _profiler.end_gpu_zone(cmd);
     }
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestamp_query_pool, query + 1);
+    rt_frame._trace_extent = _trace_extent;
 
     // copy to swapchain
-    // TODO: need more specific cmd stage
+    _profiler.begin_gpu_zone(cmd, "swapchain copy");
     rt_utils::image_barrier(cmd,
         _offscreen_image[0]._image._image,
         subresource_range,
         VK_ACCESS_SHADER_WRITE_BIT,
         VK_ACCESS_TRANSFER_READ_BIT,
         VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        shader_stages,
+        VK_PIPELINE_STAGE_TRANSFER_BIT
     );
 
+    // the acquire semaphore is waited at the color attachment output: chained to the blit
     VkImage swap = _swapchain_images[_swapchain_image_index];
     rt_utils::image_barrier(cmd,
         swap,
@@ -442,35 +608,47 @@ void RTApp::fill_rt_command_buffer(VkCommandBuffer cmd) {
         0,
         VK_ACCESS_TRANSFER_WRITE_BIT,
         VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT
     );
 
-    VkImageCopy copy_region = {};
-    copy_region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-    copy_region.srcOffset = { 0, 0, 0 };
-    copy_region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-    copy_region.dstOffset = { 0, 0, 0 };
-    copy_region.extent = { _window_extent.width, _window_extent.height, 1 };
-    vkCmdCopyImage(cmd,
+    // dynamic resolution: the traced part is upscaled (bilinear), 1:1 at the full extent
+    VkImageBlit blit_region = {};
+    blit_region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blit_region.srcOffsets[0] = { 0, 0, 0 };
+    blit_region.srcOffsets[1] = { static_cast<int32_t>(_trace_extent.width), static_cast<int32_t>(_trace_extent.height), 1 };
+    blit_region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blit_region.dstOffsets[0] = { 0, 0, 0 };
+    blit_region.dstOffsets[1] = { static_cast<int32_t>(_window_extent.width), static_cast<int32_t>(_window_extent.height), 1 };
+    vkCmdBlitImage(cmd,
         _offscreen_image[0]._image._image,
         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
         swap,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1,
-        &copy_region
+        &blit_region,
+        VK_FILTER_LINEAR
     );
 
+    // loaded by the imgui render pass
     rt_utils::image_barrier(cmd,
         swap,
         subresource_range,
         VK_ACCESS_TRANSFER_WRITE_BIT,
-        0,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
     );
+    _profiler.end_gpu_zone(cmd);
 
     // draw imgui
+    Profiler::CpuZone zone(_profiler, "imgui");
+    _profiler.begin_gpu_zone(cmd, "imgui");
     draw_imgui(cmd);
+    _profiler.end_gpu_zone(cmd);
 }
 
 bool RTApp::check_test_end() {
@@ -492,6 +670,175 @@ bool RTApp::check_test_end() {
     return ret;
 }
 
+void RTApp::read_trace_time() {
+    // the fence of this frame is waited, its timestamps from `_frames_in_flight` frames ago are done
+    const uint32_t frame_idx = get_current_frame_idx();
+    const VkExtent2D timestamp_extent = get_current_rt_frame()._trace_extent;
+    if (timestamp_extent.width == 0) {
+        return;
+    }
+    uint64_t timestamps[2] = {};
+    const VkResult result = vkGetQueryPoolResults(_device, _timestamp_query_pool, frame_idx * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+    _trace_ms = static_cast<float>(timestamps[1] - timestamps[0]) * _physical_device_properties.limits.timestampPeriod * 1e-6f;
+    // only the frames of the current extent are measured
+    if (timestamp_extent.width == _trace_extent.width && timestamp_extent.height == _trace_extent.height) {
+        _trace_ms_sum += _trace_ms;
+        ++_trace_ms_count;
+    }
+}
+
+void RTApp::update_trace_extent(bool camera_changed) {
+    // the extent is scaled while the camera moves, the full extent is traced once it stays still
+    // (a new extent resets the accumulation, the converged image is not traded for the frame time)
+    if (camera_changed) {
+        _frames_since_camera_change = 0;
+    } else if (_frames_since_camera_change < RESOLUTION_INTERVAL) {
+        ++_frames_since_camera_change;
+    }
+    const bool interacting = _dynamic_resolution_on && _frames_since_camera_change < RESOLUTION_INTERVAL;
+
+    // every `RESOLUTION_INTERVAL` measured frames: the trace time ~ the number of pixels (scale^2),
+    // the dead band keeps the scale (and the accumulation) for small errors
+    if (interacting && _trace_ms_count >= RESOLUTION_INTERVAL) {
+        const float trace_ms = _trace_ms_sum / static_cast<float>(_trace_ms_count);
+        if (trace_ms > 1.1f * _target_trace_ms || trace_ms < 0.9f * _target_trace_ms) {
+            _interactive_scale = std::clamp(_resolution_scale * std::sqrt(_target_trace_ms / trace_ms), _min_resolution_scale, _max_resolution_scale);
+        }
+        _trace_ms_sum = 0.0f;
+        _trace_ms_count = 0;
+    }
+
+    const float scale = interacting ? _interactive_scale : _max_resolution_scale;
+    VkExtent2D extent = {
+        std::max(1u, static_cast<uint32_t>(static_cast<float>(_window_extent.width) * scale + 0.5f)),
+        std::max(1u, static_cast<uint32_t>(static_cast<float>(_window_extent.height) * scale + 0.5f))
+    };
+    extent.width = std::min(extent.width, _window_extent.width);
+    extent.height = std::min(extent.height, _window_extent.height);
+    if (extent.width == _trace_extent.width && extent.height == _trace_extent.height) {
+        return;
+    }
+
+    // the images & buffers are allocated at the full extent, only the traced part changes
+    _trace_extent = extent;
+    _resolution_scale = scale;
+    _num_tiles = ((extent.width + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE) * ((extent.height + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE);
+    _trace_ms_sum = 0.0f;
+    _trace_ms_count = 0;
+    _spp = 1;
+    _time_start = _frame_time_samples.back();
+}
+
+void RTApp::copy_history_images(VkCommandBuffer cmd) {
+    // accumulated, variance, normal & depth -> history, read by `reproject_history` at the reprojected pixels
+    // the images stay in the general layout
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    const int sources[] = { 1, 2, 4 };
+    const int histories[] = { 7, 8, 9 };
+
+    VkImageCopy copy_region = {};
+    copy_region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    copy_region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    copy_region.extent = { _trace_extent.width, _trace_extent.height, 1 };
+    for (int i = 0; i < 3; ++i) {
+        VkImage src = _offscreen_image[sources[i]]._image._image;
+        VkImage dst = _offscreen_image[histories[i]]._image._image;
+        rt_utils::image_barrier(cmd, src, subresource_range,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+        rt_utils::image_barrier(cmd, dst, subresource_range,
+            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+        vkCmdCopyImage(cmd, src, VK_IMAGE_LAYOUT_GENERAL, dst, VK_IMAGE_LAYOUT_GENERAL, 1, &copy_region);
+        rt_utils::image_barrier(cmd, src, subresource_range,
+            VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+        rt_utils::image_barrier(cmd, dst, subresource_range,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+    }
+}
+
+bool RTApp::adaptive_sampling_on() const {
+    return _adaptive_on && !(_ppg_on && _ppg_train_on);
+}
+
+bool RTApp::adaptive_sampling_converged() const {
+    return adaptive_sampling_on() && _spp > 1 && _active_tiles.empty();
+}
+
+void RTApp::update_active_tiles(VkCommandBuffer cmd) {
+    _adaptive_measure = false;
+    if (!adaptive_sampling_on()) {
+        _adaptive_last_spp = 0;
+        return;
+    }
+
+    // 1. reset (just turned on, or the ui resets `_spp` after this call: it is 2 in the next frame), every tile is traced
+    const bool reset = (_spp == 1 || _adaptive_last_spp == 0 || _spp < _adaptive_last_spp);
+    _adaptive_last_spp = _spp;
+    if (reset) {
+        // a pending measurement is of the old image
+        _adaptive_measure_frame = -1;
+        _adaptive_measure_spp = _spp;
+        _active_tiles.resize(_num_tiles);
+        for (uint32_t i = 0; i < _num_tiles; ++i) {
+            _active_tiles[i] = i;
+        }
+        upload_active_tiles(cmd);
+        return;
+    }
+    if (_active_tiles.empty()) {
+        return;
+    }
+
+    // 2. the last measurement is done (the fence of the frame that copied it is waited), the tiles below the threshold are removed
+    // (not `_spp` arithmetic: `_spp` also counts the frames skipped while the window is minimized)
+    const int frame_idx = static_cast<int>(get_current_frame_idx());
+    if (_adaptive_measure_frame == frame_idx) {
+        _adaptive_measure_frame = -1;
+        void* data;
+        vmaMapMemory(_allocator, _tile_errors_cpu._allocation, &data);
+        const uint32_t* tile_errors = static_cast<const uint32_t*>(data);
+        size_t num_active = 0;
+        for (uint32_t tile_index : _active_tiles) {
+            float error;
+            memcpy(&error, &tile_errors[tile_index], sizeof(float));
+            if (error > _adaptive_threshold) {
+                _active_tiles[num_active++] = tile_index;
+            }
+        }
+        vmaUnmapMemory(_allocator, _tile_errors_cpu._allocation);
+        _active_tiles.resize(num_active);
+        upload_active_tiles(cmd);
+    }
+
+    // 3. measure the max error of the active tiles in this frame
+    if (_adaptive_measure_frame < 0 && _spp >= _adaptive_measure_spp + _adaptive_interval) {
+        _adaptive_measure_frame = frame_idx;
+        _adaptive_measure_spp = _spp;
+        rt_utils::buffer_barrier(cmd, _tile_errors_gpu._buffer, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdFillBuffer(cmd, _tile_errors_gpu._buffer, 0, VK_WHOLE_SIZE, 0);
+        rt_utils::buffer_barrier(cmd, _tile_errors_gpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        _adaptive_measure = true;
+    }
+}
+
+void RTApp::upload_active_tiles(VkCommandBuffer cmd) {
+    if (_active_tiles.empty()) {
+        return;
+    }
+    // recorded into the command buffer, no staging buffer shared with the frames in flight
+    // (vkCmdUpdateBuffer: up to 65536 bytes per call)
+    rt_utils::buffer_barrier(cmd, _active_tiles_gpu._buffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    const VkDeviceSize max_update_size = 65536;
+    const VkDeviceSize total_size = _active_tiles.size() * sizeof(uint32_t);
+    for (VkDeviceSize offset = 0; offset < total_size; offset += max_update_size) {
+        const VkDeviceSize size = std::min(max_update_size, total_size - offset);
+        vkCmdUpdateBuffer(cmd, _active_tiles_gpu._buffer, offset, size, reinterpret_cast<const uint8_t*>(_active_tiles.data()) + offset);
+    }
+    rt_utils::buffer_barrier(cmd, _active_tiles_gpu._buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
 RTApp::RTApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer) :_frame_time_samples(30) {
     _window_extent.width = width;
     _window_extent.height = height;
@@ -500,6 +847,12 @@ RTApp::RTApp(const char* name, uint32_t width, uint32_t height, bool use_validat
     create_window(name, width, height);
 }
 
+void RTApp::set_frames_in_flight(uint32_t frames_in_flight) {
+    _frames_in_flight = std::clamp(frames_in_flight, 1u, MAX_FRAMES_IN_FLIGHT);
+    _frames.assign(_frames_in_flight, FrameData{});
+    _rt_frames.assign(_frames_in_flight, RTFrameData{});
+}
+
 RTApp::~RTApp() {
     // must do it!
     // the resources of this derived class may be freed when the base class call it
@@ -527,69 +880,6 @@ int get_dtree_index(vec3 position, STree* s_root) {
 }
 
 
-vec2 xyz2thetaphi(vec3 xyz) {
-    xyz = normalize(xyz);
-    float cos_theta = std::min(std::max(xyz.z, -1.0f), 1.0f);
-    float phi = std::atan2(xyz.y, xyz.z);
-    if (phi < 0) { phi += BB_PI2; }
-    return vec2((cos_theta + 1.0f) / 2.0f, phi / BB_PI2);
-}
-
-vec3 thetaphi2xyz(vec2 tp) {
-    float cos_theta = 2.0f * tp.x - 1.0f;
-    float phi = tp.y * BB_PI2;
-    float sin_theta = sqrt(1 - cos_theta * cos_theta);
-
-    vec2 sc_phi = vec2(sin(phi), cos(phi));
-    return vec3(sin_theta * sc_phi.y, sin_theta * sc_phi.x, cos_theta);
-}
-
-float sample_direction(vec3 direction, int index, DTree* d_root) {
-    std::random_device seed;
-    std::ranlux48 engine(seed());
-    std::uniform_real_distribution<> distrib(0, 1.0f);
-
-    index = (index << DTREE_MAX_NODE_BIT);
-    DTree* now = d_root + index;
-    float root_flux = now->_flux;
-    vec4 interval = vec4(0.0f, 1.0f, 0.0f, 1.0f);
-    int depth = 0;
-
-    while (now->_child_index[0] != -1) {
-        float prob = distrib(engine) * now->_flux;
-        int idx = 0;
-        for (idx = 0; idx < 3; ++idx) {
-            prob -= d_root[now->_child_index[idx]]._flux;
-            if (prob < 0) {
-                break;
-            }
-        }
-
-        float t1 = interval[0];
-        float t2 = interval[1];
-        float p1 = interval[2];
-        float p2 = interval[3];
-        float tm = (t1 + t2) / 2;
-        float pm = (p1 + p2) / 2;
-        interval[0] = ((idx & 1) == 0) ? t1 : tm;
-        interval[1] = ((idx & 1) == 0) ? tm : t2;
-        interval[2] = ((idx >> 1) == 0) ? p1 : pm;
-        interval[3] = ((idx >> 1) == 0) ? pm : p2;
-
-        ++depth;
-        index = now->_child_index[idx];
-        now = d_root + index;
-    }
-
-    float pdf = now->_flux / root_flux / (4 * BB_PI);
-    //pdf *= pow(4, depth);
-    vec2 dir;
-    dir[0] = (distrib(engine) * (interval[1] - interval[0]) + interval[0]);
-    dir[1] = (distrib(engine) * (interval[3] - interval[2]) + interval[2]);
-    direction = thetaphi2xyz(dir);
-    return pdf;
-}
-
 void test_sdtree() {
     std::vector<STree> tmp_stree(STree::MAX_NODE);
     std::vector<DTree> tmp_dtree(DTree::MAX_NODE * STree::MAX_NODE); // TODO: node aligned, root_idx = 0 \to root_idx = MAX_NODE - 1
@@ -630,9 +920,17 @@ void test_sdtree() {
     const Position pos = { 0.1f,0.1f,0.1f };
     const vec3 pos_v = { pos.v[0], pos.v[1], pos.v[2] };
     int t_index = get_dtree_index(pos_v, s_root);
-    sample_direction(vec3(1.0f), t_index, d_root);
 
-    sample_direction(vec3(1.0f), 9, d_root);
+    GuideTables guide_tables;
+    guide_tables.build(d_root, STree::__node_index + 1);
+    std::mt19937 engine(0);
+    std::uniform_real_distribution<float> distrib(0.0f, 1.0f);
+    for (int index : { t_index, 9 }) {
+        float pdf;
+        const vec3 direction = guide_tables.sample(index, distrib(engine), vec2(distrib(engine), distrib(engine)), pdf);
+        std::cout << "sample " << index << ": " << direction.x << ", " << direction.y << ", " << direction.z
+            << ", pdf: " << pdf << ", eval: " << guide_tables.pdf(index, direction) << std::endl;
+    }
 
 
     // sample test
@@ -680,7 +978,7 @@ void RTApp::run() {
 }
 
 void RTApp::init_per_frame() {
-    if (_test_start && check_test_end()) {
+    if ((_test_start && check_test_end()) || adaptive_sampling_converged()) {
     } else {
         // FPS
         _frame_time_samples.push(std::chrono::high_resolution_clock::now());
@@ -709,6 +1007,13 @@ void RTApp::init() {
 
     init_pipeline();
 
+    init_denoise_pipeline();
+    if (_wavefront_supported) {
+        init_wavefront_pipelines();
+    }
+    init_radiance_grid_pipeline();
+    _pipeline_cache.log_creation_times();
+
     init_imgui();
 
     update_descriptors();
@@ -798,10 +1103,16 @@ void RTApp::draw() {
     // blocked or timeout
     // wait until the GPU has finished rendering the last frame.
     // timeout of 1 second
-    VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
-    VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    {
+        Profiler::CpuZone zone(_profiler, "wait fence");
+        VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
+        VK_CHECK(vkResetFences(_device, 1, &frame._render_fence)); // !!important!!
+    }
 
-    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+    {
+        Profiler::CpuZone zone(_profiler, "acquire");
+        acquire_swapchain_image(frame);
+    }
 
     // 2. prepare command buffer
 
@@ -815,7 +1126,14 @@ void RTApp::draw() {
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
 
     // fill ray-tracing cmd
-    fill_rt_command_buffer(cmd);
+    {
+        Profiler::CpuZone zone(_profiler, "record");
+        // the queries of this frame in flight were resolved, reused from here
+        _profiler.begin_frame(cmd, get_current_frame_idx());
+        _profiler.begin_gpu_zone(cmd, "frame");
+        fill_rt_command_buffer(cmd);
+        _profiler.end_gpu_zone(cmd);
+    }
 
     VK_CHECK(vkEndCommandBuffer(cmd));
 
@@ -833,7 +1151,10 @@ void RTApp::draw() {
 
     // submit command buffer to the queue and execute it.
     // _renderFence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    {
+        Profiler::CpuZone zone(_profiler, "submit");
+        VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit_info, frame._render_fence));
+    }
 
     // 5. display to the screen
     VkPresentInfoKHR present_info = vkinit::present_info();
@@ -845,7 +1166,10 @@ void RTApp::draw() {
     present_info.waitSemaphoreCount = 1;
     present_info.pWaitSemaphores = &frame._render_semaphore;
 
-    VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    {
+        Profiler::CpuZone zone(_profiler, "present");
+        VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+    }
 
     ++_frame_number;
 }
@@ -923,11 +1247,38 @@ void RTApp::init_vulkan() {
     // get ray-tracing properties
     _rt_properties = {};
     _rt_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+    // and the UUIDs for the acceleration structure cache
+    VkPhysicalDeviceIDProperties id_properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+    _rt_properties.pNext = &id_properties;
+    // and the subgroup operations of the wavefront compute shaders
+    VkPhysicalDeviceSubgroupProperties subgroup_properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES };
+    id_properties.pNext = &subgroup_properties;
     VkPhysicalDeviceProperties2 device_properties;
     device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
     device_properties.pNext = &_rt_properties;
     device_properties.properties = {};
     vkGetPhysicalDeviceProperties2(_physical_device, &device_properties);
+    _rt_properties.pNext = nullptr;
+
+    // wavefront: the queue sizes are on the GPU (indirect traces), the queues are appended with subgroup ballots
+    VkPhysicalDeviceRayTracingPipelineFeaturesKHR supported_rt_pipeline_feature{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR };
+    VkPhysicalDeviceFeatures2 supported_features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+    supported_features.pNext = &supported_rt_pipeline_feature;
+    vkGetPhysicalDeviceFeatures2(_physical_device, &supported_features);
+    const VkSubgroupFeatureFlags ballot = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+    _wavefront_supported = supported_rt_pipeline_feature.rayTracingPipelineTraceRaysIndirect
+        && (subgroup_properties.supportedOperations & ballot) == ballot
+        && (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT);
+    if (!_wavefront_supported) {
+        _wavefront_on = false;
+        std::cout << "[Wavefront] unsupported (needs rayTracingPipelineTraceRaysIndirect & subgroup ballots in compute shaders)" << std::endl;
+    }
+
+    ASCache::Identity as_identity;
+    memcpy(as_identity._device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+    memcpy(as_identity._driver_uuid, id_properties.driverUUID, VK_UUID_SIZE);
+    as_identity._driver_version = _physical_device_properties.driverVersion;
+    _as_cache.init(PROJECT_DIRECTORY"/cache", as_identity);
 
     // 4. VkDevice
     vkb::DeviceBuilder device_builder(physical_device);
@@ -939,6 +1290,7 @@ void RTApp::init_vulkan() {
     // (2) required by ray tracing pipeline
     VkPhysicalDeviceRayTracingPipelineFeaturesKHR rt_pipeline_feature{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR };
     rt_pipeline_feature.rayTracingPipeline = VK_TRUE;
+    rt_pipeline_feature.rayTracingPipelineTraceRaysIndirect = _wavefront_supported ? VK_TRUE : VK_FALSE; // wavefront only
     device_builder.add_pNext(&rt_pipeline_feature);
     // TODO
     VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES };
@@ -983,6 +1335,18 @@ void RTApp::init_vulkan() {
     // 7. loader
     _loader_manager = LoaderManager::get_instance();
     _loader_manager->init_extension_addr(_device);
+
+    // 8. Pipeline Cache
+    init_pipeline_cache();
+}
+
+void RTApp::init_pipeline_cache() {
+    _pipeline_cache.init(_device, _physical_device_properties, PROJECT_DIRECTORY"/cache", _name);
+    _main_deletion_queue.push_function(
+        [=]() {
+            _pipeline_cache.destroy();
+        }
+    );
 }
 
 void RTApp::init_swapchain() {
@@ -1038,7 +1402,7 @@ void RTApp::init_sync_structures_for_graphics_pass() {
     // so we can wait on it before using it on a GPU command (for the first frame)
     // initialized with signaled state
     VkFenceCreateInfo fence_create_info = vkinit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
-    for (int i = 0; i < FRAME_OVERLAP; ++i) {
+    for (uint32_t i = 0; i < _frames_in_flight; ++i) {
         FrameData& frame = _frames[i];
         VK_CHECK(vkCreateFence(_device, &fence_create_info, nullptr, &frame._render_fence));
 
@@ -1069,6 +1433,24 @@ void RTApp::init_sync_structures() {
             vkDestroyFence(_device, _upload_context._upload_fence, nullptr);
         }
     );
+
+    // trace time: 2 timestamps per frame in flight
+    VkQueryPoolCreateInfo query_pool_info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, nullptr };
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = _frames_in_flight * 2;
+    VK_CHECK(vkCreateQueryPool(_device, &query_pool_info, nullptr, &_timestamp_query_pool));
+    _main_deletion_queue.push_function(
+        [&]() {
+            vkDestroyQueryPool(_device, _timestamp_query_pool, nullptr);
+        }
+    );
+
+    _profiler.init(_physical_device, _device, _graphics_queue_family, _frames_in_flight);
+    _main_deletion_queue.push_function(
+        [&]() {
+            _profiler.destroy();
+        }
+    );
 }
 
 void RTApp::init_commands_for_graphics_pipeline() {
@@ -1080,7 +1462,7 @@ void RTApp::init_commands_for_graphics_pipeline() {
         VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
     );
 
-    for (int i = 0; i < FRAME_OVERLAP; ++i) {
+    for (uint32_t i = 0; i < _frames_in_flight; ++i) {
         FrameData& frame = _frames[i];
         VK_CHECK(vkCreateCommandPool(_device, &cmd_pool_info, nullptr, &frame._command_pool));
         // Create Command Buffer
@@ -1091,8 +1473,7 @@ void RTApp::init_commands_for_graphics_pipeline() {
     // resources
     _main_deletion_queue.push_function(
         [&]() {
-            for (int i = 0; i < FRAME_OVERLAP; ++i) {
-                FrameData& frame = _frames[i];
+            for (FrameData& frame : _frames) {
                 // destroying their parent pool will destroy all of the command buffers allocated from it
                 vkDestroyCommandPool(_device, frame._command_pool, nullptr);
             }
@@ -1105,13 +1486,31 @@ FrameData& RTApp::get_current_frame() {
 }
 
 uint32_t RTApp::get_current_frame_idx() const {
-    return _frame_number % FRAME_OVERLAP;
+    return _frame_number % _frames_in_flight;
+}
+
+RTApp::RTFrameData& RTApp::get_current_rt_frame() {
+    return _rt_frames[get_current_frame_idx()];
+}
+
+void RTApp::acquire_swapchain_image(FrameData& frame) {
+    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1'000'000'000, frame._present_semaphore, nullptr, &_swapchain_image_index));
+
+    // more frames in flight than swapchain images: the image may still be rendered by another frame
+    // (its own fence was waited & reset already)
+    if (_images_in_flight.size() != _swapchain_images.size()) {
+        _images_in_flight.assign(_swapchain_images.size(), VK_NULL_HANDLE);
+    }
+    VkFence& image_fence = _images_in_flight[_swapchain_image_index];
+    if (image_fence != VK_NULL_HANDLE && image_fence != frame._render_fence) {
+        VK_CHECK(vkWaitForFences(_device, 1, &image_fence, true, 1'000'000'000));
+    }
+    image_fence = frame._render_fence;
 }
 
 void RTApp::basic_clean_up() {
     if (_is_initialized) {
-        for (int i = 0; i < FRAME_OVERLAP; ++i) {
-            FrameData& frame = _frames[i];
+        for (FrameData& frame : _frames) {
             VK_CHECK(vkWaitForFences(_device, 1, &frame._render_fence, true, 1'000'000'000));
         }
         VK_CHECK(vkDeviceWaitIdle(_device));
@@ -1193,14 +1592,27 @@ void RTApp::init_offscreen_image() {
         1
     };
 
-    _offscreen_image.resize(2);
+    // result, accumulated, variance, albedo, normal & depth, denoiser ping, denoiser pong,
+    // history of the accumulated, variance, normal & depth (temporal reprojection)
+    // allocated once at the full extent, the dynamic resolution traces the top left `_trace_extent` part
+    _trace_extent = _window_extent;
+    _offscreen_image.resize(10);
     std::vector<VkImageUsageFlags> usage_flags = {
         { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT },
-        { VK_IMAGE_USAGE_STORAGE_BIT }
+        { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT },
+        { VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT }
     };
 
     // high precision for storage buffer
-    std::vector<VkFormat> formats = { _swapchain_image_format, VK_FORMAT_R32G32B32A32_SFLOAT };
+    std::vector<VkFormat> formats(_offscreen_image.size(), VK_FORMAT_R32G32B32A32_SFLOAT);
+    formats[0] = _swapchain_image_format;
 
     for (int i = 0; i < _offscreen_image.size(); ++i) {
         FrameBufferAttachment& attach = _offscreen_image[i];
@@ -1263,53 +1675,73 @@ void RTApp::init_framebuffers_for_imgui() {
 }
 
 void RTApp::init_pipeline() {
+    // 1. pipeline-layout, shared by the wavefront kernels (compute)
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(WavefrontParams);
+    push_constant_range.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = vkinit::pipeline_layout_create_info();
+    pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(_rt_set_layout.size());
+    pipeline_layout_info.pSetLayouts = _rt_set_layout.data();
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    VK_CHECK(vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr, &_rt_pipeline_layout));
+
+    // 2. pipeline and SBT
+    create_rt_pipeline("rt/ray_gen.rgen.bin", _SBT, _rt_pipeline);
+
+    _main_deletion_queue.push_function(
+        [=]() {
+            vkDestroyPipelineLayout(_device, _rt_pipeline_layout, nullptr);
+        }
+    );
+}
+
+void RTApp::create_rt_pipeline(const char* ray_gen_path, SBTHelper& sbt, VkPipeline& pipeline) {
     // 1. shaders and SBT
-    VkShaderModule ray_gen_shader = Shader::load_shader_module(_device, "rt/ray_gen.rgen.bin");
+    VkShaderModule ray_gen_shader = Shader::load_shader_module(_device, ray_gen_path);
     VkShaderModule ray_chit_shader = Shader::load_shader_module(_device, "rt/ray_chit.rchit.bin");
     VkShaderModule ray_miss_shader = Shader::load_shader_module(_device, "rt/ray_miss.rmiss.bin");
     VkShaderModule shadow_chit_shader = Shader::load_shader_module(_device, "rt/shadow_ray_chit.rchit.bin");
     VkShaderModule shadow_miss_shader = Shader::load_shader_module(_device, "rt/shadow_ray_miss.rmiss.bin");
 
-    _SBT.initialize(2, 2, _rt_properties.shaderGroupHandleSize, _rt_properties.shaderGroupBaseAlignment);
-    _SBT.set_raygen_stage(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_RAYGEN_BIT_KHR, ray_gen_shader));
+    sbt.initialize(2, 2, _rt_properties.shaderGroupHandleSize, _rt_properties.shaderGroupBaseAlignment);
+    sbt.set_raygen_stage(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_RAYGEN_BIT_KHR, ray_gen_shader));
 
-    _SBT.add_stage_to_hit_groups(
+    sbt.add_stage_to_hit_groups(
         { vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, ray_chit_shader) },
         SWS_PRIMARY_HIT_SHADERS_IDX
     );
-    _SBT.add_stage_to_hit_groups(
+    sbt.add_stage_to_hit_groups(
         { vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, shadow_chit_shader) },
         SWS_SHADOW_HIT_SHADERS_IDX
     );
 
-    _SBT.add_stage_to_miss_groups(
+    sbt.add_stage_to_miss_groups(
         vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_MISS_BIT_KHR, ray_miss_shader),
         SWS_PRIMARY_MISS_SHADERS_IDX
     );
-    _SBT.add_stage_to_miss_groups(
+    sbt.add_stage_to_miss_groups(
         vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_MISS_BIT_KHR, shadow_miss_shader),
         SWS_SHADOW_MISS_SHADERS_IDX
     );
 
-    // 2. pipeline-layout
-    VkPipelineLayoutCreateInfo pipeline_layout_info = vkinit::pipeline_layout_create_info();
-    pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(_rt_set_layout.size());
-    pipeline_layout_info.pSetLayouts = _rt_set_layout.data();
-    VK_CHECK(vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr, &_rt_pipeline_layout));
-
-    // 3. pipeline
+    // 2. pipeline
     VkRayTracingPipelineCreateInfoKHR rt_pipeline_info = { VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR, nullptr };
-    rt_pipeline_info.stageCount = _SBT.get_num_stages();
-    rt_pipeline_info.pStages = _SBT.get_stages();
-    rt_pipeline_info.groupCount = _SBT.get_num_groups();
-    rt_pipeline_info.pGroups = _SBT.get_groups();
+    rt_pipeline_info.stageCount = sbt.get_num_stages();
+    rt_pipeline_info.pStages = sbt.get_stages();
+    rt_pipeline_info.groupCount = sbt.get_num_groups();
+    rt_pipeline_info.pGroups = sbt.get_groups();
     rt_pipeline_info.maxPipelineRayRecursionDepth = 1; // TODO
     rt_pipeline_info.layout = _rt_pipeline_layout;
 
-    VK_CHECK(_loader_manager->vkCreateRayTracingPipelinesKHR(_device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rt_pipeline_info, VK_NULL_HANDLE, &_rt_pipeline));
+    auto start = std::chrono::high_resolution_clock::now();
+    VK_CHECK(_loader_manager->vkCreateRayTracingPipelinesKHR(_device, VK_NULL_HANDLE, _pipeline_cache.get(), 1, &rt_pipeline_info, VK_NULL_HANDLE, &pipeline));
+    _pipeline_cache.add_creation_time(start);
 
-    // 4. shader binding table
-    create_SBT();
+    // 3. shader binding table
+    create_SBT(pipeline, sbt);
 
     // shader module clean
     vkDestroyShaderModule(_device, ray_gen_shader, nullptr);
@@ -1318,19 +1750,227 @@ void RTApp::init_pipeline() {
     vkDestroyShaderModule(_device, shadow_chit_shader, nullptr);
     vkDestroyShaderModule(_device, shadow_miss_shader, nullptr);
 
+    const VkPipeline created = pipeline;
     _main_deletion_queue.push_function(
         [=]() {
-            vkDestroyPipeline(_device, _rt_pipeline, nullptr);
-            vkDestroyPipelineLayout(_device, _rt_pipeline_layout, nullptr);
+            vkDestroyPipeline(_device, created, nullptr);
+        }
+    );
+}
+
+void RTApp::init_denoise_pipeline() {
+    VkShaderModule atrous_shader = Shader::load_shader_module(_device, "rt/atrous.comp.bin");
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(DenoiseParams);
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = vkinit::pipeline_layout_create_info();
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &_denoise_set_layout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    VK_CHECK(vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr, &_denoise_pipeline_layout));
+
+    VkComputePipelineCreateInfo pipeline_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+    pipeline_info.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, atrous_shader);
+    pipeline_info.layout = _denoise_pipeline_layout;
+    auto start = std::chrono::high_resolution_clock::now();
+    VK_CHECK(vkCreateComputePipelines(_device, _pipeline_cache.get(), 1, &pipeline_info, nullptr, &_denoise_pipeline));
+    _pipeline_cache.add_creation_time(start);
+
+    vkDestroyShaderModule(_device, atrous_shader, nullptr);
+
+    _main_deletion_queue.push_function(
+        [=]() {
+            vkDestroyPipeline(_device, _denoise_pipeline, nullptr);
+            vkDestroyPipelineLayout(_device, _denoise_pipeline_layout, nullptr);
+        }
+    );
+}
+
+void RTApp::fill_denoise_command_buffer(VkCommandBuffer cmd) {
+    // the same passes as `CPUDenoiser::denoise`: prepare (iteration 0), then a-trous ping <-> pong,
+    // the last iteration writes the result image
+    VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _denoise_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _denoise_pipeline_layout, 0, 1, &_denoise_set, 0, nullptr);
+
+    DenoiseParams params = {};
+    params.num_iterations = _denoise_iterations;
+    params.light_strength = _light_strength;
+    params.width = static_cast<int>(_trace_extent.width);
+    params.height = static_cast<int>(_trace_extent.height);
+    const uint32_t groups_x = (_trace_extent.width + SWS_DENOISE_GROUP_SIZE - 1) / SWS_DENOISE_GROUP_SIZE;
+    const uint32_t groups_y = (_trace_extent.height + SWS_DENOISE_GROUP_SIZE - 1) / SWS_DENOISE_GROUP_SIZE;
+    for (int i = 0; i <= _denoise_iterations; ++i) {
+        // iteration 0: the ray tracing outputs & the previous use of the result image,
+        // then only the ping-pong pair, read & written by every iteration
+        const int first_binding = (i == 0) ? 0 : SWS_DENOISE_PING_BINDING;
+        const int last_binding = (i == 0) ? SWS_DENOISE_NUM_BINDINGS - 1 : SWS_DENOISE_PONG_BINDING;
+        for (int binding = first_binding; binding <= last_binding; ++binding) {
+            rt_utils::image_barrier(cmd,
+                _offscreen_image[sDenoiseImages[binding]]._image._image,
+                subresource_range,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_LAYOUT_GENERAL
+            );
+        }
+        params.iteration = i;
+        vkCmdPushConstants(cmd, _denoise_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoiseParams), &params);
+        vkCmdDispatch(cmd, groups_x, groups_y, 1);
+    }
+}
+
+VkPipeline RTApp::create_rt_compute_pipeline(const char* path, const VkSpecializationInfo* specialization) {
+    // compute: the set & push constants of the ray tracing pipeline layout
+    VkShaderModule shader = Shader::load_shader_module(_device, path);
+    VkComputePipelineCreateInfo pipeline_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+    pipeline_info.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, shader);
+    pipeline_info.stage.pSpecializationInfo = specialization;
+    pipeline_info.layout = _rt_pipeline_layout;
+    VkPipeline pipeline;
+    auto start = std::chrono::high_resolution_clock::now();
+    VK_CHECK(vkCreateComputePipelines(_device, _pipeline_cache.get(), 1, &pipeline_info, nullptr, &pipeline));
+    _pipeline_cache.add_creation_time(start);
+    vkDestroyShaderModule(_device, shader, nullptr);
+    return pipeline;
+}
+
+void RTApp::init_wavefront_pipelines() {
+    // ray tracing: the extension & shadow rays, the same hit & miss groups as the megakernel
+    create_rt_pipeline("rt/wavefront_extend.rgen.bin", _wavefront_extend_SBT, _wavefront_extend_pipeline);
+    create_rt_pipeline("rt/wavefront_shadow.rgen.bin", _wavefront_shadow_SBT, _wavefront_shadow_pipeline);
+
+    _wavefront_generate_pipeline = create_rt_compute_pipeline("rt/wavefront_generate.comp.bin", nullptr);
+    _wavefront_args_pipeline = create_rt_compute_pipeline("rt/wavefront_args.comp.bin", nullptr);
+    _wavefront_resolve_pipeline = create_rt_compute_pipeline("rt/wavefront_resolve.comp.bin", nullptr);
+
+    // one shading pipeline per material queue, the material is a specialization constant (no divergent branches)
+    VkSpecializationMapEntry queue_entry = { 0, 0, sizeof(int) };
+    for (int queue = 0; queue < SWS_WAVEFRONT_NUM_MATERIAL_QUEUES; ++queue) {
+        VkSpecializationInfo specialization = {};
+        specialization.mapEntryCount = 1;
+        specialization.pMapEntries = &queue_entry;
+        specialization.dataSize = sizeof(int);
+        specialization.pData = &queue;
+        _wavefront_shade_pipelines[queue] = create_rt_compute_pipeline("rt/wavefront_shade.comp.bin", &specialization);
+    }
+
+    _main_deletion_queue.push_function(
+        [=]() {
+            vkDestroyPipeline(_device, _wavefront_generate_pipeline, nullptr);
+            vkDestroyPipeline(_device, _wavefront_args_pipeline, nullptr);
+            vkDestroyPipeline(_device, _wavefront_resolve_pipeline, nullptr);
+            for (VkPipeline pipeline : _wavefront_shade_pipelines) {
+                vkDestroyPipeline(_device, pipeline, nullptr);
+            }
+        }
+    );
+}
+
+void RTApp::fill_wavefront_command_buffer(VkCommandBuffer cmd, uint32_t groups_x, uint32_t groups_y) {
+    // generate -> per bounce: shadow rays of the previous bounce, extension rays, shading by material -> resolve
+    // the queue sizes stay on the GPU, the launches read them as indirect arguments
+    const VkAccessFlags src_access = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    const VkAccessFlags dst_access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    const VkDeviceAddress counters_address = rt_utils::get_buffer_device_address(_device, _wavefront_counters_gpu._buffer).deviceAddress;
+    auto args_offset = [](int queue) {
+        return static_cast<VkDeviceSize>((SWS_WAVEFRONT_ARGS_OFFSET + 3 * queue) * sizeof(uint32_t));
+    };
+
+    VkStridedDeviceAddressRegionKHR extend_regions[3], shadow_regions[3];
+    _wavefront_extend_SBT.get_regions(_device, extend_regions[0], extend_regions[1], extend_regions[2]);
+    _wavefront_shadow_SBT.get_regions(_device, shadow_regions[0], shadow_regions[1], shadow_regions[2]);
+    VkStridedDeviceAddressRegionKHR callable_region = {};
+
+    rt_utils::buffer_barrier(cmd, _wavefront_counters_gpu._buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(cmd, _wavefront_counters_gpu._buffer, 0, VK_WHOLE_SIZE, 0);
+    rt_utils::memory_barrier(cmd, src_access, dst_access);
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _rt_pipeline_layout, 0, static_cast<uint32_t>(get_current_rt_frame()._rt_set.size()), get_current_rt_frame()._rt_set.data(), 0, 0);
+    const VkShaderStageFlags push_stages = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    WavefrontParams params = {};
+    params.extend_queue = SWS_QUEUE_EXTEND;
+    params.next_queue = SWS_QUEUE_EXTEND + 1;
+    vkCmdPushConstants(cmd, _rt_pipeline_layout, push_stages, 0, sizeof(WavefrontParams), &params);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _wavefront_generate_pipeline);
+    vkCmdDispatch(cmd, groups_x, groups_y, 1);
+
+    for (int bounce = 0; bounce <= SWS_MAX_RECURSION; ++bounce) {
+        params.bounce = bounce;
+        params.extend_queue = SWS_QUEUE_EXTEND + bounce % 2;
+        params.next_queue = SWS_QUEUE_EXTEND + (bounce + 1) % 2;
+
+        // trace arguments of the extension & shadow queues
+        rt_utils::memory_barrier(cmd, src_access, dst_access);
+        params.stage = SWS_WAVEFRONT_ARGS_TRACE;
+        vkCmdPushConstants(cmd, _rt_pipeline_layout, push_stages, 0, sizeof(WavefrontParams), &params);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _wavefront_args_pipeline);
+        vkCmdDispatch(cmd, 1, 1, 1);
+        rt_utils::memory_barrier(cmd, src_access, dst_access);
+
+        // the shadow rays of the previous shading
+        if (bounce > 0) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _wavefront_shadow_pipeline);
+            _loader_manager->vkCmdTraceRaysIndirectKHR(cmd, &shadow_regions[0], &shadow_regions[1], &shadow_regions[2], &callable_region,
+                counters_address + args_offset(SWS_QUEUE_SHADOW));
+        }
+        if (bounce == SWS_MAX_RECURSION) {
+            break;
+        }
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _wavefront_extend_pipeline);
+        _loader_manager->vkCmdTraceRaysIndirectKHR(cmd, &extend_regions[0], &extend_regions[1], &extend_regions[2], &callable_region,
+            counters_address + args_offset(params.extend_queue));
+
+        // dispatch arguments of the material queues
+        rt_utils::memory_barrier(cmd, src_access, dst_access);
+        params.stage = SWS_WAVEFRONT_ARGS_SHADE;
+        vkCmdPushConstants(cmd, _rt_pipeline_layout, push_stages, 0, sizeof(WavefrontParams), &params);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _wavefront_args_pipeline);
+        vkCmdDispatch(cmd, 1, 1, 1);
+        rt_utils::memory_barrier(cmd, src_access, dst_access);
+
+        // the queues are disjoint, no barriers between the materials
+        for (int queue = 0; queue < SWS_WAVEFRONT_NUM_MATERIAL_QUEUES; ++queue) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _wavefront_shade_pipelines[queue]);
+            vkCmdDispatchIndirect(cmd, _wavefront_counters_gpu._buffer, args_offset(queue));
+        }
+    }
+
+    rt_utils::memory_barrier(cmd, src_access, dst_access);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _wavefront_resolve_pipeline);
+    vkCmdDispatch(cmd, groups_x, groups_y, 1);
+}
+
+void RTApp::init_radiance_grid_pipeline() {
+    _radiance_grid_resolve_pipeline = create_rt_compute_pipeline("rt/radiance_grid_resolve.comp.bin", nullptr);
+    _main_deletion_queue.push_function(
+        [=]() {
+            vkDestroyPipeline(_device, _radiance_grid_resolve_pipeline, nullptr);
         }
     );
 }
 
-void RTApp::create_SBT() {
-    std::vector<unsigned char> group_handles(_SBT.get_num_groups() * _SBT.get_shader_handle_size());
-    VK_CHECK(_loader_manager->vkGetRayTracingShaderGroupHandlesKHR(_device, _rt_pipeline, 0, _SBT.get_num_groups(), group_handles.size(), group_handles.data()));
+void RTApp::fill_radiance_grid_command_buffer(VkCommandBuffer cmd) {
+    // the samples of this launch -> the history of the cells, read by the next launch
+    rt_utils::buffer_barrier(cmd, _radiance_grid_gpu._buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _radiance_grid_resolve_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _rt_pipeline_layout, 0, static_cast<uint32_t>(get_current_rt_frame()._rt_set.size()), get_current_rt_frame()._rt_set.data(), 0, 0);
+    vkCmdDispatch(cmd, (SWS_RADIANCE_GRID_NUM_CELLS + SWS_RADIANCE_GRID_GROUP_SIZE - 1) / SWS_RADIANCE_GRID_GROUP_SIZE, 1, 1);
+    rt_utils::buffer_barrier(cmd, _radiance_grid_gpu._buffer, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void RTApp::create_SBT(VkPipeline pipeline, SBTHelper& sbt) {
+    std::vector<unsigned char> group_handles(sbt.get_num_groups() * sbt.get_shader_handle_size());
+    VK_CHECK(_loader_manager->vkGetRayTracingShaderGroupHandlesKHR(_device, pipeline, 0, sbt.get_num_groups(), group_handles.size(), group_handles.data()));
 
-    const uint32_t buffer_size = _SBT.get_SBT_size();
+    const uint32_t buffer_size = sbt.get_SBT_size();
 
     // CPU Buffer ( for staging )
     AllocatedBuffer staging_buffer = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
@@ -1340,9 +1980,9 @@ void RTApp::create_SBT() {
         void* data;
         vmaMapMemory(_allocator, staging_buffer._allocation, &data);
         uint8_t* data_char = static_cast<uint8_t*>(data);
-        const uint32_t group_num = _SBT.get_num_groups();
-        const uint32_t shader_group_alignment = _SBT.get_shader_group_alignment();
-        const uint32_t shader_handle_size = _SBT.get_shader_handle_size();
+        const uint32_t group_num = sbt.get_num_groups();
+        const uint32_t shader_group_alignment = sbt.get_shader_group_alignment();
+        const uint32_t shader_handle_size = sbt.get_shader_handle_size();
         for (size_t i = 0; i < group_num; ++i) {
             memcpy(data_char, group_handles.data() + i * shader_handle_size, shader_handle_size);
             data_char += shader_group_alignment;
@@ -1369,7 +2009,7 @@ void RTApp::create_SBT() {
         }
     );
 
-    _SBT.set_SBT(dst_buffer);
+    sbt.set_SBT(dst_buffer);
     vmaDestroyBuffer(_allocator, staging_buffer._buffer, staging_buffer._allocation);
 
     _main_deletion_queue.push_function(
@@ -1424,6 +2064,7 @@ void RTApp::init_scenes() {
         std::cout << "[Obj Loading] " << path << ", Error: " << err << std::endl;
     }
 
+    _rt_scene._name = path;
     _rt_scene._meshes.resize(shapes.size());
     _rt_scene._materials.resize(materials.size());
 
@@ -1456,6 +2097,7 @@ void RTApp::init_scenes() {
     }
 
     // upload
+    std::vector<EmitterTriangle> emitters{};
     for (size_t mesh_idx = 0; mesh_idx < shapes.size(); ++mesh_idx) {
         RTMesh& mesh = _rt_scene._meshes[mesh_idx];
         const tinyobj::shape_t& shape = shapes[mesh_idx];
@@ -1472,6 +2114,13 @@ void RTApp::init_scenes() {
         const size_t attribs_buffer_size = num_vertices * sizeof(VertexAttribute);
         const size_t mat_IDs_buffer_size = num_faces * sizeof(uint32_t);
 
+        // the key of the blas in the AS cache: source vertices + normalization (the indices are 0, 1, 2, ...)
+        uint64_t geometry_hash = ASCache::hash(&aabb, sizeof(Interval3D));
+        for (size_t vertex_idx = 0; vertex_idx < num_vertices; ++vertex_idx) {
+            geometry_hash = ASCache::hash(&attrib.vertices[3 * shape.mesh.indices[vertex_idx].vertex_index], 3 * sizeof(float), geometry_hash);
+        }
+        mesh._geometry_hash = geometry_hash;
+
         // (1) create staging buffer
         const int BUFFER_KIND = 5;
         std::vector<AllocatedBuffer> staging_buffers(BUFFER_KIND);
@@ -1583,6 +2232,15 @@ void RTApp::init_scenes() {
             data_faces[4 * f + 2] = c;
 
             data_mat_IDs[f] = static_cast<uint32_t>(shape.mesh.material_ids[f]);
+
+            // emitters for the next-event estimation
+            if (shape.mesh.material_ids[f] == _light_id) {
+                EmitterTriangle emitter;
+                emitter.v0 = vec4(data_positions[a], 0.0f);
+                emitter.v1 = vec4(data_positions[b], 0.0f);
+                emitter.v2 = vec4(data_positions[c], 0.0f);
+                emitters.push_back(emitter);
+            }
         }
 
         // unmap
@@ -1750,30 +2408,116 @@ void RTApp::init_scenes() {
 
     std::cout << "[Obj Loading] successfully load \"" << path << "\"" << std::endl;
 
+    // emitters (area cdf), only valid for the light id they are built with
+    {
+        _emitters_light_id = _light_id;
+        _num_emitters = static_cast<uint32_t>(emitters.size());
+        _emitters_area = BuildEmitterCdf(emitters.data(), _num_emitters);
+        std::cout << "[NEE] " << _num_emitters << " emitter triangles, area: " << _emitters_area << std::endl;
+        if (emitters.empty()) {
+            // no empty buffer
+            emitters.push_back(EmitterTriangle{});
+        }
+
+        const uint32_t buffer_size = static_cast<uint32_t>(emitters.size() * sizeof(EmitterTriangle));
+        AllocatedBuffer staging_buffer = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        void* data;
+        vmaMapMemory(_allocator, staging_buffer._allocation, &data);
+        memcpy(data, emitters.data(), buffer_size);
+        vmaUnmapMemory(_allocator, staging_buffer._allocation);
+
+        _emitters_gpu = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        const AllocatedBuffer emitters_gpu = _emitters_gpu;
+        immediate_submit(
+            [=](VkCommandBuffer cmd) {
+                VkBufferCopy copy = {};
+                copy.srcOffset = 0;
+                copy.dstOffset = 0;
+                copy.size = buffer_size;
+                vkCmdCopyBuffer(cmd, staging_buffer._buffer, emitters_gpu._buffer, 1, &copy);
+            }
+        );
+        vmaDestroyBuffer(_allocator, staging_buffer._buffer, staging_buffer._allocation);
+
+        _main_deletion_queue.push_function(
+            [=]() {
+                vmaDestroyBuffer(_allocator, emitters_gpu._buffer, emitters_gpu._allocation);
+            }
+        );
+    }
+
+    // sampler tables (sobol matrices & blue-noise ranks), the same as the CPU tracer
+    {
+        _sampler_tables.build();
+
+        const uint32_t buffer_size = _sampler_tables.get_size_in_bytes();
+        AllocatedBuffer staging_buffer = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        void* data;
+        vmaMapMemory(_allocator, staging_buffer._allocation, &data);
+        memcpy(data, _sampler_tables.get_data().data(), buffer_size);
+        vmaUnmapMemory(_allocator, staging_buffer._allocation);
+
+        _sampler_tables_gpu = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        const AllocatedBuffer sampler_tables_gpu = _sampler_tables_gpu;
+        immediate_submit(
+            [=](VkCommandBuffer cmd) {
+                VkBufferCopy copy = {};
+                copy.srcOffset = 0;
+                copy.dstOffset = 0;
+                copy.size = buffer_size;
+                vkCmdCopyBuffer(cmd, staging_buffer._buffer, sampler_tables_gpu._buffer, 1, &copy);
+            }
+        );
+        vmaDestroyBuffer(_allocator, staging_buffer._buffer, staging_buffer._allocation);
+
+        _main_deletion_queue.push_function(
+            [=]() {
+                vmaDestroyBuffer(_allocator, sampler_tables_gpu._buffer, sampler_tables_gpu._allocation);
+            }
+        );
+    }
+
     // 2. shader info
     const size_t num_meshes = _rt_scene._meshes.size();
     const size_t num_materials = _rt_scene._materials.size();
 
-    _rt_scene._mat_IDs_buffer_infos.resize(num_meshes);
-    _rt_scene._attribs_buffer_infos.resize(num_meshes);
-    _rt_scene._faces_buffer_infos.resize(num_meshes);
-    for (size_t mesh_idx = 0; mesh_idx < num_meshes; ++mesh_idx) {
-        const RTMesh& mesh = _rt_scene._meshes[mesh_idx];
-        VkDescriptorBufferInfo& mat_IDs_info = _rt_scene._mat_IDs_buffer_infos[mesh_idx];
-        VkDescriptorBufferInfo& attribs_info = _rt_scene._attribs_buffer_infos[mesh_idx];
-        VkDescriptorBufferInfo& faces_info = _rt_scene._faces_buffer_infos[mesh_idx];
+    {
+        // one entry per instance (the instance custom index is the mesh index): a single descriptor for all the meshes
+        std::vector<InstanceAddresses> instances(num_meshes);
+        for (size_t mesh_idx = 0; mesh_idx < num_meshes; ++mesh_idx) {
+            const RTMesh& mesh = _rt_scene._meshes[mesh_idx];
+            InstanceAddresses& instance = instances[mesh_idx];
+            instance.mat_IDs = rt_utils::get_buffer_device_address(_device, mesh._mat_IDs._buffer).deviceAddress;
+            instance.attribs = rt_utils::get_buffer_device_address(_device, mesh._attribs._buffer).deviceAddress;
+            instance.faces = rt_utils::get_buffer_device_address(_device, mesh._faces._buffer).deviceAddress;
+            instance.padding = 0;
+        }
 
-        mat_IDs_info.buffer = mesh._mat_IDs._buffer;
-        mat_IDs_info.offset = 0;
-        mat_IDs_info.range = mesh._mat_IDs._size;
+        const uint32_t buffer_size = static_cast<uint32_t>(std::max<size_t>(num_meshes, 1) * sizeof(InstanceAddresses));
+        AllocatedBuffer staging_buffer = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        void* data;
+        vmaMapMemory(_allocator, staging_buffer._allocation, &data);
+        memcpy(data, instances.data(), num_meshes * sizeof(InstanceAddresses));
+        vmaUnmapMemory(_allocator, staging_buffer._allocation);
 
-        attribs_info.buffer = mesh._attribs._buffer;
-        attribs_info.offset = 0;
-        attribs_info.range = mesh._attribs._size;
+        _instances_gpu = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        const AllocatedBuffer instances_gpu = _instances_gpu;
+        immediate_submit(
+            [=](VkCommandBuffer cmd) {
+                VkBufferCopy copy = {};
+                copy.srcOffset = 0;
+                copy.dstOffset = 0;
+                copy.size = buffer_size;
+                vkCmdCopyBuffer(cmd, staging_buffer._buffer, instances_gpu._buffer, 1, &copy);
+            }
+        );
+        vmaDestroyBuffer(_allocator, staging_buffer._buffer, staging_buffer._allocation);
 
-        faces_info.buffer = mesh._faces._buffer;
-        faces_info.offset = 0;
-        faces_info.range = mesh._faces._size;
+        _main_deletion_queue.push_function(
+            [=]() {
+                vmaDestroyBuffer(_allocator, instances_gpu._buffer, instances_gpu._allocation);
+            }
+        );
     }
     _rt_scene._textures_infos.resize(num_materials);
     for (size_t i = 0; i < num_materials; ++i) {
@@ -1787,7 +2531,7 @@ void RTApp::init_scenes() {
 
     // 3. create scene
     // (3.1) scene
-    _rt_scene.build_blas(_device, _allocator, this);
+    _rt_scene.build_blas(_device, _allocator, this, &_as_cache);
     _rt_scene.build_tlas(_device, _allocator, this);
 
     // (3.2) environment map 
@@ -1814,6 +2558,37 @@ void RTApp::init_scenes() {
     vmaMapMemory(_allocator, staging_buffer._allocation, &data);
     memcpy(data, pixels, image_size);
     vmaUnmapMemory(_allocator, staging_buffer._allocation);
+
+    // importance sampling distribution, the same as the CPU tracer
+    {
+        _env_distribution.build(pixels, width, height);
+
+        const uint32_t buffer_size = _env_distribution.get_size_in_bytes();
+        AllocatedBuffer distribution_staging_buffer = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        void* distribution_data;
+        vmaMapMemory(_allocator, distribution_staging_buffer._allocation, &distribution_data);
+        memcpy(distribution_data, _env_distribution.get_data().data(), buffer_size);
+        vmaUnmapMemory(_allocator, distribution_staging_buffer._allocation);
+
+        _env_distribution_gpu = rt_utils::create_buffer(_allocator, buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        const AllocatedBuffer env_distribution_gpu = _env_distribution_gpu;
+        immediate_submit(
+            [=](VkCommandBuffer cmd) {
+                VkBufferCopy copy = {};
+                copy.srcOffset = 0;
+                copy.dstOffset = 0;
+                copy.size = buffer_size;
+                vkCmdCopyBuffer(cmd, distribution_staging_buffer._buffer, env_distribution_gpu._buffer, 1, &copy);
+            }
+        );
+        vmaDestroyBuffer(_allocator, distribution_staging_buffer._buffer, distribution_staging_buffer._allocation);
+
+        _main_deletion_queue.push_function(
+            [=]() {
+                vmaDestroyBuffer(_allocator, env_distribution_gpu._buffer, env_distribution_gpu._allocation);
+            }
+        );
+    }
     stbi_image_free(pixels);
 
     // create VkImage
@@ -1897,7 +2672,6 @@ void RTApp::init_scenes() {
 }
 
 void RTApp::init_descriptors() {
-    const uint32_t num_meshes = static_cast<uint32_t>(_rt_scene._meshes.size());
     const uint32_t num_materials = static_cast<uint32_t>(_rt_scene._materials.size());
 
     // TODO: max = 4?
@@ -1919,16 +2693,27 @@ void RTApp::init_descriptors() {
         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
     };
-    VkShaderStageFlags stages0[] = {
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-    };
+    // the wavefront kernels (compute) use the same set as the ray generation shaders
+    std::vector<VkShaderStageFlags> stages0(types0.size(), VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT);
+    stages0[SWS_INSTANCES_BINDING] = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
 
     // binding number is ascending
     // SWS_SCENE_AS_BINDING     : 0
@@ -1937,44 +2722,49 @@ void RTApp::init_descriptors() {
     // SWS_ACCUMULATED_IMAGE_BINDING : 3
     // SWS_RADIANCE_CACHE_BINDING : 4
     // SWS_STREE_BINDING : 5
-    // SWS_DTREE_BINDING : 6
-    _rt_set_layout[SWS_SCENE_AS_SET] = _descriptors.create_set_layout(types0.data(), stages0, types0.size());
+    // SWS_GUIDE_TABLES_BINDING : 6
+    // SWS_EMITTERS_BINDING : 7
+    // SWS_SAMPLER_BINDING : 8
+    // SWS_VARIANCE_IMAGE_BINDING : 9
+    // SWS_TILE_ERRORS_BINDING : 10
+    // SWS_ACTIVE_TILES_BINDING : 11
+    // SWS_ALBEDO_IMAGE_BINDING : 12
+    // SWS_NORMAL_DEPTH_IMAGE_BINDING : 13
+    // SWS_HISTORY_COLOR_BINDING : 14
+    // SWS_HISTORY_STATS_BINDING : 15
+    // SWS_HISTORY_NORMAL_DEPTH_BINDING : 16
+    // SWS_WAVEFRONT_PATHS_BINDING : 17
+    // SWS_WAVEFRONT_PATH_STATES_BINDING : 18
+    // SWS_WAVEFRONT_QUEUES_BINDING : 19
+    // SWS_WAVEFRONT_COUNTERS_BINDING : 20
+    // SWS_ENV_DISTRIBUTION_BINDING : 21
+    // SWS_RADIANCE_GRID_BINDING : 22
+    // SWS_INSTANCES_BINDING : 23
+    _rt_set_layout[SWS_SCENE_AS_SET] = _descriptors.create_set_layout(types0.data(), stages0.data(), types0.size());
 
     // Second set:
-    //  binding 0 (N)  ->  per-face material IDs for our meshes  (N = num meshes)
-    const VkDescriptorBindingFlags flag = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT; // binding.descriptorCount > 1, must set this flag
-    VkDescriptorSetLayoutBindingFlagsCreateInfo flag1 = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
-    flag1.pBindingFlags = &flag;
-    flag1.bindingCount = 1;
-
-    VkDescriptorSetLayoutBindingFlagsCreateInfo flags1[] = { flag1 };
-    VkDescriptorType types1[] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+    //  binding 0 (N)  ->  textures (N = num materials), bindless: the count is given when the set is allocated
+    const VkDescriptorBindingFlags flag = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags1 = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+    flags1.pBindingFlags = &flag;
+    flags1.bindingCount = 1;
+
+    VkDescriptorType types1[] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
     VkShaderStageFlags stages1[] = { VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR };
-    uint32_t descriptor_count1[] = { num_meshes };
-    _rt_set_layout[SWS_MATIDS_SET] = _descriptors.create_set_layout(types1, stages1, 1, descriptor_count1, flags1);
+    uint32_t descriptor_count1[] = { std::max(num_materials, 1u) };
+    _rt_set_layout[SWS_TEXTURES_SET] = _descriptors.create_set_layout(types1, stages1, 1, descriptor_count1, &flags1);
 
     // Third set:
-    //  binding 0 (N)  ->  vertex attributes for our meshes  (N = num meshes)
-    //   (re-using second's set info)
-    _rt_set_layout[SWS_ATTRIBS_SET] = _descriptors.create_set_layout(types1, stages1, 1, descriptor_count1, flags1);
-
-    // Fourth set:
-    //  binding 0 (N)  ->  faces info (indices) for our meshes  (N = num meshes)
-    //   (re-using second's set info)
-    _rt_set_layout[SWS_FACES_SET] = _descriptors.create_set_layout(types1, stages1, 1, descriptor_count1, flags1);
-
-    // Fifth set:
-    //  binding 0 (N)  ->  textures (N = num materials)
-    VkDescriptorType types5[] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
-    VkShaderStageFlags stages5[] = { VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR };
-    uint32_t descriptor_count5[] = { num_materials };
-    _rt_set_layout[SWS_TEXTURES_SET] = _descriptors.create_set_layout(types5, stages5, 1, descriptor_count5);
-
-    // Sixth set:
     //  binding 0 ->  env texture
-    VkDescriptorType types6[] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
-    VkShaderStageFlags stages6[] = { VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_RAYGEN_BIT_KHR }; // TODO: 00000000 remove this stage
-    _rt_set_layout[SWS_ENVS_SET] = _descriptors.create_set_layout(types6, stages6, 1);
+    VkDescriptorType types2[] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+    VkShaderStageFlags stages2[] = { VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_COMPUTE_BIT }; // the next-event estimation samples it
+    _rt_set_layout[SWS_ENVS_SET] = _descriptors.create_set_layout(types2, stages2, 1);
+
+    // denoiser set (compute, not a part of the ray tracing pipeline):
+    //  binding 0 ~ 6  ->  accumulated, albedo, normal & depth, variance, ping, pong, result image
+    std::vector<VkDescriptorType> types_denoise(SWS_DENOISE_NUM_BINDINGS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    std::vector<VkShaderStageFlags> stages_denoise(SWS_DENOISE_NUM_BINDINGS, VK_SHADER_STAGE_COMPUTE_BIT);
+    _denoise_set_layout = _descriptors.create_set_layout(types_denoise.data(), stages_denoise.data(), SWS_DENOISE_NUM_BINDINGS);
 
     _main_deletion_queue.push_function(
         [&]() {
@@ -1984,15 +2774,14 @@ void RTApp::init_descriptors() {
 }
 
 void RTApp::update_descriptors() {
-    const uint32_t num_meshes = static_cast<uint32_t>(_rt_scene._meshes.size());
     const uint32_t num_materials = static_cast<uint32_t>(_rt_scene._materials.size());
     _rt_set.resize(_rt_set_layout.size());
 
-    std::vector<uint32_t> desc_cnt = { 1, num_meshes, num_meshes, num_meshes, num_materials, 1 };
+    std::vector<uint32_t> desc_cnt = { 1, num_materials, 1 };
     assert(static_cast<uint32_t>(_rt_set_layout.size()) == static_cast<uint32_t>(desc_cnt.size()));
     _descriptors.create_set(_rt_set.data(), _rt_set_layout.data(), desc_cnt.data(), static_cast<uint32_t>(_rt_set_layout.size()));
 
-    std::vector<VkWriteDescriptorSet> write_sets{};
+    DescriptorWriter writer{};
     // First set:
     //  binding 0  ->  AS
     //  binding 1  ->  Camera data
@@ -2000,31 +2789,27 @@ void RTApp::update_descriptors() {
     //  binding 3  ->  accumulated image
     //  binding 4  ->  radiance cache
     //  binding 5/6  ->  sample tree
-    VkWriteDescriptorSetAccelerationStructureKHR descriptor_as_info = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR, nullptr };
-    descriptor_as_info.accelerationStructureCount = 1;
-    descriptor_as_info.pAccelerationStructures = &_rt_scene._tlas._acceleration_structure;
-
-    VkWriteDescriptorSet ws = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-    ws.pNext = &descriptor_as_info; // extension
-    ws.dstSet = _rt_set[SWS_SCENE_AS_SET];
-    ws.dstBinding = SWS_SCENE_AS_BINDING;
-    ws.descriptorCount = 1;
-    ws.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-    write_sets.push_back(ws);
+    //  binding 7  ->  emitters
+    //  binding 8  ->  sampler tables
+    //  binding 9  ->  variance image
+    //  binding 10/11  ->  adaptive sampling tiles
+    //  binding 12/13  ->  denoiser guides (albedo, normal & depth)
+    //  binding 14/15/16  ->  history (temporal reprojection)
+    writer.write_acceleration_structure(_rt_set[SWS_SCENE_AS_SET], SWS_SCENE_AS_BINDING, _rt_scene._tlas._acceleration_structure);
     // binding 0 end
 
-    // TODO: only 1 buffer, do not need alignment
-    const uint32_t padding_buffer_size = vkutils::padding(sizeof(UniformParams), _physical_device_properties.limits.minUniformBufferOffsetAlignment);
-    const uint32_t total_buffer_size = padding_buffer_size;
+    // one slice per frame in flight, the set 0 of each frame points to its slice
+    _uniform_data_stride = vkutils::padding(sizeof(UniformParams), _physical_device_properties.limits.minUniformBufferOffsetAlignment);
+    const uint32_t total_buffer_size = _uniform_data_stride * _frames_in_flight;
     _uniform_data_buffer = rt_utils::create_buffer(_allocator, total_buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    VK_CHECK(vmaMapMemory(_allocator, _uniform_data_buffer._allocation, reinterpret_cast<void**>(&_uniform_data_mapped)));
 
     VkDescriptorBufferInfo uniform_data_info = {};
     uniform_data_info.buffer = _uniform_data_buffer._buffer;
     uniform_data_info.offset = 0;
-    uniform_data_info.range = total_buffer_size;
+    uniform_data_info.range = _uniform_data_stride;
 
-    ws = vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, _rt_set[SWS_SCENE_AS_SET], &uniform_data_info, SWS_CAMDATA_BINDING);
-    write_sets.push_back(ws);
+    writer.write_buffer(_rt_set[SWS_SCENE_AS_SET], SWS_CAMDATA_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniform_data_info);
     // binding 1 end
 
     VkDescriptorImageInfo res_image_info = {};
@@ -2032,30 +2817,29 @@ void RTApp::update_descriptors() {
     res_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
     res_image_info.imageView = _offscreen_image[0]._image_view;
 
-    ws = vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, _rt_set[SWS_RESULT_IMAGE_SET], &res_image_info, SWS_RESULT_IMAGE_BINDING);
-    write_sets.push_back(ws);
+    writer.write_image(_rt_set[SWS_RESULT_IMAGE_SET], SWS_RESULT_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, res_image_info);
     // binding 2 end
 
     VkDescriptorImageInfo accu_image_info = {};
     accu_image_info.sampler = VK_NULL_HANDLE;
     accu_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
     accu_image_info.imageView = _offscreen_image[1]._image_view;
-    ws = vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, _rt_set[SWS_ACCUMULATED_IMAGE_SET], &accu_image_info, SWS_ACCUMULATED_IMAGE_BINDING);
-    write_sets.push_back(ws);
+    writer.write_image(_rt_set[SWS_ACCUMULATED_IMAGE_SET], SWS_ACCUMULATED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, accu_image_info);
     // binding 3 end
 
     {
         // radiance cache buffer
         _radiance_cache_buffer_size = sizeof(RecordPerPixel) * _window_extent.width * _window_extent.height;
         _radiance_cache_gpu = rt_utils::create_buffer(_allocator, _radiance_cache_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-        _radiance_cache_cpu = rt_utils::create_buffer(_allocator, _radiance_cache_buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        for (RTFrameData& rt_frame : _rt_frames) {
+            rt_frame._radiance_cache_cpu = rt_utils::create_buffer(_allocator, _radiance_cache_buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        }
 
         VkDescriptorBufferInfo rc_info = {};
         rc_info.buffer = _radiance_cache_gpu._buffer;
         rc_info.offset = 0;
         rc_info.range = _radiance_cache_buffer_size;
-        ws = vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _rt_set[SWS_RADIANCE_CACHE_SET], &rc_info, SWS_RADIANCE_CACHE_BINDING);
-        write_sets.push_back(ws);
+        writer.write_buffer(_rt_set[SWS_RADIANCE_CACHE_SET], SWS_RADIANCE_CACHE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, rc_info);
     }
 
     {
@@ -2075,82 +2859,215 @@ void RTApp::update_descriptors() {
 
         _stree_buffer_size = _stree.size() * sizeof(STree);
         _stree_gpu = rt_utils::create_buffer(_allocator, _stree_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-        _stree_cpu = rt_utils::create_buffer(_allocator, _stree_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
         VkDescriptorBufferInfo stree_info = {};
         stree_info.buffer = _stree_gpu._buffer;
         stree_info.offset = 0;
         stree_info.range = _stree_buffer_size;
-        ws = vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _rt_set[SWS_STREE_SET], &stree_info, SWS_STREE_BINDING);
-        write_sets.push_back(ws);
+        writer.write_buffer(_rt_set[SWS_STREE_SET], SWS_STREE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stree_info);
+
+        // a table for every STree node, only the used ones are uploaded
+        _guide_tables_buffer_size = static_cast<uint32_t>(STree::MAX_NODE * SWS_GUIDE_TABLE_SIZE * sizeof(vec4));
+        _guide_tables_gpu = rt_utils::create_buffer(_allocator, _guide_tables_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        for (RTFrameData& rt_frame : _rt_frames) {
+            rt_frame._stree_staging = rt_utils::create_buffer(_allocator, _stree_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+            rt_frame._guide_tables_staging = rt_utils::create_buffer(_allocator, _guide_tables_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        }
 
-        _dtree_buffer_size = _dtree.size() * sizeof(DTree);
-        _dtree_gpu = rt_utils::create_buffer(_allocator, _dtree_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-        _dtree_cpu = rt_utils::create_buffer(_allocator, _dtree_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        VkDescriptorBufferInfo guide_tables_info = {};
+        guide_tables_info.buffer = _guide_tables_gpu._buffer;
+        guide_tables_info.offset = 0;
+        guide_tables_info.range = _guide_tables_buffer_size;
+        writer.write_buffer(_rt_set[SWS_GUIDE_TABLES_SET], SWS_GUIDE_TABLES_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, guide_tables_info);
+    }
+
+    VkDescriptorBufferInfo emitters_info = {};
+    emitters_info.buffer = _emitters_gpu._buffer;
+    emitters_info.offset = 0;
+    emitters_info.range = _emitters_gpu._size;
+    writer.write_buffer(_rt_set[SWS_EMITTERS_SET], SWS_EMITTERS_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, emitters_info);
+    // binding 7 end
+
+    VkDescriptorBufferInfo sampler_tables_info = {};
+    sampler_tables_info.buffer = _sampler_tables_gpu._buffer;
+    sampler_tables_info.offset = 0;
+    sampler_tables_info.range = _sampler_tables_gpu._size;
+    writer.write_buffer(_rt_set[SWS_SAMPLER_SET], SWS_SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, sampler_tables_info);
+    // binding 8 end
+
+    VkDescriptorImageInfo variance_image_info = {};
+    variance_image_info.sampler = VK_NULL_HANDLE;
+    variance_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    variance_image_info.imageView = _offscreen_image[2]._image_view;
+    writer.write_image(_rt_set[SWS_VARIANCE_IMAGE_SET], SWS_VARIANCE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, variance_image_info);
+    // binding 9 end
 
-        VkDescriptorBufferInfo dtree_info = {};
-        dtree_info.buffer = _dtree_gpu._buffer;
-        dtree_info.offset = 0;
-        dtree_info.range = _dtree_buffer_size;
-        ws = vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _rt_set[SWS_DTREE_SET], &dtree_info, SWS_DTREE_BINDING);
-        write_sets.push_back(ws);
+    {
+        // adaptive sampling: one error & one list entry per tile (of the full extent, the dynamic resolution traces fewer)
+        const uint32_t tiles_x = (_window_extent.width + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+        const uint32_t tiles_y = (_window_extent.height + SWS_ADAPTIVE_TILE_SIZE - 1) / SWS_ADAPTIVE_TILE_SIZE;
+        _num_tiles = tiles_x * tiles_y;
+        const uint32_t tiles_buffer_size = _num_tiles * sizeof(uint32_t);
+        _tile_errors_gpu = rt_utils::create_buffer(_allocator, tiles_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        _tile_errors_cpu = rt_utils::create_buffer(_allocator, tiles_buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        _active_tiles_gpu = rt_utils::create_buffer(_allocator, tiles_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+        VkDescriptorBufferInfo tile_errors_info = {};
+        tile_errors_info.buffer = _tile_errors_gpu._buffer;
+        tile_errors_info.offset = 0;
+        tile_errors_info.range = tiles_buffer_size;
+        writer.write_buffer(_rt_set[SWS_TILE_ERRORS_SET], SWS_TILE_ERRORS_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, tile_errors_info);
+
+        VkDescriptorBufferInfo active_tiles_info = {};
+        active_tiles_info.buffer = _active_tiles_gpu._buffer;
+        active_tiles_info.offset = 0;
+        active_tiles_info.range = tiles_buffer_size;
+        writer.write_buffer(_rt_set[SWS_ACTIVE_TILES_SET], SWS_ACTIVE_TILES_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, active_tiles_info);
+
+        const AllocatedBuffer tile_errors_gpu = _tile_errors_gpu;
+        const AllocatedBuffer tile_errors_cpu = _tile_errors_cpu;
+        const AllocatedBuffer active_tiles_gpu = _active_tiles_gpu;
+        _main_deletion_queue.push_function(
+            [=]() {
+                vmaDestroyBuffer(_allocator, tile_errors_gpu._buffer, tile_errors_gpu._allocation);
+                vmaDestroyBuffer(_allocator, tile_errors_cpu._buffer, tile_errors_cpu._allocation);
+                vmaDestroyBuffer(_allocator, active_tiles_gpu._buffer, active_tiles_gpu._allocation);
+            }
+        );
+    }
+    // binding 10/11 end
+
+    VkDescriptorImageInfo albedo_image_info = {};
+    albedo_image_info.sampler = VK_NULL_HANDLE;
+    albedo_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    albedo_image_info.imageView = _offscreen_image[3]._image_view;
+    writer.write_image(_rt_set[SWS_ALBEDO_IMAGE_SET], SWS_ALBEDO_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, albedo_image_info);
+
+    VkDescriptorImageInfo normal_depth_image_info = {};
+    normal_depth_image_info.sampler = VK_NULL_HANDLE;
+    normal_depth_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    normal_depth_image_info.imageView = _offscreen_image[4]._image_view;
+    writer.write_image(_rt_set[SWS_NORMAL_DEPTH_IMAGE_SET], SWS_NORMAL_DEPTH_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, normal_depth_image_info);
+    // binding 12/13 end
+
+    VkDescriptorImageInfo history_image_infos[3] = {};
+    const uint32_t history_bindings[3] = { SWS_HISTORY_COLOR_BINDING, SWS_HISTORY_STATS_BINDING, SWS_HISTORY_NORMAL_DEPTH_BINDING };
+    for (uint32_t i = 0; i < 3; ++i) {
+        history_image_infos[i].sampler = VK_NULL_HANDLE;
+        history_image_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        history_image_infos[i].imageView = _offscreen_image[7 + i]._image_view;
+        writer.write_image(_rt_set[SWS_HISTORY_COLOR_SET], history_bindings[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, history_image_infos[i]);
+    }
+    // binding 14/15/16 end
+
+    // wavefront: one path per pixel of the full extent (the dynamic resolution traces fewer)
+    const uint32_t num_paths = _window_extent.width * _window_extent.height;
+    _wavefront_paths_gpu = rt_utils::create_buffer(_allocator, SWS_WAVEFRONT_PATH_FIELDS * sizeof(vec4) * num_paths, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    _wavefront_path_states_gpu = rt_utils::create_buffer(_allocator, 4 * sizeof(uint32_t) * num_paths, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    _wavefront_queues_gpu = rt_utils::create_buffer(_allocator, SWS_WAVEFRONT_NUM_QUEUES * sizeof(uint32_t) * num_paths, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    // the indirect arguments are read at the device address of the buffer
+    _wavefront_counters_gpu = rt_utils::create_buffer(_allocator, SWS_WAVEFRONT_COUNTERS_SIZE * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const AllocatedBuffer wavefront_buffers[4] = { _wavefront_paths_gpu, _wavefront_path_states_gpu, _wavefront_queues_gpu, _wavefront_counters_gpu };
+    const uint32_t wavefront_bindings[4] = { SWS_WAVEFRONT_PATHS_BINDING, SWS_WAVEFRONT_PATH_STATES_BINDING, SWS_WAVEFRONT_QUEUES_BINDING, SWS_WAVEFRONT_COUNTERS_BINDING };
+    VkDescriptorBufferInfo wavefront_infos[4] = {};
+    for (uint32_t i = 0; i < 4; ++i) {
+        wavefront_infos[i].buffer = wavefront_buffers[i]._buffer;
+        wavefront_infos[i].offset = 0;
+        wavefront_infos[i].range = VK_WHOLE_SIZE;
+        writer.write_buffer(_rt_set[SWS_WAVEFRONT_PATHS_SET], wavefront_bindings[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, wavefront_infos[i]);
     }
+    _main_deletion_queue.push_function(
+        [=]() {
+            for (const AllocatedBuffer& buffer : wavefront_buffers) {
+                vmaDestroyBuffer(_allocator, buffer._buffer, buffer._allocation);
+            }
+        }
+    );
+    // binding 17/18/19/20 end
+
+    VkDescriptorBufferInfo env_distribution_info = {};
+    env_distribution_info.buffer = _env_distribution_gpu._buffer;
+    env_distribution_info.offset = 0;
+    env_distribution_info.range = VK_WHOLE_SIZE;
+    writer.write_buffer(_rt_set[SWS_ENV_DISTRIBUTION_SET], SWS_ENV_DISTRIBUTION_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, env_distribution_info);
+    // binding 21 end
+
+    // radiance grid, cleared before the first launch (`_radiance_grid_clear`)
+    _radiance_grid_gpu = rt_utils::create_buffer(_allocator, SWS_RADIANCE_GRID_NUM_CELLS * sizeof(RadianceGridCell),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    const AllocatedBuffer radiance_grid_gpu = _radiance_grid_gpu;
+    _main_deletion_queue.push_function(
+        [=]() {
+            vmaDestroyBuffer(_allocator, radiance_grid_gpu._buffer, radiance_grid_gpu._allocation);
+        }
+    );
+    VkDescriptorBufferInfo radiance_grid_info = {};
+    radiance_grid_info.buffer = _radiance_grid_gpu._buffer;
+    radiance_grid_info.offset = 0;
+    radiance_grid_info.range = VK_WHOLE_SIZE;
+    writer.write_buffer(_rt_set[SWS_RADIANCE_GRID_SET], SWS_RADIANCE_GRID_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, radiance_grid_info);
+    // binding 22 end
+
+    VkDescriptorBufferInfo instances_info = {};
+    instances_info.buffer = _instances_gpu._buffer;
+    instances_info.offset = 0;
+    instances_info.range = VK_WHOLE_SIZE;
+    writer.write_buffer(_rt_set[SWS_INSTANCES_SET], SWS_INSTANCES_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instances_info);
+    // binding 23 end
 
     // Second set:
-    // binding 0 (N)  ->  per-face material IDs for our meshes  (N = num meshes)
-    ws = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-    ws.dstSet = _rt_set[SWS_MATIDS_SET];
-    ws.dstBinding = 0;
-    ws.descriptorCount = num_meshes;
-    ws.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    ws.pBufferInfo = _rt_scene._mat_IDs_buffer_infos.data();
-    write_sets.push_back(ws);
+    //  binding 0 (N)  ->  textures (N = num materials)
+    if (num_materials > 0) {
+        writer.write_images(_rt_set[SWS_TEXTURES_SET], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _rt_scene._textures_infos.data(), num_materials);
+    }
 
     // Third set:
-    //  binding 0 (N)  ->  vertex attributes for our meshes  (N = num meshes)
-    //   (re-using second's set info)
-    ws.dstSet = _rt_set[SWS_ATTRIBS_SET];
-    ws.pBufferInfo = _rt_scene._attribs_buffer_infos.data();
-    write_sets.push_back(ws);
-
-    // Fourth set:
-    //  binding 0 (N)  ->  faces info (indices) for our meshes  (N = num meshes)
-    //   (re-using second's set info)
-    ws.dstSet = _rt_set[SWS_FACES_SET];
-    ws.pBufferInfo = _rt_scene._faces_buffer_infos.data();
-    write_sets.push_back(ws);
-
-    // Fifth set:
-    //  binding 0 (N)  ->  textures (N = num materials)
-    ws = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-    ws.dstSet = _rt_set[SWS_TEXTURES_SET];
-    ws.dstBinding = 0;
-    ws.descriptorCount = num_materials;
-    ws.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    ws.pImageInfo = _rt_scene._textures_infos.data();
-    write_sets.push_back(ws);
-
-    // Sixth set:
     //  binding 0 ->  env texture
-    ws = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-    ws.dstSet = _rt_set[SWS_ENVS_SET];
-    ws.dstBinding = 0;
-    ws.descriptorCount = 1;
-    ws.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    ws.pImageInfo = &_env_map_info;
-    write_sets.push_back(ws);
+    writer.write_image(_rt_set[SWS_ENVS_SET], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _env_map_info);
+
+    // denoiser set: SWS_DENOISE_*_BINDING -> offscreen image
+    _denoise_set = _descriptors.create_set(_denoise_set_layout);
+    VkDescriptorImageInfo denoise_image_infos[SWS_DENOISE_NUM_BINDINGS] = {};
+    for (uint32_t i = 0; i < SWS_DENOISE_NUM_BINDINGS; ++i) {
+        denoise_image_infos[i].sampler = VK_NULL_HANDLE;
+        denoise_image_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        denoise_image_infos[i].imageView = _offscreen_image[sDenoiseImages[i]]._image_view;
+        writer.write_image(_denoise_set, i, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, denoise_image_infos[i]);
+    }
+
+    // the other frames in flight: their own set 0 is a copy of the first one (the copies follow the writes), but their slice of the uniform data
+    _rt_frames[0]._rt_set = _rt_set;
+    for (uint32_t i = 1; i < _frames_in_flight; ++i) {
+        RTFrameData& rt_frame = _rt_frames[i];
+        rt_frame._rt_set = _rt_set;
+        rt_frame._rt_set[SWS_SCENE_AS_SET] = _descriptors.create_set(_rt_set_layout[SWS_SCENE_AS_SET]);
+        for (uint32_t binding = 0; binding <= SWS_INSTANCES_BINDING; ++binding) {
+            if (binding != SWS_CAMDATA_BINDING) {
+                writer.copy(_rt_set[SWS_SCENE_AS_SET], rt_frame._rt_set[SWS_SCENE_AS_SET], binding);
+            }
+        }
+        VkDescriptorBufferInfo frame_uniform_data_info = uniform_data_info;
+        frame_uniform_data_info.offset = i * _uniform_data_stride;
+        writer.write_buffer(rt_frame._rt_set[SWS_SCENE_AS_SET], SWS_CAMDATA_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame_uniform_data_info);
+    }
 
-    _descriptors.bind(write_sets.data(), static_cast<uint32_t>(write_sets.size()));
+    writer.flush(_device);
 
     _main_deletion_queue.push_function(
         [&]() {
+            vmaUnmapMemory(_allocator, _uniform_data_buffer._allocation);
             vmaDestroyBuffer(_allocator, _uniform_data_buffer._buffer, _uniform_data_buffer._allocation);
-            vmaDestroyBuffer(_allocator, _radiance_cache_cpu._buffer, _radiance_cache_cpu._allocation);
+            for (RTFrameData& rt_frame : _rt_frames) {
+                vmaDestroyBuffer(_allocator, rt_frame._radiance_cache_cpu._buffer, rt_frame._radiance_cache_cpu._allocation);
+                vmaDestroyBuffer(_allocator, rt_frame._stree_staging._buffer, rt_frame._stree_staging._allocation);
+                vmaDestroyBuffer(_allocator, rt_frame._guide_tables_staging._buffer, rt_frame._guide_tables_staging._allocation);
+            }
             vmaDestroyBuffer(_allocator, _radiance_cache_gpu._buffer, _radiance_cache_gpu._allocation);
-            vmaDestroyBuffer(_allocator, _stree_cpu._buffer, _stree_cpu._allocation);
             vmaDestroyBuffer(_allocator, _stree_gpu._buffer, _stree_gpu._allocation);
-            vmaDestroyBuffer(_allocator, _dtree_cpu._buffer, _dtree_cpu._allocation);
-            vmaDestroyBuffer(_allocator, _dtree_gpu._buffer, _dtree_gpu._allocation);
+            vmaDestroyBuffer(_allocator, _guide_tables_gpu._buffer, _guide_tables_gpu._allocation);
         }
     );
 }
@@ -20,11 +20,17 @@
 #include "../pipeline.h"
 #include "../data.h"
 #include "../render.h"
+#include "../profiler.h"
+#include "../pipelineCache.h"
 
 #include "sbtHelper.h"
 #include "rtHelper.h"
 #include "camera.h"
 #include "ppg.h"
+#include "samplerTables.h"
+#include "envDistribution.h"
+#include "guideTables.h"
+#include "ppgSchedule.h"
 
 #define NAME(X) #X
 #define OUTPUT_KV(X) {                                                      \
@@ -43,6 +49,9 @@ public:
     RTApp(const char* name, uint32_t width, uint32_t height, bool use_validation_layer);
     virtual ~RTApp();
 
+    // before `run`, clamped to [1, MAX_FRAMES_IN_FLIGHT]
+    void set_frames_in_flight(uint32_t frames_in_flight);
+
     // run main loop
     void run();
 
@@ -60,6 +69,7 @@ protected:
 
     void init_vulkan();
     void init_swapchain();
+    void init_pipeline_cache();
 
     // must be called at the end of the cleanup (deconstructor)
     void flush_deletion_queue_and_vulkan_resources();
@@ -125,8 +135,26 @@ protected:
     void basic_clean_up();
 
     // frame Data
-    static const uint32_t FRAME_OVERLAP = 2U; // TODO: !!!! error when set = 4
-    FrameData _frames[FRAME_OVERLAP]{};
+    // the staging & readback buffers and the copies of set 0 are per frame in flight, the descriptor pools grow as needed
+    static const uint32_t MAX_FRAMES_IN_FLIGHT = 4U;
+    uint32_t _frames_in_flight{ 3U };
+    std::vector<FrameData> _frames = std::vector<FrameData>(_frames_in_flight);
+
+    // the resources the gpu reads or writes while the next frames are recorded, one per frame in flight
+    struct RTFrameData {
+        std::vector<VkDescriptorSet> _rt_set{};     // its own set 0 (the uniform data of this frame), the other sets are shared
+        AllocatedBuffer _radiance_cache_cpu{};      // the ppg records of this frame, read when its fence is waited again
+        AllocatedBuffer _stree_staging{};           // the uploads of the ppg, written when its fence is waited
+        AllocatedBuffer _guide_tables_staging{};
+        bool _radiance_cache_copied{ false };
+        VkExtent2D _trace_extent{};                 // of the records & the trace timestamps, 0: not traced yet
+    };
+    std::vector<RTFrameData> _rt_frames = std::vector<RTFrameData>(_frames_in_flight);
+    RTFrameData& get_current_rt_frame();
+
+    // the fence of the frame that rendered each swapchain image last, the acquired image may still be in flight
+    std::vector<VkFence> _images_in_flight{};
+    void acquire_swapchain_image(FrameData& frame);
 
     // immediately execute
     ImmediateStructure _upload_context{};
@@ -134,29 +162,145 @@ protected:
     void update_descriptors();
 
     Descriptor _descriptors{};
+    // a slice per frame in flight, mapped for the lifetime of the buffer
     AllocatedBuffer _uniform_data_buffer{};
+    uint32_t _uniform_data_stride{ 0 };
+    uint8_t* _uniform_data_mapped = nullptr;
 
     uint32_t _radiance_cache_buffer_size{};
     AllocatedBuffer _radiance_cache_gpu{};
-    AllocatedBuffer _radiance_cache_cpu{};
 
     // Ray Tracing
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR _rt_properties{};
     VkPhysicalDeviceAccelerationStructurePropertiesKHR _as_property{};
     std::vector<VkDescriptorSetLayout> _rt_set_layout{};
+    // the sets of the first frame in flight, the others copy set 0 (`RTFrameData::_rt_set`)
     std::vector<VkDescriptorSet> _rt_set{};
 
-    // one for result, one for accumulate
+    // result, accumulate, per-pixel variance, denoiser guides (albedo, normal & depth), the denoiser ping & pong
+    // and the history of the accumulate, variance, normal & depth (temporal reprojection)
     std::vector<FrameBufferAttachment> _offscreen_image{};
 
     VkPipeline _rt_pipeline = VK_NULL_HANDLE;
     VkPipelineLayout _rt_pipeline_layout = VK_NULL_HANDLE;
     SBTHelper _SBT{};
     void fill_rt_command_buffer(VkCommandBuffer cmd);
-    void create_SBT();
+    // the hit & miss shaders of the scene with the raygen shader `ray_gen_path`, `_rt_pipeline_layout`
+    void create_rt_pipeline(const char* ray_gen_path, SBTHelper& sbt, VkPipeline& pipeline);
+    void create_SBT(VkPipeline pipeline, SBTHelper& sbt);
 
     RTScene _rt_scene{};
+    ASCache _as_cache{};    // blas across runs, keyed by the device/driver & geometry
+    PipelineCache _pipeline_cache{};    // every pipeline, across runs
     RTMaterial _env_map{};
+    // environment light, importance sampled by the next-event estimation
+    float _env_strength{ 1.0f };
+    EnvDistribution _env_distribution{};
+    AllocatedBuffer _env_distribution_gpu{};
+
+    // next-event estimation
+    bool _nee_on{ true };
+    AllocatedBuffer _emitters_gpu{};
+    uint32_t _num_emitters{ 0 };
+    float _emitters_area{ 0.0f };
+    int _emitters_light_id{ -1 };
+
+    // russian roulette after this many bounces
+    int _rr_depth{ 3 };
+
+    // the device addresses of the mesh buffers, one `InstanceAddresses` per instance of the tlas
+    AllocatedBuffer _instances_gpu{};
+
+    // SWS_SAMPLER_*
+    int _sampler_type{ SWS_SAMPLER_SOBOL };
+    SamplerTables _sampler_tables{};
+    AllocatedBuffer _sampler_tables_gpu{};
+
+    // adaptive sampling, the tile errors are measured every `_adaptive_interval` frames (one measurement at a time)
+    // and read back when the fence of the frame that copied them is waited again
+    bool _adaptive_on{ false };
+    float _adaptive_threshold{ 0.05f };
+    uint32_t _adaptive_interval{ 8 };
+    bool _adaptive_measure{ false };
+    int _adaptive_measure_frame{ -1 };      // the frame in flight of the pending measurement, -1: none
+    uint32_t _adaptive_measure_spp{ 0 };    // of the last measurement
+    uint32_t _adaptive_last_spp{ 0 };
+    uint32_t _num_tiles{ 0 };
+    std::vector<uint32_t> _active_tiles{};
+    AllocatedBuffer _tile_errors_gpu{};
+    AllocatedBuffer _tile_errors_cpu{};
+    AllocatedBuffer _active_tiles_gpu{};
+    bool adaptive_sampling_on() const;
+    bool adaptive_sampling_converged() const;
+    void update_active_tiles(VkCommandBuffer cmd);
+    void upload_active_tiles(VkCommandBuffer cmd);
+
+    // a-trous denoiser (`atrous.comp`) on the accumulated image, after the ray tracing
+    bool _denoise_on{ true };
+    int _denoise_iterations{ SWS_DENOISE_MAX_ITERATIONS };
+    VkDescriptorSetLayout _denoise_set_layout = VK_NULL_HANDLE;
+    VkDescriptorSet _denoise_set = VK_NULL_HANDLE;
+    VkPipeline _denoise_pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout _denoise_pipeline_layout = VK_NULL_HANDLE;
+    void init_denoise_pipeline();
+    void fill_denoise_command_buffer(VkCommandBuffer cmd);
+
+    // wavefront path tracing instead of the megakernel: one trace per bounce, the hits are binned by material
+    // into the queues of `wavefront_shade.comp` (one pipeline per material), the paths are kept in the buffers
+    bool _wavefront_on{ false };
+    bool _wavefront_supported{ false };  // TraceRaysIndirect & subgroup ballots in the compute stage
+    SBTHelper _wavefront_extend_SBT{};
+    SBTHelper _wavefront_shadow_SBT{};
+    VkPipeline _wavefront_extend_pipeline = VK_NULL_HANDLE;
+    VkPipeline _wavefront_shadow_pipeline = VK_NULL_HANDLE;
+    VkPipeline _wavefront_generate_pipeline = VK_NULL_HANDLE;
+    VkPipeline _wavefront_args_pipeline = VK_NULL_HANDLE;
+    VkPipeline _wavefront_shade_pipelines[SWS_WAVEFRONT_NUM_MATERIAL_QUEUES]{};
+    VkPipeline _wavefront_resolve_pipeline = VK_NULL_HANDLE;
+    AllocatedBuffer _wavefront_paths_gpu{};
+    AllocatedBuffer _wavefront_path_states_gpu{};
+    AllocatedBuffer _wavefront_queues_gpu{};
+    AllocatedBuffer _wavefront_counters_gpu{};
+    void init_wavefront_pipelines();
+    void fill_wavefront_command_buffer(VkCommandBuffer cmd, uint32_t groups_x, uint32_t groups_y);
+    VkPipeline create_rt_compute_pipeline(const char* path, const VkSpecializationInfo* specialization);
+
+    // radiance grid: the megakernel caches the outgoing radiance of its diffuse vertices (`SWS_RADIANCE_GRID_BINDING`)
+    // and ends the wide paths there, resolved after every launch (`radiance_grid_resolve.comp`)
+    bool _grid_on{ false };
+    int _grid_start_bounce{ 2 };
+    float _grid_footprint{ 0.01f };
+    bool _radiance_grid_clear{ true };
+    AllocatedBuffer _radiance_grid_gpu{};
+    VkPipeline _radiance_grid_resolve_pipeline = VK_NULL_HANDLE;
+    bool radiance_grid_on() const { return _grid_on && !_wavefront_on; }
+    void init_radiance_grid_pipeline();
+    void fill_radiance_grid_command_buffer(VkCommandBuffer cmd);
+
+    // temporal reprojection instead of the reset when the camera moves, the camera of the last frame
+    bool _temporal_on{ true };
+    UniformParams _prev_uniform_data{};
+    void copy_history_images(VkCommandBuffer cmd);
+
+    // dynamic resolution: the trace extent holds `_target_trace_ms` (gpu timestamps) while the camera moves,
+    // the top left part of the offscreen images is traced and blitted to the swapchain
+    static const uint32_t RESOLUTION_INTERVAL = 8;
+    bool _dynamic_resolution_on{ false };
+    float _target_trace_ms{ 16.0f };
+    float _min_resolution_scale{ 0.25f };
+    float _max_resolution_scale{ 1.0f };
+    float _resolution_scale{ 1.0f };
+    float _interactive_scale{ 1.0f };
+    VkExtent2D _trace_extent{};
+    uint32_t _frames_since_camera_change{ RESOLUTION_INTERVAL };
+    VkQueryPool _timestamp_query_pool = VK_NULL_HANDLE;
+    float _trace_ms{ 0.0f };
+    float _trace_ms_sum{ 0.0f };
+    uint32_t _trace_ms_count{ 0 };
+    void read_trace_time();
+    // the stages of `draw` & `fill_rt_command_buffer`
+    Profiler _profiler{};
+    void update_trace_extent(bool camera_changed);
     VkDescriptorImageInfo _env_map_info{};
 
     LoaderManager* _loader_manager;
@@ -189,19 +333,20 @@ protected:
     float _test_time{ 5.0f };
     bool check_test_end();
 
-    // ppg
+    // ppg, the training iterations & the switch to the guided rendering are driven by `_ppg_schedule`
     bool _ppg_train_on{ false };
-    int _ppg_skip_first_data_obtain{ 2 }; // TODO: why skip 2
     bool _ppg_test_on{ false };
+    int _ppg_budget_spp{ 1024 };
+    PPGSchedule _ppg_schedule{};
     bool _ppg_update_gpu_sdtree{ false };
     std::vector<STree> _stree{};
     std::vector<DTree> _dtree{};
     uint32_t _stree_buffer_size{};
-    uint32_t _dtree_buffer_size{};
+    uint32_t _guide_tables_buffer_size{};
     AllocatedBuffer _stree_gpu{};
-    AllocatedBuffer _stree_cpu{};
-    AllocatedBuffer _dtree_gpu{};
-    AllocatedBuffer _dtree_cpu{};
+    // the DTrees compiled for the sampling on the GPU
+    GuideTables _guide_tables{};
+    AllocatedBuffer _guide_tables_gpu{};
 
 public:
     void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
@@ -4,6 +4,9 @@
 #include "../utils.h"
 #include "rt.h"
 
+#include <cstring>
+#include <cstdio>
+
 LoaderManager* LoaderManager::instance = nullptr;
 
 LoaderManager::LoaderManager() {}
@@ -32,6 +35,11 @@ void LoaderManager::init_extension_addr(const VkDevice device) {
     instance->vkCmdBuildAccelerationStructuresKHR = (PFN_vkCmdBuildAccelerationStructuresKHR)vkGetDeviceProcAddr(device, "vkCmdBuildAccelerationStructuresKHR");
     instance->vkDestroyAccelerationStructureKHR = (PFN_vkDestroyAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkDestroyAccelerationStructureKHR");
     instance->vkCmdTraceRaysKHR = (PFN_vkCmdTraceRaysKHR)vkGetDeviceProcAddr(device, "vkCmdTraceRaysKHR");
+    instance->vkCmdTraceRaysIndirectKHR = (PFN_vkCmdTraceRaysIndirectKHR)vkGetDeviceProcAddr(device, "vkCmdTraceRaysIndirectKHR");
+    instance->vkCmdCopyAccelerationStructureToMemoryKHR = (PFN_vkCmdCopyAccelerationStructureToMemoryKHR)vkGetDeviceProcAddr(device, "vkCmdCopyAccelerationStructureToMemoryKHR");
+    instance->vkCmdCopyMemoryToAccelerationStructureKHR = (PFN_vkCmdCopyMemoryToAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkCmdCopyMemoryToAccelerationStructureKHR");
+    instance->vkCmdWriteAccelerationStructuresPropertiesKHR = (PFN_vkCmdWriteAccelerationStructuresPropertiesKHR)vkGetDeviceProcAddr(device, "vkCmdWriteAccelerationStructuresPropertiesKHR");
+    instance->vkGetDeviceAccelerationStructureCompatibilityKHR = (PFN_vkGetDeviceAccelerationStructureCompatibilityKHR)vkGetDeviceProcAddr(device, "vkGetDeviceAccelerationStructureCompatibilityKHR");
 }
 
 AllocatedBuffer rt_utils::create_buffer(const VmaAllocator& allocator,
@@ -73,7 +81,34 @@ VkDeviceOrHostAddressConstKHR rt_utils::get_buffer_device_address_const(const Vk
     return result;
 }
 
-void RTScene::build_blas(VkDevice device, VmaAllocator allocator, RTApp* app) {
+namespace {
+    // the serialized blob starts with: driver UUID, compatibility UUID, serialized size, deserialized size, ...
+    const size_t SERIALIZED_HEADER_SIZE = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+    // for the device addresses of vkCmdCopy(AccelerationStructureToMemory|MemoryToAccelerationStructure)KHR
+    const VkDeviceSize SERIALIZED_ALIGNMENT = 256;
+
+    VkDeviceSize align_up(VkDeviceSize size, VkDeviceSize alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    // 0 if the driver can not deserialize it
+    VkDeviceSize get_deserialized_size(VkDevice device, const std::vector<uint8_t>& blob) {
+        if (blob.size() < SERIALIZED_HEADER_SIZE) { return 0; }
+
+        VkAccelerationStructureVersionInfoKHR version_info = { VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR };
+        version_info.pVersionData = blob.data();
+        VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+        LoaderManager::get_instance()->vkGetDeviceAccelerationStructureCompatibilityKHR(device, &version_info, &compatibility);
+        if (compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR) { return 0; }
+
+        uint64_t serialized_size = 0, deserialized_size = 0;
+        memcpy(&serialized_size, blob.data() + 2 * VK_UUID_SIZE, sizeof(uint64_t));
+        memcpy(&deserialized_size, blob.data() + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+        return (serialized_size == blob.size()) ? deserialized_size : 0;
+    }
+}
+
+void RTScene::build_blas(VkDevice device, VmaAllocator allocator, RTApp* app, const ASCache* cache) {
     const size_t num_meshes = _meshes.size();
 
     std::vector<VkAccelerationStructureGeometryKHR> geometries(num_meshes, VkAccelerationStructureGeometryKHR{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR });
@@ -113,9 +148,65 @@ void RTScene::build_blas(VkDevice device, VmaAllocator allocator, RTApp* app) {
         LoaderManager::get_instance()->vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &build_info, &range.primitiveCount, &size_info);
     }
 
+    LoaderManager* loader_manager = LoaderManager::get_instance();
+
+    // (1) look up the cache, deserialized_sizes[i] == 0 means build it
+    const bool use_cache = cache && cache->is_enabled();
+    std::vector<std::string> cache_names(num_meshes);
+    std::vector<uint64_t> cache_keys(num_meshes, 0);
+    std::vector<std::vector<uint8_t>> blobs(num_meshes);
+    std::vector<VkDeviceSize> deserialized_sizes(num_meshes, 0);
+    std::vector<VkDeviceSize> blob_offsets(num_meshes, 0);
+    VkDeviceSize blobs_size = 0;
+    size_t num_cached = 0;
+    if (use_cache) {
+        const uint64_t scene_hash = ASCache::hash(_name.data(), _name.size());
+        for (size_t i = 0; i < num_meshes; ++i) {
+            char name[64];
+            snprintf(name, sizeof(name), "blas_%016llx_%zu", static_cast<unsigned long long>(scene_hash), i);
+            cache_names[i] = name;
+            // the build flags change the result as well
+            cache_keys[i] = ASCache::hash(&build_infos[i].flags, sizeof(VkBuildAccelerationStructureFlagsKHR), _meshes[i]._geometry_hash);
+            cache_keys[i] = ASCache::hash(&geometries[i].flags, sizeof(VkGeometryFlagsKHR), cache_keys[i]);
+
+            if (!cache->load(cache_names[i], cache_keys[i], blobs[i])) { continue; }
+            deserialized_sizes[i] = get_deserialized_size(device, blobs[i]);
+            if (deserialized_sizes[i] == 0) {
+                std::cout << "[AS Cache] " << cache_names[i] << ": incompatible with the driver, rebuild" << std::endl;
+                blobs[i].clear();
+                continue;
+            }
+            blob_offsets[i] = blobs_size;
+            blobs_size += align_up(blobs[i].size(), SERIALIZED_ALIGNMENT);
+            ++num_cached;
+        }
+    }
+
+    // (2) the cached blobs are read by the device (the same padding trick as the scratch buffer)
+    AllocatedBuffer blob_buffer{};
+    VkDeviceAddress blob_address = 0;
+    if (num_cached > 0) {
+        blob_buffer = rt_utils::create_buffer(allocator, static_cast<uint32_t>(blobs_size + SERIALIZED_ALIGNMENT),
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+            VMA_MEMORY_USAGE_CPU_TO_GPU
+        );
+        const VkDeviceAddress base_address = rt_utils::get_buffer_device_address(device, blob_buffer._buffer).deviceAddress;
+        blob_address = align_up(base_address, SERIALIZED_ALIGNMENT);
+
+        uint8_t* data;
+        vmaMapMemory(allocator, blob_buffer._allocation, reinterpret_cast<void**>(&data));
+        for (size_t i = 0; i < num_meshes; ++i) {
+            if (deserialized_sizes[i] == 0) { continue; }
+            memcpy(data + (blob_address - base_address) + blob_offsets[i], blobs[i].data(), blobs[i].size());
+        }
+        vmaFlushAllocation(allocator, blob_buffer._allocation, 0, VK_WHOLE_SIZE);
+        vmaUnmapMemory(allocator, blob_buffer._allocation);
+    }
+
     VkDeviceSize max_blas_size = 0;
-    for (const auto& size_info : size_infos) {
-        max_blas_size = std::max(size_info.buildScratchSize, max_blas_size);
+    for (size_t i = 0; i < num_meshes; ++i) {
+        if (deserialized_sizes[i] != 0) { continue; }
+        max_blas_size = std::max(size_infos[i].buildScratchSize, max_blas_size);
     }
     max_blas_size += app->get_min_acceleration_structure_scratch_offset_alignment();
 
@@ -125,8 +216,6 @@ void RTScene::build_blas(VkDevice device, VmaAllocator allocator, RTApp* app) {
         VMA_MEMORY_USAGE_GPU_ONLY
     );
 
-    LoaderManager* loader_manager = LoaderManager::get_instance();
-
     app->immediate_submit(
         [&](VkCommandBuffer cmd) {
             VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
@@ -138,27 +227,37 @@ void RTScene::build_blas(VkDevice device, VmaAllocator allocator, RTApp* app) {
                 VkAccelerationStructureBuildSizesInfoKHR& size_info = size_infos[i];
                 VkAccelerationStructureBuildGeometryInfoKHR& build_info = build_infos[i];
                 const VkAccelerationStructureBuildRangeInfoKHR* range[1] = { &ranges[i] };
+                const bool cached = deserialized_sizes[i] != 0;
+                const VkDeviceSize as_size = cached ? deserialized_sizes[i] : size_info.accelerationStructureSize;
 
-                mesh._blas._buffer = rt_utils::create_buffer(allocator, size_info.accelerationStructureSize,
+                mesh._blas._buffer = rt_utils::create_buffer(allocator, as_size,
                     VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
                     VMA_MEMORY_USAGE_GPU_ONLY
                 );
 
                 VkAccelerationStructureCreateInfoKHR create_info = { VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR };
                 create_info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-                create_info.size = size_info.accelerationStructureSize;
+                create_info.size = as_size;
                 create_info.buffer = mesh._blas._buffer._buffer;
 
                 loader_manager->vkCreateAccelerationStructureKHR(device, &create_info, nullptr, &mesh._blas._acceleration_structure);
 
-                // aligned VkPhysicalDeviceAccelerationStructurePropertiesKHR::minAccelerationStructureScratchOffsetAlignment
-                build_info.scratchData = rt_utils::get_buffer_device_address(device, scratch_buffer._buffer);
-                build_info.scratchData.deviceAddress = vkutils::padding(build_info.scratchData.deviceAddress, app->get_min_acceleration_structure_scratch_offset_alignment());
+                if (cached) {
+                    VkCopyMemoryToAccelerationStructureInfoKHR copy_info = { VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR };
+                    copy_info.src.deviceAddress = blob_address + blob_offsets[i];
+                    copy_info.dst = mesh._blas._acceleration_structure;
+                    copy_info.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+                    loader_manager->vkCmdCopyMemoryToAccelerationStructureKHR(cmd, &copy_info);
+                } else {
+                    // aligned VkPhysicalDeviceAccelerationStructurePropertiesKHR::minAccelerationStructureScratchOffsetAlignment
+                    build_info.scratchData = rt_utils::get_buffer_device_address(device, scratch_buffer._buffer);
+                    build_info.scratchData.deviceAddress = vkutils::padding(build_info.scratchData.deviceAddress, app->get_min_acceleration_structure_scratch_offset_alignment());
 
-                build_info.srcAccelerationStructure = VK_NULL_HANDLE;
-                build_info.dstAccelerationStructure = mesh._blas._acceleration_structure;
+                    build_info.srcAccelerationStructure = VK_NULL_HANDLE;
+                    build_info.dstAccelerationStructure = mesh._blas._acceleration_structure;
 
-                loader_manager->vkCmdBuildAccelerationStructuresKHR(cmd, 1, &build_info, range);
+                    loader_manager->vkCmdBuildAccelerationStructuresKHR(cmd, 1, &build_info, range);
+                }
 
                 // guard our scratch buffer
                 vkCmdPipelineBarrier(cmd,
@@ -171,6 +270,97 @@ void RTScene::build_blas(VkDevice device, VmaAllocator allocator, RTApp* app) {
     );
 
     vmaDestroyBuffer(allocator, scratch_buffer._buffer, scratch_buffer._allocation);
+    if (num_cached > 0) {
+        vmaDestroyBuffer(allocator, blob_buffer._buffer, blob_buffer._allocation);
+    }
+    if (use_cache) {
+        std::cout << "[AS Cache] " << num_cached << "/" << num_meshes << " blas loaded from cache" << std::endl;
+    }
+
+    // (3) write the new ones back to the cache
+    std::vector<size_t> to_save;
+    std::vector<VkAccelerationStructureKHR> to_save_as;
+    for (size_t i = 0; use_cache && i < num_meshes; ++i) {
+        if (deserialized_sizes[i] != 0) { continue; }
+        to_save.push_back(i);
+        to_save_as.push_back(_meshes[i]._blas._acceleration_structure);
+    }
+    if (!to_save.empty()) {
+        const uint32_t num_queries = static_cast<uint32_t>(to_save.size());
+        VkQueryPoolCreateInfo query_pool_info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+        query_pool_info.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR;
+        query_pool_info.queryCount = num_queries;
+        VkQueryPool query_pool;
+        VK_CHECK(vkCreateQueryPool(device, &query_pool_info, nullptr, &query_pool));
+
+        // (3.1) serialized sizes
+        app->immediate_submit(
+            [&](VkCommandBuffer cmd) {
+                VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+                memory_barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+                memory_barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+                vkCmdPipelineBarrier(cmd,
+                    VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                    VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                    0, 1, &memory_barrier, 0, nullptr, 0, nullptr
+                );
+                vkCmdResetQueryPool(cmd, query_pool, 0, num_queries);
+                loader_manager->vkCmdWriteAccelerationStructuresPropertiesKHR(cmd, num_queries, to_save_as.data(),
+                    VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, query_pool, 0);
+            }
+        );
+        std::vector<uint64_t> serialized_sizes(num_queries, 0);
+        VK_CHECK(vkGetQueryPoolResults(device, query_pool, 0, num_queries, num_queries * sizeof(uint64_t), serialized_sizes.data(),
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+        vkDestroyQueryPool(device, query_pool, nullptr);
+
+        std::vector<VkDeviceSize> readback_offsets(num_queries, 0);
+        VkDeviceSize readback_size = 0;
+        for (uint32_t q = 0; q < num_queries; ++q) {
+            readback_offsets[q] = readback_size;
+            readback_size += align_up(serialized_sizes[q], SERIALIZED_ALIGNMENT);
+        }
+
+        // (3.2) serialize & read back
+        AllocatedBuffer readback_buffer = rt_utils::create_buffer(allocator, static_cast<uint32_t>(readback_size + SERIALIZED_ALIGNMENT),
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VMA_MEMORY_USAGE_GPU_TO_CPU
+        );
+        const VkDeviceAddress base_address = rt_utils::get_buffer_device_address(device, readback_buffer._buffer).deviceAddress;
+        const VkDeviceAddress readback_address = align_up(base_address, SERIALIZED_ALIGNMENT);
+
+        app->immediate_submit(
+            [&](VkCommandBuffer cmd) {
+                for (uint32_t q = 0; q < num_queries; ++q) {
+                    VkCopyAccelerationStructureToMemoryInfoKHR copy_info = { VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR };
+                    copy_info.src = to_save_as[q];
+                    copy_info.dst.deviceAddress = readback_address + readback_offsets[q];
+                    copy_info.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+                    loader_manager->vkCmdCopyAccelerationStructureToMemoryKHR(cmd, &copy_info);
+                }
+
+                VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+                memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+                vkCmdPipelineBarrier(cmd,
+                    VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                    VK_PIPELINE_STAGE_HOST_BIT,
+                    0, 1, &memory_barrier, 0, nullptr, 0, nullptr
+                );
+            }
+        );
+
+        uint8_t* data;
+        vmaMapMemory(allocator, readback_buffer._allocation, reinterpret_cast<void**>(&data));
+        vmaInvalidateAllocation(allocator, readback_buffer._allocation, 0, VK_WHOLE_SIZE);
+        for (uint32_t q = 0; q < num_queries; ++q) {
+            const size_t i = to_save[q];
+            cache->save(cache_names[i], cache_keys[i], data + (readback_address - base_address) + readback_offsets[q], serialized_sizes[q]);
+        }
+        vmaUnmapMemory(allocator, readback_buffer._allocation);
+        vmaDestroyBuffer(allocator, readback_buffer._buffer, readback_buffer._allocation);
+        std::cout << "[AS Cache] " << num_queries << " blas written to cache" << std::endl;
+    }
 
     // get handles(for tlas)
     for (size_t i = 0; i < num_meshes; ++i) {
@@ -320,7 +510,9 @@ void rt_utils::image_barrier(VkCommandBuffer cmd,
     VkAccessFlags src_access_mask,
     VkAccessFlags dst_access_mask,
     VkImageLayout old_layout,
-    VkImageLayout new_layout) {
+    VkImageLayout new_layout,
+    VkPipelineStageFlags src_stage_mask,
+    VkPipelineStageFlags dst_stage_mask) {
 
     VkImageMemoryBarrier imageMemoryBarrier;
     imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -335,8 +527,48 @@ void rt_utils::image_barrier(VkCommandBuffer cmd,
     imageMemoryBarrier.subresourceRange = subresource_range;
 
     vkCmdPipelineBarrier(cmd,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        src_stage_mask,
+        dst_stage_mask,
         0, 0, nullptr, 0, nullptr, 1,
         &imageMemoryBarrier);
-}
\ No newline at end of file
+}
+
+void rt_utils::buffer_barrier(VkCommandBuffer cmd,
+    VkBuffer buffer,
+    VkAccessFlags src_access_mask,
+    VkAccessFlags dst_access_mask) {
+
+    VkBufferMemoryBarrier bufferMemoryBarrier;
+    bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferMemoryBarrier.pNext = nullptr;
+    bufferMemoryBarrier.srcAccessMask = src_access_mask;
+    bufferMemoryBarrier.dstAccessMask = dst_access_mask;
+    bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferMemoryBarrier.buffer = buffer;
+    bufferMemoryBarrier.offset = 0;
+    bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 0, nullptr, 1, &bufferMemoryBarrier, 0,
+        nullptr);
+}
+
+void rt_utils::memory_barrier(VkCommandBuffer cmd,
+    VkAccessFlags src_access_mask,
+    VkAccessFlags dst_access_mask) {
+
+    VkMemoryBarrier memoryBarrier;
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.pNext = nullptr;
+    memoryBarrier.srcAccessMask = src_access_mask;
+    memoryBarrier.dstAccessMask = dst_access_mask;
+
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0,
+        nullptr);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "../types.h"
+#include "asCache.h"
 #include <vector>
+#include <string>
 
 struct RTAccelerationStructure {
     AllocatedBuffer                         _buffer;
@@ -18,6 +20,7 @@ struct RTMesh {
     AllocatedBuffer             _faces;
     AllocatedBuffer             _mat_IDs;
 
+    uint64_t                    _geometry_hash{ 0 };    // key of the blas in `ASCache`
     RTAccelerationStructure     _blas;
 };
 
@@ -32,17 +35,16 @@ struct RTMaterial {
 class RTApp;
 
 struct RTScene {
+    std::string                     _name;              // obj path, names the cache entries
     std::vector<RTMesh>             _meshes;
     std::vector<RTMaterial>         _materials;
     RTAccelerationStructure         _tlas;
 
-    // shader resources stuff
-    std::vector<VkDescriptorBufferInfo>   _mat_IDs_buffer_infos;
-    std::vector<VkDescriptorBufferInfo>   _attribs_buffer_infos;
-    std::vector<VkDescriptorBufferInfo>   _faces_buffer_infos;
+    // shader resources stuff (the mesh buffers are read by device address, `InstanceAddresses`)
     std::vector<VkDescriptorImageInfo>    _textures_infos;
 
-    void build_blas(VkDevice device, VmaAllocator allocator, RTApp* app);
+    // blas are deserialized from `cache` when possible, the new ones are written back (nullptr: always build)
+    void build_blas(VkDevice device, VmaAllocator allocator, RTApp* app, const ASCache* cache = nullptr);
     void build_tlas(VkDevice device, VmaAllocator allocator, RTApp* app);
 };
 
@@ -67,6 +69,11 @@ public:
     PFN_vkCmdBuildAccelerationStructuresKHR vkCmdBuildAccelerationStructuresKHR{};
     PFN_vkDestroyAccelerationStructureKHR vkDestroyAccelerationStructureKHR{};
     PFN_vkCmdTraceRaysKHR vkCmdTraceRaysKHR{};
+    PFN_vkCmdTraceRaysIndirectKHR vkCmdTraceRaysIndirectKHR{};
+    PFN_vkCmdCopyAccelerationStructureToMemoryKHR vkCmdCopyAccelerationStructureToMemoryKHR{};
+    PFN_vkCmdCopyMemoryToAccelerationStructureKHR vkCmdCopyMemoryToAccelerationStructureKHR{};
+    PFN_vkCmdWriteAccelerationStructuresPropertiesKHR vkCmdWriteAccelerationStructuresPropertiesKHR{};
+    PFN_vkGetDeviceAccelerationStructureCompatibilityKHR vkGetDeviceAccelerationStructureCompatibilityKHR{};
 };
 
 namespace rt_utils {
@@ -84,5 +91,15 @@ namespace rt_utils {
         VkAccessFlags src_access_mask,
         VkAccessFlags dst_access_mask,
         VkImageLayout old_layout,
-        VkImageLayout new_layout);
+        VkImageLayout new_layout,
+        VkPipelineStageFlags src_stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VkPipelineStageFlags dst_stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    void buffer_barrier(VkCommandBuffer cmd,
+        VkBuffer buffer,
+        VkAccessFlags src_access_mask,
+        VkAccessFlags dst_access_mask);
+    // all the buffers & images (the layouts are kept)
+    void memory_barrier(VkCommandBuffer cmd,
+        VkAccessFlags src_access_mask,
+        VkAccessFlags dst_access_mask);
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "samplerTables.h"
+
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+    // primitive polynomials & initial direction numbers of the dims > 0 (Joe & Kuo, new-joe-kuo-6.21201)
+    struct SobolParams {
+        uint32_t s;         // degree
+        uint32_t a;         // coefficients
+        uint32_t m[5];      // initial direction numbers
+    };
+    const SobolParams SOBOL_PARAMS[] = {
+        { 1, 0, { 1 } },
+        { 2, 1, { 1, 3 } },
+        { 3, 1, { 1, 3, 1 } },
+        { 3, 2, { 1, 1, 1 } },
+        { 4, 1, { 1, 1, 3, 3 } },
+        { 4, 4, { 1, 3, 5, 13 } },
+        { 5, 2, { 1, 1, 5, 5, 17 } },
+        { 5, 4, { 1, 1, 5, 5, 5 } },
+    };
+
+    // void-and-cluster: gaussian energy on the torus
+    const float BLUE_NOISE_SIGMA = 1.5f;
+    const float BLUE_NOISE_INITIAL_DENSITY = 0.1f;
+}
+
+void SamplerTables::build() {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    _data.assign(SWS_SOBOL_DIMS * 32 + SWS_BLUE_NOISE_SIZE * SWS_BLUE_NOISE_SIZE, 0);
+    build_sobol_matrices(_data.data());
+    build_blue_noise_ranks(_data.data() + SWS_SOBOL_DIMS * 32);
+
+    auto delta = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - start);
+    std::cout << "[Sampler] " << SWS_SOBOL_DIMS << " sobol dims, " << SWS_BLUE_NOISE_SIZE << "x" << SWS_BLUE_NOISE_SIZE
+        << " blue-noise ranks, build time: " << delta.count() << "s" << std::endl;
+}
+
+void SamplerTables::build_sobol_matrices(uint32_t* matrices) const {
+    static_assert(SWS_SOBOL_DIMS - 1 <= sizeof(SOBOL_PARAMS) / sizeof(SobolParams), "not enough sobol parameters");
+
+    // dim 0: van der Corput
+    for (uint32_t k = 0; k < 32; ++k) {
+        matrices[k] = 1u << (31 - k);
+    }
+
+    for (uint32_t dim = 1; dim < SWS_SOBOL_DIMS; ++dim) {
+        const SobolParams& p = SOBOL_PARAMS[dim - 1];
+        uint32_t* v = matrices + dim * 32;
+        for (uint32_t k = 0; k < 32; ++k) {
+            if (k < p.s) {
+                v[k] = p.m[k] << (31 - k);
+                continue;
+            }
+            v[k] = v[k - p.s] ^ (v[k - p.s] >> p.s);
+            for (uint32_t i = 1; i < p.s; ++i) {
+                if ((p.a >> (p.s - 1 - i)) & 1) {
+                    v[k] ^= v[k - i];
+                }
+            }
+        }
+    }
+}
+
+void SamplerTables::build_blue_noise_ranks(uint32_t* ranks) const {
+    const int size = SWS_BLUE_NOISE_SIZE;
+    const int n = size * size;
+
+    // energy contribution of a point at a toroidal offset
+    std::vector<float> kernel(n);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            const int dx = std::min(x, size - x);
+            const int dy = std::min(y, size - y);
+            kernel[y * size + x] = std::exp(-static_cast<float>(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+        }
+    }
+
+    std::vector<uint8_t> pattern(n, 0);
+    std::vector<float> energy(n, 0.0f);
+    auto splat = [&](int index, float sign) {
+        const int px = index % size;
+        const int py = index / size;
+        for (int y = 0; y < size; ++y) {
+            const int ky = ((y - py + size) % size) * size;
+            for (int x = 0; x < size; ++x) {
+                energy[y * size + x] += sign * kernel[ky + (x - px + size) % size];
+            }
+        }
+    };
+    // tightest cluster: the point with the highest energy, largest void: the empty pixel with the lowest
+    auto find = [&](uint8_t value, bool highest) {
+        int best = -1;
+        for (int i = 0; i < n; ++i) {
+            if (pattern[i] != value) { continue; }
+            if (best == -1 || (highest ? energy[i] > energy[best] : energy[i] < energy[best])) {
+                best = i;
+            }
+        }
+        return best;
+    };
+
+    // 1. initial binary pattern: random points, relaxed by moving the tightest cluster to the largest void
+    std::mt19937 engine(1234);
+    const int num_initial = static_cast<int>(n * BLUE_NOISE_INITIAL_DENSITY);
+    for (int placed = 0; placed < num_initial; ) {
+        const int i = static_cast<int>(engine() % n);
+        if (pattern[i]) { continue; }
+        pattern[i] = 1;
+        splat(i, 1.0f);
+        ++placed;
+    }
+    for (int iter = 0; iter < n; ++iter) {
+        const int cluster = find(1, true);
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+        const int void_index = find(0, false);
+        pattern[void_index] = 1;
+        splat(void_index, 1.0f);
+        if (void_index == cluster) { break; }
+    }
+    const std::vector<uint8_t> initial_pattern = pattern;
+    const std::vector<float> initial_energy = energy;
+
+    // 2. ranks of the initial points: remove the tightest cluster first, it gets the highest rank
+    for (int rank = num_initial - 1; rank >= 0; --rank) {
+        const int cluster = find(1, true);
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+        ranks[cluster] = rank;
+    }
+
+    // 3. the remaining pixels: fill the largest void first
+    pattern = initial_pattern;
+    energy = initial_energy;
+    for (int rank = num_initial; rank < n; ++rank) {
+        const int void_index = find(0, false);
+        pattern[void_index] = 1;
+        splat(void_index, 1.0f);
+        ranks[void_index] = rank;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "shared_with_shaders.h"
+
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// tables of the low-discrepancy sampler (`SWS_SAMPLER_SOBOL`), built once on the CPU,
+/// uploaded to `SWS_SAMPLER_BINDING` and read by the CPU tracer as well
+///  [SWS_SOBOL_DIMS x 32] sobol generator matrices (one column per index bit, msb first)
+///  [SWS_BLUE_NOISE_SIZE x SWS_BLUE_NOISE_SIZE] blue-noise ranks (void-and-cluster), the per-pixel sample index offset
+/// </summary>
+class SamplerTables {
+public:
+    void build();
+
+    const std::vector<uint32_t>& get_data() const { return _data; }
+    uint32_t get_size_in_bytes() const { return static_cast<uint32_t>(_data.size() * sizeof(uint32_t)); }
+
+    uint32_t get_sobol_column(uint32_t dim, uint32_t bit) const { return _data[dim * 32 + bit]; }
+    uint32_t get_blue_noise_rank(uint32_t x, uint32_t y) const {
+        return _data[SWS_SOBOL_DIMS * 32 + (y % SWS_BLUE_NOISE_SIZE) * SWS_BLUE_NOISE_SIZE + (x % SWS_BLUE_NOISE_SIZE)];
+    }
+
+private:
+    void build_sobol_matrices(uint32_t* matrices) const;
+    void build_blue_noise_ranks(uint32_t* ranks) const;
+
+    std::vector<uint32_t> _data{};
+};
@@ -174,4 +174,11 @@ uint32_t SBTHelper::get_miss_groups_offset() const{
 
 uint32_t SBTHelper::get_miss_groups_size() const {
     return _num_miss_groups * _shader_group_alignment;
-}
\ No newline at end of file
+}
+
+void SBTHelper::get_regions(VkDevice device, VkStridedDeviceAddressRegionKHR& raygen, VkStridedDeviceAddressRegionKHR& miss, VkStridedDeviceAddressRegionKHR& hit) const {
+    const VkDeviceAddress address = get_SBT_address(device);
+    raygen = { address + get_raygen_offset(), get_groups_stride(), get_raygen_size() };
+    miss = { address + get_miss_groups_offset(), get_groups_stride(), get_miss_groups_size() };
+    hit = { address + get_hit_groups_offset(), get_groups_stride(), get_hit_groups_size() };
+}
@@ -31,6 +31,8 @@ public:
     uint32_t    get_hit_groups_size() const;
     uint32_t    get_miss_groups_offset() const;
     uint32_t    get_miss_groups_size() const;
+    // the regions of vkCmdTraceRaysKHR
+    void        get_regions(VkDevice device, VkStridedDeviceAddressRegionKHR& raygen, VkStridedDeviceAddressRegionKHR& miss, VkStridedDeviceAddressRegionKHR& hit) const;
 
     uint32_t    get_num_stages() const;
     const VkPipelineShaderStageCreateInfo* get_stages() const;
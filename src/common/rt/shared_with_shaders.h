@@ -4,6 +4,11 @@
 #ifdef __cplusplus
 // include vec & mat types (same namings as in GLSL)
 #include "common.h"
+#include <cstdint>
+// helpers are defined in this header, avoid multiple definitions when included by several cpp files
+#define SWS_INLINE inline
+#else
+#define SWS_INLINE
 #endif // __cplusplus
 
 // shader index
@@ -25,16 +30,57 @@
 #define SWS_RADIANCE_CACHE_BINDING      4
 #define SWS_STREE_SET                   0
 #define SWS_STREE_BINDING               5
-#define SWS_DTREE_SET                   0
-#define SWS_DTREE_BINDING               6
+#define SWS_GUIDE_TABLES_SET            0
+#define SWS_GUIDE_TABLES_BINDING        6
+#define SWS_EMITTERS_SET                0
+#define SWS_EMITTERS_BINDING            7
+#define SWS_SAMPLER_SET                 0
+#define SWS_SAMPLER_BINDING             8
+#define SWS_VARIANCE_IMAGE_SET          0
+#define SWS_VARIANCE_IMAGE_BINDING      9
+#define SWS_TILE_ERRORS_SET             0
+#define SWS_TILE_ERRORS_BINDING         10
+#define SWS_ACTIVE_TILES_SET            0
+#define SWS_ACTIVE_TILES_BINDING        11
+#define SWS_ALBEDO_IMAGE_SET            0
+#define SWS_ALBEDO_IMAGE_BINDING        12
+#define SWS_NORMAL_DEPTH_IMAGE_SET      0
+#define SWS_NORMAL_DEPTH_IMAGE_BINDING  13
+#define SWS_HISTORY_COLOR_SET           0
+#define SWS_HISTORY_COLOR_BINDING       14
+#define SWS_HISTORY_STATS_SET           0
+#define SWS_HISTORY_STATS_BINDING       15
+#define SWS_HISTORY_NORMAL_DEPTH_SET    0
+#define SWS_HISTORY_NORMAL_DEPTH_BINDING 16
+#define SWS_WAVEFRONT_PATHS_SET         0
+#define SWS_WAVEFRONT_PATHS_BINDING     17
+#define SWS_WAVEFRONT_PATH_STATES_SET   0
+#define SWS_WAVEFRONT_PATH_STATES_BINDING 18
+#define SWS_WAVEFRONT_QUEUES_SET        0
+#define SWS_WAVEFRONT_QUEUES_BINDING    19
+#define SWS_WAVEFRONT_COUNTERS_SET      0
+#define SWS_WAVEFRONT_COUNTERS_BINDING  20
+#define SWS_ENV_DISTRIBUTION_SET        0
+#define SWS_ENV_DISTRIBUTION_BINDING    21
+#define SWS_RADIANCE_GRID_SET           0
+#define SWS_RADIANCE_GRID_BINDING       22
+#define SWS_INSTANCES_SET               0
+#define SWS_INSTANCES_BINDING           23  // the last binding of the set 0
+
+#define SWS_TEXTURES_SET                1   // bindless, indexed by the material id
+#define SWS_ENVS_SET                    2
 
-#define SWS_MATIDS_SET                  1
-#define SWS_ATTRIBS_SET                 2
-#define SWS_FACES_SET                   3
-#define SWS_TEXTURES_SET                4
-#define SWS_ENVS_SET                    5
+#define SWS_NUM_SETS                    3
 
-#define SWS_NUM_SETS                    6
+// denoiser (compute, its own set)
+#define SWS_DENOISE_COLOR_BINDING           0   // accumulated image
+#define SWS_DENOISE_ALBEDO_BINDING          1
+#define SWS_DENOISE_NORMAL_DEPTH_BINDING    2
+#define SWS_DENOISE_VARIANCE_BINDING        3
+#define SWS_DENOISE_PING_BINDING            4   // demodulated color, w: variance
+#define SWS_DENOISE_PONG_BINDING            5
+#define SWS_DENOISE_RESULT_BINDING          6
+#define SWS_DENOISE_NUM_BINDINGS            7
 
 // cross-shader locations
 #define SWS_LOC_PRIMARY_RAY             0
@@ -43,6 +89,84 @@
 
 #define SWS_MAX_RECURSION               10
 
+// samplers
+#define SWS_SAMPLER_INDEPENDENT         0   // LCG, white noise
+#define SWS_SAMPLER_SOBOL               1   // owen scrambled sobol + blue-noise rank offsets
+#define SWS_BLUE_NOISE_SIZE             64
+
+// sobol dimensions of one bounce (2d samples take two), the bounces are padded
+#define SWS_DIM_BSDF                    0
+#define SWS_DIM_LIGHT_POINT             2
+#define SWS_DIM_LIGHT_CHOICE            4
+#define SWS_DIM_GUIDE_CHOICE            5
+#define SWS_DIM_RR                      6
+#define SWS_DIM_GUIDE_CELL              7   // the cell of the guide table (alias method)
+#define SWS_SOBOL_DIMS                  8
+
+// adaptive sampling, only the tiles with a pixel above the error threshold are traced
+#define SWS_ADAPTIVE_TILE_SIZE          8
+#define SWS_ADAPTIVE_MIN_SPP            16
+#define SWS_ADAPTIVE_MAX_ERROR          1e30f
+
+// edge-avoiding a-trous denoiser, iteration 0 prepares, iteration i >= 1 is a 5x5 b3-spline with the step 2^(i - 1)
+#define SWS_DENOISE_MAX_ITERATIONS      5
+#define SWS_DENOISE_GROUP_SIZE          16
+#define SWS_DENOISE_MIN_TEMPORAL_SPP    4   // fewer samples: the variance comes from the neighbors
+#define SWS_DENOISE_SIGMA_LUMINANCE     4.0f
+#define SWS_DENOISE_SIGMA_NORMAL        128.0f
+#define SWS_DENOISE_SIGMA_DEPTH         0.05f
+
+// temporal reprojection while the camera moves, the new sample weight is >= 1 / (SWS_TEMPORAL_MAX_HISTORY + 1)
+#define SWS_TEMPORAL_MAX_HISTORY        32.0f
+#define SWS_TEMPORAL_DEPTH_TOLERANCE    0.05f   // relative to the expected depth
+#define SWS_TEMPORAL_NORMAL_THRESHOLD   0.9f    // min cos between the normals
+#define SWS_TEMPORAL_MIN_WEIGHT         0.05f   // min bilinear weight of the valid taps
+
+// wavefront path tracing: one path per traced pixel, the hits of a bounce are binned by material into the shading queues
+#define SWS_QUEUE_EMISSIVE              0   // background & emitters, the path ends
+#define SWS_QUEUE_MIRROR                1
+#define SWS_QUEUE_GLASS                 2
+#define SWS_QUEUE_DIFFUSE               3
+#define SWS_WAVEFRONT_NUM_MATERIAL_QUEUES 4
+#define SWS_QUEUE_EXTEND                4   // the extension rays, 4 & 5 (ping-pong between the bounces)
+#define SWS_QUEUE_SHADOW                6   // the shadow rays of the next-event estimation
+#define SWS_WAVEFRONT_NUM_QUEUES        7
+#define SWS_WAVEFRONT_PATH_FIELDS       10  // vec4 of a path (`wavefront.glsl`)
+#define SWS_WAVEFRONT_GROUP_SIZE        64
+// counters buffer: the queue sizes, then the indirect arguments (x, y, z) of each queue
+#define SWS_WAVEFRONT_COUNT_OFFSET      0
+#define SWS_WAVEFRONT_ARGS_OFFSET       8
+#define SWS_WAVEFRONT_COUNTERS_SIZE     (SWS_WAVEFRONT_ARGS_OFFSET + 3 * SWS_WAVEFRONT_NUM_QUEUES)
+// stages of `wavefront_args.comp`
+#define SWS_WAVEFRONT_ARGS_TRACE        0   // extension & shadow rays (trace rays indirect)
+#define SWS_WAVEFRONT_ARGS_SHADE        1   // material queues (dispatch indirect)
+
+// environment light importance sampling (`EnvDistribution`), floats of `SWS_ENV_DISTRIBUTION_BINDING`:
+//  [SWS_ENV_HEADER_SIZE] width, height, integral (0: black, not sampled), padding
+//  [width x height] pdf of the texels over the lat-long uv square, [height x (width + 1)] conditional cdf of the rows,
+//  [height + 1] marginal cdf
+#define SWS_ENV_HEADER_SIZE             4
+#define SWS_ENV_LIGHT_PROB              0.5f    // the environment & the emitters are both sampled, one of them per vertex
+
+// ppg guiding: the DTree of every STree node as an alias table (`GuideTables`), vec4 of `SWS_GUIDE_TABLES_BINDING`
+//  [SWS_GUIDE_TABLE_SIZE] cells of the (cos theta, phi) square, x: the probability of keeping the cell
+//  (x < 0 in the first cell: no flux, BSDF only), y: the alias cell, z: the pdf of the cell, w: the pdf of the alias
+#define SWS_GUIDE_TABLE_RES             32
+#define SWS_GUIDE_TABLE_SIZE            (SWS_GUIDE_TABLE_RES * SWS_GUIDE_TABLE_RES)
+
+// radiance grid: world-space cache of the outgoing radiance of the diffuse vertices (`RadianceGridCell`),
+// a hash table of the cells (position / SWS_RADIANCE_GRID_CELL_SIZE x the dominant axis of the normal), linear probing
+#define SWS_RADIANCE_GRID_NUM_CELLS     (1 << 18)
+#define SWS_RADIANCE_GRID_NUM_PROBES    8
+#define SWS_RADIANCE_GRID_CELL_SIZE     0.01f   // the scene is in [0, 1]^3
+#define SWS_RADIANCE_GRID_NUM_BINS      6       // +x, -x, +y, -y, +z, -z
+#define SWS_RADIANCE_GRID_FIXED_POINT   256.0f  // the samples of a frame are summed by integer atomics
+#define SWS_RADIANCE_GRID_MAX_RADIANCE  256.0f  // the samples are clamped (fireflies & the fixed point range)
+#define SWS_RADIANCE_GRID_MIN_SAMPLES   16.0f   // cells with fewer samples are not queried
+#define SWS_RADIANCE_GRID_MAX_SAMPLES   1024.0f // the history, an exponential moving average beyond
+#define SWS_RADIANCE_GRID_MAX_AGE       64u     // frames without samples, then the cell is evicted
+#define SWS_RADIANCE_GRID_GROUP_SIZE    64
+
 #define OBJECT_ID_BUNNY                 0.0f
 #define OBJECT_ID_PLANE                 1.0f
 #define OBJECT_ID_TEAPOT                2.0f
@@ -72,6 +196,25 @@ struct RecordPerPixel {
 #endif
 };
 
+// a cell of the radiance grid, the samples of this frame are resolved into `radiance` (`radiance_grid_resolve.comp`)
+struct RadianceGridCell {
+#ifdef __cplusplus
+    uint32_t accum[4];  // rgb: the sum of the samples (SWS_RADIANCE_GRID_FIXED_POINT), w: the sample count
+    vec4 radiance;      // w: sample count of the history
+    uint32_t checksum;  // 0: empty
+    uint32_t age;       // frames since the last sample
+    uint32_t padding0;
+    uint32_t padding1;
+#else
+    uvec4 accum;
+    vec4 radiance;
+    uint checksum;
+    uint age;
+    uint padding0;
+    uint padding1;
+#endif
+};
+
 struct RayPayload {
     vec4 colorAndDist;
     vec4 normalAndObjId;
@@ -81,11 +224,55 @@ struct ShadowRayPayload {
     float distance;
 };
 
+// light triangle for the next-event estimation, sampled proportional to its area
+struct EmitterTriangle {
+    vec4 v0;    // w: area cdf (inclusive, normalized)
+    vec4 v1;    // w: area
+    vec4 v2;
+};
+
+// the buffers of a mesh by device address (`SWS_INSTANCES_BINDING`, indexed by gl_InstanceCustomIndexEXT),
+// dereferenced in the hit shader through GL_EXT_buffer_reference
+struct InstanceAddresses {
+#ifdef __cplusplus
+    uint64_t mat_IDs;
+    uint64_t attribs;
+    uint64_t faces;
+    uint64_t padding;
+#else
+    uvec2 mat_IDs;
+    uvec2 attribs;
+    uvec2 faces;
+    uvec2 padding;
+#endif
+};
+
 struct VertexAttribute {
     vec4 normal;
     vec4 uv;
 };
 
+// push constants of the denoiser, one dispatch per iteration
+struct DenoiseParams {
+    int iteration;
+    int num_iterations;
+    float light_strength;
+    int padding0;
+    // the traced part of the images (dynamic resolution)
+    int width;
+    int height;
+    int padding1;
+    int padding2;
+};
+
+// push constants of the wavefront launches (ray tracing & compute)
+struct WavefrontParams {
+    int bounce;
+    int stage;          // SWS_WAVEFRONT_ARGS_*
+    int extend_queue;   // the extension rays of this bounce
+    int next_queue;     // the extension rays of the next bounce
+};
+
 // packed std140
 struct UniformParams {
     // Lighting
@@ -98,6 +285,12 @@ struct UniformParams {
     vec4 camSide;
     vec4 camNearFarFov;
 
+    // camera of the previous frame (temporal reprojection), prevCamPos.w: fov
+    vec4 prevCamPos;
+    vec4 prevCamDir;
+    vec4 prevCamUp;
+    vec4 prevCamSide;
+
     // spp
     int accumulate_spp;
     int random_seed;
@@ -108,19 +301,54 @@ struct UniformParams {
     int mirror_id;
     int ppg_train_on;
     int ppg_test_on;
+
+    // next-event estimation
+    int nee_on;
+    int num_emitters;
+    float emitters_area;
+
+    // russian roulette after `rr_depth` bounces (>= SWS_MAX_RECURSION: off)
+    int rr_depth;
+
+    // SWS_SAMPLER_*
+    int sampler_type;
+
+    // adaptive sampling: the launch is `num_active_tiles` tiles of `SWS_ACTIVE_TILES_BINDING` in a row
+    int adaptive_on;
+    int num_active_tiles;
+
+    // temporal reprojection: the camera moved, the history is reprojected instead of reset,
+    // `accumulate_spp` keeps counting the frames
+    int reproject_on;
+
+    // dynamic resolution: the traced part of the images, the top left `trace_width` x `trace_height` pixels
+    int trace_width;
+    int trace_height;
+
+    // environment light: the radiance of `EnvTexture` is scaled by `env_strength` (0: off),
+    // the next-event estimation samples it (`EnvDistribution`) with the probability `env_light_prob`, the emitters otherwise
+    float env_strength;
+    float env_light_prob;
+
+    // radiance grid: the diffuse vertices after `grid_start_bounce` bounces stop at a cached cell once the footprint
+    // of the path (squared spread) is larger than `grid_footprint` x the pixel footprint (the bias: larger is less)
+    int grid_on;
+    int grid_start_bounce;
+    float grid_footprint;
+    int padding0;
 };
 
 
 // shaders helper functions
-vec2 BaryLerp(vec2 a, vec2 b, vec2 c, vec3 barycentrics) {
+SWS_INLINE vec2 BaryLerp(vec2 a, vec2 b, vec2 c, vec3 barycentrics) {
     return a * barycentrics.x + b * barycentrics.y + c * barycentrics.z;
 }
 
-vec3 BaryLerp(vec3 a, vec3 b, vec3 c, vec3 barycentrics) {
+SWS_INLINE vec3 BaryLerp(vec3 a, vec3 b, vec3 c, vec3 barycentrics) {
     return a * barycentrics.x + b * barycentrics.y + c * barycentrics.z;
 }
 
-float LinearToSrgb(float channel) {
+SWS_INLINE float LinearToSrgb(float channel) {
     if (channel <= 0.0031308f) {
         return 12.92f * channel;
     } else {
@@ -128,8 +356,101 @@ float LinearToSrgb(float channel) {
     }
 }
 
-vec3 LinearToSrgb(vec3 linear) {
+SWS_INLINE vec3 LinearToSrgb(vec3 linear) {
     return vec3(LinearToSrgb(linear.r), LinearToSrgb(linear.g), LinearToSrgb(linear.b));
 }
 
+SWS_INLINE float Luminance(vec3 color) {
+    return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+// per-pixel running luminance statistics (welford), x: mean, y: sum of squared differences, z: sample count
+SWS_INLINE vec4 UpdatePixelStats(vec4 stats, vec3 color) {
+    const float lum = Luminance(color);
+    const float n = stats.z + 1.0f;
+    const float delta = lum - stats.x;
+    const float mean = stats.x + delta / n;
+    return vec4(mean, stats.y + delta * (lum - mean), n, 0.0f);
+}
+
+// relative standard error of the pixel mean, dark pixels are measured against a small floor
+SWS_INLINE float PixelRelativeError(vec4 stats) {
+    if (stats.z < float(SWS_ADAPTIVE_MIN_SPP)) {
+        return SWS_ADAPTIVE_MAX_ERROR;
+    }
+    const float variance_of_mean = stats.y / (stats.z * (stats.z - 1.0f));
+    return sqrt(variance_of_mean) / (stats.x + 0.01f);
+}
+
+// a-trous: 1d b3-spline weights of the taps -2..2
+SWS_INLINE float AtrousKernelWeight(int offset) {
+    const int d = (offset < 0) ? -offset : offset;
+    return (d == 0) ? 0.375f : ((d == 1) ? 0.25f : 0.0625f);
+}
+
+// edge-stopping weight of the tap q: normal & depth (x, y, z: normal, w: depth, < 0: background & emitters) guides,
+// luminance against the std deviation of the center, the depth tolerance grows with the step
+SWS_INLINE float DenoiseEdgeWeight(vec4 normal_depth_p, vec4 normal_depth_q, float lum_p, float lum_q, float lum_std, float step) {
+    if (normal_depth_q.w < 0.0f) {
+        return 0.0f;
+    }
+    const float cos_normal = dot(vec3(normal_depth_p), vec3(normal_depth_q));
+    const float w_normal = (cos_normal > 0.0f) ? pow(cos_normal, SWS_DENOISE_SIGMA_NORMAL) : 0.0f;
+    const float dz = normal_depth_p.w - normal_depth_q.w;
+    const float w_depth = exp(-((dz < 0.0f) ? -dz : dz) / (SWS_DENOISE_SIGMA_DEPTH * step * normal_depth_p.w + 1e-4f));
+    const float dl = lum_p - lum_q;
+    const float w_lum = exp(-((dl < 0.0f) ? -dl : dl) / (SWS_DENOISE_SIGMA_LUMINANCE * lum_std + 1e-4f));
+    return w_normal * w_depth * w_lum;
+}
+
+// temporal reprojection: screen uv (-1 ~ 1, the inverse of `CalcRayDir`) of a world position seen by a camera,
+// z: the distance along the view direction (<= 0: behind the camera)
+SWS_INLINE vec3 ProjectToCamera(vec3 position, vec3 cam_pos, vec3 cam_dir, vec3 cam_up, vec3 cam_side, float fov, float aspect) {
+    const vec3 d = position - cam_pos;
+    const float z = dot(d, cam_dir);
+    if (z <= 0.0f) {
+        return vec3(0.0f, 0.0f, z);
+    }
+    const float plane_width = tan(fov * 0.5f);
+    return vec3(dot(d, cam_side) / (z * plane_width * aspect), -dot(d, cam_up) / (z * plane_width), z);
+}
+
+// temporal reprojection: the history tap shows the same surface (disocclusion test),
+// normal_depth: the guides of `NormalDepthImage`, the depth of the history tap is expected to be `expected_depth`
+SWS_INLINE bool TemporalTapValid(vec4 normal_depth, vec4 history_normal_depth, float expected_depth) {
+    if (normal_depth.w < 0.0f || history_normal_depth.w < 0.0f) {
+        return false;
+    }
+    const float dz = history_normal_depth.w - expected_depth;
+    return ((dz < 0.0f) ? -dz : dz) <= SWS_TEMPORAL_DEPTH_TOLERANCE * expected_depth
+        && dot(vec3(normal_depth), vec3(history_normal_depth)) >= SWS_TEMPORAL_NORMAL_THRESHOLD;
+}
+
+// temporal reprojection: the history keeps at most SWS_TEMPORAL_MAX_HISTORY samples (`UpdatePixelStats`, the variance is kept),
+// the accumulation of `ray_gen.rgen` becomes an exponential moving average while the camera moves
+SWS_INLINE vec4 ClampHistoryStats(vec4 stats) {
+    const float n = floor((stats.z < SWS_TEMPORAL_MAX_HISTORY) ? stats.z : SWS_TEMPORAL_MAX_HISTORY);
+    return (n > 0.0f) ? vec4(stats.x, stats.y * n / stats.z, n, 0.0f) : vec4(0.0f);
+}
+
+#ifdef __cplusplus
+// fills the areas & the area cdf of the emitters, returns the total area
+inline float BuildEmitterCdf(EmitterTriangle* emitters, uint32_t count) {
+    float total = 0.0f;
+    for (uint32_t i = 0; i < count; ++i) {
+        const vec3 e1 = vec3(emitters[i].v1) - vec3(emitters[i].v0);
+        const vec3 e2 = vec3(emitters[i].v2) - vec3(emitters[i].v0);
+        emitters[i].v1.w = 0.5f * glm::length(glm::cross(e1, e2));
+        total += emitters[i].v1.w;
+        emitters[i].v0.w = total;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        emitters[i].v0.w = (total > 0.0f) ? emitters[i].v0.w / total : 0.0f;
+    }
+    // guard the binary search against rounding
+    if (count > 0) { emitters[count - 1].v0.w = 1.0f; }
+    return total;
+}
+#endif // __cplusplus
+
 #endif // SHARED_WITH_SHADERS_H
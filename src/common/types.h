@@ -26,4 +26,5 @@ struct FrameBufferAttachment {
     VkFormat _format = VK_FORMAT_UNDEFINED;
     AllocatedImage _image{};
     VkImageView _image_view = VK_NULL_HANDLE;
+    bool _lazily_allocated{ false };    // transient, the memory is only committed if the tile memory is not enough
 };